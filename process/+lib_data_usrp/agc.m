@@ -5,19 +5,27 @@ function [gain_change] = agc(samp_rate, n_channels, data_type_re_im, center_freq
     % how many samples to we record for our agc?
     n_samples = 25e6;
     
-    % wait time for C++-program to save binary iq samples file after sending udp instruction
-    wait_time_cpp_file_save_sec = n_samples/samp_rate + 3.0;
+    % maximum wait time for the completion message of the C++-program, we continue as soon as it arrives
+    timeout_cpp_file_save_sec = n_samples/samp_rate + 10.0;
 
     % record samples with USRP, iq samples are written to binary file
     fprintf('AGC: Starting recording via UDP.\n');
     file_id = 1e6 + run_id;
+    udpr = lib_data_usrp.completion_receiver();
     lib_data_usrp.udp_cmd(file_id, center_freq, n_samples, repmat(gain_default, n_channels, 1), false);
 
-    pause(wait_time_cpp_file_save_sec);
+    completion = lib_data_usrp.wait_for_completion(udpr, timeout_cpp_file_save_sec);
+    release(udpr);
 
-    % C++ program should have created one file. Load it, extract samples and then delete it.
+    if isempty(completion) == true || isempty(completion.full_filepath) == true
+        lib_util.clear_directory("../data/");
+        disp('AGC: No completion message received. Content of WiFi6/data/ deleted.');
+        gain_change = [];
+        return;
+    end
+
+    % C++ program has created one file and renamed it after it was completely written. Load it, extract samples and then delete it.
     % Should actually never throw errors, but theroretically it could.
-    %   - IQ samples file is not completely written by C++ program, we load prematurely and therefore the number of bytes is not a multiple of the item size
     %   - we detect a file, but just before loading it somehow gets deleted
     % In case of an error best idea is to delete all binary IQ-samples files if there are any.
     try
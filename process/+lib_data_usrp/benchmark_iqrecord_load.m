@@ -0,0 +1,65 @@
+function [] = benchmark_iqrecord_load(full_filepath, n_channels, data_type_re_im)
+
+    % Loads a .bin file written by the C++ program with the Matlab loader (measurement_file.m without MEX) and with the MEX loader
+    % iqrecord_load, checks that both return the same samples and prints the times, e.g. for a capture of 100e6 samples on 2 channels:
+    %
+    %   lib_data_usrp.benchmark_iqrecord_load('../data/iqrecord_0000000000_0001000001_00001700000000000000.bin', 2, 'float')
+
+    file_struct = dir(full_filepath);
+
+    iq_file_param.folderpath = file_struct.folder;
+    iq_file_param.data_type = data_type_re_im;
+    iq_file_param.n_rx_channels = n_channels;
+    iq_file_param.ch_measurement_per_sec = 1;
+    iq_file_param.ch_measurement_len = file_struct.bytes/(n_channels*2*bytes_per_value(data_type_re_im));
+    iq_file_param.ch_measurement_save_period_sec = 1;
+    iq_file_param.use_mex = false;
+
+    t_start = tic;
+    file_matlab = lib_data_usrp.measurement_file(file_struct, iq_file_param);
+    t_matlab = toc(t_start);
+
+    t_start = tic;
+    samples_double = lib_data_usrp.iqrecord_load(full_filepath, n_channels, data_type_re_im);
+    t_mex_double = toc(t_start);
+
+    t_start = tic;
+    samples_single = lib_data_usrp.iqrecord_load(full_filepath, n_channels, data_type_re_im, 0, 0, [], 'single');
+    t_mex_single = toc(t_start);
+
+    t_start = tic;
+    samples_single_1 = lib_data_usrp.iqrecord_load(full_filepath, n_channels, data_type_re_im, 0, 0, [], 'single', 1);
+    t_mex_single_1 = toc(t_start);
+
+    % 10 ms of the last channel at 20 MS/s
+    count = min(200e3, iq_file_param.ch_measurement_len);
+    skip = floor((iq_file_param.ch_measurement_len - count)/2);
+    t_start = tic;
+    samples_window = lib_data_usrp.iqrecord_load(full_filepath, n_channels, data_type_re_im, skip, count, n_channels);
+    t_mex_window = toc(t_start);
+
+    if isequal(file_matlab.complex_samples, samples_double) == false || isequal(single(file_matlab.complex_samples), samples_single) == false || ...
+       isequal(samples_single, samples_single_1) == false || isequal(file_matlab.complex_samples(skip+1:skip+count, n_channels), samples_window) == false
+        error('MEX loader and Matlab loader return different samples.');
+    end
+
+    fprintf('%d samples on %d channels, %.1f MB\n', iq_file_param.ch_measurement_len, n_channels, file_struct.bytes/1e6);
+    fprintf('Matlab loader, double:             %8.3f s\n', t_matlab);
+    fprintf('MEX loader, double:                %8.3f s\n', t_mex_double);
+    fprintf('MEX loader, single:                %8.3f s\n', t_mex_single);
+    fprintf('MEX loader, single, one thread:    %8.3f s\n', t_mex_single_1);
+    fprintf('MEX loader, %d samples of one channel: %8.3f s\n', count, t_mex_window);
+end
+
+function [n_bytes] = bytes_per_value(data_type_re_im)
+    switch data_type_re_im
+        case {'float', 'single'}
+            n_bytes = 4;
+        case 'int16'
+            n_bytes = 2;
+        case 'int8'
+            n_bytes = 1;
+        otherwise
+            n_bytes = 8;
+    end
+end
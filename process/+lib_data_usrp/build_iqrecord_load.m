@@ -0,0 +1,12 @@
+function [] = build_iqrecord_load()
+
+    % Builds the MEX loader iqrecord_load.cpp together with libiqrecord from the folder record, e.g. after "mex -setup C++" on Linux.
+    % The MEX file is placed next to this file, measurement_file.m and load_manifest.m use it from then on instead of reading the files
+    % in Matlab. Compare both with benchmark_iqrecord_load.m.
+
+    folder = fileparts(mfilename('fullpath'));
+    record_folder = fullfile(folder, '..', '..', 'record');
+
+    mex('-R2018a', '-O', ['-I' record_folder], 'CXXFLAGS=$CXXFLAGS -std=c++11 -pthread', 'LDFLAGS=$LDFLAGS -pthread', '-outdir', folder, ...
+        fullfile(folder, 'iqrecord_load.cpp'), fullfile(record_folder, 'iqrecord_reader.cpp'));
+end
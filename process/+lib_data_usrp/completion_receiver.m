@@ -0,0 +1,8 @@
+function [udpr] = completion_receiver()
+
+    % Creates the receiver for completion messages of the C++ program.
+    % Must be created before the command is sent, otherwise the message might be missed.
+    % The port must be the same as --notify_port of the C++ program.
+    udpr = dsp.UDPReceiver('LocalIPPort', 8889, 'MessageDataType', 'uint8', 'MaximumMessageLength', 1024);
+    setup(udpr);
+end
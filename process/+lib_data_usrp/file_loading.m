@@ -8,8 +8,17 @@ function [complex_samples, n_files] = file_loading(n_channels, data_type_re_im,
     iq_file_param.ch_measurement_len = n_samples;
     iq_file_param.ch_measurement_save_period_sec = 1;   % old parameter, set to 1
 
-    % first find all recorded files
-    [filenames, n_files] = lib_util.get_all_filenames(iq_file_param.folderpath);
+    % first find all recorded files, the gap index files next to them are not loaded here
+    filenames = dir(fullfile(iq_file_param.folderpath, "iqrecord_*.bin"));
+    n_files = numel(filenames);
+
+    % with --write_layout channel or stripes a measurement is described by a manifest
+    manifests = dir(fullfile(iq_file_param.folderpath, "iqrecord_*.manifest"));
+    if n_files == 0 && numel(manifests) == 1
+        n_files = 1;
+        complex_samples = lib_data_usrp.load_manifest(fullfile(manifests(1).folder, manifests(1).name), data_type_re_im);
+        return;
+    end
     
     % if we have no file, we cannot load anything
     if n_files == 0
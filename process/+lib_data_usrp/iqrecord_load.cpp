@@ -0,0 +1,229 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+// MEX loader of the measurements of the recorder, built with build_iqrecord_load.m on top of libiqrecord (record/iqrecord_reader.h).
+//
+//   [complex_samples, info] = lib_data_usrp.iqrecord_load(full_filepath, n_channels, data_type_re_im, skip_samples, count, channels, class_name, n_threads)
+//
+// full_filepath        .bin file, .manifest or archive entry <segment index>#<file name>
+// n_channels           channels of a .bin file, not used for a manifest or an archive entry
+// data_type_re_im      'float' or 'single' (fc32), 'int16' (sc16), 'int8' (sc8) or 'double' (fc64), not used for a manifest or an archive entry
+// skip_samples         samples skipped at the start of each channel, default 0
+// count                samples per channel, default 0 for all after skip_samples
+// channels             channels to load, one based, default [] for all
+// class_name           'double' (default) or 'single'
+// n_threads            conversion threads, default 0 for one per core
+//
+// Returns a matrix with one column per loaded channel. Like read_complex_binary() in measurement_file.m, integer samples are not scaled.
+// info has the fields n_samples (per channel of the file), sample_rate (0 if unknown), layout, n_gaps and zero_fill.
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "mex.h"
+#include "iqrecord_reader.h"
+
+#define LOAD_PIECE_SAMPLES              65536       // samples converted at once, views are requested per piece
+
+// one contiguous range of samples of a channel converted by one thread
+struct load_task_t{
+    size_t channel;                                     // of the file
+    size_t column;                                      // of the output
+    unsigned long long offset;                          // first sample of the file
+    unsigned long long n_samples;
+    unsigned long long out_offset;                      // first sample of the column
+};
+
+template <typename T_in, typename T_out>
+static void convert(const void* in, T_out* out, const unsigned long long n){
+    const T_in* x = static_cast<const T_in*>(in);
+    for(unsigned long long k = 0; k < 2*n; k++)
+        out[k] = (T_out) x[k];
+}
+
+template <typename T_out>
+static bool run_task(const iqrecord_t* record, const load_task_t& task, T_out* out, const unsigned long long count, std::vector<char>& scratch){
+    const size_t bps = iqrecord_bytes_per_sample(record);
+    for(unsigned long long done = 0; done < task.n_samples; done += LOAD_PIECE_SAMPLES){
+        const unsigned long long n = std::min<unsigned long long>(LOAD_PIECE_SAMPLES, task.n_samples - done);
+        const unsigned long long offset = task.offset + done;
+
+        // samples crossing a stripe boundary are copied first
+        const void* in = iqrecord_view(record, task.channel, offset, n);
+        if(in == NULL){
+            scratch.resize(LOAD_PIECE_SAMPLES*bps);
+            if(iqrecord_read(record, task.channel, offset, n, scratch.data()) != n)
+                return false;
+            in = scratch.data();
+        }
+
+        T_out* dst = out + 2*(task.column*count + task.out_offset + done);
+        switch(bps){
+            case 16:
+                convert<double>(in, dst, n);
+                break;
+            case 8:
+                convert<float>(in, dst, n);
+                break;
+            case 4:
+                convert<int16_t>(in, dst, n);
+                break;
+            default:
+                convert<int8_t>(in, dst, n);
+                break;
+        }
+    }
+    return true;
+}
+
+// splits all samples evenly over the threads, a thread can get parts of several channels
+template <typename T_out>
+static bool load(const iqrecord_t* record, const std::vector<size_t>& channels, const unsigned long long skip, const unsigned long long count, T_out* out, size_t n_threads){
+    const unsigned long long n_total = count*channels.size();
+    n_threads = (size_t) std::max<unsigned long long>(1, std::min<unsigned long long>(n_threads, n_total/LOAD_PIECE_SAMPLES));
+
+    std::vector<std::vector<load_task_t>> tasks(n_threads);
+    for(size_t t = 0; t < n_threads; t++){
+        unsigned long long begin = n_total*t/n_threads;
+        const unsigned long long end = n_total*(t + 1)/n_threads;
+        while(begin < end){
+            const size_t column = (size_t) (begin/count);
+            const unsigned long long out_offset = begin % count;
+            const unsigned long long n = std::min(end - begin, count - out_offset);
+            tasks[t].push_back({channels[column], column, skip + out_offset, n, out_offset});
+            begin += n;
+        }
+    }
+
+    std::vector<char> success(n_threads, 1);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < n_threads; t++){
+        threads.emplace_back([&, t](){
+            std::vector<char> scratch;
+            for(size_t i = 0; i < tasks[t].size() && success[t]; i++)
+                success[t] = run_task(record, tasks[t][i], out, count, scratch) ? 1 : 0;
+        });
+    }
+    for(size_t t = 0; t < n_threads; t++)
+        threads[t].join();
+
+    return std::find(success.begin(), success.end(), 0) == success.end();
+}
+
+static std::string get_string(const mxArray* arg, const char* name){
+    if(!mxIsChar(arg))
+        mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "%s must be a string.", name);
+    char* s = mxArrayToString(arg);
+    std::string str(s);
+    mxFree(s);
+    return str;
+}
+
+static size_t get_bytes_per_sample(const std::string& data_type){
+    if(data_type == "float" || data_type == "single")
+        return 8;
+    if(data_type == "int16")
+        return 4;
+    if(data_type == "int8")
+        return 2;
+    if(data_type == "double")
+        return 16;
+    mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "Unknown data type %s.", data_type.c_str());
+    return 0;
+}
+
+static mxArray* create_info(const iqrecord_t* record){
+    const char* fields[] = {"n_samples", "sample_rate", "layout", "n_gaps", "zero_fill"};
+    mxArray* info = mxCreateStructMatrix(1, 1, 5, fields);
+    mxSetField(info, 0, "n_samples", mxCreateDoubleScalar((double) iqrecord_n_samples(record)));
+    mxSetField(info, 0, "sample_rate", mxCreateDoubleScalar(iqrecord_sample_rate(record)));
+    mxSetField(info, 0, "layout", mxCreateString(iqrecord_layout(record)));
+    mxSetField(info, 0, "n_gaps", mxCreateDoubleScalar((double) iqrecord_n_gaps(record)));
+    mxSetField(info, 0, "zero_fill", mxCreateLogicalScalar(iqrecord_zero_fill(record) != 0));
+    return info;
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]){
+    if(nrhs < 3 || nrhs > 8)
+        mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "Usage: iqrecord_load(full_filepath, n_channels, data_type_re_im, skip_samples, count, channels, class_name, n_threads)");
+
+    const std::string path = get_string(prhs[0], "full_filepath");
+    const size_t n_channels = (size_t) mxGetScalar(prhs[1]);
+    const size_t bytes_per_sample = get_bytes_per_sample(get_string(prhs[2], "data_type_re_im"));
+    const unsigned long long skip = (nrhs > 3) ? (unsigned long long) mxGetScalar(prhs[3]) : 0;
+    unsigned long long count = (nrhs > 4) ? (unsigned long long) mxGetScalar(prhs[4]) : 0;
+    const std::string class_name = (nrhs > 6) ? get_string(prhs[6], "class_name") : std::string("double");
+    size_t n_threads = (nrhs > 7) ? (size_t) mxGetScalar(prhs[7]) : 0;
+    if(n_threads == 0)
+        n_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    if(class_name != "double" && class_name != "single")
+        mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "class_name must be double or single.");
+
+    iqrecord_t* record = iqrecord_open(path.c_str(), n_channels, bytes_per_sample);
+    if(record == NULL)
+        mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "%s", iqrecord_last_error());
+
+    // one based channels as in matlab, all by default
+    std::vector<size_t> channels;
+    if(nrhs > 5 && !mxIsEmpty(prhs[5])){
+        const size_t n = mxGetNumberOfElements(prhs[5]);
+        const double* ch = mxGetPr(prhs[5]);
+        for(size_t i = 0; i < n; i++)
+            channels.push_back((size_t) ch[i] - 1);
+    }
+    else{
+        for(size_t ch = 0; ch < iqrecord_n_channels(record); ch++)
+            channels.push_back(ch);
+    }
+
+    const unsigned long long n_samples = iqrecord_n_samples(record);
+    std::string error;
+    for(size_t i = 0; i < channels.size(); i++){
+        if(channels[i] >= iqrecord_n_channels(record))
+            error = "Channel out of range.";
+    }
+    if(skip > n_samples || (count > 0 && skip + count > n_samples))
+        error = "Skip and count are larger than the file.";
+    if(error.size() > 0){
+        iqrecord_close(record);
+        mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "%s", error.c_str());
+    }
+    if(count == 0)
+        count = n_samples - skip;
+
+    // interleaved complex, real and imag of a sample are next to each other as in the file
+    bool success = true;
+    if(class_name == "single"){
+        plhs[0] = mxCreateUninitNumericMatrix((size_t) count, channels.size(), mxSINGLE_CLASS, mxCOMPLEX);
+        if(count > 0)
+            success = load(record, channels, skip, count, reinterpret_cast<float*>(mxGetComplexSingles(plhs[0])), n_threads);
+    }
+    else{
+        plhs[0] = mxCreateUninitNumericMatrix((size_t) count, channels.size(), mxDOUBLE_CLASS, mxCOMPLEX);
+        if(count > 0)
+            success = load(record, channels, skip, count, reinterpret_cast<double*>(mxGetComplexDoubles(plhs[0])), n_threads);
+    }
+    if(nlhs > 1)
+        plhs[1] = create_info(record);
+    iqrecord_close(record);
+
+    if(!success)
+        mexErrMsgIdAndTxt("lib_data_usrp:iqrecord_load", "Unable to read %s, the file is shorter than expected.", path.c_str());
+}
@@ -0,0 +1,56 @@
+function [complex_samples] = load_archive(full_filepath, data_type_re_im)
+
+    % Loads a measurement that the C++ program appended to its rolling archive with --write_layout archive.
+    % The measurement is addressed as <path of the segment index>#<file name>. The index lists the segment file and one entry per measurement:
+    %
+    %   segment <path of the segment file>
+    %   entry <file name> <byte offset in the segment> <n_channels> <n_samples> <bytes_per_sample> <sample_rate>
+    %
+    % An entry is appended after its samples are on disk. Once the archive exceeds --archive_budget, the oldest segments are recycled and
+    % their indices removed, so a measurement has to be loaded or copied before that.
+    %
+    % Returns a matrix with one column per channel. The MEX loader is used if it was built, see build_iqrecord_load.m.
+
+    if ~isempty(which('lib_data_usrp.iqrecord_load'))
+        complex_samples = lib_data_usrp.iqrecord_load(full_filepath, 0, data_type_re_im);
+        return;
+    end
+
+    parts = split(string(full_filepath), '#');
+    index_filepath = parts(1);
+    file_name = parts(2);
+
+    segment_filepath = '';
+    entry = [];
+    lines = readlines(index_filepath);
+    for k=1:numel(lines)
+        fields = split(strtrim(lines(k)));
+        switch fields(1)
+            case 'segment'
+                segment_filepath = char(strjoin(fields(2:end), ' '));
+            case 'entry'
+                if fields(2) == file_name
+                    entry = str2double(fields(3:7));
+                end
+        end
+    end
+    if isempty(entry)
+        error('No entry %s in archive index %s.', file_name, index_filepath);
+    end
+
+    offset = entry(1);
+    n_channels = entry(2);
+    n_samples = entry(3);
+
+    f = fopen(segment_filepath, 'rb');
+    if f < 0
+        error('ERROR: Cannot read file with path: %s', segment_filepath);
+    end
+    fseek(f, offset, 'bof');
+    t = fread(f, [2, n_channels*n_samples], data_type_re_im);
+    fclose(f);
+
+    % real and imag interleaved, channels concatenated
+    complex_samples = t(1,:) + t(2,:)*1i;
+    complex_samples = reshape(complex_samples, n_samples, n_channels);
+end
@@ -0,0 +1,39 @@
+function [gaps] = load_gap_index(full_filepath)
+
+    % The C++ program writes a gap index next to each data file that contains missing samples:
+    %
+    %   iqrecord_<...>.bin  ->  iqrecord_<...>.gaps
+    %
+    % One line per gap: <file offset in samples> <missing samples per channel> <uhd|ringbuffer> <device>
+    % Lines starting with # are comments. A gap only affects the channels of its device, see --streamer_per_device. If samples were zero filled, the missing samples are zeros in the data file and
+    % the offset is the index of the first zero, otherwise the offset is the index of the first sample after the gap.
+    %
+    % Returns a struct array with the fields offset (zero based), length, source and device (zero based), empty if there is no gap index.
+
+    gaps = struct('offset', {}, 'length', {}, 'source', {}, 'device', {});
+
+    % measurements of the archive have their gap index next to the index of the segment
+    full_filepath = char(full_filepath);
+    hash = find(full_filepath == '#', 1);
+    if isempty(hash) == false
+        folder = fileparts(full_filepath(1:hash-1));
+        name = full_filepath(hash+1:end);
+    else
+        [folder, name, ~] = fileparts(full_filepath);
+    end
+    gap_filepath = fullfile(folder, [char(name) '.gaps']);
+    if isfile(gap_filepath) == false
+        return;
+    end
+
+    fileID = fopen(gap_filepath, 'r');
+    lines = textscan(fileID, '%u64 %u64 %s %u64', 'CommentStyle', '#');
+    fclose(fileID);
+
+    for k=1:numel(lines{1})
+        gaps(k).offset  = lines{1}(k);
+        gaps(k).length  = lines{2}(k);
+        gaps(k).source  = lines{3}{k};
+        gaps(k).device  = lines{4}(k);
+    end
+end
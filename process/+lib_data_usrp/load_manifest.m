@@ -0,0 +1,85 @@
+function [complex_samples] = load_manifest(full_filepath, data_type_re_im)
+
+    % Loads a measurement that the C++ program wrote with --write_layout channel or stripes.
+    % The manifest is written after all files of the measurement, so all files listed exist:
+    %
+    %   layout <channel|stripes>
+    %   n_channels <n>
+    %   n_samples <samples per channel>
+    %   bytes_per_sample <bytes of one complex sample>
+    %   sample_rate <samples per second of the saved samples>
+    %   stripe_bytes <bytes per stripe, 0 for channel>
+    %   n_files <n>
+    %   file <index> <path>
+    %
+    % channel: channel ch is in file ch.
+    % stripes: the channels are concatenated as in a single file, stripe k is in file mod(k, n_files) at byte offset floor(k/n_files)*stripe_bytes.
+    %
+    % Returns a matrix with one column per channel. The MEX loader is used if it was built, see build_iqrecord_load.m.
+
+    if ~isempty(which('lib_data_usrp.iqrecord_load'))
+        complex_samples = lib_data_usrp.iqrecord_load(full_filepath, 0, data_type_re_im);
+        return;
+    end
+
+    manifest = struct('layout', '', 'files', {{}});
+
+    lines = readlines(full_filepath);
+    for k=1:numel(lines)
+        line = strtrim(lines(k));
+        if strlength(line) == 0 || startsWith(line, '#')
+            continue;
+        end
+        fields = split(line);
+        switch fields(1)
+            case 'layout'
+                manifest.layout = char(fields(2));
+            case 'file'
+                manifest.files{str2double(fields(2)) + 1} = char(strjoin(fields(3:end), ' '));
+            otherwise
+                manifest.(char(fields(1))) = str2double(fields(2));
+        end
+    end
+
+    n_bytes_total = manifest.n_channels*manifest.n_samples*manifest.bytes_per_sample;
+    raw = zeros(n_bytes_total, 1, 'uint8');
+
+    switch manifest.layout
+        case 'channel'
+            n_bytes_per_channel = n_bytes_total/manifest.n_channels;
+            for ch=1:manifest.n_channels
+                raw((ch-1)*n_bytes_per_channel+1 : ch*n_bytes_per_channel) = read_bytes(manifest.files{ch});
+            end
+        case 'stripes'
+            n_files = manifest.n_files;
+            parts = cell(n_files, 1);
+            for f=1:n_files
+                parts{f} = read_bytes(manifest.files{f});
+            end
+            stripe = 0;
+            for offset=0:manifest.stripe_bytes:n_bytes_total-1
+                n_bytes_stripe = min(manifest.stripe_bytes, n_bytes_total - offset);
+                f = mod(stripe, n_files) + 1;
+                offset_in_file = floor(stripe/n_files)*manifest.stripe_bytes;
+                raw(offset+1 : offset+n_bytes_stripe) = parts{f}(offset_in_file+1 : offset_in_file+n_bytes_stripe);
+                stripe = stripe + 1;
+            end
+        otherwise
+            error('Unknown layout %s in manifest %s.', manifest.layout, full_filepath);
+    end
+
+    % real and imag interleaved, channels concatenated
+    t = typecast(raw, data_type_re_im);
+    t = double(reshape(t, 2, []));
+    complex_samples = t(1,:) + t(2,:)*1i;
+    complex_samples = reshape(complex_samples, manifest.n_samples, manifest.n_channels);
+end
+
+function [raw] = read_bytes(filename)
+    f = fopen(filename, 'rb');
+    if f < 0
+        error('ERROR: Cannot read file with path: %s', filename);
+    end
+    raw = fread(f, Inf, '*uint8');
+    fclose(f);
+end
@@ -0,0 +1,63 @@
+function [packets] = load_packets(full_filepath, mac)
+
+    % Loads the packet windows the C++ program writes with --packet_formats, e.g. packets in the first save directory:
+    %
+    %   packets.bin     windows of all kept packets, each channel after the other as single precision complex samples (fc32)
+    %   packets.idx     one line per window, lines starting with # are comments:
+    %
+    %   <offset_bytes> <n_samples> <n_channels> <device> <file_id> <packet_offset> <time_epoch_sec> <format> <bandwidth_mhz> <mcs>
+    %   <length> <dcm> <coding> <n_sts> <bss_color> <snr_db> <cfo_hz> <ul_dl> <tx_station> <rx_station> <tx_mac> <rx_mac>
+    %
+    % full_filepath is the path without extension. packet_offset is the zero based sample of the window the packet starts at, format is
+    % legacy, ht, vht, he_su, he_tb or he_mu, fields that were not decoded are -1. tx_station and rx_station number the transmitters
+    % of a device as listed in packets.stations, tx_mac and rx_mac are their addresses, -1 and - if unknown.
+    %
+    % mac is optional, e.g. 'aa:bb:cc:dd:ee:01', only the packets of the links of this station are read then.
+    %
+    % Returns a struct array with one element per packet, samples has one column per channel.
+
+    packets = struct('device', {}, 'file_id', {}, 'packet_offset', {}, 'time', {}, 'format', {}, 'bandwidth_mhz', {}, 'mcs', {}, 'length', {}, ...
+                     'dcm', {}, 'coding', {}, 'n_sts', {}, 'bss_color', {}, 'snr_db', {}, 'cfo_hz', {}, 'ul_dl', {}, ...
+                     'tx_station', {}, 'rx_station', {}, 'tx_mac', {}, 'rx_mac', {}, 'samples', {});
+
+    fileID = fopen([char(full_filepath) '.idx'], 'r');
+    lines = textscan(fileID, '%u64 %u64 %u64 %u64 %u64 %u64 %f %s %f %f %f %f %f %f %f %f %f %f %f %f %s %s', 'CommentStyle', '#');
+    fclose(fileID);
+
+    selected = 1:numel(lines{1});
+    if nargin > 1
+        selected = find(strcmpi(lines{21}, mac) | strcmpi(lines{22}, mac))';
+    end
+
+    fileID = fopen([char(full_filepath) '.bin'], 'r', 'ieee-le');
+    k = 0;
+    for l=selected
+        k = k + 1;
+        n_samples = double(lines{2}(l));
+        n_channels = double(lines{3}(l));
+        fseek(fileID, double(lines{1}(l)), 'bof');
+        values = fread(fileID, 2*n_samples*n_channels, 'single');
+
+        packets(k).device           = lines{4}(l);
+        packets(k).file_id          = lines{5}(l);
+        packets(k).packet_offset    = lines{6}(l);
+        packets(k).time             = lines{7}(l);
+        packets(k).format           = lines{8}{l};
+        packets(k).bandwidth_mhz    = lines{9}(l);
+        packets(k).mcs              = lines{10}(l);
+        packets(k).length           = lines{11}(l);
+        packets(k).dcm              = lines{12}(l);
+        packets(k).coding           = lines{13}(l);
+        packets(k).n_sts            = lines{14}(l);
+        packets(k).bss_color        = lines{15}(l);
+        packets(k).snr_db           = lines{16}(l);
+        packets(k).cfo_hz           = lines{17}(l);
+        packets(k).ul_dl            = lines{18}(l);
+        packets(k).tx_station       = lines{19}(l);
+        packets(k).rx_station       = lines{20}(l);
+        packets(k).tx_mac           = lines{21}{l};
+        packets(k).rx_mac           = lines{22}{l};
+        packets(k).samples          = reshape(complex(values(1:2:end), values(2:2:end)), n_samples, n_channels);
+    end
+    fclose(fileID);
+end
@@ -0,0 +1,43 @@
+function [frames] = load_psd(full_filepath)
+
+    % Loads the spectrum frames the C++ program appends to --psd_output, e.g. spectrogram.psd in the first save directory.
+    % Each frame is a 52 byte header followed by the mean and the max hold of each channel in 0.01 dBFS (int16, little endian):
+    %
+    %   char[4] 'PSD1', uint32 device, uint32 n_channels, uint32 n_bins, uint32 n_spectra,
+    %   double time_start, double duration, double freq_first, double bin_width,
+    %   int16 mean[n_channels][n_bins], int16 max[n_channels][n_bins]
+    %
+    % time_start is the start of the integration period in seconds since the epoch, freq_first the center of the first bin in Hz.
+    % A measurement that ends within an integration period writes a frame with fewer spectra, n_spectra is the number averaged.
+    %
+    % Returns a struct array with one element per frame, mean_dB and max_dB have one column per channel.
+
+    frames = struct('device', {}, 'n_spectra', {}, 'time_start', {}, 'duration', {}, 'freq', {}, 'mean_dB', {}, 'max_dB', {});
+
+    fileID = fopen(full_filepath, 'r', 'ieee-le');
+    k = 0;
+    while true
+        magic = fread(fileID, 4, '*char')';
+        if numel(magic) < 4
+            break;
+        end
+        if strcmp(magic, 'PSD1') == false
+            error('load_psd: unknown frame format in %s', full_filepath);
+        end
+        header_u32 = fread(fileID, 4, 'uint32');
+        header_f64 = fread(fileID, 4, 'double');
+        n_channels = header_u32(2);
+        n_bins = header_u32(3);
+        values = fread(fileID, 2*n_channels*n_bins, 'int16');
+
+        k = k + 1;
+        frames(k).device        = header_u32(1);
+        frames(k).n_spectra     = header_u32(4);
+        frames(k).time_start    = header_f64(1);
+        frames(k).duration      = header_f64(2);
+        frames(k).freq          = header_f64(3) + (0:n_bins-1)'*header_f64(4);
+        frames(k).mean_dB       = reshape(values(1:n_channels*n_bins), n_bins, n_channels)/100;
+        frames(k).max_dB        = reshape(values(n_channels*n_bins+1:end), n_bins, n_channels)/100;
+    end
+    fclose(fileID);
+end
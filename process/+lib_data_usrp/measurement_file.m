@@ -59,14 +59,20 @@ classdef measurement_file
 end
 
 function complex_samples = read_samples(obj)
-    complex_samples = read_complex_binary(obj.full_filepath, obj.iq_file_param_cpy.data_type, 0, 0);
+    % the MEX loader reads the channels with several threads, see build_iqrecord_load.m, iq_file_param.use_mex = false disables it
+    use_mex = ~isfield(obj.iq_file_param_cpy, 'use_mex') || obj.iq_file_param_cpy.use_mex;
+    if use_mex && ~isempty(which('lib_data_usrp.iqrecord_load'))
+        complex_samples = lib_data_usrp.iqrecord_load(obj.full_filepath, obj.iq_file_param_cpy.n_rx_channels, obj.iq_file_param_cpy.data_type);
+    else
+        complex_samples = read_complex_binary(obj.full_filepath, obj.iq_file_param_cpy.data_type, 0, 0);
 
-    % channels are concatenated
-    n_complex_samples = numel(complex_samples);
-    n_complex_samples_per_channel = n_complex_samples/obj.iq_file_param_cpy.n_rx_channels;
+        % channels are concatenated
+        n_complex_samples = numel(complex_samples);
+        n_complex_samples_per_channel = n_complex_samples/obj.iq_file_param_cpy.n_rx_channels;
 
-    % separate into channels
-    complex_samples = reshape(complex_samples, n_complex_samples_per_channel, obj.iq_file_param_cpy.n_rx_channels);
+        % separate into channels
+        complex_samples = reshape(complex_samples, n_complex_samples_per_channel, obj.iq_file_param_cpy.n_rx_channels);
+    end
 
     % sanity check
     len = obj.iq_file_param_cpy.ch_measurement_per_sec;
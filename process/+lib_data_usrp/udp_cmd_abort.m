@@ -0,0 +1,16 @@
+function [] = udp_cmd_abort()
+
+    % Aborts the measurement or scan schedule the C++ program is currently recording.
+    %
+    %       18 Byte alphanumeric: Abort_Measurement_
+
+    text_sent = 'Abort_Measurement_';
+
+    fixed_message_size = 64;
+    text_sent = strcat(text_sent, repelem('x', fixed_message_size-numel(text_sent)));
+
+    udps = dsp.UDPSender('RemoteIPPort',8888);
+    dataSent = uint8(text_sent);
+    udps(dataSent);
+    release(udps);
+end
@@ -0,0 +1,29 @@
+function [] = udp_cmd_scan_schedule(file_id)
+
+    % Triggers the scan schedule passed to the C++ program with --scan_schedule.
+    %
+    %       18 Byte alphanumeric: New_Scan_Schedule_
+    %       8 Byte uint32: File ID
+    %
+    % The C++ program tunes to each dwell of the schedule with a timed command and
+    % saves one file per dwell. The file name is extended by _scanRRRR_DDDD_FFFF
+    % with repetition index, dwell index and center frequency in MHz.
+
+    % convert to unsigned integer
+    u32_file_id = uint32(file_id);
+
+    % human readable string with all data
+    text_sent = strcat('New_Scan_Schedule_', sprintf('%08d', u32_file_id));
+
+    fixed_message_size = 64;
+
+    % make sure the message has a length of fixed_message_size
+    text_sent = strcat(text_sent, repelem('x', fixed_message_size-numel(text_sent)));
+
+    % All udp functionality.
+    % Do not change to TCP, UDP nonconnected behaviour is required in case C++-program crashes.
+    udps = dsp.UDPSender('RemoteIPPort',8888);
+    dataSent = uint8(text_sent);
+    udps(dataSent);
+    release(udps);
+end
@@ -0,0 +1,53 @@
+function [status] = udp_cmd_status(timeout_sec)
+
+    % Requests the state of the C++ program. It is answered by the control thread, also during a measurement.
+    %
+    %       16 Byte alphanumeric: Status_Request__
+    %
+    % Answer sent to port 8889, fields separated by ';':
+    %
+    %       Status_;<rx state>;<file id>;<received samples>;<dropped samples>;<overruns>;<queued commands>;<writer backlog in bytes>
+    %
+    % rx state: 0 idle, 1 capturing, 2 scanning, 3 triggered capture (iqrecorder --trigger)
+    % Returns an empty array if no answer arrives within timeout_sec.
+
+    status = [];
+
+    udpr = lib_data_usrp.completion_receiver();
+
+    text_sent = 'Status_Request__';
+    fixed_message_size = 64;
+    text_sent = strcat(text_sent, repelem('x', fixed_message_size-numel(text_sent)));
+
+    udps = dsp.UDPSender('RemoteIPPort',8888);
+    udps(uint8(text_sent));
+    release(udps);
+
+    t_start = tic;
+    while toc(t_start) < timeout_sec
+        data_received = udpr();
+        if isempty(data_received) == true
+            pause(0.01);
+            continue;
+        end
+
+        fields = strsplit(char(data_received'), ';');
+        if numel(fields) < 7 || strcmp(fields{1}, 'Status_') == false
+            continue;
+        end
+
+        status.rx_state             = str2double(fields{2});
+        status.file_id              = str2double(fields{3});
+        status.n_rx_samples         = str2double(fields{4});
+        status.n_dropped_samples    = str2double(fields{5});
+        status.n_overruns           = str2double(fields{6});
+        status.n_queued_commands    = str2double(fields{7});
+        status.writer_backlog_bytes = 0;
+        if numel(fields) >= 8
+            status.writer_backlog_bytes = str2double(fields{8});
+        end
+        break;
+    end
+
+    release(udpr);
+end
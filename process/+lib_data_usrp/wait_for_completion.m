@@ -0,0 +1,50 @@
+function [completion] = wait_for_completion(udpr, timeout_sec)
+
+    % The C++ program sends one message after a file has been written and renamed to its final name:
+    %
+    %   Measurement_Done_;<file path>;<samples per channel>;<dropped samples>;<uhd start time in s>;<write throughput in MB/s>;<number of gaps>;<sample rate in S/s>;<packets>
+    %
+    % The file path is empty if the file could not be written. For --write_layout channel or stripes it is the path of the manifest (see load_manifest),
+    % for --write_layout archive <path of the segment index>#<file name> (see load_archive).
+    % If the number of gaps is larger than 0, the gaps are listed in a file next to the data file (see load_gap_index).
+    % The sample rate is the rate of the saved samples, lower than the rx rate with the digital downconverter (--ddc_decimation).
+    % Packets is the number of packets the packet filter kept during the measurement, -1 if they were not counted. With --capture_packets
+    % the measurement ends once enough packets were found, samples per channel can then be less than requested.
+    % Returns an empty array if no message arrives within timeout_sec.
+
+    completion = [];
+
+    t_start = tic;
+    while toc(t_start) < timeout_sec
+        data_received = udpr();
+        if isempty(data_received) == true
+            pause(0.01);
+            continue;
+        end
+
+        fields = strsplit(char(data_received'), ';');
+        if numel(fields) < 6 || strcmp(fields{1}, 'Measurement_Done_') == false
+            fprintf('Unknown completion message: %s\n', char(data_received'));
+            continue;
+        end
+
+        completion.full_filepath            = fields{2};
+        completion.n_samples                = str2double(fields{3});
+        completion.n_dropped_samples        = str2double(fields{4});
+        completion.uhd_start_time_sec       = str2double(fields{5});
+        completion.write_throughput_MBps    = str2double(fields{6});
+        completion.n_gaps                   = 0;
+        if numel(fields) >= 7
+            completion.n_gaps               = str2double(fields{7});
+        end
+        completion.samp_rate                = NaN;
+        if numel(fields) >= 8
+            completion.samp_rate            = str2double(fields{8});
+        end
+        completion.n_packets                = -1;
+        if numel(fields) >= 9
+            completion.n_packets            = str2double(fields{9});
+        end
+        return;
+    end
+end
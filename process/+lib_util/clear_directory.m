@@ -3,8 +3,11 @@ function [] = clear_directory(directory_path)
     % first find all recorded files
     [filenames, n_files] = lib_util.get_all_filenames(directory_path);
 
-    % delete all files
+    % delete all files, the rolling archive of --write_layout archive recycles its segments itself
     for i=1:1:n_files
+        if startsWith(filenames(i).name, 'archive_')
+            continue;
+        end
     	full_filepath = fullfile(filenames(i).folder,filenames(i).name);
         delete(full_filepath);
     end
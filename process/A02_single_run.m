@@ -10,7 +10,8 @@ function [] = A02_single_run(ext_sys_param, run_id)
     % we try to extact wifi packets, but not indefinitely
     n_max_try = 5;
     
-    % how many samples do we record per try?
+    % how many samples do we record per try? If the C++ program runs with --capture_packets, this is the maximum and a try ends as soon
+    % as the packet filter has found enough packets, e.g. --packet_formats he_su --capture_packets 10, usually making further tries unnecessary
     n_samples = 100e6;
     
     mode = "complex_samples_usrp";
@@ -53,8 +54,8 @@ function [] = A02_single_run(ext_sys_param, run_id)
 
         % error handling
         [check_n_samples, check_n_channels] = size(complex_samples);
-        if check_n_samples ~= n_samples
-            fprintf('Incorrect number of complex samples, is %d, should be %d. Next try.\n', check_n_samples, n_samples);
+        if check_n_samples == 0 || check_n_samples > n_samples
+            fprintf('Incorrect number of complex samples, is %d, should be at most %d. Next try.\n', check_n_samples, n_samples);
             pause(1.0);
             continue;
         elseif check_n_channels ~= n_channels
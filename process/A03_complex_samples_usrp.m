@@ -1,7 +1,7 @@
 function [complex_samples, samp_rate_complex_samples, gain_used] = A03_complex_samples_usrp(samp_rate, n_channels, data_type_re_im, center_freq, run_id, n_samples)
 
-    % wait time for C++-program to save binary iq samples file after sending udp instruction
-    wait_time_cpp_file_save_sec = n_samples/samp_rate + 3.0;
+    % maximum wait time for the completion message of the C++-program, we continue as soon as it arrives
+    timeout_cpp_file_save_sec = n_samples/samp_rate + 10.0;
     
     % agc
     agc_gain_default = 40;      % agc will use this defautl value to record samples, based on these samples it will adjust the gains
@@ -40,18 +40,38 @@ function [complex_samples, samp_rate_complex_samples, gain_used] = A03_complex_s
     % record samples with USRP, IQ samples are written to binary file
     fprintf('A03: Starting recording via UDP.\n');
     file_id = 1e6 + run_id;	% 1e6 is an arbitrary offset
+    udpr = lib_data_usrp.completion_receiver();
     lib_data_usrp.udp_cmd(file_id, center_freq, n_samples, gain_used, false);
 
-    pause(wait_time_cpp_file_save_sec);
+    completion = lib_data_usrp.wait_for_completion(udpr, timeout_cpp_file_save_sec);
+    release(udpr);
 
-    % C++ program should have created one file. Load it, extract samples and then delete it.
+    if isempty(completion) == true || isempty(completion.full_filepath) == true
+        lib_util.clear_directory("../data/");
+        disp('A03: No completion message received. Content of WiFi6/data/ deleted.');
+
+        complex_samples = [];
+        samp_rate_complex_samples = [];
+        gain_used = [];
+        return;
+    end
+
+    fprintf('A03: File written with %d dropped samples at %.1f MB/s.\n', completion.n_dropped_samples, completion.write_throughput_MBps);
+
+    % C++ program has created one file and renamed it after it was completely written. Load it, extract samples and then delete it.
     % Should actually never throw errors, but theroretically it could.
-    %   - IQ samples file is not completely written by C++ program, we load prematurely and therefore the number of bytes is not a multiple of the item size
     %   - we detect a file, but just before loading it somehow gets deleted
     % In case of an error best idea is to delete all binary IQ-samples files if there are any.
+    % With --write_layout archive the measurement is an entry of the archive, which is not deleted.
     try
-        [complex_samples, n_files] = lib_data_usrp.file_loading(n_channels, data_type_re_im, n_samples);
-        lib_util.clear_directory("../data/");
+        if contains(completion.full_filepath, '#')
+            complex_samples = lib_data_usrp.load_archive(completion.full_filepath, data_type_re_im);
+            n_files = 1;
+        else
+            % with --capture_packets the file can be shorter than requested
+            [complex_samples, n_files] = lib_data_usrp.file_loading(n_channels, data_type_re_im, completion.n_samples);
+            lib_util.clear_directory("../data/");
+        end
     catch
         lib_util.clear_directory("../data/");
         disp('A03: Function file_loading_deleting failed. Content of WiFi6/data/ deleted.');
@@ -0,0 +1,59 @@
+function [] = A22_plot_soak(log_filepath)
+
+    % Plots the log of a soak test of the C++ program, see iqsoak in the README.
+    % Each line of the log is one measurement:
+    %
+    %   time_sec measurement n_samples n_bytes capture_sec throughput_MSps dropped_samples drop_rate write_MBps overflows ringbuffer_gaps stalls wrong_samples
+    %
+    % Lines starting with # are comments.
+
+    if nargin == 0
+        log_filepath = 'soak.log';
+    end
+
+    f = fopen(log_filepath, 'r');
+    if f < 0
+        error('ERROR: Cannot read file with path: %s', log_filepath);
+    end
+    columns = textscan(f, '%f %f %f %f %f %f %f %f %f %f %f %f %f', 'CommentStyle', '#');
+    fclose(f);
+
+    time_sec        = columns{1};
+    n_bytes         = columns{4};
+    throughput_MSps = columns{6};
+    drop_rate       = columns{8};
+    write_MBps      = columns{9};
+    wrong_samples   = columns{13};
+
+    failed = wrong_samples ~= 0;
+
+    fprintf('Measurements:   %d\n', numel(time_sec));
+    fprintf('Failed:         %d\n', sum(failed));
+    fprintf('Verified GB:    %.1f\n', sum(n_bytes(~failed))/1e9);
+
+    figure(22)
+    clf()
+
+    subplot(3,1,1);
+    plot(time_sec, throughput_MSps, '.');
+    hold on
+    plot(time_sec(failed), throughput_MSps(failed), 'rx');
+    title("Capture Throughput per Measurement");
+    xlabel("Time in s");
+    ylabel("MS/s");
+    grid on
+
+    subplot(3,1,2);
+    semilogy(time_sec, max(drop_rate, 1e-9), '.');
+    title("Drop Rate per Measurement");
+    xlabel("Time in s");
+    ylabel("Dropped / Requested Samples");
+    grid on
+
+    subplot(3,1,3);
+    plot(time_sec, write_MBps, '.');
+    title("Write Throughput per Measurement");
+    xlabel("Time in s");
+    ylabel("MB/s");
+    grid on
+end
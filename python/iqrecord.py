@@ -0,0 +1,188 @@
+import ctypes
+import ctypes.util
+import os
+import sys
+import time
+import numpy as np
+
+class _Name(ctypes.Structure):
+    _fields_ = [('index', ctypes.c_ulonglong), ('file_id', ctypes.c_uint), ('time_us', ctypes.c_ulonglong), ('tag', ctypes.c_char*64)]
+
+# samples as stored, sc16 and sc8 as pairs of real and imag
+DTYPES = {16: np.complex128, 8: np.complex64, 4: np.dtype((np.int16, 2)), 2: np.dtype((np.int8, 2))}
+
+def _load_library():
+    '''
+    loads libiqrecord from IQRECORD_LIBRARY, the build directory next to python/ or the library path
+    '''
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [os.environ.get('IQRECORD_LIBRARY', ''), os.path.join(here, '..', 'build', 'libiqrecord.so'), ctypes.util.find_library('iqrecord') or '']
+    for path in candidates:
+        if path and (os.path.exists(path) or not os.path.dirname(path)):
+            lib = ctypes.CDLL(path)
+            break
+    else:
+        raise OSError('libiqrecord not found, build it with cmake or set IQRECORD_LIBRARY')
+
+    u64, size = ctypes.c_ulonglong, ctypes.c_size_t
+    lib.iqrecord_open.restype = ctypes.c_void_p
+    lib.iqrecord_open.argtypes = [ctypes.c_char_p, size, size]
+    lib.iqrecord_close.argtypes = [ctypes.c_void_p]
+    lib.iqrecord_last_error.restype = ctypes.c_char_p
+    lib.iqrecord_parse_name.argtypes = [ctypes.c_char_p, ctypes.POINTER(_Name)]
+    for name, restype in [('n_channels', size), ('n_samples', u64), ('bytes_per_sample', size), ('sample_rate', ctypes.c_double),
+                          ('layout', ctypes.c_char_p), ('name', ctypes.POINTER(_Name)), ('n_gaps', size), ('zero_fill', ctypes.c_int)]:
+        f = getattr(lib, 'iqrecord_' + name)
+        f.restype = restype
+        f.argtypes = [ctypes.c_void_p]
+    lib.iqrecord_gap.argtypes = [ctypes.c_void_p, size, ctypes.POINTER(u64), ctypes.POINTER(u64), ctypes.POINTER(size)]
+    lib.iqrecord_view.restype = ctypes.c_void_p
+    lib.iqrecord_view.argtypes = [ctypes.c_void_p, size, u64, u64]
+    lib.iqrecord_read.restype = u64
+    lib.iqrecord_read.argtypes = [ctypes.c_void_p, size, u64, u64, ctypes.c_void_p]
+    lib.iqrecord_read_fc32.restype = u64
+    lib.iqrecord_read_fc32.argtypes = [ctypes.c_void_p, size, u64, u64, ctypes.c_void_p]
+    return lib
+
+_lib = None
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+def parse_name(file_name):
+    '''
+    splits the name of a measurement file into index, file_id, time_us and tag, returns None for other files
+    '''
+    name = _Name()
+    if _library().iqrecord_parse_name(os.fsencode(file_name), ctypes.byref(name)) == 0:
+        return None
+    return {'index': name.index, 'file_id': name.file_id, 'time_us': name.time_us, 'tag': name.tag.decode()}
+
+def list_measurements(folderpath):
+    '''
+    complete measurements of a directory sorted by their index, .tmp files are still being written,
+    measurements of the archive are listed as <segment index>#<file name>
+    '''
+    files = [f for f in os.listdir(folderpath) if f.endswith('.bin') or f.endswith('.manifest')]
+    for index in [f for f in os.listdir(folderpath) if f.startswith('archive_') and f.endswith('.idx')]:
+        with open(os.path.join(folderpath, index)) as fin:
+            files += [index + '#' + line.split()[1] for line in fin if line.startswith('entry ')]
+    found = [(parse_name(f), os.path.join(folderpath, f)) for f in files]
+    return [path for index, path in sorted((name['index'], path) for name, path in found if name is not None)]
+
+class Measurement:
+    '''
+    measurement of the recorder, a .bin file, a manifest or an entry of the archive, samples are mapped and only read when accessed
+
+    with Measurement('../data/iqrecord_..._.bin', n_channels=2, bytes_per_sample=4) as m:
+        x = m.window(0.5, 0.01)         # 10 ms of all channels from 0.5 s on, complex64 [n_channels, n_samples]
+        v = m.view(1, 1000, 4096)       # channel 1 as stored in the file, no copy
+    '''
+    def __init__(self, path, n_channels=0, bytes_per_sample=8, sample_rate=0.0):
+        self._lib = _library()
+        self._handle = self._lib.iqrecord_open(os.fsencode(path), n_channels, bytes_per_sample)
+        if not self._handle:
+            raise IOError(self._lib.iqrecord_last_error().decode())
+        self.path = path
+        self.n_channels = self._lib.iqrecord_n_channels(self._handle)
+        self.n_samples = self._lib.iqrecord_n_samples(self._handle)
+        self.bytes_per_sample = self._lib.iqrecord_bytes_per_sample(self._handle)
+        self.sample_rate = self._lib.iqrecord_sample_rate(self._handle) or sample_rate
+        self.layout = self._lib.iqrecord_layout(self._handle).decode()
+        name = self._lib.iqrecord_name(self._handle).contents
+        self.name = {'index': name.index, 'file_id': name.file_id, 'time_us': name.time_us, 'tag': name.tag.decode()}
+        self.zero_fill = bool(self._lib.iqrecord_zero_fill(self._handle))
+        self.gaps = []
+        offset, length, device = ctypes.c_ulonglong(), ctypes.c_ulonglong(), ctypes.c_size_t()
+        for i in range(self._lib.iqrecord_n_gaps(self._handle)):
+            self._lib.iqrecord_gap(self._handle, i, ctypes.byref(offset), ctypes.byref(length), ctypes.byref(device))
+            self.gaps.append({'offset': offset.value, 'length': length.value, 'device': device.value})
+
+    def close(self):
+        '''
+        unmaps the files, views must not be used afterwards
+        '''
+        if self._handle:
+            self._lib.iqrecord_close(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def view(self, channel, offset=0, n_samples=None):
+        '''
+        read-only samples of one channel as stored in the file, without copy if they are contiguous in one file, otherwise copied
+        '''
+        if n_samples is None:
+            n_samples = self.n_samples - offset
+        dtype = np.dtype(DTYPES[self.bytes_per_sample])
+        ptr = self._lib.iqrecord_view(self._handle, channel, offset, n_samples)
+        if ptr:
+            buf = (ctypes.c_char*(n_samples*self.bytes_per_sample)).from_address(ptr)
+            x = np.frombuffer(buf, dtype=dtype, count=n_samples)
+        else:
+            x = np.empty(n_samples, dtype=dtype)
+            n = self._lib.iqrecord_read(self._handle, channel, offset, n_samples, x.ctypes.data)
+            if n != n_samples:
+                raise IndexError(self._lib.iqrecord_last_error().decode())
+        x.flags.writeable = False
+        return x
+
+    def channels(self, offset=0, n_samples=None):
+        '''
+        views of all channels, see view()
+        '''
+        return [self.view(ch, offset, n_samples) for ch in range(self.n_channels)]
+
+    def read(self, offset=0, n_samples=None, channels=None):
+        '''
+        copy of the samples as complex64 [n_channels, n_samples], sc16 and sc8 scaled to full scale 1
+        '''
+        if n_samples is None:
+            n_samples = self.n_samples - offset
+        channels = range(self.n_channels) if channels is None else channels
+        x = np.empty((len(channels), n_samples), dtype=np.complex64)
+        for i, ch in enumerate(channels):
+            n = self._lib.iqrecord_read_fc32(self._handle, ch, offset, n_samples, x[i].ctypes.data)
+            if n != n_samples:
+                raise IndexError('samples %d to %d of channel %d out of range' % (offset, offset + n_samples, ch))
+        return x
+
+    def window(self, start_sec, duration_sec, channels=None):
+        '''
+        time window of the measurement, see read(), needs the sample rate
+        '''
+        if self.sample_rate <= 0.0:
+            raise ValueError('sample rate unknown, pass it to Measurement()')
+        return self.read(int(round(start_sec*self.sample_rate)), int(round(duration_sec*self.sample_rate)), channels)
+
+    def chunks(self, channel, n_samples_per_chunk):
+        '''
+        iterates over a channel in views of n_samples_per_chunk samples, the last one can be shorter
+        '''
+        for offset in range(0, self.n_samples, n_samples_per_chunk):
+            yield offset, self.view(channel, offset, min(n_samples_per_chunk, self.n_samples - offset))
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: python3 iqrecord.py <.bin, .manifest or index#name> [n_channels bytes_per_sample sample_rate]')
+        return
+    args = sys.argv[2:]
+    m = Measurement(sys.argv[1], int(args[0]) if len(args) > 0 else 0, int(args[1]) if len(args) > 1 else 8, float(args[2]) if len(args) > 2 else 0.0)
+    print('%s: layout %s, %d channels, %d samples, %d bytes per sample, %.0f S/s, %d gaps' % (m.name, m.layout, m.n_channels, m.n_samples, m.bytes_per_sample, m.sample_rate, len(m.gaps)))
+    if m.sample_rate > 0.0:
+        n = int(round(0.01*m.sample_rate))
+        offset = np.random.randint(0, max(1, m.n_samples - n))
+        t_start = time.perf_counter()
+        x = m.read(offset, n)
+        print('10 ms window of %d channels read in %.2f ms, rms %.4f' % (m.n_channels, 1e3*(time.perf_counter() - t_start), np.sqrt(np.mean(np.abs(x)**2))))
+    m.close()
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,84 @@
+import socket
+import struct
+import sys
+import math
+import numpy as np
+
+HEADER = struct.Struct('<4s3IQ3dfI')
+CHANNEL = struct.Struct('<2f2I')
+
+def parse(datagram):
+    '''
+    parses one datagram of the live preview of the recorder (--preview_addr),
+    returns a dictionary with the header, the levels of each channel and the IQ samples as complex array [n_channels, n_iq]
+    '''
+    magic, device, n_channels, n_iq, sequence, time_start, duration, iq_rate, cost, n_missing = HEADER.unpack_from(datagram, 0)
+    if magic != b'PRV1':
+        raise ValueError('not a preview datagram')
+    offset = HEADER.size
+    channels = []
+    for ch in range(n_channels):
+        rms, peak, n_clipped, n_analysed = CHANNEL.unpack_from(datagram, offset)
+        channels.append({'rms': rms, 'peak': peak, 'n_clipped': n_clipped, 'n_analysed': n_analysed})
+        offset += CHANNEL.size
+    iq = np.frombuffer(datagram, dtype=np.complex64, count=n_channels*n_iq, offset=offset).reshape(n_channels, n_iq)
+    return {'device': device, 'sequence': sequence, 'time_start': time_start, 'duration': duration, 'iq_rate': iq_rate,
+            'cost': cost, 'n_missing': n_missing, 'channels': channels, 'iq': iq}
+
+def open_socket(address, port):
+    '''
+    binds to the port and joins the group if address is a multicast address
+    '''
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', port))
+    if 224 <= int(address.split('.')[0]) <= 239:
+        mreq = struct.pack('4s4s', socket.inet_aton(address), socket.inet_aton('0.0.0.0'))
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    return sock
+
+def dbfs(x):
+    return 20.0*math.log10(x) if x > 0.0 else -math.inf
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: python3 preview_viewer.py <address>:<port> [plot]')
+        return
+    address, port = sys.argv[1].rsplit(':', 1)
+    sock = open_socket(address, int(port))
+
+    plot = len(sys.argv) > 2 and sys.argv[2] == 'plot'
+    if plot:
+        import matplotlib.pyplot as plt
+        plt.ion()
+        fig, ax = plt.subplots()
+
+    last_sequence = {}
+    while True:
+        p = parse(sock.recv(65536))
+
+        # datagrams lost on the network
+        lost = p['sequence'] - last_sequence.get(p['device'], p['sequence'] - 1) - 1
+        last_sequence[p['device']] = p['sequence']
+
+        line = 'dev %d seq %d cost %5.2f %%' % (p['device'], p['sequence'], 100.0*p['cost'])
+        for ch, c in enumerate(p['channels']):
+            line += ' | ch %d rms %6.1f peak %6.1f dBFS clip %d' % (ch, dbfs(c['rms']), dbfs(c['peak']), c['n_clipped'])
+        if p['n_missing'] > 0:
+            line += ' | missing %d' % p['n_missing']
+        if lost > 0:
+            line += ' | lost %d' % lost
+        print(line, flush=True)
+
+        if plot and p['device'] == 0:
+            ax.clear()
+            for ch in range(p['iq'].shape[0]):
+                ax.plot(p['iq'][ch].real, p['iq'][ch].imag, '.', label='ch %d' % ch)
+            ax.set_xlim(-1, 1)
+            ax.set_ylim(-1, 1)
+            ax.set_aspect('equal')
+            ax.legend(loc='upper right')
+            plt.pause(0.001)
+
+if __name__ == '__main__':
+    main()
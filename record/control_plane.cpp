@@ -0,0 +1,287 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <boost/asio.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "debug.h"
+#include "control_plane.h"
+#include "writer.h"
+
+#define MAILBOX_CAPACITY                    64
+#define MAX_MESSAGE_LENGTH                  64      // maximum length of message, must be the same in matlab
+#define SHUTDOWN_POLL_PERIOD_MS             100
+
+namespace channelsounder
+{
+static unsigned short port;
+static unsigned short notify_port;
+static size_t n_channels;
+
+// single producer (control thread), single consumer (rx thread)
+static boost::lockfree::spsc_queue<command_t, boost::lockfree::capacity<MAILBOX_CAPACITY>> mailbox;
+
+// commands the rx thread took from the mailbox to look for an abort behind them, only used by the rx thread, oldest first
+static command_t pending[MAILBOX_CAPACITY];
+static size_t pending_head = 0;
+static size_t n_pending = 0;
+static std::atomic<size_t> n_pending_published(0);      // n_pending for status replies
+
+// the io_context and everything that belongs to it lives in the control thread
+static boost::asio::io_service io_context;
+static boost::asio::ip::udp::socket *socket_ptr = nullptr;
+static boost::asio::deadline_timer *timer_ptr = nullptr;
+static boost::asio::ip::udp::endpoint sender;
+static char buffer[MAX_MESSAGE_LENGTH+256];         // add 256 Byte as security
+static std::atomic<bool> *burst_timer_elapsed_ptr = nullptr;
+
+// published by the rx thread
+static std::atomic<int> rx_state(RX_STATE_IDLE);
+static std::atomic<unsigned int> rx_file_id(0);
+static std::atomic<unsigned long long> rx_n_rx_samps(0);
+static std::atomic<unsigned long long> rx_n_dropped_samps(0);
+static std::atomic<unsigned long long> rx_n_overruns(0);
+
+// we have five predefined messages
+static const std::string predefined_message_new_meas("New_Measurement_");                    // message for new measurement (16 Byte)
+static const std::string predefined_message_new_scan("New_Scan_Schedule_");                  // message to execute the scan schedule (18 Byte)
+static const std::string predefined_message_status("Status_Request__");                      // message to request the state of the rx thread (16 Byte)
+static const std::string predefined_message_abort("Abort_Measurement_");                     // message to abort the current measurement or scan schedule (18 Byte)
+static const std::string predefined_message_end_exec("End_Measurement_programm_now1234");    // message to shut down program (32 Byte)
+
+// statistics
+static unsigned long long n_messages_received = 0;
+static unsigned long long n_messages_unknown = 0;
+static unsigned long long n_status_requests = 0;
+static unsigned long long n_mailbox_full = 0;
+
+static void start_receive();
+
+static void push_command(const command_t& cmd){
+    if(!mailbox.push(cmd)){
+        n_mailbox_full++;
+        std::cerr << "Control plane: mailbox full, command dropped." << std::endl;
+    }
+}
+
+// Message format, fields separated by ';':
+//  Status_;<rx state>;<file id>;<received samples>;<dropped samples>;<overruns>;<queued commands>;<writer backlog in bytes>
+static void send_status(){
+
+    if(notify_port == 0)
+        return;
+
+    std::ostringstream ss;
+    ss << "Status_";
+    ss << ";" << rx_state.load(std::memory_order_relaxed);
+    ss << ";" << rx_file_id.load(std::memory_order_relaxed);
+    ss << ";" << rx_n_rx_samps.load(std::memory_order_relaxed);
+    ss << ";" << rx_n_dropped_samps.load(std::memory_order_relaxed);
+    ss << ";" << rx_n_overruns.load(std::memory_order_relaxed);
+    ss << ";" << MAILBOX_CAPACITY - mailbox.write_available() + n_pending_published.load(std::memory_order_relaxed);
+    ss << ";" << get_writer_backlog_bytes();
+    std::string message = ss.str();
+
+    boost::system::error_code ec;
+    boost::asio::ip::udp::endpoint endpoint(sender.address(), notify_port);
+    socket_ptr->send_to(boost::asio::buffer(message), endpoint, 0, ec);
+}
+
+static void handle_message(const std::string& message_from_matlab){
+
+    command_t cmd;
+    cmd.file_id = 0;
+    cmd.center_freq = 0.0;
+    cmd.n_samples = 0;
+    cmd.n_gains = 0;
+    std::strncpy(cmd.sender_address, sender.address().to_string().c_str(), COMMAND_MAX_ADDRESS_LENGTH - 1);
+    cmd.sender_address[COMMAND_MAX_ADDRESS_LENGTH - 1] = '\0';
+
+    try{
+        std::string::size_type sz;
+
+        // message to start new measurement?
+        if (message_from_matlab.compare(0, predefined_message_new_meas.size(), predefined_message_new_meas) == 0){
+            cmd.type = CMD_NEW_MEASUREMENT;
+            cmd.file_id = std::stoi(message_from_matlab.substr(16,8),&sz);                      // extract file id (8 Byte)
+            unsigned int center_freq_MHz = std::stoi(message_from_matlab.substr(25,4),&sz);     // extract center frequency in MHz (4 Byte)
+            cmd.center_freq = ((double) center_freq_MHz)*1e6;
+            cmd.n_samples = std::stoull(message_from_matlab.substr(30,10),&sz);                  // extract number of samples (10 Byte)
+
+            // gains (4 Byte per channel)
+            for (size_t j=0; j<n_channels; j++){
+                unsigned int gain = std::stoi(message_from_matlab.substr(41 + j*4,4),&sz);
+                cmd.gains[cmd.n_gains++] = (double) gain;
+            }
+            push_command(cmd);
+        }
+        // message to execute the scan schedule?
+        else if (message_from_matlab.compare(0, predefined_message_new_scan.size(), predefined_message_new_scan) == 0){
+            cmd.type = CMD_NEW_SCAN_SCHEDULE;
+            cmd.file_id = std::stoi(message_from_matlab.substr(18,8),&sz);                      // extract file id (8 Byte)
+            push_command(cmd);
+        }
+        // status request, answered right here without involving the rx thread
+        else if (message_from_matlab.compare(0, predefined_message_status.size(), predefined_message_status) == 0){
+            n_status_requests++;
+            send_status();
+        }
+        // abort current measurement?
+        else if (message_from_matlab.compare(0, predefined_message_abort.size(), predefined_message_abort) == 0){
+            cmd.type = CMD_ABORT;
+            push_command(cmd);
+        }
+        // terminate execution?
+        else if (message_from_matlab.compare(0, predefined_message_end_exec.size(), predefined_message_end_exec) == 0){
+            cmd.type = CMD_SHUTDOWN;
+            push_command(cmd);
+        }
+        // should never happen
+        else{
+            n_messages_unknown++;
+            std::cout << "Unknown message: " << message_from_matlab << std::endl;
+        }
+    }
+    catch(std::exception& e){
+        n_messages_unknown++;
+        std::cout << "Malformed message: " << message_from_matlab << std::endl;
+    }
+}
+
+static void handle_receive(const boost::system::error_code& ec, std::size_t bytes_transferred){
+
+    if(!ec){
+        n_messages_received++;
+
+        // convert buffer to one string and resize to maximum message size
+        std::string message_from_matlab(buffer, std::min<std::size_t>(bytes_transferred, MAX_MESSAGE_LENGTH));
+        message_from_matlab.resize(MAX_MESSAGE_LENGTH);
+
+        handle_message(message_from_matlab);
+    }
+
+    start_receive();
+}
+
+static void start_receive(){
+    socket_ptr->async_receive_from(boost::asio::buffer(buffer), sender, [](const boost::system::error_code& ec, std::size_t bytes_transferred){handle_receive(ec, bytes_transferred);});
+}
+
+// from time to time we check if "burst_timer_elapsed" was set to true
+static void handle_timer(const boost::system::error_code&){
+    if(*burst_timer_elapsed_ptr == true){
+        io_context.stop();
+        return;
+    }
+    timer_ptr->expires_from_now(boost::posix_time::milliseconds(SHUTDOWN_POLL_PERIOD_MS));
+    timer_ptr->async_wait(&handle_timer);
+}
+
+int init_control_plane(const unsigned short port_arg, const unsigned short notify_port_arg, const size_t n_channels_arg){
+    port = port_arg;
+    notify_port = notify_port_arg;
+    n_channels = n_channels_arg;
+
+    if(n_channels == 0 || n_channels > COMMAND_MAX_GAINS){
+        std::cerr << "Control plane: between 1 and " << COMMAND_MAX_GAINS << " channels supported." << std::endl;
+        return 0;
+    }
+
+    mailbox.reset();
+    pending_head = 0;
+    n_pending = 0;
+    n_pending_published = 0;
+
+    return 1;
+}
+
+void run_control_plane(std::atomic<bool>& burst_timer_elapsed){
+
+    burst_timer_elapsed_ptr = &burst_timer_elapsed;
+
+    boost::asio::ip::udp::endpoint receiver(boost::asio::ip::udp::v4(), port);
+    boost::asio::ip::udp::socket socket(io_context, receiver);
+    boost::asio::deadline_timer timer(io_context);
+    socket_ptr = &socket;
+    timer_ptr = &timer;
+
+    start_receive();
+    handle_timer(boost::system::error_code());
+
+    std::cout << "Control plane: awaiting messages via UDP on port " << port << std::endl;
+
+    io_context.run();
+
+    socket_ptr = nullptr;
+    timer_ptr = nullptr;
+}
+
+bool pop_control_command(command_t& cmd){
+    if(n_pending == 0)
+        return mailbox.pop(cmd);
+
+    cmd = pending[pending_head];
+    pending_head = (pending_head + 1) % MAILBOX_CAPACITY;
+    n_pending--;
+    n_pending_published.store(n_pending, std::memory_order_relaxed);
+    return true;
+}
+
+bool pop_control_abort(command_t& cmd){
+    // everything in the mailbox is moved behind the pending commands, pending has room for a full mailbox
+    while(n_pending < MAILBOX_CAPACITY && mailbox.pop(pending[(pending_head + n_pending) % MAILBOX_CAPACITY]))
+        n_pending++;
+
+    for(size_t i = 0; i < n_pending; i++){
+        const command_t& candidate = pending[(pending_head + i) % MAILBOX_CAPACITY];
+        if(candidate.type != CMD_ABORT && candidate.type != CMD_SHUTDOWN)
+            continue;
+
+        // the commands behind it move up by one
+        cmd = candidate;
+        for(size_t k = i; k + 1 < n_pending; k++)
+            pending[(pending_head + k) % MAILBOX_CAPACITY] = pending[(pending_head + k + 1) % MAILBOX_CAPACITY];
+        n_pending--;
+        n_pending_published.store(n_pending, std::memory_order_relaxed);
+        return true;
+    }
+
+    n_pending_published.store(n_pending, std::memory_order_relaxed);
+    return false;
+}
+
+void publish_rx_status(const rx_state_t state, const unsigned int file_id, const unsigned long long n_rx_samps, const unsigned long long n_dropped_samps, const unsigned long long n_overruns){
+    rx_state.store(state, std::memory_order_relaxed);
+    rx_file_id.store(file_id, std::memory_order_relaxed);
+    rx_n_rx_samps.store(n_rx_samps, std::memory_order_relaxed);
+    rx_n_dropped_samps.store(n_dropped_samps, std::memory_order_relaxed);
+    rx_n_overruns.store(n_overruns, std::memory_order_relaxed);
+}
+
+void show_debug_information_control_plane(){
+    std::cout << "--------------------------" << std::endl;
+    std::cout << "control_plane" << std::endl;
+    std::cout << "n_messages_received: " << n_messages_received << std::endl;
+    std::cout << "n_messages_unknown: " << n_messages_unknown << std::endl;
+    std::cout << "n_status_requests: " << n_status_requests << std::endl;
+    std::cout << "n_mailbox_full: " << n_mailbox_full << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+}
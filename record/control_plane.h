@@ -0,0 +1,110 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_CONTROL_PLANE_H
+#define CHANNELSOUNDER_CONTROL_PLANE_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+namespace channelsounder
+{
+/*!
+ * Commands passed from the control thread to the rx thread.
+*/
+enum command_type_t{
+    CMD_NEW_MEASUREMENT,
+    CMD_NEW_SCAN_SCHEDULE,
+    CMD_ABORT,
+    CMD_SHUTDOWN
+};
+
+#define COMMAND_MAX_GAINS               16
+#define COMMAND_MAX_ADDRESS_LENGTH      64
+
+/*!
+ * Plain data, so passing it through the mailbox never allocates on the rx thread.
+*/
+struct command_t{
+    command_type_t type;
+    unsigned int file_id;
+    double center_freq;                                 // in Hz
+    unsigned long long n_samples;
+    size_t n_gains;
+    double gains[COMMAND_MAX_GAINS];                    // one gain per channel
+    char sender_address[COMMAND_MAX_ADDRESS_LENGTH];    // ip address of the command sender, receives completion messages
+};
+
+/*!
+ * State of the rx thread as seen by the control thread.
+*/
+enum rx_state_t{
+    RX_STATE_IDLE = 0,
+    RX_STATE_CAPTURING = 1,
+    RX_STATE_SCANNING = 2,
+    RX_STATE_TRIGGERED = 3              // streaming, every trigger is saved as a measurement
+};
+
+/*!
+ * Inits unit internally. Must be called first.
+ *
+ * port                         udp port commands are received on, must be the same in matlab
+ * notify_port                  udp port at the command sender status replies are sent to, 0 disables replies
+ * n_channels_arg               number of rx channels, each new measurement contains one gain per channel, at most COMMAND_MAX_GAINS
+ * return                       1 on success and 0 on failure
+*/
+int init_control_plane(const unsigned short port, const unsigned short notify_port, const size_t n_channels_arg);
+
+/*!
+ * Must be started in additional thread. Receives and parses udp messages asynchronously with its own io_context.
+ * Status requests are answered directly, all other commands are put into the mailbox of the rx thread.
+ *
+ * burst_timer_elapsed          when set to true, the thread has to finish
+*/
+void run_control_plane(std::atomic<bool>& burst_timer_elapsed);
+
+/*!
+ * Called by the rx thread. Lock-free and non-blocking, never blocks the recv loop.
+ *
+ * cmd                          next command if there is one
+ * return                       true if a command was taken from the mailbox
+*/
+bool pop_control_command(command_t& cmd);
+
+/*!
+ * Called by the rx thread while capturing. Lock-free and non-blocking.
+ * Looks at all queued commands and removes the first abort or shutdown, even if other commands were queued before it. They stay queued
+ * in their order.
+ *
+ * cmd                          the abort or shutdown command
+ * return                       true if the capture must be stopped
+*/
+bool pop_control_abort(command_t& cmd);
+
+/*!
+ * Called by the rx thread to publish its state, answered on status requests. Only relaxed atomic stores.
+*/
+void publish_rx_status(const rx_state_t state, const unsigned int file_id, const unsigned long long n_rx_samps, const unsigned long long n_dropped_samps, const unsigned long long n_overruns);
+
+/*!
+ * Shows some stats of the control plane.
+*/
+void show_debug_information_control_plane();
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <cstdint>
+#include <cstring>
+#include <complex>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "copy_kernel.h"
+
+// copies of at least this many bytes per channel bypass the cache
+#define COPY_KERNEL_STREAMING_BYTES     (256*1024)
+
+namespace channelsounder
+{
+// plain copy of one channel, a tight loop over complex samples the compiler vectorizes
+template<typename T>
+static inline void copy_channel_cached(T* __restrict dst, const T* __restrict src, const size_t n_items){
+    for(size_t i = 0; i < n_items; i++)
+        dst[i] = src[i];
+}
+
+// copy of one channel with non-temporal stores, head and tail are copied regularly until dst is aligned to 16 bytes
+template<typename T>
+static inline void copy_channel_streaming(T* __restrict dst, const T* __restrict src, const size_t n_items){
+#ifdef __SSE2__
+    char* d = reinterpret_cast<char*>(dst);
+    const char* s = reinterpret_cast<const char*>(src);
+    size_t n_bytes = n_items*sizeof(T);
+
+    const size_t n_head = std::min(n_bytes, (size_t) ((16 - reinterpret_cast<uintptr_t>(d) % 16) % 16));
+    std::memcpy(d, s, n_head);
+    d += n_head;
+    s += n_head;
+    n_bytes -= n_head;
+
+    for(; n_bytes >= 64; n_bytes -= 64, d += 64, s += 64){
+        __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+        __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+        __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d), x0);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d + 16), x1);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d + 32), x2);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d + 48), x3);
+    }
+    std::memcpy(d, s, n_bytes);
+#else
+    copy_channel_cached(dst, src, n_items);
+#endif
+}
+
+template<typename T>
+static inline void zero_channel(T* __restrict dst, const size_t n_items){
+    for(size_t i = 0; i < n_items; i++)
+        dst[i] = T();
+}
+
+// inlined into the kernels below, with a constant n_channels the loop over the channels is unrolled
+template<typename T>
+static inline void copy_channels(char* const* dst, const char* const* src, const size_t n_channels, const size_t n_items){
+    if(n_items*sizeof(T) >= COPY_KERNEL_STREAMING_BYTES){
+        for(size_t ch = 0; ch < n_channels; ch++)
+            copy_channel_streaming(reinterpret_cast<T*>(dst[ch]), reinterpret_cast<const T*>(src[ch]), n_items);
+#ifdef __SSE2__
+        // non-temporal stores are weakly ordered, make them visible before the chunk is handed to the writer
+        _mm_sfence();
+#endif
+    }
+    else{
+        for(size_t ch = 0; ch < n_channels; ch++)
+            copy_channel_cached(reinterpret_cast<T*>(dst[ch]), reinterpret_cast<const T*>(src[ch]), n_items);
+    }
+}
+
+template<typename T>
+static inline void zero_channels(char* const* dst, const size_t n_channels, const size_t n_items){
+    for(size_t ch = 0; ch < n_channels; ch++)
+        zero_channel(reinterpret_cast<T*>(dst[ch]), n_items);
+}
+
+// channel count known at compile time
+template<typename T, size_t N>
+static void copy_kernel(char* const* dst, const char* const* src, const size_t, const size_t n_items){
+    copy_channels<T>(dst, src, N, n_items);
+}
+
+template<typename T, size_t N>
+static void zero_kernel(char* const* dst, const size_t, const size_t n_items){
+    zero_channels<T>(dst, N, n_items);
+}
+
+// channel count only known at runtime
+template<typename T>
+static void copy_kernel_n(char* const* dst, const char* const* src, const size_t n_channels, const size_t n_items){
+    copy_channels<T>(dst, src, n_channels, n_items);
+}
+
+template<typename T>
+static void zero_kernel_n(char* const* dst, const size_t n_channels, const size_t n_items){
+    zero_channels<T>(dst, n_channels, n_items);
+}
+
+template<typename T>
+static copy_kernel_t select_copy_kernel_type(const size_t n_channels, const char* name_1, const char* name_2, const char* name_4, const char* name_n){
+    switch(n_channels){
+        case 1: return {copy_kernel<T, 1>, zero_kernel<T, 1>, name_1};
+        case 2: return {copy_kernel<T, 2>, zero_kernel<T, 2>, name_2};
+        case 4: return {copy_kernel<T, 4>, zero_kernel<T, 4>, name_4};
+    }
+    return {copy_kernel_n<T>, zero_kernel_n<T>, name_n};
+}
+
+copy_kernel_t select_copy_kernel(const size_t n_bytes_per_item, const size_t n_channels){
+    copy_kernel_t kernel = {nullptr, nullptr, nullptr};
+
+    switch(n_bytes_per_item){
+        case sizeof(std::complex<double>):
+            kernel = select_copy_kernel_type<std::complex<double>>(n_channels, "fc64 x 1", "fc64 x 2", "fc64 x 4", "fc64 x n");
+            break;
+        case sizeof(std::complex<float>):
+            kernel = select_copy_kernel_type<std::complex<float>>(n_channels, "fc32 x 1", "fc32 x 2", "fc32 x 4", "fc32 x n");
+            break;
+        case sizeof(std::complex<int16_t>):
+            kernel = select_copy_kernel_type<std::complex<int16_t>>(n_channels, "sc16 x 1", "sc16 x 2", "sc16 x 4", "sc16 x n");
+            break;
+        case sizeof(std::complex<int8_t>):
+            kernel = select_copy_kernel_type<std::complex<int8_t>>(n_channels, "sc8 x 1", "sc8 x 2", "sc8 x 4", "sc8 x n");
+            break;
+    }
+
+    return kernel;
+}
+}
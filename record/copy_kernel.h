@@ -0,0 +1,65 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_COPY_KERNEL_H
+#define CHANNELSOUNDER_COPY_KERNEL_H
+
+#include <cstddef>
+
+namespace channelsounder
+{
+/*!
+ * Copies n_items samples of each channel from src[ch] to dst[ch].
+ *
+ * dst                          destination pointer of each channel
+ * src                          source pointer of each channel
+ * n_channels                   number of channels, only used by kernels without fixed channel count
+ * n_items                      number of samples per channel
+*/
+typedef void (*copy_kernel_fn_t)(char* const* dst, const char* const* src, const size_t n_channels, const size_t n_items);
+
+/*!
+ * Sets n_items samples of each channel at dst[ch] to zero.
+*/
+typedef void (*zero_kernel_fn_t)(char* const* dst, const size_t n_channels, const size_t n_items);
+
+/*!
+ * Kernels for one sample type and channel count, selected once at init so the hot path does not branch on either.
+ *
+ * copy                         copies samples of all channels
+ * zero                         zero fills samples of all channels
+ * name                         configuration of the kernels, e.g. "sc16 x 2", "x n" if the channel count is not fixed
+*/
+struct copy_kernel_t{
+    copy_kernel_fn_t copy;
+    zero_kernel_fn_t zero;
+    const char* name;
+};
+
+/*!
+ * Selects the kernels specialized for the sample size and channel count. Samples of 16, 8, 4 and 2 bytes (fc64, fc32, sc16, sc8) are supported,
+ * the loop over the channels is unrolled for 1, 2 and 4 channels.
+ * Copies of at least 256 KiB per channel use non-temporal stores if the cpu supports them, the destination
+ * is not read again before it is written to disk and would only evict the ringbuffer from the cache.
+ *
+ * n_bytes_per_item             size of complex sample
+ * n_channels                   number of channels copied per call
+ * return                       kernels, copy is nullptr if the sample size is not supported
+*/
+copy_kernel_t select_copy_kernel(const size_t n_bytes_per_item, const size_t n_channels);
+}
+
+#endif
@@ -0,0 +1,216 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <cstring>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
+
+#include "crc32c.h"
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLYNOMIAL       0x82F63B78u
+
+// bytes per stream when three blocks are hashed interleaved
+#define CRC32C_BLOCK_BYTES      8192
+
+namespace channelsounder
+{
+typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const unsigned char* p, size_t n_bytes);
+
+// slicing by 8, table k advances a byte by k further bytes
+struct crc32c_table_t{
+    uint32_t t[8][256];
+
+    crc32c_table_t(){
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t crc = i;
+            for(int k = 0; k < 8; k++)
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+            t[0][i] = crc;
+        }
+        for(uint32_t i = 0; i < 256; i++)
+            for(int k = 1; k < 8; k++)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+    }
+};
+
+static const crc32c_table_t& get_crc32c_table(){
+    static const crc32c_table_t table;
+    return table;
+}
+
+// Advances a CRC register over CRC32C_BLOCK_BYTES zero bytes. The register is linear in its bits, so the operator is the sum of the
+// shifted bits, tabulated per byte of the register.
+struct crc32c_shift_t{
+    uint32_t t[4][256];
+
+    crc32c_shift_t(){
+        const uint32_t (*t_crc)[256] = get_crc32c_table().t;
+        uint32_t basis[32];
+        for(int b = 0; b < 32; b++){
+            uint32_t crc = 1u << b;
+            for(size_t i = 0; i < CRC32C_BLOCK_BYTES; i++)
+                crc = (crc >> 8) ^ t_crc[0][crc & 0xff];
+            basis[b] = crc;
+        }
+        for(int k = 0; k < 4; k++){
+            for(uint32_t v = 0; v < 256; v++){
+                uint32_t crc = 0;
+                for(int j = 0; j < 8; j++)
+                    if(v & (1u << j))
+                        crc ^= basis[8*k + j];
+                t[k][v] = crc;
+            }
+        }
+    }
+
+    uint32_t apply(const uint32_t crc) const{
+        return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^ t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+    }
+};
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char* p, size_t n_bytes){
+    const crc32c_table_t& table = get_crc32c_table();
+    const uint32_t (*t)[256] = table.t;
+
+    for(; n_bytes >= 8; n_bytes -= 8, p += 8){
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for(; n_bytes > 0; n_bytes--, p++)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// the instruction handles 8 bytes per call, the build does not enable SSE 4.2 for the whole program
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* p, size_t n_bytes){
+    for(; n_bytes > 0 && reinterpret_cast<uintptr_t>(p) % 8 != 0; n_bytes--, p++)
+        crc = _mm_crc32_u8(crc, *p);
+
+    // three independent streams hide the latency of the instruction, the CRC registers of the first blocks are shifted over the blocks after them
+    static const crc32c_shift_t shift;
+    for(; n_bytes >= 3*CRC32C_BLOCK_BYTES; n_bytes -= 3*CRC32C_BLOCK_BYTES, p += 3*CRC32C_BLOCK_BYTES){
+        uint64_t crc0 = crc;
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for(size_t i = 0; i < CRC32C_BLOCK_BYTES; i += 8){
+            uint64_t v0, v1, v2;
+            std::memcpy(&v0, p + i, 8);
+            std::memcpy(&v1, p + CRC32C_BLOCK_BYTES + i, 8);
+            std::memcpy(&v2, p + 2*CRC32C_BLOCK_BYTES + i, 8);
+            crc0 = _mm_crc32_u64(crc0, v0);
+            crc1 = _mm_crc32_u64(crc1, v1);
+            crc2 = _mm_crc32_u64(crc2, v2);
+        }
+        crc = shift.apply(shift.apply((uint32_t) crc0) ^ (uint32_t) crc1) ^ (uint32_t) crc2;
+    }
+
+    uint64_t crc64 = crc;
+    for(; n_bytes >= 8; n_bytes -= 8, p += 8){
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = (uint32_t) crc64;
+
+    for(; n_bytes > 0; n_bytes--, p++)
+        crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+#endif
+
+static crc32c_fn_t select_crc32c(){
+#if defined(__x86_64__) && defined(__GNUC__)
+    if(__builtin_cpu_supports("sse4.2"))
+        return crc32c_sse42;
+#endif
+    return crc32c_table;
+}
+
+static crc32c_fn_t get_crc32c_fn(){
+    static const crc32c_fn_t fn = select_crc32c();
+    return fn;
+}
+
+uint32_t crc32c_update(const uint32_t crc, const void* data, const size_t n_bytes){
+    return ~get_crc32c_fn()(~crc, static_cast<const unsigned char*>(data), n_bytes);
+}
+
+// multiplication of a 32x32 matrix over GF(2) with a vector, columns are stored as bits
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec){
+    uint32_t sum = 0;
+    for(; vec != 0; vec >>= 1, mat++)
+        if(vec & 1)
+            sum ^= *mat;
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat){
+    for(int n = 0; n < 32; n++)
+        square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+// as crc32_combine() of zlib, the CRC of a is advanced by the zeros of n_bytes_b with matrices for 1, 2, 4, ... zero bytes
+uint32_t crc32c_combine(const uint32_t crc_a, const uint32_t crc_b, unsigned long long n_bytes_b){
+    if(n_bytes_b == 0)
+        return crc_a;
+
+    uint32_t even[32];
+    uint32_t odd[32];
+
+    // operator for one zero bit
+    odd[0] = CRC32C_POLYNOMIAL;
+    uint32_t row = 1;
+    for(int n = 1; n < 32; n++){
+        odd[n] = row;
+        row <<= 1;
+    }
+
+    // operators for two and four zero bits
+    gf2_matrix_square(even, odd);
+    gf2_matrix_square(odd, even);
+
+    uint32_t crc = crc_a;
+    while(1){
+        gf2_matrix_square(even, odd);
+        if(n_bytes_b & 1)
+            crc = gf2_matrix_times(even, crc);
+        n_bytes_b >>= 1;
+        if(n_bytes_b == 0)
+            break;
+
+        gf2_matrix_square(odd, even);
+        if(n_bytes_b & 1)
+            crc = gf2_matrix_times(odd, crc);
+        n_bytes_b >>= 1;
+        if(n_bytes_b == 0)
+            break;
+    }
+
+    return crc ^ crc_b;
+}
+
+const char* get_crc32c_implementation(){
+    return (get_crc32c_fn() == crc32c_table) ? "table" : "sse4.2";
+}
+}
@@ -0,0 +1,53 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_CRC32C_H
+#define CHANNELSOUNDER_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace channelsounder
+{
+/*!
+ * Continues the CRC-32C (Castagnoli) of a byte sequence. Uses the crc32 instruction if the cpu supports SSE 4.2, a table otherwise.
+ * The CRC of an empty sequence is 0, so crc32c_update(0, data, n_bytes) is the CRC of data alone.
+ *
+ * crc                          CRC of the bytes before data
+ * data                         next bytes of the sequence
+ * n_bytes                      number of bytes at data
+ * return                       CRC of the sequence including data
+*/
+uint32_t crc32c_update(const uint32_t crc, const void* data, const size_t n_bytes);
+
+/*!
+ * CRC of two concatenated byte sequences from the CRCs of both, so pieces of a sequence can be hashed in any order.
+ *
+ * crc_a                        CRC of the first sequence
+ * crc_b                        CRC of the second sequence
+ * n_bytes_b                    length of the second sequence
+ * return                       CRC of the first sequence followed by the second
+*/
+uint32_t crc32c_combine(const uint32_t crc_a, const uint32_t crc_b, unsigned long long n_bytes_b);
+
+/*!
+ * Implementation crc32c_update() uses on this cpu, "sse4.2" or "table".
+*/
+const char* get_crc32c_implementation();
+}
+
+#endif
@@ -0,0 +1,738 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <iostream>
+#include <deque>
+#include <complex>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DDC_X86_KERNELS
+#endif
+
+#include "debug.h"
+#include "ddc.h"
+#include "fft.h"
+#include "fifo_measurement.h"
+
+#define NCO_TABLE_SIZE                  1024        // phasors are exact at the start of each run of this many samples
+#define N_MAX_GAPS_PER_BUFFER           4096
+#define N_FLOATS_PER_ITERATION          16          // taps are padded to a multiple of this, the kernels process 16 floats per iteration
+
+namespace channelsounder
+{
+// sum of x[i]*taps[i] over n_floats interleaved re/im floats, out[0] is the sum of the even, out[1] of the odd floats
+typedef void (*ddc_dot_fn_t)(const float* x, const float* taps, const size_t n_floats, float* out);
+
+// out[i] = sum of x[r*n_floats_row + i]*taps[r*n_floats_row + i] over n_rows rows, i < n_floats_row
+typedef void (*ddc_fold_fn_t)(const float* x, const float* taps, const size_t n_floats_row, const size_t n_rows, float* out);
+
+static void dot_scalar(const float* x, const float* taps, const size_t n_floats, float* out){
+    float re = 0.0f, im = 0.0f;
+    for(size_t i = 0; i < n_floats; i += 2){
+        re += x[i]*taps[i];
+        im += x[i + 1]*taps[i + 1];
+    }
+    out[0] = re;
+    out[1] = im;
+}
+
+static void fold_scalar(const float* x, const float* taps, const size_t n_floats_row, const size_t n_rows, float* out){
+    for(size_t i = 0; i < n_floats_row; i++)
+        out[i] = x[i]*taps[i];
+    for(size_t r = 1; r < n_rows; r++){
+        const float* xr = x + r*n_floats_row;
+        const float* tr = taps + r*n_floats_row;
+        for(size_t i = 0; i < n_floats_row; i++)
+            out[i] += xr[i]*tr[i];
+    }
+}
+
+#ifdef DDC_X86_KERNELS
+__attribute__((target("avx2,fma")))
+static void dot_avx2(const float* x, const float* taps, const size_t n_floats, float* out){
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for(size_t i = 0; i < n_floats; i += 16){
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(taps + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(taps + i + 8), acc1);
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+
+    // re im re im re im re im -> re im
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    out[0] = _mm_cvtss_f32(s);
+    out[1] = _mm_cvtss_f32(_mm_shuffle_ps(s, s, 1));
+}
+
+__attribute__((target("avx2,fma")))
+static void fold_avx2(const float* x, const float* taps, const size_t n_floats_row, const size_t n_rows, float* out){
+    size_t i = 0;
+    for(; i + 8 <= n_floats_row; i += 8){
+        __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(taps + i));
+        for(size_t r = 1; r < n_rows; r++)
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(x + r*n_floats_row + i), _mm256_loadu_ps(taps + r*n_floats_row + i), acc);
+        _mm256_storeu_ps(out + i, acc);
+    }
+    for(; i < n_floats_row; i++){
+        float acc = 0.0f;
+        for(size_t r = 0; r < n_rows; r++)
+            acc += x[r*n_floats_row + i]*taps[r*n_floats_row + i];
+        out[i] = acc;
+    }
+}
+
+__attribute__((target("avx512f")))
+static void dot_avx512(const float* x, const float* taps, const size_t n_floats, float* out){
+    __m512 acc = _mm512_setzero_ps();
+    for(size_t i = 0; i < n_floats; i += 16)
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(taps + i), acc);
+
+    // re im re im ... -> re im
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, acc);
+    out[0] = 0.0f;
+    out[1] = 0.0f;
+    for(size_t i = 0; i < 16; i += 2){
+        out[0] += lanes[i];
+        out[1] += lanes[i + 1];
+    }
+}
+
+// rows of few bands are shorter than one register, the rest of a row is done with avx2
+__attribute__((target("avx512f,avx2,fma")))
+static void fold_avx512(const float* x, const float* taps, const size_t n_floats_row, const size_t n_rows, float* out){
+    size_t i = 0;
+    for(; i + 16 <= n_floats_row; i += 16){
+        __m512 acc = _mm512_mul_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(taps + i));
+        for(size_t r = 1; r < n_rows; r++)
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(x + r*n_floats_row + i), _mm512_loadu_ps(taps + r*n_floats_row + i), acc);
+        _mm512_storeu_ps(out + i, acc);
+    }
+    for(; i + 8 <= n_floats_row; i += 8){
+        __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(taps + i));
+        for(size_t r = 1; r < n_rows; r++)
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(x + r*n_floats_row + i), _mm256_loadu_ps(taps + r*n_floats_row + i), acc);
+        _mm256_storeu_ps(out + i, acc);
+    }
+    for(; i < n_floats_row; i++){
+        float acc = 0.0f;
+        for(size_t r = 0; r < n_rows; r++)
+            acc += x[r*n_floats_row + i]*taps[r*n_floats_row + i];
+        out[i] = acc;
+    }
+}
+#endif
+
+// kernels for all devices, selected once in init_ddc() or init_ddc_filterbank()
+static ddc_dot_fn_t dot_kernel = dot_scalar;
+static ddc_fold_fn_t fold_kernel = fold_scalar;
+static const char* kernel_name = "scalar";
+
+static void select_kernels(){
+#ifdef DDC_X86_KERNELS
+    if(__builtin_cpu_supports("avx512f")){
+        dot_kernel = dot_avx512;
+        fold_kernel = fold_avx512;
+        kernel_name = "avx512";
+    }
+    else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        dot_kernel = dot_avx2;
+        fold_kernel = fold_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+}
+
+static size_t decimation = 1;
+
+enum ddc_mode_t{
+    DDC_MODE_OFF = 0,                                   // samples are passed on unchanged
+    DDC_MODE_NCO = 1,                                   // one channel, shifted by an nco and filtered
+    DDC_MODE_FILTERBANK = 2                             // polyphase filterbank, n_bands channels spaced by rate/n_bands
+};
+static ddc_mode_t mode = DDC_MODE_OFF;
+
+// a job split into parts of the samples of each channel runs in two stages, all input samples must be in the work buffer before filtering
+enum ddc_stage_t{
+    DDC_STAGE_LOAD = 0,                                 // input samples are mixed into the work buffer
+    DDC_STAGE_FILTER = 1                                // output samples are computed
+};
+
+struct ddc_t{
+    size_t n_channels;                                  // input channels (antennas)
+    size_t n_taps;                                      // odd
+    size_t n_floats_taps;                               // floats of taps, zero padded for the kernels
+    std::vector<float> taps;                            // reversed and duplicated for re and im, zero padded
+    bool mix;                                           // false if the channel of interest is already at 0 Hz
+    double phase_increment;                             // NCO phase increment per input sample in rad
+    std::vector<float> nco_table;                       // phasor of sample k relative to the start of a run, re im interleaved
+
+    // filterbank
+    size_t n_bands;                                     // fft size
+    size_t n_rows;                                      // rows of n_bands taps, n_taps rounded up
+    std::vector<int> bands;                             // bands kept, band b is centered on b*rate/n_bands
+    std::vector<cf32_t> rotation;                       // per kept band and input sample index modulo n_bands
+    fft_plan_t fft;
+    bool direct;                                        // few bands are kept, their dft bins are cheaper than the fft
+
+    // state, reset before each measurement, sample indices count from the start of the measurement at the input rate
+    double phase;                                       // NCO phase of the next input sample in rad
+    unsigned long long n_in;                            // index of the next input sample, gaps included
+    unsigned long long m_next;                          // index of the next output sample, centered on input sample m_next*decimation
+    std::deque<gap_t> gaps_pending;                     // gaps of the input that still contain centers of future output samples, offset is the input index
+
+    // columns: number of rx channels (antennas)
+    // rows: n_taps-1 samples of history followed by the new samples, re im interleaved
+    std::vector<std::vector<float>> work;
+    std::vector<float> zeros;                           // fed through the filter for the samples of a gap
+
+    // filterbank scratch of each part of each input channel, so that groups can run in parallel
+    std::vector<std::vector<cf32_t>> folded;
+    std::vector<std::vector<cf32_t>> spectrum;
+    std::vector<std::vector<cf32_t>> fft_scratch;
+
+    // output samples computed by the current job, position of their last input sample in the work buffer
+    std::vector<size_t> positions;
+
+    // Job executed by the processing thread and the worker threads, each takes groups until none are left. With at least as many
+    // channels as threads a group is a range of channels, otherwise the samples of each channel are split into n_parts groups.
+    const std::vector<std::vector<char>>* job_buffs;    // nullptr for zeros
+    unsigned long long job_offset;
+    size_t job_n;
+    size_t job_n_out;                                   // output samples before the first one of the job
+    ddc_stage_t job_stage;
+    size_t n_parts;
+    size_t n_groups;
+    std::atomic<size_t> next_group;
+    size_t n_groups_done;
+    unsigned long long job_generation = 0;
+    size_t n_workers;
+    boost::mutex m_mutex;
+    boost::condition_variable m_condition_job;
+    boost::condition_variable m_condition_done;
+
+    // output passed on to the fifo
+    std::vector<std::vector<char>> buffs_out;
+    std::vector<gap_t> gaps_out;
+
+    // statistics
+    unsigned long long n_samples_in = 0;
+    unsigned long long n_samples_out = 0;
+    unsigned long long n_gaps = 0;
+    unsigned long long n_gaps_merged = 0;              // always collected, output gaps that did not fit and absorbed the samples before them
+    unsigned long long n_jobs = 0;
+};
+
+// deque, elements are never moved when devices are added
+static std::deque<ddc_t> ddcs;
+
+// Blackman windowed sinc with cutoff fc in cycles per sample, unity gain at 0 Hz
+static std::vector<double> design_lowpass(const size_t n_taps, const double fc){
+    const double center = 0.5*(n_taps - 1);
+
+    std::vector<double> h(n_taps);
+    double sum = 0.0;
+    for(size_t k = 0; k < n_taps; k++){
+        const double t = k - center;
+        const double sinc = (t == 0.0) ? 2.0*fc : std::sin(2.0*M_PI*fc*t)/(M_PI*t);
+        const double window = 0.42 - 0.5*std::cos(2.0*M_PI*k/(n_taps - 1)) + 0.08*std::cos(4.0*M_PI*k/(n_taps - 1));
+        h[k] = sinc*window;
+        sum += h[k];
+    }
+    for(size_t k = 0; k < n_taps; k++)
+        h[k] /= sum;
+
+    return h;
+}
+
+// buffers and taps shared by both modes, taps are stored reversed so that output samples are inner products with the work buffer
+static void init_buffers(ddc_t &ddc, const size_t n_channels, const size_t n_channels_out, const size_t max_samples_per_block, const size_t n_floats_padding,
+                         const size_t n_workers){
+    const std::vector<double> h = design_lowpass(ddc.n_taps, 0.5/((mode == DDC_MODE_FILTERBANK) ? ddc.n_bands : decimation));
+    ddc.taps.assign(ddc.n_floats_taps, 0.0f);
+    for(size_t k = 0; k < ddc.n_taps; k++){
+        ddc.taps[2*k] = (float) h[ddc.n_taps - 1 - k];
+        ddc.taps[2*k + 1] = (float) h[ddc.n_taps - 1 - k];
+    }
+
+    ddc.n_channels = n_channels;
+
+    // the kernels read up to n_floats_padding floats beyond the last sample, these are multiplied by zero taps
+    const size_t max_samples_per_call = std::max(max_samples_per_block, ddc.n_taps - 1);
+    std::vector<float> work_template(2*(ddc.n_taps - 1 + max_samples_per_call) + n_floats_padding, 0.0f);
+    ddc.work.assign(n_channels, work_template);
+    ddc.zeros.assign(2*(ddc.n_taps - 1), 0.0f);
+
+    // output samples of a block are centered on its samples or on the last (n_taps-1)/2 samples of the block before
+    const size_t max_samples_out = (max_samples_per_block + ddc.n_taps)/decimation + 2;
+    std::vector<char> buff_template(max_samples_out*2*sizeof(float));
+    ddc.buffs_out.assign(n_channels_out, buff_template);
+    ddc.gaps_out.reserve(N_MAX_GAPS_PER_BUFFER);
+    ddc.positions.reserve(max_samples_out);
+
+    // a single antenna would keep all but one thread idle, fewer channels than threads are split into parts of their samples
+    ddc.n_workers = n_workers;
+    ddc.n_parts = (n_workers + n_channels)/std::max<size_t>(n_channels, 1);
+    ddc.n_groups = (ddc.n_parts > 1) ? n_channels*ddc.n_parts : std::min(n_channels, n_workers + 1);
+}
+
+int init_ddc(const size_t device, const size_t n_channels, const size_t max_samples_per_block, const double rate, const double freq_offset,
+             const size_t decimation_arg, const size_t n_taps_per_phase, const size_t n_workers){
+
+    // devices are initialized in order
+    if(device > ddcs.size() || decimation_arg == 0 || n_taps_per_phase == 0 || rate <= 0.0)
+        return 0;
+    if(device == ddcs.size())
+        ddcs.emplace_back();
+
+    ddc_t &ddc = ddcs[device];
+    decimation = decimation_arg;
+    ddc.n_channels = n_channels;
+
+    if(decimation == 1)
+        return 1;
+
+    mode = DDC_MODE_NCO;
+    select_kernels();
+
+    // output sample m is the dot product of the taps with input samples m*decimation - (n_taps-1)/2 to m*decimation + (n_taps-1)/2
+    ddc.n_taps = n_taps_per_phase*decimation + 1;
+    ddc.n_floats_taps = (2*ddc.n_taps + N_FLOATS_PER_ITERATION - 1)/N_FLOATS_PER_ITERATION*N_FLOATS_PER_ITERATION;
+    init_buffers(ddc, n_channels, n_channels, max_samples_per_block, N_FLOATS_PER_ITERATION, n_workers);
+
+    // shift freq_offset to 0 Hz
+    ddc.mix = (freq_offset != 0.0);
+    ddc.phase_increment = -2.0*M_PI*freq_offset/rate;
+    ddc.nco_table.resize(2*NCO_TABLE_SIZE);
+    for(size_t k = 0; k < NCO_TABLE_SIZE; k++){
+        ddc.nco_table[2*k] = (float) std::cos(ddc.phase_increment*k);
+        ddc.nco_table[2*k + 1] = (float) std::sin(ddc.phase_increment*k);
+    }
+
+    std::cout << "ddc: device " << device << " shifts " << freq_offset/1.0e6 << " MHz to 0 Hz and decimates by " << decimation
+              << " to " << rate/decimation/1.0e6 << " MS/s, " << ddc.n_taps << " taps, kernel " << kernel_name << ", " << n_workers << " worker threads" << std::endl;
+
+    return reset_ddc(device);
+}
+
+int init_ddc_filterbank(const size_t device, const size_t n_channels, const size_t max_samples_per_block, const double rate, const size_t n_bands,
+                        const std::vector<int>& bands, const size_t oversampling, const size_t n_taps_per_band, const size_t n_workers){
+
+    // devices are initialized in order
+    if(device > ddcs.size() || n_bands < 2 || oversampling == 0 || n_bands % oversampling != 0 || n_taps_per_band == 0 || rate <= 0.0)
+        return 0;
+    for(size_t i = 0; i < bands.size(); i++)
+        if(bands[i] <= -(int) n_bands || bands[i] >= (int) n_bands)
+            return 0;
+    if(device == ddcs.size())
+        ddcs.emplace_back();
+
+    ddc_t &ddc = ddcs[device];
+    decimation = n_bands/oversampling;
+    mode = DDC_MODE_FILTERBANK;
+    select_kernels();
+
+    ddc.n_bands = n_bands;
+    ddc.bands = bands;
+    if(ddc.bands.size() == 0)
+        for(int b = 0; b < (int) n_bands; b++)
+            ddc.bands.push_back((b <= (int) n_bands/2) ? b : b - (int) n_bands);
+
+    // the taps are folded row by row into n_bands branches, the last row is zero padded
+    ddc.n_taps = n_taps_per_band*n_bands + 1;
+    ddc.n_rows = (ddc.n_taps + n_bands - 1)/n_bands;
+    ddc.n_floats_taps = 2*ddc.n_rows*n_bands;
+    init_buffers(ddc, n_channels, n_channels*ddc.bands.size(), max_samples_per_block, 2*n_bands, n_workers);
+    ddc.mix = false;
+    ddc.phase_increment = 0.0;
+
+    // The output of band b with last input sample a is exp(-j*2*pi*b*a/n_bands) * sum_i h[i]*x[a-i]*exp(j*2*pi*b*i/n_bands). With the branches
+    // v[t] = sum_k taps[k*n_bands + t]*x[a - n_taps + 1 + k*n_bands + t] this is exp(j*2*pi*b*((n_taps-1-a) mod n_bands)/n_bands) * fft(v)[b].
+    init_fft_plan(ddc.fft, n_bands);
+    size_t fft_cost = 0;
+    for(size_t i = 0; i < ddc.fft.factors.size(); i++)
+        fft_cost += ddc.fft.factors[i];
+    ddc.direct = (ddc.bands.size() < fft_cost);
+    ddc.rotation.resize(ddc.bands.size()*n_bands);
+    for(size_t i = 0; i < ddc.bands.size(); i++){
+        for(size_t r = 0; r < n_bands; r++){
+            const size_t shift = (ddc.n_taps - 1 + n_bands - r) % n_bands;
+            ddc.rotation[i*n_bands + r] = std::polar(1.0f, (float) (2.0*M_PI*ddc.bands[i]*(double) shift/n_bands));
+        }
+    }
+    ddc.folded.assign(n_channels*ddc.n_parts, std::vector<cf32_t>(n_bands));
+    ddc.spectrum.assign(n_channels*ddc.n_parts, std::vector<cf32_t>(n_bands));
+    ddc.fft_scratch.assign(n_channels*ddc.n_parts, std::vector<cf32_t>(n_bands));
+
+    std::cout << "ddc: device " << device << " splits " << rate/1.0e6 << " MS/s into " << n_bands << " bands of " << rate/n_bands/1.0e6 << " MHz at "
+              << rate/decimation/1.0e6 << " MS/s, " << ddc.n_taps << " taps, kernel " << kernel_name << ", " << n_workers << " worker threads" << std::endl;
+    std::cout << "ddc: device " << device << " saves";
+    for(size_t i = 0; i < ddc.bands.size(); i++)
+        std::cout << " band " << ddc.bands[i] << " (" << ddc.bands[i]*rate/n_bands/1.0e6 << " MHz)" << ((i + 1 < ddc.bands.size()) ? "," : "");
+    std::cout << ", the channels of each band are saved together" << std::endl;
+
+    return reset_ddc(device);
+}
+
+int reset_ddc(const size_t device){
+    ddc_t &ddc = ddcs[device];
+
+    if(mode == DDC_MODE_OFF)
+        return 1;
+
+    // the first output sample is centered on the first input sample, the history before it is zero
+    ddc.phase = 0.0;
+    ddc.n_in = 0;
+    ddc.m_next = 0;
+    ddc.gaps_pending.clear();
+    for(size_t ch = 0; ch < ddc.n_channels; ch++)
+        std::fill_n(ddc.work[ch].begin(), 2*(ddc.n_taps - 1), 0.0f);
+    ddc.gaps_out.clear();
+
+    return 1;
+}
+
+size_t get_ddc_decimation(){
+    return decimation;
+}
+
+// mixes n samples into the work buffer, starting at NCO phase "phase"
+static void mix_samples(const ddc_t &ddc, double phase, const float* in, float* out, const size_t n){
+    if(!ddc.mix){
+        std::memcpy(out, in, 2*n*sizeof(float));
+        return;
+    }
+
+    for(size_t run = 0; run < n; run += NCO_TABLE_SIZE){
+        const size_t n_run = std::min<size_t>(NCO_TABLE_SIZE, n - run);
+        const float p_re = (float) std::cos(phase);
+        const float p_im = (float) std::sin(phase);
+        const float* t = ddc.nco_table.data();
+        const float* x = in + 2*run;
+        float* y = out + 2*run;
+
+        // y = x*p*t, written out to avoid the nan checks of std::complex multiplication
+        for(size_t k = 0; k < n_run; k++){
+            const float r_re = p_re*t[2*k] - p_im*t[2*k + 1];
+            const float r_im = p_re*t[2*k + 1] + p_im*t[2*k];
+            y[2*k] = x[2*k]*r_re - x[2*k + 1]*r_im;
+            y[2*k + 1] = x[2*k]*r_im + x[2*k + 1]*r_re;
+        }
+        phase = std::fmod(phase + ddc.phase_increment*n_run, 2.0*M_PI);
+    }
+}
+
+// The next n_missing output samples are centered on a gap. They are not passed on, the fifo records them as one gap.
+// Returns the new number of output samples in buffs_out, which is smaller than n_out if the gaps were full.
+static size_t skip_output(ddc_t &ddc, const gap_t &gap, const unsigned long long n_missing, const size_t n_out){
+    ddc.m_next += n_missing;
+
+    // continues the gap of the output sample before
+    if(ddc.gaps_out.size() > 0 && ddc.gaps_out.back().offset == n_out){
+        ddc.gaps_out.back().length += n_missing;
+        return n_out;
+    }
+    if(ddc.gaps_out.size() < N_MAX_GAPS_PER_BUFFER){
+        gap_t gap_out = {n_out, n_missing, gap.source, gap.device};
+        ddc.gaps_out.push_back(gap_out);
+        DBG_RB(ddc.n_gaps++;)
+        return n_out;
+    }
+
+    // no room for another gap, the output samples since the last gap join it and are overwritten, sample indices stay exact
+    gap_t &last = ddc.gaps_out.back();
+    last.length += n_out - last.offset + n_missing;
+    ddc.n_gaps_merged++;
+    return (size_t) last.offset;
+}
+
+// copies input samples first to last of the current job of channel ch into the work buffer behind the history
+static void load_samples(ddc_t &ddc, const size_t ch, const size_t first, const size_t last){
+    float* w = ddc.work[ch].data() + 2*(ddc.n_taps - 1);
+
+    if(ddc.job_buffs == nullptr)
+        std::memcpy(w + 2*first, ddc.zeros.data(), 2*(last - first)*sizeof(float));
+    else
+        mix_samples(ddc, std::fmod(ddc.phase + ddc.phase_increment*first, 2.0*M_PI),
+                    reinterpret_cast<const float*>(&(*ddc.job_buffs)[ch][0]) + 2*(ddc.job_offset + first), w + 2*first, last - first);
+}
+
+// computes output samples first to last of the current job for input channel ch, scratch selects the filterbank scratch
+static void filter_outputs(ddc_t &ddc, const size_t ch, const size_t first, const size_t last, const size_t scratch){
+    const float* w = ddc.work[ch].data();
+
+    if(mode == DDC_MODE_NCO){
+        float* y = reinterpret_cast<float*>(&ddc.buffs_out[ch][0]) + 2*ddc.job_n_out;
+        for(size_t i = first; i < last; i++)
+            dot_kernel(w + 2*ddc.positions[i], ddc.taps.data(), ddc.n_floats_taps, y + 2*i);
+    }
+    else{
+        cf32_t* folded = ddc.folded[scratch].data();
+        cf32_t* spectrum = ddc.spectrum[scratch].data();
+        for(size_t i = first; i < last; i++){
+            const size_t s = ddc.positions[i];
+            fold_kernel(w + 2*s, ddc.taps.data(), 2*ddc.n_bands, ddc.n_rows, reinterpret_cast<float*>(folded));
+            if(ddc.direct){
+                for(size_t b = 0; b < ddc.bands.size(); b++){
+                    const size_t bin = (ddc.bands[b] + ddc.n_bands) % ddc.n_bands;
+                    cf32_t acc = folded[0];
+                    size_t idx = 0;
+                    for(size_t t = 1; t < ddc.n_bands; t++){
+                        idx += bin;
+                        if(idx >= ddc.n_bands)
+                            idx -= ddc.n_bands;
+                        acc += cmul(folded[t], ddc.fft.twiddles[idx]);
+                    }
+                    spectrum[bin] = acc;
+                }
+            }
+            else{
+                fft(ddc.fft, spectrum, folded, ddc.fft_scratch[scratch].data());
+            }
+
+            // the last input sample of this output sample, modulo n_bands
+            const size_t r = (ddc.n_in + s) % ddc.n_bands;
+            for(size_t b = 0; b < ddc.bands.size(); b++){
+                const size_t bin = (ddc.bands[b] + ddc.n_bands) % ddc.n_bands;
+                cf32_t* y = reinterpret_cast<cf32_t*>(&ddc.buffs_out[b*ddc.n_channels + ch][0]) + ddc.job_n_out;
+                y[i] = cmul(spectrum[bin], ddc.rotation[b*ddc.n_bands + r]);
+            }
+        }
+    }
+}
+
+// the last input samples are the history of the next call
+static void keep_history(ddc_t &ddc, const size_t ch){
+    float* w = ddc.work[ch].data();
+    std::memmove(w, w + 2*ddc.job_n, 2*(ddc.n_taps - 1)*sizeof(float));
+}
+
+static void process_group(ddc_t &ddc, const size_t group){
+    if(ddc.n_parts == 1){
+        for(size_t ch = group*ddc.n_channels/ddc.n_groups; ch < (group + 1)*ddc.n_channels/ddc.n_groups; ch++){
+            load_samples(ddc, ch, 0, ddc.job_n);
+            filter_outputs(ddc, ch, 0, ddc.positions.size(), ch);
+            keep_history(ddc, ch);
+        }
+        return;
+    }
+
+    // parts of the input start at multiples of NCO_TABLE_SIZE, the mixed samples are the same as without parts
+    const size_t ch = group/ddc.n_parts;
+    const size_t part = group % ddc.n_parts;
+    if(ddc.job_stage == DDC_STAGE_LOAD){
+        const size_t first = part*ddc.job_n/ddc.n_parts/NCO_TABLE_SIZE*NCO_TABLE_SIZE;
+        const size_t last = (part + 1 == ddc.n_parts) ? ddc.job_n : (part + 1)*ddc.job_n/ddc.n_parts/NCO_TABLE_SIZE*NCO_TABLE_SIZE;
+        load_samples(ddc, ch, first, last);
+    }
+    else{
+        filter_outputs(ddc, ch, part*ddc.positions.size()/ddc.n_parts, (part + 1)*ddc.positions.size()/ddc.n_parts, group);
+    }
+}
+
+// takes groups of the current job until none are left
+static void process_groups(ddc_t &ddc){
+    size_t group;
+    while((group = ddc.next_group.fetch_add(1)) < ddc.n_groups){
+        process_group(ddc, group);
+
+        boost::mutex::scoped_lock lock(ddc.m_mutex);
+        ddc.n_groups_done++;
+        if(ddc.n_groups_done == ddc.n_groups)
+            ddc.m_condition_done.notify_all();
+    }
+}
+
+// the processing thread and the worker threads each take groups of the current job until all are done
+static void run_job(ddc_t &ddc, const ddc_stage_t stage){
+    ddc.job_stage = stage;
+    ddc.n_groups_done = 0;
+    ddc.next_group = 0;
+    if(ddc.n_workers > 0){
+        {
+            boost::mutex::scoped_lock lock(ddc.m_mutex);
+            ddc.job_generation++;
+        }
+        ddc.m_condition_job.notify_all();
+    }
+    process_groups(ddc);
+    {
+        boost::mutex::scoped_lock lock(ddc.m_mutex);
+        while(ddc.n_groups_done < ddc.n_groups)
+            ddc.m_condition_done.wait(lock);
+    }
+    DBG_RB(ddc.n_jobs++;)
+}
+
+// Feeds n input samples of all channels through the filter, zeros if buffs is nullptr. Computes all output samples whose
+// last input sample is among them, unless they are centered on a gap. Returns the new number of output samples in buffs_out.
+static size_t filter_samples(ddc_t &ddc, const std::vector<std::vector<char>>* buffs, const unsigned long long offset, const size_t n, size_t n_out){
+    const unsigned long long half = (ddc.n_taps - 1)/2;
+
+    // output sample m uses the input samples m*decimation - half to m*decimation + half, only the output samples that are kept are computed
+    ddc.job_n_out = n_out;
+    ddc.positions.clear();
+    while(ddc.m_next*decimation + half < ddc.n_in + n){
+        const unsigned long long center = ddc.m_next*decimation;
+
+        // gaps that end before the center have no influence anymore
+        while(ddc.gaps_pending.size() > 0 && ddc.gaps_pending.front().offset + ddc.gaps_pending.front().length <= center)
+            ddc.gaps_pending.pop_front();
+        if(ddc.gaps_pending.size() > 0 && ddc.gaps_pending.front().offset <= center){
+            n_out = skip_output(ddc, ddc.gaps_pending.front(), 1, n_out);
+
+            // output samples dropped by skip_output() are not computed
+            ddc.job_n_out = std::min(ddc.job_n_out, n_out);
+            ddc.positions.resize(n_out - ddc.job_n_out);
+            continue;
+        }
+
+        ddc.positions.push_back(center + half - ddc.n_in);
+        ddc.m_next++;
+        n_out++;
+    }
+
+    ddc.job_buffs = buffs;
+    ddc.job_offset = offset;
+    ddc.job_n = n;
+    if(ddc.n_parts == 1){
+        run_job(ddc, DDC_STAGE_FILTER);
+    }
+    else{
+        run_job(ddc, DDC_STAGE_LOAD);
+        run_job(ddc, DDC_STAGE_FILTER);
+        for(size_t ch = 0; ch < ddc.n_channels; ch++)
+            keep_history(ddc, ch);
+    }
+
+    ddc.n_in += n;
+    ddc.phase = std::fmod(ddc.phase + ddc.phase_increment*n, 2.0*M_PI);
+
+    return n_out;
+}
+// Samples of a gap are treated as zeros. Once the history only contains zeros, the output samples are skipped without computing them.
+static size_t feed_gap_samples(ddc_t &ddc, const gap_t &gap, size_t n_out){
+    const size_t n_history = ddc.n_taps - 1;
+    const unsigned long long half = n_history/2;
+
+    gap_t gap_pending = {ddc.n_in, gap.length, gap.source, gap.device};
+    ddc.gaps_pending.push_back(gap_pending);
+
+    const size_t n_zeros = (size_t) std::min<unsigned long long>(gap.length, n_history);
+    n_out = filter_samples(ddc, nullptr, 0, n_zeros, n_out);
+
+    // all output samples whose last input sample lies in the rest of the gap are centered on the gap
+    const unsigned long long n_in_end = gap_pending.offset + gap.length;
+    if(ddc.m_next*decimation + half < n_in_end){
+        const unsigned long long n_missing = (n_in_end - half - ddc.m_next*decimation + decimation - 1)/decimation;
+        n_out = skip_output(ddc, gap_pending, n_missing, n_out);
+    }
+    ddc.phase = std::fmod(ddc.phase + ddc.phase_increment*(double) (n_in_end - ddc.n_in), 2.0*M_PI);
+    ddc.n_in = n_in_end;
+
+    return n_out;
+}
+
+void feed_ddc(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+
+    if(mode == DDC_MODE_OFF){
+        feed_new_ch_measurement(device, buffs, n_new_samples, gaps);
+        return;
+    }
+
+    ddc_t &ddc = ddcs[device];
+    ddc.gaps_out.clear();
+    DBG_RB(ddc.n_samples_in += n_new_samples;)
+
+    // samples between gaps are filtered, gaps are translated to the output rate
+    unsigned long long n_consumed_samples = 0;
+    size_t n_out = 0;
+    for(size_t i = 0; i < gaps.size(); i++){
+        unsigned long long gap_offset = std::min(gaps[i].offset, n_new_samples);
+        if(gap_offset > n_consumed_samples){
+            n_out = filter_samples(ddc, &buffs, n_consumed_samples, gap_offset - n_consumed_samples, n_out);
+            n_consumed_samples = gap_offset;
+        }
+        n_out = feed_gap_samples(ddc, gaps[i], n_out);
+    }
+
+    if(n_new_samples > n_consumed_samples)
+        n_out = filter_samples(ddc, &buffs, n_consumed_samples, n_new_samples - n_consumed_samples, n_out);
+
+    DBG_RB(ddc.n_samples_out += n_out;)
+    feed_new_ch_measurement(device, ddc.buffs_out, n_out, ddc.gaps_out);
+}
+
+void run_ddc_worker(const size_t device, std::atomic<bool>& burst_timer_elapsed){
+    ddc_t &ddc = ddcs[device];
+
+    unsigned long long generation = 0;
+    while(1){
+        {
+            boost::mutex::scoped_lock lock(ddc.m_mutex);
+            while(ddc.job_generation == generation){
+                // from time to time we check if "burst_timer_elapsed" was set to true, workers only leave between jobs
+                ddc.m_condition_job.wait_for(lock, boost::chrono::milliseconds(5000));
+                if(burst_timer_elapsed == true)
+                    return;
+            }
+            generation = ddc.job_generation;
+        }
+        process_groups(ddc);
+    }
+}
+
+unsigned long long get_n_gaps_merged_ddc(){
+    unsigned long long n_gaps_merged = 0;
+    for(size_t device = 0; device < ddcs.size(); device++)
+        n_gaps_merged += ddcs[device].n_gaps_merged;
+    return n_gaps_merged;
+}
+
+void show_debug_information_ddc(){
+    if(mode == DDC_MODE_OFF)
+        return;
+    for(size_t device = 0; device < ddcs.size(); device++){
+        const ddc_t &ddc = ddcs[device];
+        std::cout << "--------------------------" << std::endl;
+        std::cout << "ddc " << device << std::endl;
+        std::cout << "mode: " << ((mode == DDC_MODE_NCO) ? "nco" : "filterbank") << std::endl;
+        std::cout << "decimation: " << decimation << std::endl;
+        if(mode == DDC_MODE_FILTERBANK){
+            std::cout << "n_bands: " << ddc.n_bands << std::endl;
+            std::cout << "transform: " << (ddc.direct ? "dft" : "fft") << std::endl;
+            std::cout << "n_bands_saved: " << ddc.bands.size() << std::endl;
+        }
+        std::cout << "n_taps: " << ddc.n_taps << std::endl;
+        std::cout << "kernel: " << kernel_name << std::endl;
+        std::cout << "n_workers: " << ddc.n_workers << std::endl;
+        std::cout << "n_parts: " << ddc.n_parts << std::endl;
+        std::cout << "n_groups: " << ddc.n_groups << std::endl;
+        std::cout << "n_jobs: " << ddc.n_jobs << std::endl;
+        std::cout << "n_samples_in: " << ddc.n_samples_in << std::endl;
+        std::cout << "n_samples_out: " << ddc.n_samples_out << std::endl;
+        std::cout << "n_gaps: " << ddc.n_gaps << std::endl;
+        std::cout << "n_gaps_merged: " << ddc.n_gaps_merged << std::endl;
+        std::cout << "--------------------------" << std::endl;
+    }
+}
+}
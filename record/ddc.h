@@ -0,0 +1,115 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_DDC_H
+#define CHANNELSOUNDER_DDC_H
+
+#include <vector>
+#include <atomic>
+
+#include "gap.h"
+
+namespace channelsounder
+{
+/*!
+ * Inits unit internally. Must be called first, once for each device in ascending order.
+ * The digital downconverter sits between the ringbuffer and the fifo. It shifts the channel of interest to 0 Hz with an NCO,
+ * low pass filters it and keeps every decimation-th sample. Only the kept samples are computed (polyphase decimation).
+ * The filter is a Blackman windowed sinc with cutoff at half the output rate and n_taps_per_phase*decimation + 1 taps. Output sample m is
+ * centered on input sample m*decimation, so the first output sample still belongs to the start time of the measurement.
+ * Samples must be fc32. With decimation 1 the samples are passed to the fifo unchanged.
+ *
+ * device                       index of the device
+ * n_channels                   number of channels of the device
+ * max_samples_per_block        maximum number of samples per channel passed to feed_ddc() at once
+ * rate                         input sample rate in samples per second
+ * freq_offset                  center of the channel of interest relative to the rx center frequency in Hz
+ * decimation                   ratio of input and output sample rate, 1 disables the downconverter
+ * n_taps_per_phase             filter length per output sample and decimation, longer filters have a narrower transition band
+ * n_workers                    threads started with run_ddc_worker() in addition to the processing thread, channels are split into groups,
+ *                              with fewer channels than threads the samples of each channel as well
+ * return                       1 on success and 0 on failure
+*/
+int init_ddc(const size_t device, const size_t n_channels, const size_t max_samples_per_block, const double rate, const double freq_offset,
+             const size_t decimation, const size_t n_taps_per_phase, const size_t n_workers);
+
+/*!
+ * Alternative to init_ddc(). Splits the wideband capture of a device into n_bands bands, e.g. 20 MHz Wi-Fi channels of an 80 MHz capture.
+ * Band b is centered on b*rate/n_bands relative to the rx center frequency and is filtered by the same prototype low pass as init_ddc()
+ * with cutoff rate/(2*n_bands) and n_taps_per_band*n_bands + 1 taps. Each output sample of all bands costs one fold of the input
+ * into n_bands branches and one fft of size n_bands (polyphase filterbank), independent of the number of bands kept.
+ * The output rate is rate*oversampling/n_bands, oversampling 2 keeps the edges of neighbouring bands free of aliases.
+ * Every kept band becomes a separate group of output channels: output channel b*n_channels + ch is band bands[b] of input channel ch.
+ * Samples must be fc32.
+ *
+ * device                       index of the device
+ * n_channels                   number of channels of the device
+ * max_samples_per_block        maximum number of samples per channel passed to feed_ddc() at once
+ * rate                         input sample rate in samples per second
+ * n_bands                      number of bands and fft size, at least 2
+ * bands                        bands to keep from -n_bands+1 to n_bands-1, negative bands are below the center frequency, empty for all
+ * oversampling                 ratio of output rate and band spacing, must divide n_bands
+ * n_taps_per_band              filter length per band
+ * n_workers                    threads started with run_ddc_worker() in addition to the processing thread, channels are split into groups,
+ *                              with fewer channels than threads the samples of each channel as well
+ * return                       1 on success and 0 on failure
+*/
+int init_ddc_filterbank(const size_t device, const size_t n_channels, const size_t max_samples_per_block, const double rate, const size_t n_bands,
+                        const std::vector<int>& bands, const size_t oversampling, const size_t n_taps_per_band, const size_t n_workers);
+
+/*!
+ * Resets the NCO phase and the filter history. Must be called before each measurement while the processing thread is idle.
+ *
+ * return                       1 on success and 0 on failure
+*/
+int reset_ddc(const size_t device);
+
+/*!
+ * Decimation of all devices, 1 if the downconverter is disabled.
+*/
+size_t get_ddc_decimation();
+
+/*!
+ * Called by the processing thread of the device instead of feed_new_ch_measurement(). Downconverts the samples and passes them on
+ * to feed_new_ch_measurement(). Gaps are translated to the output rate and clear the filter history, samples around a gap are
+ * computed as if the gap was filled with zeros.
+ *
+ * buffs                        samples of each channel of the device
+ * n_new_samples                number of samples per channel
+ * gaps                         gaps within the samples, ordered by offset
+*/
+void feed_ddc(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
+
+/*!
+ * Worker thread of a device, helps the processing thread to filter groups of channels or samples. Returns once "burst_timer_elapsed" is set.
+ *
+ * burst_timer_elapsed          set to true to end the thread
+*/
+void run_ddc_worker(const size_t device, std::atomic<bool>& burst_timer_elapsed);
+
+/*!
+ * Number of output gaps of all devices that did not fit into the gaps passed to the fifo. Such a gap absorbs the output samples since the gap
+ * before it, sample indices stay exact. Read it once the processing threads are done.
+*/
+unsigned long long get_n_gaps_merged_ddc();
+
+/*!
+ * Shows some stats of the downconverter.
+*/
+void show_debug_information_ddc();
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <cmath>
+
+#include "fft.h"
+
+namespace channelsounder
+{
+void init_fft_plan(fft_plan_t &plan, const size_t n){
+    plan.n = n;
+    plan.factors.clear();
+    size_t rest = n;
+    for(size_t p = 2; rest > 1; p++){
+        while(rest % p == 0){
+            plan.factors.push_back(p);
+            rest /= p;
+        }
+    }
+    plan.twiddles.resize(n);
+    for(size_t k = 0; k < n; k++)
+        plan.twiddles[k] = std::polar(1.0f, (float) (-2.0*M_PI*k/n));
+}
+
+// decimation in time, the stage with radix p combines p transforms of size m taken from the input with stride fstride
+static void fft_stage(const fft_plan_t &plan, cf32_t* out, const cf32_t* in, const size_t fstride, const size_t stage, cf32_t* scratch){
+    const size_t p = plan.factors[stage];
+    const size_t m = plan.n/fstride/p;
+
+    if(m == 1){
+        for(size_t j = 0; j < p; j++)
+            out[j] = in[j*fstride];
+    }
+    else{
+        for(size_t j = 0; j < p; j++)
+            fft_stage(plan, out + j*m, in + j*fstride, fstride*p, stage + 1, scratch);
+    }
+
+    if(p == 2){
+        for(size_t u = 0; u < m; u++){
+            const cf32_t t = cmul(out[u + m], plan.twiddles[u*fstride]);
+            out[u + m] = out[u] - t;
+            out[u] += t;
+        }
+        return;
+    }
+
+    for(size_t u = 0; u < m; u++){
+        for(size_t q = 0; q < p; q++)
+            scratch[q] = out[u + q*m];
+        for(size_t q1 = 0; q1 < p; q1++){
+            const size_t k = u + q1*m;
+            const size_t step = fstride*k % plan.n;
+            cf32_t acc = scratch[0];
+            size_t idx = 0;
+            for(size_t q = 1; q < p; q++){
+                idx += step;
+                if(idx >= plan.n)
+                    idx -= plan.n;
+                acc += cmul(scratch[q], plan.twiddles[idx]);
+            }
+            out[k] = acc;
+        }
+    }
+}
+
+void fft(const fft_plan_t &plan, cf32_t* out, const cf32_t* in, cf32_t* scratch){
+    if(plan.factors.size() == 0){
+        out[0] = in[0];
+        return;
+    }
+    fft_stage(plan, out, in, 1, 0, scratch);
+}
+}
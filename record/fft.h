@@ -0,0 +1,67 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_FFT_H
+#define CHANNELSOUNDER_FFT_H
+
+#include <vector>
+#include <complex>
+
+namespace channelsounder
+{
+typedef std::complex<float> cf32_t;
+
+/*!
+ * Complex multiplication without the nan and inf checks of std::complex, which are not inlined.
+*/
+inline cf32_t cmul(const cf32_t a, const cf32_t b){
+    return cf32_t(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+}
+
+/*!
+ * Mixed radix fft of any size. Radix 2 stages have their own butterfly, all other prime factors use a plain dft butterfly.
+ * A plan is read-only after init_fft_plan(), several threads can use it at once with their own scratch.
+ *
+ * n                            fft size
+ * factors                      radix of each stage
+ * twiddles                     exp(-j*2*pi*k/n)
+*/
+struct fft_plan_t{
+    size_t n;
+    std::vector<size_t> factors;
+    std::vector<cf32_t> twiddles;
+};
+
+/*!
+ * Factorizes n and computes the twiddles.
+ *
+ * plan                         plan to initialize
+ * n                            fft size, at least 1
+*/
+void init_fft_plan(fft_plan_t &plan, const size_t n);
+
+/*!
+ * Forward transform out[k] = sum_t in[t]*exp(-j*2*pi*k*t/n).
+ *
+ * plan                         plan of size n
+ * out                          n output samples, must not overlap with in
+ * in                           n input samples
+ * scratch                      at least the largest factor of n samples
+*/
+void fft(const fft_plan_t &plan, cf32_t* out, const cf32_t* in, cf32_t* scratch);
+}
+
+#endif
@@ -20,19 +20,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <boost/thread/thread.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/asio.hpp>
 #include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
 
 #include "debug.h"
-#include "config.h"
 #include "fifo_measurement.h"
+#include "gap.h"
+#include "writer.h"
+#include "copy_kernel.h"
 
-static unsigned int CH_MEASUREMENT_LENGTH_IN_SAMPLES = 1000000;
+static unsigned long long CH_MEASUREMENT_LENGTH_IN_SAMPLES = 1000000;
 static unsigned int FILE_ID = 0;
+static std::string FILE_TAG;
 
 namespace channelsounder
 {
-static size_t n_channels;                       // number of channels/antennas, set in init function
+static size_t n_channels;                       // number of channels/antennas of all devices, set in init function
 static size_t n_bytes_per_item;                 // size of complex sample
+static double sample_rate;                      // of the saved samples, after the downconverter
 
 enum buffer_enum{
     NO_BUFFER = -1,
@@ -45,8 +55,25 @@ enum buffer_enum_state{
     COLLECT_CHANNEL_MEASUREMENT,
     DROP_SAMPLES
 };
-static buffer_enum_state d_STATE;
-static unsigned int n_state;                    // state counter
+
+// each device feeds its own channels from its own processing thread, devices advance independently
+struct device_state_t{
+    size_t channel_offset;                      // index of the first channel of this device within the measurement
+    size_t n_channels;
+    buffer_enum_state d_STATE;
+    unsigned long long n_state;                 // state counter
+    unsigned long long chunk_number;            // chunk currently being filled when streaming
+    copy_kernel_t kernel;                       // selected for the sample size and channel count of the device
+    std::vector<char*> destinations;            // one pointer per channel, allocated at init
+    std::vector<const char*> sources;
+};
+static std::vector<device_state_t> devices;
+
+// coordination between the processing threads of the devices
+static boost::mutex m_mutex_devices;
+static boost::condition_variable m_condition_devices;
+static size_t n_devices_complete;
+static bool chunk_wait_cancelled = false;
 
 // columns: number of rx channels (antennas)
 // rows: container for samples
@@ -54,44 +81,177 @@ static std::vector<std::vector<char>> buffs0;
 
 static boost::mutex m_mutex;
 static boost::condition_variable m_condition;
+static boost::condition_variable m_condition_saved;
 
 static uint64_t current_time_since_epoch_microseconds;
 
+// metadata of the current measurement reported by the rx thread
+static std::atomic<double> start_time_uhd_sec(0.0);
+static std::atomic<long long> n_packets_measurement(-1);
+
+// the measurement ends early with this many samples, set by the rx thread, e.g. when enough packets were detected
+static std::atomic<unsigned long long> n_samples_stop(ULLONG_MAX);
+
+// gaps of the current measurement, offsets are relative to the file
+static bool zero_fill;
+static std::vector<gap_t> gaps_measurement;
+static std::atomic<bool> measurement_complete(false);
+
+// streaming mode, samples are handed to the writer in chunks as they arrive instead of keeping the whole measurement in memory
+static unsigned long long stream_chunk_samples = 0;     // 0 disables streaming
+static std::vector<write_chunk_t> chunks;               // chunk number c is stored in slot c % chunks.size(), their number is limited by the in-flight budget
+static std::vector<unsigned long long> chunk_numbers;   // chunk number currently assigned to each slot
+static std::vector<size_t> n_devices_done;              // devices that have filled their channels of the chunk in each slot
+static std::vector<char> slot_ready;                    // false while the chunk previously stored in a slot is still being written
+static bool measurement_open = false;                   // files of the current measurement have been opened by the writer
+static std::string file_name_measurement;
+static double busy_sec_start_measurement = 0.0;          // get_writer_busy_sec() when the files were opened
+
+// completion message is sent to this receiver after a file has been written, port 0 disables it
+static boost::mutex m_mutex_receiver;
+static std::string receiver_address_pending;
+static unsigned short receiver_port_pending = 0;
+static std::string receiver_address;
+static unsigned short receiver_port = 0;
+static boost::asio::io_service io_context;
+static boost::asio::ip::udp::socket notification_socket(io_context);
+
 // statistics
 static unsigned long long n_measurement_saved = 0;
-static unsigned long long n_samples_total = 0;
-static unsigned long long n_worker_not_done = 0;
+static std::atomic<unsigned long long> n_measurement_finished(0);
+static std::atomic<double> finished_time_epoch_sec(0.0);
+static std::atomic<unsigned long long> n_samples_total(0);
 static unsigned long long n_worker_wait = 0;
 static unsigned long long n_worker_executed = 0;
+static unsigned long long n_measurement_failed = 0;
+static double write_throughput_sum_MBps = 0.0;
+static unsigned long long n_gaps_total = 0;
+static unsigned long long n_samples_missing_total = 0;
+static std::atomic<unsigned long long> n_chunk_waits(0);
+static unsigned long long n_chunk_waits_device = 0;
+static unsigned long long n_measurement_aborted = 0;
+
+// prepares all devices and chunk slots for a new measurement
+static void reset_devices(){
+    for(size_t device = 0; device < devices.size(); device++){
+        devices[device].d_STATE = COLLECT_CHANNEL_MEASUREMENT;
+        devices[device].n_state = 0;
+        devices[device].chunk_number = 0;
+    }
+    n_devices_complete = 0;
+    chunk_wait_cancelled = false;
+
+    // the first chunks are assigned in advance, all buffers are free at this point
+    for(size_t slot = 0; slot < chunks.size(); slot++){
+        chunk_numbers[slot] = slot;
+        n_devices_done[slot] = 0;
+        slot_ready[slot] = 1;
+        chunks[slot].sample_offset = slot*stream_chunk_samples;
+    }
+}
 
-int init_fifo_ch_measurement(const size_t n_channels_arg, const size_t n_bytes_per_item_arg){
-    n_channels = n_channels_arg;
+int init_fifo_ch_measurement(const std::vector<size_t>& n_channels_per_device, const size_t n_bytes_per_item_arg, const bool zero_fill_arg, const size_t stream_chunk_bytes, const size_t stream_budget_bytes,
+                             const double sample_rate_arg){
+    if(n_channels_per_device.size() == 0)
+        return 0;
+
+    n_channels = 0;
+    devices.resize(n_channels_per_device.size());
+    for(size_t device = 0; device < devices.size(); device++){
+        devices[device].channel_offset = n_channels;
+        devices[device].n_channels = n_channels_per_device[device];
+        devices[device].kernel = select_copy_kernel(n_bytes_per_item_arg, n_channels_per_device[device]);
+        devices[device].destinations.resize(n_channels_per_device[device]);
+        devices[device].sources.resize(n_channels_per_device[device]);
+        if(devices[device].kernel.copy == nullptr){
+            std::cerr << "fifo_measurement: no copy kernel for samples of " << n_bytes_per_item_arg << " bytes" << std::endl;
+            return 0;
+        }
+        std::cout << "fifo_measurement: device " << device << " uses copy kernel " << devices[device].kernel.name << std::endl;
+        n_channels += n_channels_per_device[device];
+    }
     n_bytes_per_item = n_bytes_per_item_arg;
+    sample_rate = sample_rate_arg;
+    zero_fill = zero_fill_arg;
 
     buffer2process = NO_BUFFER;
 
-    d_STATE = COLLECT_CHANNEL_MEASUREMENT;
-    n_state = 0;
-
     buffs0.clear();
+    chunks.clear();
+
+    stream_chunk_samples = stream_chunk_bytes / n_bytes_per_item;
+
+    // streaming, all chunks are allocated once and reused for every measurement
+    if(stream_chunk_samples > 0){
+        size_t n_chunks = std::max<size_t>(2, stream_budget_bytes / (stream_chunk_samples*n_bytes_per_item*n_channels));
+        std::vector<char> buff_template(stream_chunk_samples * n_bytes_per_item);
+        chunks.resize(n_chunks);
+        chunk_numbers.resize(n_chunks);
+        n_devices_done.resize(n_chunks);
+        slot_ready.resize(n_chunks);
+        for(size_t i = 0; i < n_chunks; i++){
+            chunks[i].buffs.assign(n_channels, buff_template);
+            chunks[i].sample_offset = 0;
+            chunks[i].n_samples = 0;
+            chunks[i].n_jobs_pending = 0;
+        }
+        reset_devices();
+        std::cout << "fifo_measurement: streaming to disk in " << n_chunks << " chunks of " << stream_chunk_samples << " samples per channel" << std::endl;
+        return 1;
+    }
 
     // initialize buffers
     std::vector<char> buff_template(CH_MEASUREMENT_LENGTH_IN_SAMPLES * n_bytes_per_item);
     for (size_t ch = 0; ch < n_channels; ch++)
         buffs0.push_back(buff_template);
 
+    reset_devices();
+
     return 1;
 }
 
-int reset_fifo_ch_measurement(const unsigned int n_samples, const unsigned int file_id){
+int reset_fifo_ch_measurement(const unsigned long long n_samples, const unsigned int file_id, const std::string& file_tag){
+
+    // the last measurement might still be written to disk, wait until the save thread is done with it
+    boost::mutex::scoped_lock lock(m_mutex);
+    while(buffer2process != NO_BUFFER)
+        m_condition_saved.wait(lock);
 
     CH_MEASUREMENT_LENGTH_IN_SAMPLES = n_samples;
     FILE_ID = file_id;
+    FILE_TAG = file_tag;
+
+    start_time_uhd_sec = 0.0;
+    n_packets_measurement = -1;
+    n_samples_stop = ULLONG_MAX;
+    gaps_measurement.clear();
+    measurement_complete = false;
+
+    // receiver of the completion message of this measurement
+    {
+        boost::mutex::scoped_lock lock_receiver(m_mutex_receiver);
+        receiver_address = receiver_address_pending;
+        receiver_port = receiver_port_pending;
+    }
 
     buffer2process = NO_BUFFER;
 
-    d_STATE = COLLECT_CHANNEL_MEASUREMENT;
-    n_state = 0;
+    if(stream_chunk_samples > 0){
+        // the last measurement was aborted before it was complete, its files are removed
+        if(measurement_open){
+            abort_measurement_writer();
+            measurement_open = false;
+            n_measurement_aborted++;
+        }
+    }
+
+    {
+        boost::mutex::scoped_lock lock_devices(m_mutex_devices);
+        reset_devices();
+    }
+
+    if(stream_chunk_samples > 0)
+        return 1;
 
     buffs0.clear();
 
@@ -114,58 +274,297 @@ void current_time(const unsigned int offset_microseconds){
     current_time_since_epoch_microseconds = current_time_since_epoch_microseconds + (uint64_t) offset_microseconds;
 }
 
-void feed_new_ch_measurement(const std::vector<std::vector<char>> &buffs01, const unsigned long long n_new_samples){
-    DBG_RB(n_samples_total += n_new_samples;)
-    unsigned int n_consumed_samples = 0;
+void set_notification_receiver(const std::string& address, const unsigned short port){
+    boost::mutex::scoped_lock lock_receiver(m_mutex_receiver);
+    receiver_address_pending = address;
+    receiver_port_pending = port;
+}
+
+void report_start_time(const double uhd_time_sec){
+    start_time_uhd_sec = uhd_time_sec;
+}
+
+void report_packets(const long long n_packets){
+    n_packets_measurement = n_packets;
+}
+
+void stop_fifo_ch_measurement(const unsigned long long n_samples){
+    if(stream_chunk_samples > 0)
+        return;
+    n_samples_stop = std::min<unsigned long long>(n_samples_stop, n_samples);
+}
+
+bool is_complete_fifo_ch_measurement(){
+    return measurement_complete;
+}
+
+unsigned long long get_finished_fifo_ch_measurement(double& time_epoch_sec){
+    const unsigned long long n_finished = n_measurement_finished.load();
+    time_epoch_sec = finished_time_epoch_sec.load();
+    return n_finished;
+}
+
+void cancel_fifo_ch_measurement(){
+    {
+        boost::mutex::scoped_lock lock_devices(m_mutex_devices);
+        chunk_wait_cancelled = true;
+    }
+    m_condition_devices.notify_all();
+}
+
+// Text file next to the measurement with one line per gap. Written before the measurement is renamed to its final name.
+// Gaps only affect the channels of the device they belong to.
+static bool write_gap_index(const std::string& full_file_path_gaps){
+
+    std::string full_file_path_tmp = full_file_path_gaps + ".tmp";
+    std::ofstream fout(full_file_path_tmp);
+    if(!fout.is_open())
+        return false;
+
+    fout << "# zero_fill " << (zero_fill ? 1 : 0) << std::endl;
+    fout << "# file_offset_samples n_missing_samples source device" << std::endl;
+    for(size_t i = 0; i < gaps_measurement.size(); i++){
+        const gap_t &gap = gaps_measurement[i];
+        fout << gap.offset << " " << gap.length << " " << ((gap.source == GAP_SOURCE_UHD) ? "uhd" : "ringbuffer") << " " << gap.device << std::endl;
+    }
+    fout.close();
+
+    return !fout.fail() && std::rename(full_file_path_tmp.c_str(), full_file_path_gaps.c_str()) == 0;
+}
+
+static unsigned long long get_n_missing_samples(){
+    unsigned long long n_missing_samples = 0;
+    for(size_t i = 0; i < gaps_measurement.size(); i++)
+        n_missing_samples += gaps_measurement[i].length;
+    return n_missing_samples;
+}
+
+// Message format, fields separated by ';':
+//  Measurement_Done_;<file path>;<samples per channel>;<dropped samples>;<uhd start time in s>;<write throughput in MB/s>;<gaps>;<sample rate in S/s>;<packets>
+// The write throughput counts only the time the writer was busy with the measurement, see get_writer_busy_sec(), also when streaming.
+// The number of packets is -1 if the packets were not counted.
+// If the file could not be written, the file path is empty.
+static void send_completion_message(const std::string& full_file_path, const double write_throughput_MBps){
+
+    if(receiver_port == 0 || receiver_address.size() == 0)
+        return;
+
+    // the receiver might run in a different working directory
+    std::string full_file_path_abs = full_file_path;
+    char* path_resolved = realpath(full_file_path.c_str(), NULL);
+    if(path_resolved != NULL){
+        full_file_path_abs = path_resolved;
+        free(path_resolved);
+    }
+
+    std::ostringstream ss;
+    ss << "Measurement_Done_;" << full_file_path_abs;
+    ss << ";" << CH_MEASUREMENT_LENGTH_IN_SAMPLES;
+    ss << ";" << get_n_missing_samples();
+    ss << ";" << std::fixed << std::setprecision(9) << start_time_uhd_sec;
+    ss << ";" << std::setprecision(1) << write_throughput_MBps;
+    ss << ";" << gaps_measurement.size();
+    ss << ";" << std::setprecision(3) << sample_rate;
+    ss << ";" << n_packets_measurement;
+    std::string message = ss.str();
+
+    try{
+        boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address::from_string(receiver_address), receiver_port);
+        if(!notification_socket.is_open())
+            notification_socket.open(boost::asio::ip::udp::v4());
+        notification_socket.send_to(boost::asio::buffer(message), endpoint);
+    }
+    catch(std::exception& e){
+        std::cerr << "fifo_measurement: unable to send completion message: " << e.what() << std::endl;
+    }
+}
+
+static std::string get_file_name(){
+    std::ostringstream ss;
+    ss << "iqrecord_";
+    ss << std::setw(10) << std::setfill('0') << n_measurement_saved << "_";
+    ss << std::setw(10) << std::setfill('0') << FILE_ID << "_";
+    ss << std::setw(20) << std::setfill('0') << current_time_since_epoch_microseconds;
+    if(FILE_TAG.size() > 0)
+        ss << "_" << FILE_TAG;
+    n_measurement_saved++;
+
+    return ss.str();
+}
+
+// number of samples per channel of the current measurement, less than requested if it was stopped early
+static unsigned long long get_measurement_length(){
+    return std::min<unsigned long long>(CH_MEASUREMENT_LENGTH_IN_SAMPLES, n_samples_stop);
+}
+
+// the device has collected all its samples, the last device hands the measurement over to the save thread
+static void complete_measurement(device_state_t &dev){
+    dev.d_STATE = DROP_SAMPLES;
+    dev.n_state = 0;
+
+    {
+        boost::mutex::scoped_lock lock_devices(m_mutex_devices);
+        if(++n_devices_complete < devices.size())
+            return;
+    }
+    // a measurement stopped early is saved with the samples collected until then
+    CH_MEASUREMENT_LENGTH_IN_SAMPLES = get_measurement_length();
+    measurement_complete = true;
+
+    // trigger worker thread, it is idle because reset_fifo_ch_measurement() waited for the previous measurement, but it might hold the
+    // mutex for a moment between two waits, so we block instead of dropping the measurement
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        buffer2process = BUFFER0;
+    }
+    m_condition.notify_all();
+}
+
+// number of samples that can be stored at n_state without crossing the end of the measurement or of the current chunk
+static unsigned long long get_n_samples_storable(const device_state_t &dev){
+    const unsigned long long length = get_measurement_length();
+    if(dev.n_state >= length)
+        return 0;
+    unsigned long long n_samples_storable = length - dev.n_state;
+    if(stream_chunk_samples > 0)
+        n_samples_storable = std::min(n_samples_storable, (dev.chunk_number + 1)*stream_chunk_samples - dev.n_state);
+    return n_samples_storable;
+}
+
+// position of sample n_state of channel ch of the device
+static char* get_destination(const device_state_t &dev, const size_t ch){
+    if(stream_chunk_samples > 0){
+        write_chunk_t &chunk = chunks[dev.chunk_number % chunks.size()];
+        return &chunk.buffs[dev.channel_offset + ch][(dev.n_state - chunk.sample_offset)*n_bytes_per_item];
+    }
+    return &buffs0[dev.channel_offset + ch][dev.n_state*n_bytes_per_item];
+}
+
+// The device has filled its channels of the current chunk. The last device to do so hands the chunk over to the writer.
+static void finish_chunk(const device_state_t &dev){
+    const size_t slot = dev.chunk_number % chunks.size();
+
+    boost::mutex::scoped_lock lock_devices(m_mutex_devices);
+    if(++n_devices_done[slot] < devices.size())
+        return;
+
+    write_chunk_t &chunk = chunks[slot];
+    chunk.n_samples = dev.n_state - chunk.sample_offset;
+
+    // files are opened with the first chunk, at this point the time of the measurement is known
+    if(!measurement_open){
+        file_name_measurement = get_file_name();
+        busy_sec_start_measurement = get_writer_busy_sec();
+        begin_measurement_writer(file_name_measurement, CH_MEASUREMENT_LENGTH_IN_SAMPLES, n_bytes_per_item);
+        measurement_open = true;
+    }
+    submit_chunk_writer(chunk);
+
+    // devices waiting for this slot
+    m_condition_devices.notify_all();
+}
+
+// The device continues with the next chunk. Blocks if the in-flight budget is used up or if the slot still waits for a slower device.
+// Returns false if the measurement was cancelled while waiting.
+static bool start_chunk(device_state_t &dev){
+    const unsigned long long chunk_number = dev.chunk_number + 1;
+    const size_t slot = chunk_number % chunks.size();
+
+    boost::mutex::scoped_lock lock_devices(m_mutex_devices);
+    bool waited = false;
+    while(chunk_numbers[slot] != chunk_number){
+        if(chunk_wait_cancelled)
+            return false;
+
+        // the slot still holds an older chunk, the first device to find it submitted recycles it
+        if(chunk_numbers[slot] + chunks.size() == chunk_number && n_devices_done[slot] == devices.size()){
+            chunk_numbers[slot] = chunk_number;
+            n_devices_done[slot] = 0;
+            slot_ready[slot] = 0;
+            chunks[slot].sample_offset = chunk_number*stream_chunk_samples;
+            lock_devices.unlock();
+
+            if(wait_chunk_writer(chunks[slot]))
+                waited = true;
+
+            lock_devices.lock();
+            slot_ready[slot] = 1;
+            m_condition_devices.notify_all();
+            break;
+        }
+
+        // another device is recycling the slot or a slower device has not filled its channels of the older chunk yet
+        DBG_RB(n_chunk_waits_device++;)
+        m_condition_devices.wait_for(lock_devices, boost::chrono::milliseconds(5000));
+    }
+
+    // the slot is reassigned before its buffers are free, wait until the recycling device is done
+    while(!slot_ready[slot] && !chunk_wait_cancelled){
+        waited = true;
+        m_condition_devices.wait_for(lock_devices, boost::chrono::milliseconds(5000));
+    }
+
+    if(waited)
+        n_chunk_waits++;
+
+    dev.chunk_number = chunk_number;
+    return !chunk_wait_cancelled;
+}
+
+// n_samples were stored at n_state
+static void advance(device_state_t &dev, const unsigned long long n_samples){
+    dev.n_state += n_samples;
+
+    if(stream_chunk_samples > 0){
+        if(dev.n_state == CH_MEASUREMENT_LENGTH_IN_SAMPLES || dev.n_state == (dev.chunk_number + 1)*stream_chunk_samples){
+            finish_chunk(dev);
+
+            // the measurement was cancelled, e.g. aborted while another device was behind
+            if(dev.n_state < CH_MEASUREMENT_LENGTH_IN_SAMPLES && !start_chunk(dev)){
+                dev.d_STATE = DROP_SAMPLES;
+                return;
+            }
+        }
+    }
+
+    // if this condition is met, we know that the measurement is complete
+    if(dev.n_state >= get_measurement_length())
+        complete_measurement(dev);
+}
+
+static void feed_samples(device_state_t &dev, const std::vector<std::vector<char>> &buffs01, const unsigned long long sample_offset, const unsigned long long n_new_samples){
+    unsigned long long n_consumed_samples = 0;
 
     while(n_consumed_samples < n_new_samples)
     {
-        switch(d_STATE)
+        switch(dev.d_STATE)
         {
             case COLLECT_CHANNEL_MEASUREMENT:
             {
-                unsigned int n_residual_samples = n_new_samples - n_consumed_samples;
-                unsigned int n_samples_until_measurement_complete = CH_MEASUREMENT_LENGTH_IN_SAMPLES - n_state;
-                unsigned int n_samples_usable = std::min(n_samples_until_measurement_complete, n_residual_samples);
+                // the measurement was stopped early and the device has all its samples
+                if(dev.n_state >= get_measurement_length()){
+                    complete_measurement(dev);
+                    break;
+                }
+
+                unsigned long long n_residual_samples = n_new_samples - n_consumed_samples;
+                unsigned long long n_samples_usable = std::min(get_n_samples_storable(dev), n_residual_samples);
 
                 // save binary data of this measurement
-                unsigned int offest = n_state * n_bytes_per_item;
-                for(size_t ch = 0; ch < n_channels; ch++){
-                    auto destination = buffs0[ch].begin() + offest;
-                    auto source = buffs01[ch].begin() + n_consumed_samples*n_bytes_per_item;
-                    std::copy_n(source, n_samples_usable*n_bytes_per_item, destination);
+                for(size_t ch = 0; ch < dev.n_channels; ch++){
+                    dev.sources[ch] = &buffs01[ch][(sample_offset + n_consumed_samples)*n_bytes_per_item];
+                    dev.destinations[ch] = get_destination(dev, ch);
                 }
+                dev.kernel.copy(dev.destinations.data(), dev.sources.data(), dev.n_channels, n_samples_usable);
 
-                n_state += n_samples_usable;
                 n_consumed_samples += n_samples_usable;
-
-                // if this condition is met, we know that the measurement is complete
-                if(n_state == CH_MEASUREMENT_LENGTH_IN_SAMPLES){
-                    d_STATE = DROP_SAMPLES;
-                    n_state = 0;
-
-                    // trigger worker thread
-                    {
-                        boost::mutex::scoped_lock lock(m_mutex, boost::try_to_lock);
-
-                        // if we were able to lock the mutex, processing thread must be in waiting state, so we prepare processing and then notify worker thread
-                        if(lock){
-                            buffer2process = BUFFER0;
-                        }
-                        // if we were unable to lock the mutex, we write data into the same buffer again, therefore losing samples
-                        else{
-                            DBG_RB(n_worker_not_done++;)
-                            buffer2process = NO_BUFFER;
-                        }
-                    }
-                    m_condition.notify_all();
-                }
+                advance(dev, n_samples_usable);
             }
             break;
 
             case DROP_SAMPLES:
             {
-                unsigned int n_residual_samples = n_new_samples - n_consumed_samples;
+                unsigned long long n_residual_samples = n_new_samples - n_consumed_samples;
 
                 n_consumed_samples += n_residual_samples;
             }
@@ -174,6 +573,63 @@ void feed_new_ch_measurement(const std::vector<std::vector<char>> &buffs01, cons
     }
 }
 
+static void feed_gap(device_state_t &dev, const gap_t &gap){
+
+    if(dev.d_STATE != COLLECT_CHANNEL_MEASUREMENT)
+        return;
+
+    // zero filled, a gap reaching past the end of the measurement only counts with the samples the file would have contained
+    unsigned long long gap_length = gap.length;
+    if(zero_fill)
+        gap_length = std::min(gap_length, get_measurement_length() - std::min(dev.n_state, get_measurement_length()));
+    {
+        boost::mutex::scoped_lock lock_devices(m_mutex_devices);
+        gap_t gap_file = {dev.n_state, gap_length, gap.source, gap.device};
+        gaps_measurement.push_back(gap_file);
+        DBG_RB(n_gaps_total++;)
+        DBG_RB(n_samples_missing_total += gap_file.length;)
+    }
+
+    // keep samples aligned with time by inserting zeros for the missing samples
+    if(zero_fill){
+        unsigned long long n_zeros_left = gap.length;
+        while(n_zeros_left > 0 && dev.d_STATE == COLLECT_CHANNEL_MEASUREMENT){
+            if(dev.n_state >= get_measurement_length()){
+                complete_measurement(dev);
+                break;
+            }
+            unsigned long long n_zeros = std::min(get_n_samples_storable(dev), n_zeros_left);
+
+            for(size_t ch = 0; ch < dev.n_channels; ch++)
+                dev.destinations[ch] = get_destination(dev, ch);
+            dev.kernel.zero(dev.destinations.data(), dev.n_channels, n_zeros);
+
+            n_zeros_left -= n_zeros;
+            advance(dev, n_zeros);
+        }
+    }
+}
+
+void feed_new_ch_measurement(const size_t device, const std::vector<std::vector<char>> &buffs01, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    DBG_RB(n_samples_total += n_new_samples;)
+
+    device_state_t &dev = devices[device];
+
+    // samples between gaps are copied, gaps are recorded and optionally zero filled
+    unsigned long long n_consumed_samples = 0;
+    for(size_t i = 0; i < gaps.size(); i++){
+        unsigned long long gap_offset = std::min(gaps[i].offset, n_new_samples);
+        if(gap_offset > n_consumed_samples){
+            feed_samples(dev, buffs01, n_consumed_samples, gap_offset - n_consumed_samples);
+            n_consumed_samples = gap_offset;
+        }
+        feed_gap(dev, gaps[i]);
+    }
+
+    if(n_new_samples > n_consumed_samples)
+        feed_samples(dev, buffs01, n_consumed_samples, n_new_samples - n_consumed_samples);
+}
+
 void send_save_ch_measurements(std::atomic<bool>& burst_timer_elapsed){
 
     while(1){
@@ -192,27 +648,45 @@ void send_save_ch_measurements(std::atomic<bool>& burst_timer_elapsed){
 
             DBG_RB(n_worker_executed++;)
 
-            // create, save and close file
-            std::ostringstream ss;
-            ss << std::setw(10) << std::setfill('0') << n_measurement_saved << "_";
-            ss << std::setw(10) << std::setfill('0') << FILE_ID << "_";
-            ss << std::setw(20) << std::setfill('0') << current_time_since_epoch_microseconds;
+            // when streaming, most of the measurement is on disk already and only the files have to be closed
+            const bool streaming = (stream_chunk_samples > 0);
+            std::string file_name = streaming ? file_name_measurement : get_file_name();
+            std::string folder_path = get_writer_primary_directory();
+            std::string full_file_path;
+
+            // only the time the writer was busy with the measurement counts, when streaming it waits for the samples most of the time
+            const double busy_sec_start = streaming ? busy_sec_start_measurement : get_writer_busy_sec();
+            bool success = true;
+            if(gaps_measurement.size() > 0){
+                // devices report their gaps independently
+                std::stable_sort(gaps_measurement.begin(), gaps_measurement.end(), [](const gap_t &a, const gap_t &b){return a.offset < b.offset;});
+                std::string full_file_path_gaps = folder_path + file_name + ".gaps";
+                success = write_gap_index(full_file_path_gaps);
+            }
+            if(streaming){
+                success = end_measurement_writer(full_file_path) && success;
+                measurement_open = false;
+            }
+            else{
+                success = success && write_measurement(file_name, buffs0, full_file_path, CH_MEASUREMENT_LENGTH_IN_SAMPLES, n_bytes_per_item);
+            }
+            const double write_duration_sec = get_writer_busy_sec() - busy_sec_start;
 
-            std::string str_n_measurement_saved = ss.str();
-            std::string folder_path = SAVE_PATH;
-            std::string file_name = "iqrecord_";
-            std::string full_file_path = folder_path + file_name + str_n_measurement_saved + ".bin";
-            n_measurement_saved++;
-            std::ofstream fout(full_file_path, std::ios::out | std::ios::binary);
+            double n_bytes = (double) (n_channels*CH_MEASUREMENT_LENGTH_IN_SAMPLES*n_bytes_per_item);
+            double write_throughput_MBps = n_bytes/1.0e6/std::max(write_duration_sec, 1.0e-9);
+            write_throughput_sum_MBps += write_throughput_MBps;
+            if(!success)
+                n_measurement_failed++;
 
-            // write data from buffer
-            for(size_t ch = 0; ch < n_channels; ch++)
-                fout.write((char*)&buffs0[ch][0], buffs0[ch].size()*sizeof(buffs0[ch][0]));
+            send_completion_message(success ? full_file_path : std::string(""), write_throughput_MBps);
 
-            fout.close();
+            // the time is stored first, readers see it together with the new count
+            finished_time_epoch_sec = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+            n_measurement_finished++;
 
             // we are done, make sure we enter wait loop
             buffer2process = NO_BUFFER;
+            m_condition_saved.notify_all();
     }
 }
 
@@ -220,10 +694,17 @@ void show_debug_information_fifo(){
     std::cout << "--------------------------" << std::endl;
     std::cout << "fifo_measurement" << std::endl;
     std::cout << "n_measurement_saved: " << n_measurement_saved << std::endl;
+    std::cout << "n_measurement_failed: " << n_measurement_failed << std::endl;
+    if(n_measurement_saved > 0)
+        std::cout << "write_throughput_mean_MBps: " << write_throughput_sum_MBps/n_measurement_saved << std::endl;
     std::cout << "n_samples_total: " << n_samples_total << std::endl;
-    std::cout << "n_worker_not_done: " << n_worker_not_done << std::endl;
     std::cout << "n_worker_wait: " << n_worker_wait << std::endl;
     std::cout << "n_worker_executed: " << n_worker_executed << std::endl;
+    std::cout << "n_gaps_total: " << n_gaps_total << std::endl;
+    std::cout << "n_samples_missing_total: " << n_samples_missing_total << std::endl;
+    std::cout << "n_measurement_aborted: " << n_measurement_aborted << std::endl;
+    std::cout << "n_chunk_waits: " << n_chunk_waits << std::endl;
+    std::cout << "n_chunk_waits_device: " << n_chunk_waits_device << std::endl;
     std::cout << "--------------------------" << std::endl;
 }
 }
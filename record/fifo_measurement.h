@@ -19,27 +19,39 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CHANNELSOUNDER_FIFO_CH_MEASUREMENT_H
 
 #include <vector>
+#include <string>
 #include <atomic>
 
+#include "gap.h"
+
 namespace channelsounder
 {
 /*!
  * Inits unit internally. Must be called first.
+ * Each device feeds its own channels, the channels of all devices are saved in the order of the devices.
  *
- * num_channels_arg             in our case this is the number of rx antennas
+ * n_channels_per_device        number of rx antennas of each device
  * num_bytes_per_item_arg       one item is one complex sample with real and imag, e.g. with data type "float" it is num_bytes_per_item_arg=8
- * samp_rate_arg                sampling rate for each rx channel in Samples/s
+ * zero_fill_arg                if true, missing samples are replaced by zeros so that each sample keeps its position in time
+ * stream_chunk_bytes           if larger than 0, samples are handed to the writer in chunks of this size per channel while the measurement is running,
+ *                              otherwise the whole measurement is kept in memory and written when it is complete
+ * stream_budget_bytes          memory for chunks not written yet, feeding blocks when it is used up, at least two chunks are allocated
+ * sample_rate_arg              sample rate of the saved samples in samples per second, sent with the completion message
  * return                       1 on success and 0 on failure
 */
-int init_fifo_ch_measurement(const size_t n_channels_arg, const size_t n_bytes_per_item_arg);
+int init_fifo_ch_measurement(const std::vector<size_t>& n_channels_per_device, const size_t n_bytes_per_item_arg, const bool zero_fill_arg, const size_t stream_chunk_bytes, const size_t stream_budget_bytes,
+                             const double sample_rate_arg);
 
 /*!
  * Resets unit internally. Must be called when a new file is supposed to be recorded.
+ * Blocks until the previous measurement has been saved.
  *
  * n_samples                    number of samples we record and save, all samples after this are ignored
+ * file_id                      id written into the file name
+ * file_tag                     appended to the file name if not empty, e.g. to mark the dwell of a scan schedule
  * return                       1 on success and 0 on failure
 */
-int reset_fifo_ch_measurement(const unsigned int n_samples, const unsigned int file_id);
+int reset_fifo_ch_measurement(const unsigned long long n_samples, const unsigned int file_id, const std::string& file_tag);
 
 /*!
  * Saves current time. Can be called anytime
@@ -49,17 +61,72 @@ int reset_fifo_ch_measurement(const unsigned int n_samples, const unsigned int f
 */
 void current_time(const unsigned int offset_microseconds);
 
+/*!
+ * Sets the receiver of the completion message sent after a file has been written. Takes effect with the next reset.
+ *
+ * address                      ip address of the receiver, usually the sender of the udp command
+ * port                         udp port of the receiver, 0 disables the message
+*/
+void set_notification_receiver(const std::string& address, const unsigned short port);
+
+/*!
+ * Called by the rx thread with the uhd timestamp of the first sample of the current measurement.
+*/
+void report_start_time(const double uhd_time_sec);
+
+/*!
+ * Called by the rx thread with the number of packets counted during the current measurement, sent with the completion message.
+ * Can be called repeatedly, the last value before the message is sent. -1 if the packets are not counted, the default after each reset.
+*/
+void report_packets(const long long n_packets);
+
+/*!
+ * Called by the rx thread to end the current measurement before all requested samples are collected, e.g. once enough packets were detected.
+ * The measurement is saved with n_samples samples per channel, the completion message reports this number. n_samples must not be smaller than
+ * the samples any device has stored so far, the samples received so far are a safe choice. Measurements streamed to disk cannot be stopped early,
+ * their layout depends on the requested length, the call is ignored for them.
+ *
+ * n_samples                    number of samples per channel the measurement ends with
+*/
+void stop_fifo_ch_measurement(const unsigned long long n_samples);
+
+/*!
+ * Called by the rx thread to check if all samples of the current measurement have been collected.
+ * The measurement might still be written to disk.
+*/
+bool is_complete_fifo_ch_measurement();
+
+/*!
+ * Number of measurements the save thread has finished since init, saved or failed. Can be called anytime.
+ *
+ * time_epoch_sec               time the last of them finished in seconds since the epoch
+ * return                       number of finished measurements
+*/
+unsigned long long get_finished_fifo_ch_measurement(double& time_epoch_sec);
+
+/*!
+ * Called by the rx thread when a measurement stopped before it was complete, e.g. after an abort.
+ * Releases devices that wait for a slower device, they drop their remaining samples. The measurement is removed with the next reset.
+*/
+void cancel_fifo_ch_measurement();
+
 /*!
  * Feed buffered samples. Size of single samples is known after initialization.
+ * Gaps are written to the gap index of the measurement, with zero fill the missing samples are replaced by zeros.
+ * Can be called concurrently for different devices. When streaming, a device blocks if it is more chunks ahead of the slowest device than the in-flight budget allows.
  *
+ * device                       index of the device, the caller is the processing thread of its ringbuffer
  * buffs01                      vector of pointer to samples of individual channels
  * n_new_samples                number of new samples in buffer, buffer is guaranteed to be large enough
+ * gaps                         gaps within the new samples, sorted by offset
 */
-void feed_new_ch_measurement(const std::vector<std::vector<char>> &buffs01, const unsigned long long n_new_samples);
+void feed_new_ch_measurement(const size_t device, const std::vector<std::vector<char>> &buffs01, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
 
 /*!
  * Must be started in additional thread, processes unused half of fifo.
- * Saves measurements in binary file in ../data.
+ * Saves measurements with the writer (see writer.h), by default as binary file in ../data.
+ * If samples are missing, a gap index with the same name and the extension .gaps is written before.
+ * Afterwards a completion message is sent to the receiver set with set_notification_receiver().
  * Must process faster than it takes to fill one fifo half, otherwise measurements are dropped.
  *
  * burst_timer_elapsed          when set to true, the thread has to finish
@@ -0,0 +1,49 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_GAP_H
+#define CHANNELSOUNDER_GAP_H
+
+#include <cstddef>
+
+namespace channelsounder
+{
+/*!
+ * Where samples got lost.
+*/
+enum gap_source_t{
+    GAP_SOURCE_UHD = 0,             // overflow or sequence error, detected by a jump of md.time_spec
+    GAP_SOURCE_RINGBUFFER = 1,      // processing thread was too slow, ringbuffer overwrote a full buffer
+    GAP_SOURCE_SINK = 2             // a sink that may drop blocks skipped them, never passed to the fifo
+};
+
+/*!
+ * Samples missing in a stream of samples.
+ *
+ * offset                       index of the first sample after the gap, relative to the buffer or file the gap belongs to
+ * length                       number of missing samples per channel
+ * device                       index of the device whose channels miss the samples
+*/
+struct gap_t{
+    unsigned long long offset;
+    unsigned long long length;
+    gap_source_t source;
+    size_t device;
+};
+}
+
+#endif
@@ -0,0 +1,501 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "iqrecord_reader.h"
+
+namespace channelsounder
+{
+struct mapped_file_t{
+    std::string path;
+    const char* data;
+    size_t size;
+    const char* map;                    // start of the mapping, data might lie behind it
+    size_t map_size;
+};
+
+struct record_gap_t{
+    unsigned long long offset;
+    unsigned long long length;
+    size_t device;
+};
+
+static thread_local std::string last_error;
+
+static iqrecord_t* fail(const std::string& error){
+    last_error = error;
+    return NULL;
+}
+
+static bool is_valid_sample_size(const size_t bytes_per_sample){
+    return bytes_per_sample == 16 || bytes_per_sample == 8 || bytes_per_sample == 4 || bytes_per_sample == 2;
+}
+
+// Maps n_bytes from offset on read-only, by default the whole file. An empty range has no mapping.
+static bool map_file(const std::string& path, mapped_file_t& file, const unsigned long long offset = 0, const unsigned long long n_bytes = ULLONG_MAX){
+    file.path = path;
+    file.data = NULL;
+    file.size = 0;
+    file.map = NULL;
+    file.map_size = 0;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || offset > (unsigned long long) st.st_size){
+        close(fd);
+        return false;
+    }
+    file.size = (size_t) std::min(n_bytes, (unsigned long long) st.st_size - offset);
+    if(file.size > 0){
+        // the mapping has to start at a page boundary
+        const unsigned long long map_offset = offset/sysconf(_SC_PAGESIZE)*sysconf(_SC_PAGESIZE);
+        file.map_size = (size_t) (offset - map_offset) + file.size;
+        void* map = mmap(NULL, file.map_size, PROT_READ, MAP_SHARED, fd, (off_t) map_offset);
+        if(map == MAP_FAILED){
+            close(fd);
+            return false;
+        }
+        file.map = static_cast<const char*>(map);
+        file.data = file.map + (offset - map_offset);
+    }
+    close(fd);
+    return true;
+}
+
+// path without the extension of the file name
+static std::string strip_extension(const std::string& path){
+    const size_t slash = path.find_last_of('/');
+    const size_t dot = path.find_last_of('.');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path;
+    return path.substr(0, dot);
+}
+
+static std::string get_base_name(const std::string& path){
+    const std::string path_stripped = strip_extension(path);
+    const size_t slash = path_stripped.find_last_of('/');
+    return (slash == std::string::npos) ? path_stripped : path_stripped.substr(slash + 1);
+}
+
+static bool ends_with(const std::string& s, const std::string& suffix){
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool parse_number(const std::string& s, unsigned long long& value){
+    if(s.size() == 0 || s.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    value = std::strtoull(s.c_str(), NULL, 10);
+    return true;
+}
+}
+
+using namespace channelsounder;
+
+struct iqrecord_s{
+    std::string layout;
+    size_t n_channels;
+    unsigned long long n_samples;                       // per channel
+    size_t bytes_per_sample;
+    double sample_rate;
+    unsigned long long stripe_bytes;
+    std::vector<mapped_file_t> files;
+    iqrecord_name_t name;
+    bool zero_fill;
+    std::vector<record_gap_t> gaps;
+};
+
+namespace channelsounder
+{
+// manifest written by the writer, see writer.cpp
+static bool read_manifest(const std::string& path, iqrecord_t& record, std::vector<std::string>& file_paths){
+    std::ifstream fin(path);
+    if(!fin.is_open())
+        return false;
+
+    size_t n_files = 0;
+    std::string line;
+    while(std::getline(fin, line)){
+        if(line.size() == 0 || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        std::string key;
+        ss >> key;
+        if(key == "layout")
+            ss >> record.layout;
+        else if(key == "n_channels")
+            ss >> record.n_channels;
+        else if(key == "n_samples")
+            ss >> record.n_samples;
+        else if(key == "bytes_per_sample")
+            ss >> record.bytes_per_sample;
+        else if(key == "sample_rate")
+            ss >> record.sample_rate;
+        else if(key == "stripe_bytes")
+            ss >> record.stripe_bytes;
+        else if(key == "n_files"){
+            ss >> n_files;
+            file_paths.resize(n_files);
+        }
+        else if(key == "file"){
+            size_t i = 0;
+            std::string file_path;
+            ss >> i;
+            std::getline(ss >> std::ws, file_path);
+            if(i >= file_paths.size())
+                return false;
+            file_paths[i] = file_path;
+        }
+    }
+    return n_files > 0;
+}
+
+// entry of a measurement in the index of an archive segment, see writer.h
+static bool read_archive_entry(const std::string& path, const std::string& file_name, iqrecord_t& record, std::string& segment_path, unsigned long long& offset){
+    std::ifstream fin(path);
+    if(!fin.is_open())
+        return false;
+
+    std::string line;
+    while(std::getline(fin, line)){
+        std::istringstream ss(line);
+        std::string key;
+        ss >> key;
+        if(key == "segment"){
+            std::getline(ss >> std::ws, segment_path);
+        }
+        else if(key == "entry"){
+            std::string name;
+            ss >> name;
+            if(name == file_name && ss >> offset >> record.n_channels >> record.n_samples >> record.bytes_per_sample >> record.sample_rate)
+                return segment_path.size() > 0;
+        }
+    }
+    return false;
+}
+
+// gap index written by the fifo, see fifo_measurement.cpp
+static void read_gap_index(const std::string& path, iqrecord_t& record){
+    std::ifstream fin(path);
+    if(!fin.is_open())
+        return;
+
+    std::string line;
+    while(std::getline(fin, line)){
+        if(line.compare(0, 12, "# zero_fill ") == 0){
+            record.zero_fill = (std::atoi(line.c_str() + 12) != 0);
+            continue;
+        }
+        if(line.size() == 0 || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        record_gap_t gap;
+        std::string source;
+        if(ss >> gap.offset >> gap.length >> source >> gap.device)
+            record.gaps.push_back(gap);
+    }
+}
+
+// file and byte offset of a sample, and the number of bytes from there on that are contiguous in the file and belong to the channel
+static const char* locate(const iqrecord_t& record, const size_t channel, const unsigned long long sample, unsigned long long& n_bytes_contiguous){
+    const unsigned long long bps = record.bytes_per_sample;
+    const unsigned long long n_bytes_channel_left = (record.n_samples - sample)*bps;
+    size_t file_index = 0;
+    unsigned long long file_offset = 0;
+
+    if(record.layout == "channel"){
+        file_index = channel;
+        file_offset = sample*bps;
+        n_bytes_contiguous = n_bytes_channel_left;
+    }
+    else if(record.layout == "stripes"){
+        const unsigned long long offset = (channel*record.n_samples + sample)*bps;
+        const unsigned long long stripe = offset/record.stripe_bytes;
+        const unsigned long long offset_in_stripe = offset % record.stripe_bytes;
+        file_index = (size_t) (stripe % record.files.size());
+        file_offset = (stripe/record.files.size())*record.stripe_bytes + offset_in_stripe;
+        n_bytes_contiguous = std::min(n_bytes_channel_left, record.stripe_bytes - offset_in_stripe);
+    }
+    else{
+        file_offset = (channel*record.n_samples + sample)*bps;
+        n_bytes_contiguous = n_bytes_channel_left;
+    }
+
+    const mapped_file_t& file = record.files[file_index];
+    if(file_offset >= file.size){
+        n_bytes_contiguous = 0;
+        return NULL;
+    }
+    n_bytes_contiguous = std::min<unsigned long long>(n_bytes_contiguous, file.size - file_offset);
+    return file.data + file_offset;
+}
+
+// the pages of a window are read from disk at once instead of one page fault at a time
+static void prefetch(const char* data, const unsigned long long n_bytes){
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+    madvise(reinterpret_cast<void*>(start), (size_t) (reinterpret_cast<uintptr_t>(data) + n_bytes - start), MADV_WILLNEED);
+}
+
+// calls process(data, n) for each contiguous piece of the samples, returns the number of samples passed
+template <typename F>
+static unsigned long long for_each_piece(const iqrecord_t& record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples, F process){
+    if(channel >= record.n_channels || offset >= record.n_samples)
+        return 0;
+    const unsigned long long n_wanted = std::min(n_samples, record.n_samples - offset);
+
+    unsigned long long n_done = 0;
+    while(n_done < n_wanted){
+        unsigned long long n_bytes_contiguous = 0;
+        const char* data = locate(record, channel, offset + n_done, n_bytes_contiguous);
+        const unsigned long long n = std::min(n_wanted - n_done, n_bytes_contiguous/record.bytes_per_sample);
+        if(data == NULL || n == 0)
+            break;
+        prefetch(data, n*record.bytes_per_sample);
+        process(data, n_done, n);
+        n_done += n;
+    }
+    return n_done;
+}
+
+template <typename T>
+static void convert(const char* in, float* out, const unsigned long long n, const float scale){
+    const T* x = reinterpret_cast<const T*>(in);
+    for(unsigned long long k = 0; k < 2*n; k++)
+        out[k] = (float) x[k]*scale;
+}
+}
+
+extern "C" {
+
+int iqrecord_parse_name(const char* file_name, iqrecord_name_t* name){
+    // an entry of the archive is named after the '#'
+    const char* hash = std::strrchr(file_name, '#');
+    const std::string base_name = get_base_name((hash != NULL) ? hash + 1 : file_name);
+    if(base_name.compare(0, 9, "iqrecord_") != 0)
+        return 0;
+
+    // index, file id, time and an optional tag that can contain '_' itself
+    std::vector<std::string> parts;
+    size_t start = 9;
+    for(size_t i = 0; i < 3; i++){
+        const size_t end = base_name.find('_', start);
+        parts.push_back(base_name.substr(start, (end == std::string::npos) ? std::string::npos : end - start));
+        start = (end == std::string::npos) ? base_name.size() : end + 1;
+    }
+    const std::string tag = (start < base_name.size()) ? base_name.substr(start) : std::string("");
+
+    unsigned long long index = 0, file_id = 0, time_us = 0;
+    if(!parse_number(parts[0], index) || !parse_number(parts[1], file_id) || !parse_number(parts[2], time_us))
+        return 0;
+    name->index = index;
+    name->file_id = (unsigned int) file_id;
+    name->time_us = time_us;
+    std::strncpy(name->tag, tag.c_str(), sizeof(name->tag) - 1);
+    name->tag[sizeof(name->tag) - 1] = '\0';
+    return 1;
+}
+
+iqrecord_t* iqrecord_open(const char* path, const size_t n_channels, const size_t bytes_per_sample){
+    const std::string path_str(path);
+    iqrecord_t* record = new iqrecord_t();
+    record->layout = "single";
+    record->n_channels = n_channels;
+    record->n_samples = 0;
+    record->bytes_per_sample = bytes_per_sample;
+    record->sample_rate = 0.0;
+    record->stripe_bytes = 0;
+    record->zero_fill = false;
+    std::memset(&record->name, 0, sizeof(record->name));
+    iqrecord_parse_name(path, &record->name);
+
+    // the gap index is next to the file or the manifest, for the archive next to the index of the segment
+    std::string gap_index_path = strip_extension(path_str) + ".gaps";
+
+    std::vector<std::string> file_paths;
+    std::string error;
+    const size_t hash = path_str.find('#');
+    if(hash != std::string::npos){
+        const std::string index_path = path_str.substr(0, hash);
+        const std::string file_name = path_str.substr(hash + 1);
+        std::string segment_path;
+        unsigned long long offset = 0;
+        record->layout = "archive";
+        const size_t slash = index_path.find_last_of('/');
+        gap_index_path = ((slash == std::string::npos) ? std::string("") : index_path.substr(0, slash + 1)) + file_name + ".gaps";
+        if(!read_archive_entry(index_path, file_name, *record, segment_path, offset))
+            error = "no entry " + file_name + " in archive index " + index_path;
+        else if(record->n_channels == 0 || !is_valid_sample_size(record->bytes_per_sample))
+            error = "inconsistent entry " + file_name + " in archive index " + index_path;
+        else{
+            mapped_file_t file;
+            if(!map_file(segment_path, file, offset, (unsigned long long) record->n_channels*record->n_samples*record->bytes_per_sample))
+                error = "unable to map " + segment_path;
+            record->files.push_back(file);
+        }
+    }
+    else if(ends_with(path_str, ".manifest")){
+        if(!read_manifest(path_str, *record, file_paths))
+            error = "unable to read manifest " + path_str;
+        else if((record->layout == "channel" && file_paths.size() != record->n_channels) || (record->layout == "stripes" && record->stripe_bytes == 0))
+            error = "inconsistent manifest " + path_str;
+        else if(record->layout != "channel" && record->layout != "stripes")
+            error = "unknown layout " + record->layout + " in " + path_str;
+    }
+    else{
+        file_paths.push_back(path_str);
+    }
+    if(error.size() == 0 && (record->n_channels == 0 || !is_valid_sample_size(record->bytes_per_sample)))
+        error = "number of channels and sample size of 16, 8, 4 or 2 bytes needed for " + path_str;
+
+    for(size_t i = 0; i < file_paths.size() && error.size() == 0; i++){
+        mapped_file_t file;
+        if(!map_file(file_paths[i], file))
+            error = "unable to map " + file_paths[i];
+        record->files.push_back(file);
+    }
+
+    // a single file holds all channels one after the other
+    if(error.size() == 0 && record->layout == "single"){
+        const unsigned long long n_bytes_per_column = (unsigned long long) record->n_channels*record->bytes_per_sample;
+        if(record->files[0].size % n_bytes_per_column != 0)
+            error = "size of " + path_str + " is not a multiple of the channels and the sample size";
+        record->n_samples = record->files[0].size/n_bytes_per_column;
+    }
+
+    if(error.size() > 0){
+        iqrecord_close(record);
+        return fail(error);
+    }
+
+    read_gap_index(gap_index_path, *record);
+    return record;
+}
+
+void iqrecord_close(iqrecord_t* record){
+    if(record == NULL)
+        return;
+    for(size_t i = 0; i < record->files.size(); i++){
+        if(record->files[i].map != NULL)
+            munmap(const_cast<char*>(record->files[i].map), record->files[i].map_size);
+    }
+    delete record;
+}
+
+const char* iqrecord_last_error(void){
+    return last_error.c_str();
+}
+
+size_t iqrecord_n_channels(const iqrecord_t* record){
+    return record->n_channels;
+}
+
+unsigned long long iqrecord_n_samples(const iqrecord_t* record){
+    return record->n_samples;
+}
+
+size_t iqrecord_bytes_per_sample(const iqrecord_t* record){
+    return record->bytes_per_sample;
+}
+
+double iqrecord_sample_rate(const iqrecord_t* record){
+    return record->sample_rate;
+}
+
+const char* iqrecord_layout(const iqrecord_t* record){
+    return record->layout.c_str();
+}
+
+const iqrecord_name_t* iqrecord_name(const iqrecord_t* record){
+    return &record->name;
+}
+
+size_t iqrecord_n_gaps(const iqrecord_t* record){
+    return record->gaps.size();
+}
+
+int iqrecord_zero_fill(const iqrecord_t* record){
+    return record->zero_fill ? 1 : 0;
+}
+
+int iqrecord_gap(const iqrecord_t* record, const size_t i, unsigned long long* offset, unsigned long long* length, size_t* device){
+    if(i >= record->gaps.size())
+        return 0;
+    *offset = record->gaps[i].offset;
+    *length = record->gaps[i].length;
+    *device = record->gaps[i].device;
+    return 1;
+}
+
+const void* iqrecord_view(const iqrecord_t* record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples){
+    if(channel >= record->n_channels || offset >= record->n_samples || n_samples > record->n_samples - offset){
+        last_error = "samples out of range";
+        return NULL;
+    }
+    unsigned long long n_bytes_contiguous = 0;
+    const char* data = locate(*record, channel, offset, n_bytes_contiguous);
+    if(data == NULL || n_bytes_contiguous < n_samples*record->bytes_per_sample){
+        last_error = "samples are not contiguous in one file";
+        return NULL;
+    }
+    prefetch(data, n_samples*record->bytes_per_sample);
+    return data;
+}
+
+unsigned long long iqrecord_read(const iqrecord_t* record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples, void* out){
+    const size_t bps = record->bytes_per_sample;
+    char* dst = static_cast<char*>(out);
+    return for_each_piece(*record, channel, offset, n_samples, [&](const char* data, const unsigned long long n_done, const unsigned long long n){
+        std::memcpy(dst + n_done*bps, data, n*bps);
+    });
+}
+
+unsigned long long iqrecord_read_fc32(const iqrecord_t* record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples, float* out){
+    const size_t bps = record->bytes_per_sample;
+    return for_each_piece(*record, channel, offset, n_samples, [&](const char* data, const unsigned long long n_done, const unsigned long long n){
+        float* dst = out + 2*n_done;
+        switch(bps){
+            case 16:
+                convert<double>(data, dst, n, 1.0f);
+                break;
+            case 8:
+                std::memcpy(dst, data, n*bps);
+                break;
+            case 4:
+                convert<int16_t>(data, dst, n, 1.0f/32768.0f);
+                break;
+            default:
+                convert<int8_t>(data, dst, n, 1.0f/128.0f);
+                break;
+        }
+    });
+}
+
+}
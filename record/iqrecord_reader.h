@@ -0,0 +1,135 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_IQRECORD_READER_H
+#define CHANNELSOUNDER_IQRECORD_READER_H
+
+#include <stddef.h>
+
+/*
+ * Reader of the measurements written by the recorder, built as the shared library libiqrecord without UHD or Boost.
+ * The interface is plain C, so it can be used from C, C++ and e.g. Python with ctypes (see python/iqrecord.py).
+ *
+ * A measurement is either a single file iqrecord_<index>_<file id>_<time>[_<tag>].bin with all channels concatenated, or for the layouts
+ * channel and stripes a manifest with the same name and the extension .manifest listing its files (see writer.h). A single file has no
+ * header, its number of channels and its sample size must be known. The gap index <name>.gaps next to it is read if it exists.
+ * A measurement in the rolling archive is addressed as <path of the segment index>#<file name>, its gap index is next to the segment index.
+ *
+ * All files are mapped read-only, nothing is read until samples are accessed, so windows of files larger than the memory are cheap.
+ * A handle can be used by several threads at once, only open and close must not run concurrently with other calls.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct iqrecord_s iqrecord_t;
+
+/*!
+ * Parts of the file name of a measurement.
+*/
+typedef struct{
+    unsigned long long index;           // measurements saved by the recorder before this one
+    unsigned int file_id;               // id of the measurement command
+    unsigned long long time_us;         // host time of the start in microseconds since the epoch
+    char tag[64];                       // e.g. the dwell of a scan schedule, empty if there is none
+}iqrecord_name_t;
+
+/*!
+ * Splits a file name, with or without directory and extension, into its parts. For an entry of the archive the part after '#' is used.
+ *
+ * file_name                    name of the file
+ * name                         parts of the name
+ * return                       1 on success and 0 if it is not the name of a measurement
+*/
+int iqrecord_parse_name(const char* file_name, iqrecord_name_t* name);
+
+/*!
+ * Opens a measurement, either a .bin file, a .manifest or an entry of the archive.
+ *
+ * path                         path of the file
+ * n_channels                   number of channels of a .bin file, not used for a manifest or the archive
+ * bytes_per_sample             size of a complex sample of a .bin file, 16 (fc64), 8 (fc32), 4 (sc16) or 2 (sc8), not used for a manifest or the archive
+ * return                       handle or NULL on failure, see iqrecord_last_error()
+*/
+iqrecord_t* iqrecord_open(const char* path, const size_t n_channels, const size_t bytes_per_sample);
+
+/*!
+ * Unmaps all files of the measurement. Views into it must not be used afterwards.
+*/
+void iqrecord_close(iqrecord_t* record);
+
+/*!
+ * Reason the last call of this thread failed.
+*/
+const char* iqrecord_last_error(void);
+
+/*!
+ * Properties of an open measurement. The sample rate is 0 if it is not known, i.e. for a single file.
+ * The layout is single, channel, stripes or archive.
+*/
+size_t iqrecord_n_channels(const iqrecord_t* record);
+unsigned long long iqrecord_n_samples(const iqrecord_t* record);
+size_t iqrecord_bytes_per_sample(const iqrecord_t* record);
+double iqrecord_sample_rate(const iqrecord_t* record);
+const char* iqrecord_layout(const iqrecord_t* record);
+const iqrecord_name_t* iqrecord_name(const iqrecord_t* record);
+
+/*!
+ * Gaps of the measurement from its gap index, sorted by offset. Missing samples are zeros with zero fill, otherwise the samples after a
+ * gap move forward by its length.
+ *
+ * i                            index of the gap
+ * offset                       sample of the file the gap is at
+ * length                       number of missing samples
+ * device                       device the gap belongs to
+ * return                       1 on success and 0 if there is no gap i
+*/
+size_t iqrecord_n_gaps(const iqrecord_t* record);
+int iqrecord_zero_fill(const iqrecord_t* record);
+int iqrecord_gap(const iqrecord_t* record, const size_t i, unsigned long long* offset, unsigned long long* length, size_t* device);
+
+/*!
+ * Zero-copy view of samples of one channel, as stored in the file. Valid until the measurement is closed.
+ * Fails if the samples are not contiguous, i.e. if they cross a stripe boundary, use iqrecord_read() then.
+ *
+ * channel                      channel of the measurement
+ * offset                       first sample
+ * n_samples                    number of samples
+ * return                       pointer to the first sample or NULL on failure
+*/
+const void* iqrecord_view(const iqrecord_t* record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples);
+
+/*!
+ * Copies samples of one channel as stored in the file, works for all layouts.
+ *
+ * out                          at least n_samples*bytes_per_sample bytes
+ * return                       number of samples copied, less than n_samples at the end of the measurement
+*/
+unsigned long long iqrecord_read(const iqrecord_t* record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples, void* out);
+
+/*!
+ * Copies samples of one channel converted to fc32, sc16 and sc8 scaled to full scale 1 as by the spectra and the packet filter.
+ *
+ * out                          at least 2*n_samples floats, real and imag interleaved
+ * return                       number of samples copied, less than n_samples at the end of the measurement
+*/
+unsigned long long iqrecord_read_fc32(const iqrecord_t* record, const size_t channel, const unsigned long long offset, const unsigned long long n_samples, float* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
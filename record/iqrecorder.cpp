@@ -18,7 +18,11 @@
 #include <chrono>
 #include <complex>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
 // ##########################
@@ -31,8 +35,19 @@
 //  simple c++ example:         https://kb.ettus.com/Getting_Started_with_UHD_and_C%2B%2B
 //  c++ functions:              https://files.ettus.com/manual/classuhd_1_1usrp_1_1multi__usrp.html#a72b7947cb0c434b98e9915f91b8f8fe0
 
+#include "config.h"
 #include "ringbuffer_rx.h"
+#include "rx_align.h"
 #include "fifo_measurement.h"
+#include "scan_schedule.h"
+#include "control_plane.h"
+#include "writer.h"
+#include "thread_placement.h"
+#include "ddc.h"
+#include "psd.h"
+#include "preview.h"
+#include "trigger.h"
+#include "packet_filter.h"
 
  // these are all UHD parameters that are not set in the cmd line args
 #define CS_RX_FREQ  1000e6      // default value set a startup
@@ -47,6 +62,8 @@ namespace po = boost::program_options;
 
 namespace {
 constexpr int64_t CLOCK_TIMEOUT = 1000; // 1000mS timeout for external clock locking
+constexpr unsigned long long MAX_ADDITIONAL_SAMPLES_PER_MEASUREMENT = 10000000; // streamed on top of twice the measurement length before giving up
+constexpr unsigned int MAX_CONSECUTIVE_TIMEOUTS = 3;
 } // namespace
 
 /***********************************************************************
@@ -63,6 +80,12 @@ unsigned long long num_late_commands = 0;
 unsigned long long num_timeouts_rx   = 0;
 unsigned long long num_timeouts_tx   = 0;
 
+// per device, sized in main
+std::vector<unsigned long long> num_rx_samps_device;
+std::vector<unsigned long long> num_dropped_samps_device;
+std::vector<unsigned long long> num_overruns_device;
+std::vector<unsigned long long> num_trimmed_samps_device;
+
 inline boost::posix_time::time_duration time_delta(
     const boost::posix_time::ptime& ref_time)
 {
@@ -77,17 +100,485 @@ inline std::string time_delta_str(const boost::posix_time::ptime& ref_time)
 #define NOW() (time_delta_str(start_time))
 
 
+/***********************************************************************
+ * Single capture
+ **********************************************************************/
+// Streamers of all devices. With --streamer_per_device each motherboard is one device with its own streamer, receive thread,
+// ringbuffer and processing thread, otherwise all channels form a single device.
+struct rx_devices_t{
+    std::vector<uhd::rx_streamer::sptr> rx_streams;
+    size_t n_bytes_per_item;                    // size of one complex sample on the host
+    bool elevate_priority;
+    bool save_iq;                               // false if the samples are only analysed by the psd
+    bool trigger;                               // measurements are started by the trigger, see trigger.h
+    unsigned int capture_packets;               // a measurement ends once the packet filter kept this many packets, 0 disables
+    bool random_nsamps;                         // recv() is called with random sizes to stress the pipeline
+    std::vector<size_t> first_channels;         // first rx channel of each device, its frequency is reported with the spectra
+    double rb_retune_slack;                     // slack in seconds the ringbuffers are re-tuned to between measurements, 0 keeps rb_blocks
+};
+
+struct capture_stats_t{
+    uhd::time_spec_t first_time;                // timestamp of the first received sample
+    uhd::time_spec_t end_time;                  // timestamp right after the last received sample
+    bool has_time;                              // false if no sample with timestamp was received
+    unsigned long long n_dropped_samps;         // samples dropped by uhd during this capture
+    unsigned long long n_overruns;              // overruns reported by uhd during this capture
+    bool aborted;                               // capture was aborted by the control plane
+};
+
+// Counters of one device during one capture. Atomic, because the first device reads the counters of all devices for status messages.
+struct device_capture_t{
+    std::atomic<unsigned long long> n_streamed;         // samples per channel from stream_time on, including the samples uhd dropped, trimmed samples are not counted
+    std::atomic<unsigned long long> n_rx_samps;
+    std::atomic<unsigned long long> n_dropped_samps;
+    std::atomic<unsigned long long> n_overruns;
+    std::atomic<unsigned long long> n_seqrx_errors;
+    std::atomic<unsigned long long> n_late_commands;
+    std::atomic<unsigned long long> n_timeouts_rx;
+    std::atomic<unsigned long long> n_samps_trimmed;
+    capture_stats_t stats;
+};
+
+// Receives the samples of one device until the capture is stopped. The first device also polls the control plane and
+// decides when to stop, all devices then stop their streamers and drain them. Triggered captures stream until they are aborted
+// or the trigger is done. With capture_packets the capture also stops once the packet filter has kept that many packets, the requested
+// number of samples is the maximum length then.
+// Samples are aligned to stream_time: samples before it are discarded, a late start is reported as a gap.
+// Returns false if the rx thread has to terminate.
+bool receive_device(uhd::usrp::multi_usrp::sptr usrp,
+    uhd::rx_streamer::sptr rx_stream,
+    const size_t device,
+    const size_t n_bytes_per_item,
+    const unsigned long long n_samples,
+    const bool save_iq,
+    const bool triggered,
+    const unsigned int capture_packets,
+    const bool random_nsamps,
+    const unsigned int file_id,
+    const uhd::time_spec_t& stream_time,
+    const boost::posix_time::ptime& start_time,
+    std::atomic<bool>& burst_timer_elapsed,
+    std::atomic<bool>& stop_requested,
+    std::deque<device_capture_t>& devices)
+{
+    uhd::rx_metadata_t md;
+    const size_t max_samps_per_packet = rx_stream->get_max_num_samps();
+    device_capture_t& dev = devices[device];
+    capture_stats_t& stats = dev.stats;
+
+    unsigned long long n_new_samples = 0;
+
+    // init target pointer
+    std::vector<char*> buffs = channelsounder::get_ringbuffer_rx_pointers(device, 0);
+
+    const double rate = usrp->get_rx_rate();
+
+    // we stream continuously until the fifo has collected all samples, overflows only leave gaps
+    uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+    cmd.stream_now = false;
+    cmd.time_spec = stream_time;
+    rx_stream->issue_stream_cmd(cmd);
+
+    // upper limit in case the host drops so many samples that the fifo never completes, n_samples are counted after the downconverter
+    const unsigned long long n_stream_max = 2ULL*n_samples*channelsounder::get_ddc_decimation() + MAX_ADDITIONAL_SAMPLES_PER_MEASUREMENT;
+    unsigned long long n_streamed = 0;
+
+    // timestamp of the next sample we expect, in ticks of the sample rate, the same for all devices
+    long long expected_ticks = stream_time.to_ticks(rate);
+
+    const double stream_delay = std::max(0.0, (stream_time - usrp->get_time_now()).get_real_secs());
+
+    unsigned int n_timeouts_consecutive = 0;
+
+    const float burst_pkt_time =
+        std::max<float>(0.100f, (2 * max_samps_per_packet / rate));
+    float recv_timeout = burst_pkt_time + stream_delay;
+
+    // some delay, necessary to remove error message "Receiver error: ERROR_CODE_TIMEOUT, continuing..."
+    recv_timeout = recv_timeout + 3.0f;
+
+    unsigned int cnt_recv = 0;
+    channelsounder::command_t abort_cmd;
+
+    bool stop_called = false;
+    bool packets_found = false;
+    while (true) {
+        // only the first device decides when to stop, checking the mailbox is lock-free
+        if (device == 0 and not stop_requested) {
+            // abort or shutdown requested by the control plane
+            if (channelsounder::pop_control_abort(abort_cmd)) {
+                std::cout << "[" << NOW() << "] Aborting measurement." << std::endl;
+                if (abort_cmd.type == channelsounder::CMD_SHUTDOWN)
+                    burst_timer_elapsed = true;
+                stop_requested = true;
+                stats.aborted = true;
+            }
+            // all samples collected, stop streaming and drain the remaining packets
+            if (not triggered and channelsounder::is_complete_fifo_ch_measurement())
+                stop_requested = true;
+            // without saving, the fifo is not fed and the measurement ends once its samples have been streamed
+            if (not save_iq and n_streamed >= n_samples)
+                stop_requested = true;
+            if (triggered and channelsounder::is_done_trigger())
+                stop_requested = true;
+            // enough packets found, the fifo ends the measurement with the samples streamed so far, no device has stored more
+            if (capture_packets > 0 and not triggered and not packets_found) {
+                const unsigned long long n_packets = channelsounder::get_n_kept_packet_filter();
+                if (save_iq)
+                    channelsounder::report_packets((long long) n_packets);
+                if (n_packets >= capture_packets) {
+                    packets_found = true;
+                    unsigned long long n_streamed_max = 0;
+                    for (size_t i = 0; i < devices.size(); i++)
+                        n_streamed_max = std::max<unsigned long long>(n_streamed_max, devices[i].n_streamed);
+                    const unsigned long long decimation = channelsounder::get_ddc_decimation();
+                    std::cout << "[" << NOW() << "] Found " << n_packets << " packets after " << n_streamed_max << " samples, stop measurement." << std::endl;
+                    if (save_iq)
+                        channelsounder::stop_fifo_ch_measurement((n_streamed_max + decimation - 1)/decimation);
+                    else
+                        stop_requested = true;
+                }
+            }
+            if (not triggered and n_streamed > n_stream_max) {
+                std::cerr << "[" << NOW() << "] Measurement incomplete after " << n_streamed << " samples, stop streaming." << std::endl;
+                stop_requested = true;
+            }
+            if ((++cnt_recv & 0xff) == 0) {
+                unsigned long long n_rx_samps = num_rx_samps, n_dropped_samps = num_dropped_samps, n_overruns = num_overruns;
+                for (size_t i = 0; i < devices.size(); i++) {
+                    n_rx_samps += devices[i].n_rx_samps;
+                    n_dropped_samps += devices[i].n_dropped_samps;
+                    n_overruns += devices[i].n_overruns;
+                }
+                if (triggered)
+                    channelsounder::publish_rx_status(channelsounder::RX_STATE_TRIGGERED, channelsounder::get_file_id_trigger(), n_rx_samps, n_dropped_samps, n_overruns);
+                else
+                    channelsounder::publish_rx_status(channelsounder::RX_STATE_CAPTURING, file_id, n_rx_samps, n_dropped_samps, n_overruns);
+            }
+        }
+        // if (burst_timer_elapsed.load(boost::memory_order_relaxed) and not stop_called)
+        // {
+        if ((burst_timer_elapsed or stop_requested) and not stop_called) {
+            rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+            stop_called = true;
+        }
+        try {
+            // retuns n_new_samples-many samples for each receive channel, random sizes split packets across ringbuffer blocks at every offset
+            const size_t n_samps_request = random_nsamps ? 1 + std::rand() % max_samps_per_packet : max_samps_per_packet;
+            n_new_samples = rx_stream->recv(buffs, n_samps_request, md, recv_timeout);
+
+            // uhd counts samples for each channel
+            dev.n_rx_samps += n_new_samples * rx_stream->get_num_channels();
+
+            // Sample accurate gap detection and trim, see align_packet_rx()
+            if (n_new_samples > 0 and md.has_time_spec) {
+                const channelsounder::packet_alignment_t alignment =
+                    channelsounder::align_packet_rx(device, buffs, n_bytes_per_item, n_new_samples, md.time_spec.to_ticks(rate), expected_ticks);
+                if (alignment.n_missing > 0) {
+                    dev.n_dropped_samps += alignment.n_missing;
+                    dev.n_streamed += alignment.n_missing;
+                }
+                if (alignment.n_early > 0) {
+                    if (stats.has_time) {
+                        std::cerr << "[" << NOW()
+                                  << "] Timestamp ahead of expected timestamp! Discarding overlapping samples."
+                                     "(Delta: "
+                                  << alignment.delta_ticks << " ticks)\n";
+                    }
+                    dev.n_samps_trimmed += alignment.n_early;
+                }
+                n_new_samples = alignment.n_kept;
+                md.time_spec = uhd::time_spec_t::from_ticks(alignment.first_ticks, rate);
+            }
+
+            // counted after the trim, the stop of capture_packets takes the length of the measurement from n_streamed
+            n_streamed += n_new_samples;
+            dev.n_streamed += n_new_samples;
+
+            // refresh pointers for next call of rx_stream->recv()
+            buffs = channelsounder::get_ringbuffer_rx_pointers(device, n_new_samples);
+
+            recv_timeout = burst_pkt_time;
+        } catch (uhd::io_error& e) {
+            std::cerr << "[" << NOW() << "] Caught an IO exception. " << std::endl;
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+
+        // remember first and last timestamp, used e.g. to determine the retune gap of a scan schedule
+        if (n_new_samples > 0 and md.has_time_spec) {
+            if (not stats.has_time) {
+                stats.first_time = md.time_spec;
+                stats.has_time = true;
+            }
+            stats.end_time = md.time_spec + uhd::time_spec_t::from_ticks(n_new_samples, rate);
+        }
+
+        if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
+            n_timeouts_consecutive = 0;
+
+        // handle the error codes
+        switch (md.error_code) {
+            case uhd::rx_metadata_t::ERROR_CODE_NONE:
+                if (burst_timer_elapsed and md.end_of_burst) {
+                    return false;
+                }
+                break;
+
+            // ERROR_CODE_OVERFLOW can indicate overflow or sequence error, streaming continues and the gap is measured with the next timestamp
+            case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+                // check out_of_sequence flag to see if it was a sequence error or
+                // overflow
+                if (!md.out_of_sequence) {
+                    dev.n_overruns++;
+                } else {
+                    dev.n_seqrx_errors++;
+                    std::cerr << "[" << NOW() << "] Detected Rx sequence error on device " << device << "."
+                              << std::endl;
+                }
+                break;
+
+            case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+                std::cerr << "[" << NOW() << "] Receiver error: " << md.strerror()
+                          << ", restart streaming..." << std::endl;
+                dev.n_late_commands++;
+                // Radio core will be in the idle state. Issue stream command to restart
+                // streaming.
+                if (not stop_called) {
+                    cmd.time_spec  = usrp->get_time_now() + uhd::time_spec_t(0.05);
+                    cmd.stream_now = (buffs.size() == 1);
+                    rx_stream->issue_stream_cmd(cmd);
+                }
+                break;
+
+            case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+                if (burst_timer_elapsed) {
+                    return false;
+                }
+                // after stopping, a timeout means all packets have been drained
+                if (stop_called) {
+                    md.end_of_burst = true;
+                    break;
+                }
+                std::cerr << "[" << NOW() << "] Receiver error: " << md.strerror()
+                          << ", continuing..." << std::endl;
+                dev.n_timeouts_rx++;
+                if (++n_timeouts_consecutive >= MAX_CONSECUTIVE_TIMEOUTS) {
+                    std::cerr << "[" << NOW() << "] Too many timeouts on device " << device << ", stop streaming." << std::endl;
+                    stop_requested = true;
+                }
+                break;
+
+                // Otherwise, it's an error
+            default:
+                std::cerr << "[" << NOW() << "] Receiver error: " << md.strerror()
+                          << std::endl;
+                std::cerr << "[" << NOW() << "] Unexpected error on recv, continuing..."
+                          << std::endl;
+                break;
+        }
+
+        if (stop_called and md.end_of_burst == true){
+            break;
+        }
+    }
+
+    return true;
+}
+
+// Records one measurement of n_samples samples starting at stream_time, which must have been tuned before.
+// With the trigger the stream continues until it is aborted or the trigger is done, each trigger is saved as a measurement of its own
+// with file ids counting up from file_id, n_samples is not used.
+// The first device is received in the calling thread, every further device in its own thread.
+// Returns false if the rx thread has to terminate.
+bool capture_measurement(uhd::usrp::multi_usrp::sptr usrp,
+    const rx_devices_t& rx_devices,
+    const unsigned long long n_samples,
+    const unsigned int file_id,
+    const std::string& file_tag,
+    const uhd::time_spec_t& stream_time,
+    const boost::posix_time::ptime& start_time,
+    std::atomic<bool>& burst_timer_elapsed,
+    capture_stats_t& stats,
+    const bool triggered)
+{
+    const size_t n_devices = rx_devices.rx_streams.size();
+
+    // reset the ringbuffers, so that they write to initial buffer again, and the downconverters behind them
+    for (size_t device = 0; device < n_devices; device++) {
+        channelsounder::reset_ringbuffer_rx(device);
+        channelsounder::reset_ddc(device);
+    }
+
+    // reset the fifo, tell it how many samples we want to collect, without saving it is not used, the trigger resets it for each burst
+    if (rx_devices.save_iq and not triggered)
+        channelsounder::reset_fifo_ch_measurement(n_samples, file_id, file_tag);
+
+    // save current time
+    const double stream_delay = std::max(0.0, (stream_time - usrp->get_time_now()).get_real_secs());
+    float stream_delay_microseconds_f = stream_delay*1.0e6;
+    channelsounder::current_time((unsigned int) stream_delay_microseconds_f);
+
+    // spectra, preview and packets are aligned to the host clock, the sinks are still idle
+    const double start_time_epoch_sec = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count() + stream_delay;
+    for (size_t device = 0; device < n_devices; device++) {
+        channelsounder::reset_psd(device, start_time_epoch_sec, usrp->get_rx_freq(rx_devices.first_channels[device]));
+        channelsounder::reset_preview(device, start_time_epoch_sec);
+        channelsounder::reset_packet_filter(device, file_id, start_time_epoch_sec);
+    }
+
+    // all devices are aligned to stream_time, with zero fill sample 0 of each file is the sample at stream_time
+    if (triggered) {
+        channelsounder::reset_trigger(file_id, stream_time.get_real_secs(), start_time_epoch_sec);
+        channelsounder::publish_rx_status(channelsounder::RX_STATE_TRIGGERED, file_id, num_rx_samps, num_dropped_samps, num_overruns);
+    } else {
+        channelsounder::report_start_time(stream_time.get_real_secs());
+        channelsounder::publish_rx_status(channelsounder::RX_STATE_CAPTURING, file_id, num_rx_samps, num_dropped_samps, num_overruns);
+    }
+
+    std::deque<device_capture_t> devices(n_devices);
+    for (size_t device = 0; device < n_devices; device++) {
+        device_capture_t& dev = devices[device];
+        dev.n_streamed = dev.n_rx_samps = dev.n_dropped_samps = dev.n_overruns = dev.n_seqrx_errors = 0;
+        dev.n_late_commands = dev.n_timeouts_rx = dev.n_samps_trimmed = 0;
+        dev.stats.has_time = false;
+        dev.stats.aborted = false;
+    }
+
+    std::atomic<bool> stop_requested(false);
+    std::atomic<bool> terminate(false);
+
+    boost::thread_group receive_threads;
+    for (size_t device = 1; device < n_devices; device++) {
+        auto receive_thread = receive_threads.create_thread([&, device]() {
+            if (rx_devices.elevate_priority)
+                uhd::set_thread_priority_safe();
+            channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_RX, device);
+            if (receive_device(usrp, rx_devices.rx_streams[device], device, rx_devices.n_bytes_per_item, n_samples, rx_devices.save_iq, triggered, rx_devices.capture_packets, rx_devices.random_nsamps, file_id, stream_time, start_time, burst_timer_elapsed, stop_requested, devices) == false)
+                terminate = true;
+            stop_requested = true;
+        });
+        uhd::set_thread_name(receive_thread, "rx_device");
+    }
+
+    if (receive_device(usrp, rx_devices.rx_streams[0], 0, rx_devices.n_bytes_per_item, n_samples, rx_devices.save_iq, triggered, rx_devices.capture_packets, rx_devices.random_nsamps, file_id, stream_time, start_time, burst_timer_elapsed, stop_requested, devices) == false)
+        terminate = true;
+    stop_requested = true;
+    receive_threads.join_all();
+
+    // devices waiting for a slower device are released
+    if (rx_devices.save_iq and not triggered and not channelsounder::is_complete_fifo_ch_measurement())
+        channelsounder::cancel_fifo_ch_measurement();
+    if (triggered and channelsounder::is_capturing_trigger())
+        channelsounder::cancel_fifo_ch_measurement();
+
+    stats = devices[0].stats;
+    stats.n_dropped_samps = 0;
+    stats.n_overruns = 0;
+    for (size_t device = 0; device < n_devices; device++) {
+        const device_capture_t& dev = devices[device];
+        stats.n_dropped_samps += dev.n_dropped_samps;
+        stats.n_overruns += dev.n_overruns;
+
+        num_rx_samps += dev.n_rx_samps;
+        num_dropped_samps += dev.n_dropped_samps;
+        num_overruns += dev.n_overruns;
+        num_seqrx_errors += dev.n_seqrx_errors;
+        num_late_commands += dev.n_late_commands;
+        num_timeouts_rx += dev.n_timeouts_rx;
+
+        num_rx_samps_device[device] += dev.n_rx_samps;
+        num_dropped_samps_device[device] += dev.n_dropped_samps;
+        num_overruns_device[device] += dev.n_overruns;
+        num_trimmed_samps_device[device] += dev.n_samps_trimmed;
+    }
+
+    return not terminate;
+}
+
+/***********************************************************************
+ * Scan schedule
+ **********************************************************************/
+// Executes the scan schedule loaded from the file scan_schedule_path. Each dwell is tuned with a timed command and saved as a separate tagged file.
+// Returns false if the rx thread has to terminate.
+bool run_scan_schedule(uhd::usrp::multi_usrp::sptr usrp,
+    const rx_devices_t& rx_devices,
+    const std::string& scan_schedule_path,
+    const unsigned int file_id,
+    const double rx_delay,
+    const double scan_settle,
+    const boost::posix_time::ptime& start_time,
+    std::atomic<bool>& burst_timer_elapsed)
+{
+    // reload, the schedule file might have been edited since the last run
+    if (channelsounder::init_scan_schedule(scan_schedule_path) == 0) {
+        std::cerr << "[" << NOW() << "] Unable to load scan schedule, ignoring command." << std::endl;
+        return true;
+    }
+
+    const std::vector<channelsounder::scan_dwell_t>& dwells = channelsounder::get_scan_schedule();
+    const unsigned int n_repeat = channelsounder::get_scan_schedule_repeat();
+
+    capture_stats_t stats;
+    bool has_previous_end_time = false;
+    uhd::time_spec_t previous_end_time;
+
+    for (unsigned int repeat_idx = 0; repeat_idx < n_repeat; repeat_idx++) {
+        for (size_t dwell_idx = 0; dwell_idx < dwells.size(); dwell_idx++) {
+            const channelsounder::scan_dwell_t& dwell = dwells[dwell_idx];
+
+            // timed tuning, all channels retune at the same device time
+            const uhd::time_spec_t tune_time = usrp->get_time_now() + uhd::time_spec_t(rx_delay);
+            usrp->set_command_time(tune_time);
+            for (size_t ch = 0; ch < usrp->get_rx_num_channels(); ch++){
+                uhd::tune_request_t tune_request(dwell.center_freq);
+                usrp->set_rx_freq(tune_request, ch);
+                usrp->set_rx_gain(dwell.gain, ch);
+            }
+            usrp->clear_command_time();
+
+            // file tag: repetition, dwell and center frequency in MHz
+            std::ostringstream ss;
+            ss << "scan" << std::setw(4) << std::setfill('0') << repeat_idx;
+            ss << "_" << std::setw(4) << std::setfill('0') << dwell_idx;
+            ss << "_" << std::setw(4) << std::setfill('0') << (unsigned int) (dwell.center_freq/1e6);
+
+            // stream after the LO has settled
+            const uhd::time_spec_t stream_time = tune_time + uhd::time_spec_t(scan_settle);
+            channelsounder::publish_rx_status(channelsounder::RX_STATE_SCANNING, file_id, num_rx_samps, num_dropped_samps, num_overruns);
+            if (capture_measurement(usrp, rx_devices, dwell.n_samples, file_id, ss.str(), stream_time, start_time, burst_timer_elapsed, stats, false) == false)
+                return false;
+            if (stats.aborted) {
+                std::cout << "Scan schedule aborted." << std::endl;
+                return true;
+            }
+
+            double retune_gap_sec = -1.0;
+            if (has_previous_end_time and stats.has_time)
+                retune_gap_sec = (stats.first_time - previous_end_time).get_real_secs();
+            has_previous_end_time = stats.has_time;
+            previous_end_time = stats.end_time;
+
+            channelsounder::report_scan_dwell(dwell_idx, repeat_idx, retune_gap_sec, stats.n_dropped_samps, stats.n_overruns);
+        }
+    }
+
+    return true;
+}
+
 /***********************************************************************
  * Benchmark RX Rate
  **********************************************************************/
 void benchmark_rx_rate(uhd::usrp::multi_usrp::sptr usrp,
     const std::string& rx_cpu,
-    uhd::rx_streamer::sptr rx_stream,
-    bool random_nsamps,
+    const rx_devices_t& rx_devices,
     const boost::posix_time::ptime& start_time,
     std::atomic<bool>& burst_timer_elapsed,
     bool elevate_priority,
-    double rx_delay)
+    double rx_delay,
+    const std::string& scan_schedule_path,
+    double scan_settle,
+    unsigned short notify_port)
 {
     if (elevate_priority) {
         uhd::set_thread_priority_safe();
@@ -100,291 +591,90 @@ void benchmark_rx_rate(uhd::usrp::multi_usrp::sptr usrp,
         // ##########
     }
 
-    // print pre-test summary
-    std::cout << boost::format("[%s] Testing receive rate %f Msps on %u channels") % NOW() % (usrp->get_rx_rate() / 1e6) % rx_stream->get_num_channels() << std::endl;
+    // the first device is received in this thread
+    channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_RX, 0);
 
-    // setup variables and allocate buffer
-    uhd::rx_metadata_t md;
-    const size_t max_samps_per_packet = rx_stream->get_max_num_samps();
+    // print pre-test summary
+    size_t n_channels = 0;
+    for (size_t device = 0; device < rx_devices.rx_streams.size(); device++)
+        n_channels += rx_devices.rx_streams[device]->get_num_channels();
+    std::cout << boost::format("[%s] Testing receive rate %f Msps on %u channels of %u devices") % NOW() % (usrp->get_rx_rate() / 1e6) % n_channels % rx_devices.rx_streams.size() << std::endl;
 
     // ##########################
     // ##########################
     // ##########################
-    std::uint16_t port = 8888;          // must be the same in matlab
-    boost::asio::io_service io_context;
-    boost::asio::ip::udp::endpoint receiver(boost::asio::ip::udp::v4(), port);
-    boost::asio::ip::udp::socket socket(io_context, receiver);
-
     unsigned int cnt_measurement = 0;
 
     while(true){
 
         cnt_measurement++;
 
-        std::cout << "Entered RX thread. Now awaiting new message via UDP. Current measurement cnt: " << cnt_measurement << std::endl;
+        // while idle the ringbuffers may grow, the sinks have measured their time per block in the measurements so far
+        for (size_t device = 0; rx_devices.rb_retune_slack > 0.0 and device < rx_devices.rx_streams.size(); device++)
+            channelsounder::retune_ringbuffer_rx(device, usrp->get_rx_rate(), rx_devices.rb_retune_slack);
 
-        // we have two predefined messages
-        const unsigned int max_message_length = 64;                                     // maximum length of message, must be the same in matlab
-        std::string predefined_message_new_meas("New_Measurement_");                    // message for new measurement (16 Byte)
-        std::string predefined_message_end_exec("End_Measurement_programm_now1234");    // message to shut down program (32 Byte)
+        channelsounder::publish_rx_status(channelsounder::RX_STATE_IDLE, 0, num_rx_samps, num_dropped_samps, num_overruns);
 
-        // receive the message, blocking call
-        char buffer[max_message_length+256];                                            // add 256 Byte as security
-        boost::asio::ip::udp::endpoint sender;
-        std::size_t bytes_transferred = socket.receive_from(boost::asio::buffer(buffer), sender);
+        std::cout << "Entered RX thread. Now awaiting new command from control plane. Current measurement cnt: " << cnt_measurement << std::endl;
 
-        // convert entire buffer to one string and resize to maximum message size
-        std::string message_from_matlab(buffer);
-        message_from_matlab.resize(max_message_length);
+        // the mailbox is lock-free, while idle we poll it
+        channelsounder::command_t cmd;
+        while (channelsounder::pop_control_command(cmd) == false) {
+            if (burst_timer_elapsed)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
 
-        // these variales are extracted from matlab message
-        unsigned int file_id;
-        unsigned int n_samples;
+        // completion messages of the following measurements are sent back to the sender of this command
+        channelsounder::set_notification_receiver(cmd.sender_address, notify_port);
 
         // message to start new measurement?
-        if (message_from_matlab.compare(0, predefined_message_new_meas.size(), predefined_message_new_meas) == 0){
-            std::string::size_type sz;
-
-            file_id = std::stoi(message_from_matlab.substr(16,8),&sz);                          // extract file id (8 Byte)
-            unsigned int center_freq_MHz = std::stoi(message_from_matlab.substr(25,4),&sz);     // extract center frequency in MHz (4 Byte)
-            n_samples = std::stoi(message_from_matlab.substr(30,10),&sz);                       // extract number of samples (10 Byte)
-
-            // gains (4 Byte per channel)
-            std::vector<unsigned int> gains;
-            for (int j=0; j<rx_stream->get_num_channels(); j++){
-                unsigned int gain = std::stoi(message_from_matlab.substr(41 + j*4,4),&sz);
-                gains.push_back(gain);
-            }
+        if (cmd.type == channelsounder::CMD_NEW_MEASUREMENT){
 
             // set new usrp parameters
             // source: https://files.ettus.com/manual/classuhd_1_1usrp_1_1multi__usrp.html#a72b7947cb0c434b98e9915f91b8f8fe0
-            double rx_freq(center_freq_MHz);
-            rx_freq = rx_freq*1e6;
             for (size_t ch = 0; ch < usrp->get_rx_num_channels(); ch++){
-                uhd::tune_request_t tune_request(rx_freq);
+                uhd::tune_request_t tune_request(cmd.center_freq);
                 usrp->set_rx_freq(tune_request, ch);
 
-                double rx_gain(gains[ch]);
+                double rx_gain(cmd.gains[std::min(ch, cmd.n_gains - 1)]);
                 usrp->set_rx_gain(rx_gain, ch);
             }
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            capture_stats_t stats;
+            const uhd::time_spec_t stream_time = usrp->get_time_now() + uhd::time_spec_t(rx_delay);
+            if (rx_devices.trigger)
+                std::cout << "Trigger armed, every burst is saved until the measurement is aborted." << std::endl;
+            if (capture_measurement(usrp, rx_devices, cmd.n_samples, cmd.file_id, "", stream_time, start_time, burst_timer_elapsed, stats, rx_devices.trigger) == false)
+                return;
+        }
+        // message to execute the scan schedule?
+        else if (cmd.type == channelsounder::CMD_NEW_SCAN_SCHEDULE){
+            if (scan_schedule_path.size() == 0) {
+                std::cout << "No scan schedule given on command line, ignoring message." << std::endl;
+                continue;
+            }
+            if (rx_devices.trigger) {
+                std::cout << "Scan schedules are not supported with the trigger, ignoring message." << std::endl;
+                continue;
+            }
+            if (run_scan_schedule(usrp, rx_devices, scan_schedule_path, cmd.file_id, rx_delay, scan_settle, start_time, burst_timer_elapsed) == false)
+                return;
         }
         // terminate execution?
-        else if (message_from_matlab.compare(0, predefined_message_end_exec.size(), predefined_message_end_exec) == 0){
+        else if (cmd.type == channelsounder::CMD_SHUTDOWN){
             burst_timer_elapsed = true;
             std::cout << "Stopping program execution!" << std::endl;
             break;
         }
-        // should never happen
+        // abort without a running measurement
         else{
-            std::cout << "Unknown message: " << message_from_matlab << std::endl;
+            std::cout << "Nothing to abort." << std::endl;
         }
-
-        // reset the ringbuffer, so that is writes to initial buffer again
-        channelsounder::reset_ringbuffer_rx();
-
-        // reset the fifo, tell it how many samples we want to collect
-        channelsounder::reset_fifo_ch_measurement(n_samples, file_id);
-
-        unsigned long long n_new_samples = 0;
-
-        // init target pointer
-        std::vector<char*> buffs = channelsounder::get_ringbuffer_rx_pointers(0);
         // ##########
         // ##########
         // ##########
-
-        bool had_an_overflow = false;
-        uhd::time_spec_t last_time;
-        const double rate = usrp->get_rx_rate();
-
-        // ##########################
-        // ##########################
-        // ##########################
-        //uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-        //cmd.stream_now = false;
-        //cmd.time_spec = uhd::time_spec_t(usrp->get_time_now() + uhd::time_spec_t(rx_delay));;//usrp->get_time_now() + uhd::time_spec_t(rx_delay);
-        //rx_stream->issue_stream_cmd(cmd);
-
-        uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
-        cmd.num_samps = n_samples + 1000000;    // we stream additional samples just in case the driver on the host drops samples
-        cmd.stream_now = false;
-        cmd.time_spec = uhd::time_spec_t(usrp->get_time_now() + uhd::time_spec_t(rx_delay));
-        rx_stream->issue_stream_cmd(cmd);
-
-        // save current time
-        float rx_delay_microseconds_f = rx_delay*1.0e6;
-        channelsounder::current_time((unsigned int) rx_delay_microseconds_f);
-
-        unsigned int stop_streaming_on_error = false;
-        // ##########
-        // ##########
-        // ##########
-
-        const float burst_pkt_time =
-            std::max<float>(0.100f, (2 * max_samps_per_packet / rate));
-        float recv_timeout = burst_pkt_time + rx_delay;
-
-        // ##########################
-        // ##########################
-        // ##########################
-        // some delay, necessary to remove error message "Receiver error: ERROR_CODE_TIMEOUT, continuing..."
-        recv_timeout = recv_timeout + 3.0f;
-        // ##########
-        // ##########
-        // ##########
-
-        bool stop_called = false;
-        while (true) {
-            // if (burst_timer_elapsed.load(boost::memory_order_relaxed) and not stop_called)
-            // {
-            if (burst_timer_elapsed and not stop_called) {
-                rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-                stop_called = true;
-            }
-            if (random_nsamps) {
-                //cmd.num_samps = rand() % max_samps_per_packet;
-                //rx_stream->issue_stream_cmd(cmd);
-            }
-            try {
-                // ##########################
-                // ##########################
-                // ##########################
-                // retuns n_new_samples-many samples for each receive channel
-                n_new_samples = rx_stream->recv(buffs, max_samps_per_packet, md, recv_timeout);
-
-                // uhd counts samples for each channel
-                num_rx_samps += n_new_samples * rx_stream->get_num_channels();
-
-                // refresh pointers for next call of rx_stream->recv()
-                buffs = channelsounder::get_ringbuffer_rx_pointers(n_new_samples);
-                // ##########
-                // ##########
-                // ##########
-
-                recv_timeout = burst_pkt_time;
-            } catch (uhd::io_error& e) {
-                std::cerr << "[" << NOW() << "] Caught an IO exception. " << std::endl;
-                std::cerr << e.what() << std::endl;
-                return;
-            }
-
-            // handle the error codes
-            switch (md.error_code) {
-                case uhd::rx_metadata_t::ERROR_CODE_NONE:
-                    if (had_an_overflow) {
-                        had_an_overflow          = false;
-                        const long dropped_samps = (md.time_spec - last_time).to_ticks(rate);
-                        if (dropped_samps < 0) {
-                            std::cerr << "[" << NOW()
-                                      << "] Timestamp after overrun recovery "
-                                         "ahead of error timestamp! Unable to calculate "
-                                         "number of dropped samples."
-                                         "(Delta: "
-                                      << dropped_samps << " ticks)\n";
-                        }
-                        num_dropped_samps += std::max<long>(1, dropped_samps);
-                    }
-                    if ((burst_timer_elapsed or stop_called) and md.end_of_burst) {
-                        return;
-                    }
-                    // ##########################
-                    // ##########################
-                    // ##########################
-                    //rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-                    //md.end_of_burst = true;
-                    // ##########
-                    // ##########
-                    // ##########
-                    break;
-
-                // ERROR_CODE_OVERFLOW can indicate overflow or sequence error
-                case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
-                    last_time       = md.time_spec;
-                    had_an_overflow = true;
-                    // check out_of_sequence flag to see if it was a sequence error or
-                    // overflow
-                    if (!md.out_of_sequence) {
-                        num_overruns++;
-                    } else {
-                        num_seqrx_errors++;
-                        std::cerr << "[" << NOW() << "] Detected Rx sequence error."
-                                  << std::endl;
-                    }
-                    // ##########################
-                    // ##########################
-                    // ##########################
-                    //rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-                    stop_streaming_on_error = true;
-                    // ##########
-                    // ##########
-                    // ##########
-                    break;
-
-                case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
-                    std::cerr << "[" << NOW() << "] Receiver error: " << md.strerror()
-                              << ", restart streaming..." << std::endl;
-                    num_late_commands++;
-                    // ##########################
-                    // ##########################
-                    // ##########################
-                    // Radio core will be in the idle state. Issue stream command to restart
-                    // streaming.
-                    //cmd.time_spec  = usrp->get_time_now() + uhd::time_spec_t(0.05);
-                    //cmd.stream_now = (buffs.size() == 1);
-                    //rx_stream->issue_stream_cmd(cmd);
-
-                    //rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-                    stop_streaming_on_error = true;
-                    // ##########
-                    // ##########
-                    // ##########
-                    break;
-
-                case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
-                    if (burst_timer_elapsed) {
-                        return;
-                    }
-                    std::cerr << "[" << NOW() << "] Receiver error: " << md.strerror()
-                              << ", continuing..." << std::endl;
-                    num_timeouts_rx++;
-                    // ##########################
-                    // ##########################
-                    // ##########################
-                    //rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-                    stop_streaming_on_error = true;
-                    // ##########
-                    // ##########
-                    // ##########
-                    break;
-
-                    // Otherwise, it's an error
-                default:
-                    std::cerr << "[" << NOW() << "] Receiver error: " << md.strerror()
-                              << std::endl;
-                    std::cerr << "[" << NOW() << "] Unexpected error on recv, continuing..."
-                              << std::endl;
-                    // ##########################
-                    // ##########################
-                    // ##########################
-                    //rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
-                    stop_streaming_on_error = true;
-                    // ##########
-                    // ##########
-                    // ##########
-                    break;
-            }
-
-            // ##########################
-            // ##########################
-            // ##########################
-            if (md.end_of_burst == true || stop_streaming_on_error == true){
-                break;
-            }
-            // ##########
-            // ##########
-            // ##########
-        }
     }
 }
 
@@ -404,12 +694,69 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
     std::string rx_cpu;
     std::string mode, ref, pps;
     std::string channel_list, rx_channel_list;
-    bool random_nsamps = false;
     std::atomic<bool> burst_timer_elapsed(false);
     size_t overrun_threshold, underrun_threshold, drop_threshold, seq_threshold;
     double rx_delay;
     std::string priority;
     bool elevate_priority = false;
+    std::string scan_schedule_path;
+    double scan_settle;
+    unsigned short notify_port;
+    bool zero_fill;
+    std::string save_dirs;
+    std::string write_layout;
+    size_t stripe_size_MiB;
+    size_t io_threads;
+    size_t archive_segment_MiB;
+    size_t archive_budget_GiB;
+    size_t hash_chunk_MiB;
+    size_t stream_chunk_MiB;
+    size_t stream_budget_MiB;
+    bool streamer_per_device;
+    std::string thread_placement;
+    size_t rb_block_samples;
+    size_t rb_blocks;
+    double rb_latency_ms;
+    double rb_slack_ms;
+    double ddc_freq;
+    size_t ddc_decimation;
+    size_t ddc_taps;
+    size_t ddc_threads;
+    size_t pfb_bands;
+    std::string pfb_select;
+    size_t pfb_oversample;
+    size_t pfb_taps;
+    size_t psd_fft;
+    size_t psd_bins;
+    double psd_integration;
+    double psd_fraction;
+    std::string psd_output;
+    size_t psd_threads;
+    std::string preview_addr;
+    double preview_interval;
+    size_t preview_samples;
+    size_t preview_decimation;
+    double preview_fraction;
+    int preview_ttl;
+    std::string packet_formats;
+    int packet_mcs_min;
+    int packet_mcs_max;
+    std::string packet_bw;
+    double packet_threshold;
+    size_t packet_margin;
+    double packet_cfo_tolerance;
+    std::string packet_output;
+    size_t sink_depth;
+    bool trigger;
+    double trigger_threshold;
+    size_t trigger_window;
+    size_t trigger_min_duration;
+    size_t trigger_holdoff;
+    size_t trigger_pre;
+    size_t trigger_post;
+    unsigned int trigger_count;
+    unsigned int capture_packets;
+    bool save_iq;
 
     // setup the program options
     po::options_description desc("Allowed options");
@@ -429,7 +776,7 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         ("ref", po::value<std::string>(&ref), "clock reference (internal, external, mimo, gpsdo)")
         ("pps", po::value<std::string>(&pps), "PPS source (internal, external, mimo, gpsdo)")
         ("mode", po::value<std::string>(&mode), "DEPRECATED - use \"ref\" and \"pps\" instead (none, mimo)")
-        ("random", "Run with random values of samples in send() and recv() to stress-test the I/O.")
+        ("random", "Run with random numbers of samples in recv() to stress-test the I/O, see iqsoak for a test without hardware.")
         ("channels", po::value<std::string>(&channel_list)->default_value("0"), "which channel(s) to use (specify \"0\", \"1\", \"0,1\", etc)")
         ("rx_channels", po::value<std::string>(&rx_channel_list), "which RX channel(s) to use (specify \"0\", \"1\", \"0,1\", etc)")
         //("tx_channels", po::value<std::string>(&tx_channel_list), "which TX channel(s) to use (specify \"0\", \"1\", \"0,1\", etc)")
@@ -441,6 +788,64 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         //("tx_delay", po::value<double>(&tx_delay)->default_value(0.25), "delay before starting TX in seconds")
         ("rx_delay", po::value<double>(&rx_delay)->default_value(0.05), "delay before starting RX in seconds")
         ("priority", po::value<std::string>(&priority)->default_value("high"), "thread priority (high, normal)")
+        ("scan_schedule", po::value<std::string>(&scan_schedule_path)->default_value(""), "scan schedule file executed on UDP command New_Scan_Schedule_")
+        ("zero_fill", po::value<bool>(&zero_fill)->default_value(true), "replace samples lost in overflows by zeros to keep the time alignment, gaps are always written to a .gaps index")
+        ("save_dirs", po::value<std::string>(&save_dirs)->default_value(SAVE_PATH), "directories the measurements are written to, e.g. one per drive (specify \"../data\", \"/mnt/a,/mnt/b\", etc)")
+        ("write_layout", po::value<std::string>(&write_layout)->default_value("single"), "file layout of a measurement (single, channel, stripes, archive), channel and stripes are described by a .manifest file, archive appends to segment files")
+        ("stripe_size", po::value<size_t>(&stripe_size_MiB)->default_value(64), "stripe size in MiB for write_layout stripes")
+        ("io_threads", po::value<size_t>(&io_threads)->default_value(0), "number of I/O threads of the writer, 0 selects one per file")
+        ("archive_segment", po::value<size_t>(&archive_segment_MiB)->default_value(1024), "size in MiB of the preallocated segment files for write_layout archive")
+        ("archive_budget", po::value<size_t>(&archive_budget_GiB)->default_value(100), "disk space in GiB of all segments for write_layout archive, the oldest segments are recycled")
+        ("hash_chunk", po::value<size_t>(&hash_chunk_MiB)->default_value(4), "chunk size in MiB of the CRC-32C hash table written with each measurement, 0 writes none")
+        ("stream_chunk", po::value<size_t>(&stream_chunk_MiB)->default_value(0), "chunk size in MiB per channel for streaming measurements to disk while recording, 0 keeps measurements in memory")
+        ("stream_budget", po::value<size_t>(&stream_budget_MiB)->default_value(1024), "memory in MiB for chunks not yet written to disk when streaming")
+        ("notify_port", po::value<unsigned short>(&notify_port)->default_value(8889), "UDP port at the command sender for completion messages, 0 disables them")
+        ("scan_settle", po::value<double>(&scan_settle)->default_value(0.01), "delay between timed retune and start of streaming of each dwell in seconds")
+        ("streamer_per_device", po::value<bool>(&streamer_per_device)->default_value(false), "one streamer, receive thread and ringbuffer per motherboard, the channels of each motherboard are saved together")
+        ("thread_placement", po::value<std::string>(&thread_placement)->default_value(""), "file with cpus, NUMA node and scheduling policy of the recorder threads, or its lines separated by ';' (specify \"rx 2/10 fifo 90;process 3/11 fifo 80\", etc)")
+        ("rb_block_samples", po::value<size_t>(&rb_block_samples)->default_value(1000000), "samples per channel in one ringbuffer block, 0 derives it from rx_rate and rb_latency")
+        ("rb_blocks", po::value<size_t>(&rb_blocks)->default_value(2), "number of ringbuffer blocks per device, 0 derives it from rb_slack and the measured time to process one block, blocks are added between measurements if the sinks are slower")
+        ("rb_latency", po::value<double>(&rb_latency_ms)->default_value(20.0), "target duration of one ringbuffer block in ms when auto tuning")
+        ("rb_slack", po::value<double>(&rb_slack_ms)->default_value(200.0), "target stall of the processing thread in ms the ringbuffer bridges when auto tuning")
+        ("ddc_decimation", po::value<size_t>(&ddc_decimation)->default_value(1), "decimation of the digital downconverter, only rx_rate/ddc_decimation samples per second are saved, 1 disables it")
+        ("ddc_freq", po::value<double>(&ddc_freq)->default_value(0.0), "center of the channel extracted by the digital downconverter relative to the rx center frequency in Hz")
+        ("ddc_taps", po::value<size_t>(&ddc_taps)->default_value(32), "filter taps of the digital downconverter per output sample and decimation")
+        ("ddc_threads", po::value<size_t>(&ddc_threads)->default_value(0), "worker threads per device that help the processing thread to filter groups of channels or samples")
+        ("pfb_bands", po::value<size_t>(&pfb_bands)->default_value(0), "number of bands the polyphase filterbank splits rx_rate into, each band is saved as separate channels, 0 disables it")
+        ("pfb_select", po::value<std::string>(&pfb_select)->default_value(""), "bands saved by the filterbank, band b is centered on b*rx_rate/pfb_bands, empty for all (specify \"0\", \"-1,0,1\", etc)")
+        ("pfb_oversample", po::value<size_t>(&pfb_oversample)->default_value(2), "ratio of the filterbank output rate and the band spacing, must divide pfb_bands")
+        ("pfb_taps", po::value<size_t>(&pfb_taps)->default_value(16), "filter taps of the filterbank per band")
+        ("psd_fft", po::value<size_t>(&psd_fft)->default_value(0), "fft size of the averaged power spectra written for occupancy monitoring, 0 disables them")
+        ("psd_bins", po::value<size_t>(&psd_bins)->default_value(0), "bins per spectrum frame, must divide psd_fft, 0 keeps all")
+        ("psd_integration", po::value<double>(&psd_integration)->default_value(1.0), "integration time of one spectrum frame in seconds")
+        ("psd_fraction", po::value<double>(&psd_fraction)->default_value(1.0), "fraction of the samples analysed for the spectra, from 0 to 1")
+        ("psd_output", po::value<std::string>(&psd_output)->default_value(""), "file the spectrum frames are appended to or udp:<address>:<port>, empty for spectrogram.psd in the first save directory")
+        ("psd_threads", po::value<size_t>(&psd_threads)->default_value(1), "worker threads computing the spectra, 0 computes them in the psd sink threads")
+        ("preview_addr", po::value<std::string>(&preview_addr)->default_value(""), "<address>:<port> the live preview datagrams are sent to, e.g. 239.255.42.1:5005, empty disables the preview")
+        ("preview_interval", po::value<double>(&preview_interval)->default_value(100.0), "time between two preview datagrams of a device in ms")
+        ("preview_samples", po::value<size_t>(&preview_samples)->default_value(256), "decimated IQ samples per channel in each preview datagram")
+        ("preview_decimation", po::value<size_t>(&preview_decimation)->default_value(0), "samples averaged per preview IQ sample, 0 spreads them over the analysed part of the interval")
+        ("preview_fraction", po::value<double>(&preview_fraction)->default_value(1.0), "fraction of each preview interval analysed, from 0 to 1")
+        ("preview_ttl", po::value<int>(&preview_ttl)->default_value(1), "time to live of multicast preview datagrams")
+        ("packet_formats", po::value<std::string>(&packet_formats)->default_value(""), "Wi-Fi packet formats kept by the packet filter at 20 MS/s, e.g. \"he_su\" or \"legacy,ht,vht,he_su,he_tb,he_mu\", all for every format, empty disables the filter")
+        ("packet_mcs_min", po::value<int>(&packet_mcs_min)->default_value(0), "smallest MCS of the packets kept")
+        ("packet_mcs_max", po::value<int>(&packet_mcs_max)->default_value(11), "largest MCS of the packets kept")
+        ("packet_bw", po::value<std::string>(&packet_bw)->default_value(""), "bandwidths in MHz of the packets kept, e.g. \"20,40\", empty for all")
+        ("packet_threshold", po::value<double>(&packet_threshold)->default_value(-60.0), "minimum power of a packet preamble in dBFS")
+        ("packet_margin", po::value<size_t>(&packet_margin)->default_value(320), "samples saved before and after each kept packet")
+        ("packet_cfo_tolerance", po::value<double>(&packet_cfo_tolerance)->default_value(1000.0), "largest frequency offset in Hz between two packets of the same transmitter, tells the links apart")
+        ("packet_output", po::value<std::string>(&packet_output)->default_value(""), "path of the packet windows and index without extension, empty for packets in the first save directory")
+        ("sink_depth", po::value<size_t>(&sink_depth)->default_value(2), "ringbuffer blocks the psd, the preview and the packet filter may hold each before they skip blocks, added to rb_blocks")
+        ("save_iq", po::value<bool>(&save_iq)->default_value(true), "save the samples of each measurement, false only writes the spectra")
+        ("trigger", po::value<bool>(&trigger)->default_value(false), "self-triggered capture, after a new measurement command every burst is saved as a file of its own until the measurement is aborted")
+        ("trigger_threshold", po::value<double>(&trigger_threshold)->default_value(-30.0), "mean power of a trigger window in dBFS a burst exceeds on any channel")
+        ("trigger_window", po::value<size_t>(&trigger_window)->default_value(32), "samples per window the power is evaluated for")
+        ("trigger_min_duration", po::value<size_t>(&trigger_min_duration)->default_value(160), "samples a burst must last to fire the trigger, shorter bursts are counted as false triggers")
+        ("trigger_holdoff", po::value<size_t>(&trigger_holdoff)->default_value(0), "samples after the end of a triggered measurement before the trigger is armed again")
+        ("trigger_pre", po::value<size_t>(&trigger_pre)->default_value(20000), "samples saved before the start of a burst")
+        ("trigger_post", po::value<size_t>(&trigger_post)->default_value(200000), "samples saved from the start of a burst on")
+        ("trigger_count", po::value<unsigned int>(&trigger_count)->default_value(0), "bursts saved per new measurement command, 0 until the measurement is aborted")
+        ("capture_packets", po::value<unsigned int>(&capture_packets)->default_value(0), "a measurement ends as soon as the packet filter kept this many packets, its number of samples is the maximum, 0 always records all samples")
     ;
     // clang-format on
     po::variables_map vm;
@@ -462,6 +867,11 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         elevate_priority = true;
     }
 
+    // placement of all threads, the main thread allocates the buffers
+    if (channelsounder::init_thread_placement(thread_placement) == 0)
+        return -1;
+    channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_MAIN, 0);
+
     if (vm.count("mode")) {
         if (vm.count("pps") or vm.count("ref")) {
             std::cout << "ERROR: The \"mode\" parameter cannot be used with the \"ref\" "
@@ -636,36 +1046,248 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
         // ##########
         // ##########
 
-        // create a receive streamer
-        uhd::stream_args_t stream_args(rx_cpu, rx_otw);
-        stream_args.channels             = rx_channel_nums;
-        uhd::rx_streamer::sptr rx_stream = usrp->get_rx_stream(stream_args);
+        // group the channels by device, channels are numbered across motherboards in the order of the motherboards
+        std::vector<std::vector<size_t>> rx_channel_groups;
+        if (streamer_per_device) {
+            std::vector<size_t> mboard_of_channel;
+            for (int mboard = 0; mboard < num_mboards; mboard++)
+                mboard_of_channel.resize(mboard_of_channel.size() + usrp->get_rx_subdev_spec(mboard).size(), mboard);
+            std::vector<std::vector<size_t>> channels_of_mboard(num_mboards);
+            for (size_t ch = 0; ch < rx_channel_nums.size(); ch++)
+                channels_of_mboard[mboard_of_channel.at(rx_channel_nums[ch])].push_back(rx_channel_nums[ch]);
+            for (int mboard = 0; mboard < num_mboards; mboard++) {
+                if (channels_of_mboard[mboard].size() > 0)
+                    rx_channel_groups.push_back(channels_of_mboard[mboard]);
+            }
+        } else {
+            rx_channel_groups.push_back(rx_channel_nums);
+        }
+
+        // create one receive streamer per device
+        rx_devices_t rx_devices;
+        std::vector<size_t> n_channels_per_device;
+        std::vector<size_t> rx_channel_nums_saved;
+        for (size_t device = 0; device < rx_channel_groups.size(); device++) {
+            uhd::stream_args_t stream_args(rx_cpu, rx_otw);
+            stream_args.channels = rx_channel_groups[device];
+            rx_devices.rx_streams.push_back(usrp->get_rx_stream(stream_args));
+            n_channels_per_device.push_back(rx_channel_groups[device].size());
+            rx_channel_nums_saved.insert(rx_channel_nums_saved.end(), rx_channel_groups[device].begin(), rx_channel_groups[device].end());
+        }
+        if (rx_channel_nums_saved != rx_channel_nums) {
+            std::cout << "Channels are saved grouped by device in the order:";
+            for (size_t ch = 0; ch < rx_channel_nums_saved.size(); ch++)
+                std::cout << " " << rx_channel_nums_saved[ch];
+            std::cout << std::endl;
+        }
+        const size_t n_devices = rx_devices.rx_streams.size();
+        const size_t n_bytes_per_item = uhd::convert::get_bytes_per_item(rx_cpu);
+        rx_devices.n_bytes_per_item = n_bytes_per_item;
+        rx_devices.elevate_priority = elevate_priority;
+        rx_devices.save_iq = save_iq;
+        rx_devices.trigger = trigger;
+        rx_devices.capture_packets = capture_packets;
+        rx_devices.random_nsamps = vm.count("random") > 0;
+        rx_devices.rb_retune_slack = (rb_blocks == 0) ? rb_slack_ms/1000.0 : 0.0;
+        for (size_t device = 0; device < n_devices; device++)
+            rx_devices.first_channels.push_back(rx_channel_groups[device].front());
+        if (not save_iq and psd_fft == 0 and packet_formats.size() == 0)
+            throw std::runtime_error("Without save_iq the measurements are only useful with psd_fft or packet_formats.");
+        if (trigger and (not save_iq or n_devices > 1))
+            throw std::runtime_error("The trigger needs save_iq and a single device.");
+        if (capture_packets > 0 and (packet_formats.size() == 0 or trigger or (save_iq and stream_chunk_MiB > 0)))
+            throw std::runtime_error("capture_packets needs packet_formats, no trigger and measurements kept in memory (stream_chunk 0).");
+        if (ddc_decimation == 0 or (ddc_decimation > 1 and rx_cpu != "fc32"))
+            throw std::runtime_error("The digital downconverter needs ddc_decimation of at least 1 and rx_cpu fc32.");
+
+        // the filterbank replaces the downconverter, every saved band adds the channels of the device once more
+        std::vector<int> pfb_bands_saved;
+        if (pfb_bands > 0) {
+            if (ddc_decimation > 1 or rx_cpu != "fc32" or pfb_oversample == 0 or pfb_bands % pfb_oversample != 0)
+                throw std::runtime_error("The filterbank needs ddc_decimation 1, rx_cpu fc32 and pfb_oversample must divide pfb_bands.");
+            std::vector<std::string> band_list;
+            boost::split(band_list, pfb_select, boost::is_any_of("\"',"));
+            for (size_t i = 0; i < band_list.size(); i++) {
+                if (band_list[i].size() > 0)
+                    pfb_bands_saved.push_back(std::stoi(band_list[i]));
+            }
+            ddc_decimation = pfb_bands/pfb_oversample;
+        }
+        const size_t n_bands_saved = (pfb_bands == 0) ? 1 : ((pfb_bands_saved.size() == 0) ? pfb_bands : pfb_bands_saved.size());
+        std::vector<size_t> n_channels_saved_per_device;
+        for (size_t device = 0; device < n_devices; device++)
+            n_channels_saved_per_device.push_back(n_channels_per_device[device]*n_bands_saved);
+        num_rx_samps_device.assign(n_devices, 0);
+        num_dropped_samps_device.assign(n_devices, 0);
+        num_overruns_device.assign(n_devices, 0);
+        num_trimmed_samps_device.assign(n_devices, 0);
 
         // ##########################
         // ##########################
         // ##########################
+        // initialize writer, the save thread hands each file of a measurement to an I/O thread
+        std::vector<std::string> save_dir_list;
+        boost::split(save_dir_list, save_dirs, boost::is_any_of("\"',"));
+        channelsounder::writer_layout_t layout = channelsounder::WRITER_LAYOUT_SINGLE_FILE;
+        if (write_layout == "channel")
+            layout = channelsounder::WRITER_LAYOUT_CHANNEL_PER_FILE;
+        else if (write_layout == "stripes")
+            layout = channelsounder::WRITER_LAYOUT_STRIPES;
+        else if (write_layout == "archive")
+            layout = channelsounder::WRITER_LAYOUT_ARCHIVE;
+        else if (write_layout != "single")
+            throw std::runtime_error("Invalid write layout specified.");
+        if (channelsounder::init_writer(save_dir_list, layout, stripe_size_MiB*1024*1024, io_threads, rx_channel_nums_saved.size()*n_bands_saved, usrp->get_rx_rate()/ddc_decimation) == 0)
+            throw std::runtime_error("Unable to initialize writer.");
+        if (layout == channelsounder::WRITER_LAYOUT_ARCHIVE and channelsounder::init_archive_writer(archive_segment_MiB*1024ULL*1024, archive_budget_GiB*1024ULL*1024*1024) == 0)
+            throw std::runtime_error("Unable to initialize archive.");
+        if (channelsounder::init_hash_writer(hash_chunk_MiB*1024*1024) == 0)
+            throw std::runtime_error("Unable to initialize chunk hashes.");
+        for (size_t i = 0; i < channelsounder::get_writer_n_io_threads(); i++) {
+            auto io_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
+                channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_WRITER, i);
+                channelsounder::run_writer_io(burst_timer_elapsed);
+            });
+            uhd::set_thread_name(io_thread, "writer_io");
+        }
+
         // initialize fifo
-        channelsounder::init_fifo_ch_measurement(rx_stream->get_num_channels(), uhd::convert::get_bytes_per_item(rx_cpu));
-        auto save_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {channelsounder::send_save_ch_measurements(burst_timer_elapsed);});
+        if (channelsounder::init_fifo_ch_measurement(n_channels_saved_per_device, n_bytes_per_item, zero_fill, stream_chunk_MiB*1024*1024, stream_budget_MiB*1024*1024, usrp->get_rx_rate()/ddc_decimation) == 0)
+            throw std::runtime_error("Unable to initialize fifo, no copy kernel for rx_cpu " + rx_cpu + ".");
+        auto save_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
+            channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_SAVE, 0);
+            channelsounder::send_save_ch_measurements(burst_timer_elapsed);
+        });
         boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
 
-        // initialize ring buffer rx
-        channelsounder::init_ringbuffer_rx(rx_stream->get_num_channels(), uhd::convert::get_bytes_per_item(rx_cpu), rx_stream->get_max_num_samps());
-        auto process_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {channelsounder::process_ringbuffer_rx(burst_timer_elapsed);});
+        // sinks of each ringbuffer, the capture never skips blocks, the psd, the preview and the packet filter skip blocks if they fall behind
+        std::vector<channelsounder::ringbuffer_sink_t> sinks;
+        if (save_iq)
+            sinks.push_back({trigger ? "trigger" : "capture", trigger ? channelsounder::feed_trigger : channelsounder::feed_ddc, channelsounder::SINK_POLICY_BLOCK, 0});
+        if (psd_fft > 0)
+            sinks.push_back({"psd", channelsounder::feed_psd, save_iq ? channelsounder::SINK_POLICY_DROP_NEWEST : channelsounder::SINK_POLICY_BLOCK, sink_depth});
+        if (preview_addr.size() > 0)
+            sinks.push_back({"preview", channelsounder::feed_preview, channelsounder::SINK_POLICY_DROP_OLDEST, sink_depth});
+        if (packet_formats.size() > 0)
+            sinks.push_back({"packets", channelsounder::feed_packet_filter, save_iq ? channelsounder::SINK_POLICY_DROP_NEWEST : channelsounder::SINK_POLICY_BLOCK, sink_depth});
+
+        // initialize ring buffer rx, one per device
+        std::vector<size_t> max_samples_per_block;
+        for (size_t device = 0; device < n_devices; device++) {
+            const size_t max_samps_per_packet = rx_devices.rx_streams[device]->get_max_num_samps();
+            size_t n_samples_per_block = rb_block_samples;
+            size_t n_blocks = rb_blocks;
+            channelsounder::tune_ringbuffer_rx(usrp->get_rx_rate(), n_channels_per_device[device], n_bytes_per_item, max_samps_per_packet,
+                                               rb_latency_ms/1000.0, rb_slack_ms/1000.0, n_samples_per_block, n_blocks);
+            if (channelsounder::init_ringbuffer_rx(device, n_channels_per_device[device], n_bytes_per_item, max_samps_per_packet, n_samples_per_block, n_blocks, sinks) == 0)
+                throw std::runtime_error("Unable to initialize ringbuffer, rb_blocks must be at least 2 and sink_depth at least 1.");
+            max_samples_per_block.push_back(n_samples_per_block + 2*max_samps_per_packet);
+            if (pfb_bands > 0) {
+                if (channelsounder::init_ddc_filterbank(device, n_channels_per_device[device], max_samples_per_block[device], usrp->get_rx_rate(), pfb_bands,
+                                                        pfb_bands_saved, pfb_oversample, pfb_taps, ddc_threads) == 0)
+                    throw std::runtime_error("Unable to initialize filterbank, pfb_select must be within -pfb_bands+1 and pfb_bands-1.");
+            } else if (channelsounder::init_ddc(device, n_channels_per_device[device], max_samples_per_block[device], usrp->get_rx_rate(), ddc_freq, ddc_decimation, ddc_taps, ddc_threads) == 0) {
+                throw std::runtime_error("Unable to initialize digital downconverter.");
+            }
+            for (size_t i = 0; (pfb_bands > 0 or ddc_decimation > 1) and i < ddc_threads; i++) {
+                auto ddc_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
+                    channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_FILTER, device*ddc_threads + i);
+                    channelsounder::run_ddc_worker(device, burst_timer_elapsed);
+                });
+                uhd::set_thread_name(ddc_thread, "ddc_worker");
+            }
+        }
+
+        // initialize trigger, the measurements it starts pass through the downconverter
+        if (trigger) {
+            const size_t n_samples_saved = (trigger_pre + trigger_post)/channelsounder::get_ddc_decimation();
+            if (channelsounder::init_trigger(n_channels_per_device[0], n_bytes_per_item, max_samples_per_block[0], usrp->get_rx_rate(), trigger_threshold, trigger_window,
+                                             trigger_min_duration, trigger_holdoff, trigger_pre, trigger_post, n_samples_saved, trigger_count) == 0)
+                throw std::runtime_error("Unable to initialize trigger, trigger_window and trigger_post must be at least 1.");
+        }
+
+        // initialize psd, its workers serve all devices
+        if (psd_fft > 0) {
+            if (psd_output.size() == 0)
+                psd_output = save_dir_list[0] + "/spectrogram.psd";
+            if (channelsounder::init_psd(n_channels_per_device, max_samples_per_block, n_bytes_per_item, usrp->get_rx_rate(), psd_fft, psd_bins, psd_integration, psd_fraction, psd_output, psd_threads) == 0)
+                throw std::runtime_error("Unable to initialize psd, psd_bins must divide psd_fft and psd_fraction must be within 0 and 1.");
+            for (size_t i = 0; i < psd_threads; i++) {
+                auto psd_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
+                    channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_PSD, i);
+                    channelsounder::run_psd_worker(burst_timer_elapsed);
+                });
+                uhd::set_thread_name(psd_thread, "psd_worker");
+            }
+        }
+
+        // initialize preview
+        if (preview_addr.size() > 0) {
+            if (channelsounder::init_preview(n_channels_per_device, n_bytes_per_item, usrp->get_rx_rate(), preview_interval/1.0e3, preview_fraction, preview_samples, preview_decimation, preview_addr, preview_ttl) == 0)
+                throw std::runtime_error("Unable to initialize preview, check preview_addr, preview_interval, preview_fraction and preview_samples.");
+        }
+
+        // initialize packet filter
+        if (packet_formats.size() > 0) {
+            std::vector<std::string> format_list;
+            std::vector<std::string> formats;
+            boost::split(format_list, packet_formats, boost::is_any_of("\"',"));
+            for (size_t i = 0; i < format_list.size(); i++) {
+                if (format_list[i].size() > 0 and format_list[i] != "all")
+                    formats.push_back(format_list[i]);
+            }
+            std::vector<std::string> bw_list;
+            std::vector<int> bandwidths;
+            boost::split(bw_list, packet_bw, boost::is_any_of("\"',"));
+            for (size_t i = 0; i < bw_list.size(); i++) {
+                if (bw_list[i].size() > 0)
+                    bandwidths.push_back(std::stoi(bw_list[i]));
+            }
+            if (packet_output.size() == 0)
+                packet_output = save_dir_list[0] + "/packets";
+            if (channelsounder::init_packet_filter(n_channels_per_device, max_samples_per_block, n_bytes_per_item, usrp->get_rx_rate(), formats, packet_mcs_min, packet_mcs_max,
+                                                   bandwidths, packet_threshold, packet_margin, packet_cfo_tolerance, packet_output) == 0)
+                throw std::runtime_error("Unable to initialize packet filter, it needs rx_rate 20e6 and known packet_formats.");
+        }
+
+        // the sink threads start once all sinks are initialized, the first sink of each device runs in its processing thread
+        for (size_t device = 0; device < n_devices; device++) {
+            for (size_t sink = 0; sink < sinks.size(); sink++) {
+                auto process_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
+                    if (sink == 0)
+                        channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_PROCESS, device);
+                    else
+                        channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_SINK, device*(sinks.size() - 1) + sink - 1);
+                    channelsounder::process_ringbuffer_rx(device, sink, burst_timer_elapsed);
+                });
+                uhd::set_thread_name(process_thread, (sink == 0) ? "process_rx" : "sink_rx");
+            }
+        }
         boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
         // ##########
         // ##########
         // ##########
 
+        // control plane, receives udp commands independently of the rx thread
+        if (channelsounder::init_control_plane(8888, notify_port, rx_channel_nums_saved.size()) == 0)
+            throw std::runtime_error("Unable to initialize control plane.");
+        auto control_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
+            channelsounder::apply_thread_placement(channelsounder::THREAD_ROLE_CONTROL, 0);
+            channelsounder::run_control_plane(burst_timer_elapsed);
+        });
+        uhd::set_thread_name(control_thread, "control_plane");
+
         auto rx_thread = thread_group.create_thread([=, &burst_timer_elapsed]() {
             benchmark_rx_rate(usrp,
                 rx_cpu,
-                rx_stream,
-                random_nsamps,
+                rx_devices,
                 start_time,
                 burst_timer_elapsed,
                 elevate_priority,
-                rx_delay);
+                rx_delay,
+                scan_schedule_path,
+                scan_settle,
+                notify_port);
         });
         uhd::set_thread_name(rx_thread, "bmark_rx_stream");
     }
@@ -675,8 +1297,21 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
     // ##########################
     // ##########################
     // ##########################
+    channelsounder::close_psd();
+    channelsounder::close_packet_filter();
+
     channelsounder::show_debug_information_ringbuffer_rx();
+    channelsounder::show_debug_information_ddc();
+    channelsounder::show_debug_information_psd();
+    channelsounder::show_debug_information_preview();
+    channelsounder::show_debug_information_packet_filter();
+    channelsounder::show_debug_information_trigger();
     channelsounder::show_debug_information_fifo();
+    channelsounder::show_debug_information_writer();
+    channelsounder::show_debug_information_control_plane();
+    channelsounder::show_debug_information_thread_placement();
+    if (scan_schedule_path.size() > 0)
+        channelsounder::show_debug_information_scan_schedule();
     // ##########
     // ##########
     // ##########
@@ -704,11 +1339,21 @@ int UHD_SAFE_MAIN(int argc, char* argv[])
                                "  Num underruns detected:   %u\n"
                                "  Num late commands:        %u\n"
                                "  Num timeouts (Tx):        %u\n"
-                               "  Num timeouts (Rx):        %u\n")
+                               "  Num timeouts (Rx):        %u\n"
+                               "  Num merged gaps:          %u\n")
                      % num_rx_samps % num_dropped_samps % num_overruns % num_tx_samps
                      % num_seq_errors % num_seqrx_errors % num_underruns
                      % num_late_commands % num_timeouts_tx % num_timeouts_rx
+                     % (channelsounder::get_n_gaps_merged_ringbuffer_rx() + channelsounder::get_n_gaps_merged_ddc())
               << std::endl;
+    if (num_rx_samps_device.size() > 1) {
+        for (size_t device = 0; device < num_rx_samps_device.size(); device++) {
+            std::cout << boost::format("  Device %u: received %u, dropped %u, overruns %u, discarded before start %u\n")
+                             % device % num_rx_samps_device[device] % num_dropped_samps_device[device]
+                             % num_overruns_device[device] % num_trimmed_samps_device[device];
+        }
+        std::cout << std::endl;
+    }
     // finished
     std::cout << std::endl << "Done!" << std::endl << std::endl;
 
@@ -0,0 +1,618 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Replay of recorded measurements through the recording pipeline without a USRP. A replay source per device takes the place of the rx thread
+// and streams the samples of the recorded files into the ringbuffer in packets of a fixed size, paced at the original sample rate or as fast
+// as possible. Each input passes through the downconverter, the fifo and the writer as in iqrecorder.cpp and the output is compared with the
+// input sample by sample. Every input appends a line with its timing to a log, so runs with the same input can be compared.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "gap.h"
+#include "ringbuffer_rx.h"
+#include "ddc.h"
+#include "fifo_measurement.h"
+#include "writer.h"
+#include "iqrecord_reader.h"
+
+namespace po = boost::program_options;
+
+namespace {
+constexpr unsigned long long VERIFY_PIECE_SAMPLES = 1 << 20;                    // samples per channel compared at once
+constexpr double COMPLETION_TIMEOUT_SEC = 60.0;                                 // plus the duration of the replay and one second per 100 MB
+constexpr auto SPIN_BEFORE_DUE = std::chrono::microseconds(200);                // the source sleeps until shortly before a packet is due and spins the rest
+} // namespace
+
+/***********************************************************************
+ * Replay source
+ **********************************************************************/
+struct replay_config_t{
+    size_t n_devices;
+    size_t n_channels;                          // per device
+    size_t n_bytes_per_item;
+    double speed;                               // multiple of the sample rate of the input, 0 replays as fast as the pipeline takes the samples
+    size_t packet;                              // samples per recv
+    unsigned long long readahead;               // samples per channel mapped and requested from disk at once
+};
+static replay_config_t cfg;
+
+// Timing of the source of one device. Atomic, the main thread reads it after each input.
+struct replay_device_t{
+    std::atomic<unsigned long long> n_streamed;         // samples per channel of the current input, including the padding after it
+    std::atomic<unsigned long long> n_packets;
+    std::atomic<unsigned long long> late_sum_ns;        // how late the packets were committed compared to their due time
+    std::atomic<unsigned long long> late_max_ns;
+};
+static std::deque<replay_device_t> devices;
+
+// Samples of one channel of the input. Contiguous layouts are used in place, the pages of the window after the current one are requested from
+// disk before they are needed. Samples that are not contiguous in the files, i.e. stripes, are copied window by window.
+struct replay_channel_t{
+    const char* window;
+    unsigned long long window_offset;
+    unsigned long long n_window;
+    std::vector<char> copy;
+};
+
+static bool load_window(const iqrecord_t* record, const size_t ch, const unsigned long long offset, replay_channel_t& channel){
+    const unsigned long long n_samples = iqrecord_n_samples(record);
+    const unsigned long long n_window = std::min(cfg.readahead, n_samples - offset);
+    channel.window = static_cast<const char*>(iqrecord_view(record, ch, offset, n_window));
+    if(channel.window == NULL){
+        channel.copy.resize(n_window*cfg.n_bytes_per_item);
+        if(iqrecord_read(record, ch, offset, n_window, channel.copy.data()) != n_window)
+            return false;
+        channel.window = channel.copy.data();
+    }
+    channel.window_offset = offset;
+    channel.n_window = n_window;
+
+    // readahead of the next window, the view only maps it and asks the kernel to read its pages
+    const unsigned long long next_offset = offset + n_window;
+    if(next_offset < n_samples)
+        iqrecord_view(record, ch, next_offset, std::min(cfg.readahead, n_samples - next_offset));
+    return true;
+}
+
+// copies n samples of a channel from offset s on, the input must have them
+static bool copy_samples(const iqrecord_t* record, const size_t ch, replay_channel_t& channel, const unsigned long long s, const unsigned long long n, char* dst){
+    unsigned long long done = 0;
+    while(done < n){
+        if(s + done < channel.window_offset or s + done >= channel.window_offset + channel.n_window){
+            if(not load_window(record, ch, s + done, channel))
+                return false;
+        }
+        const unsigned long long offset_in_window = s + done - channel.window_offset;
+        const unsigned long long n_copy = std::min(n - done, channel.n_window - offset_in_window);
+        std::memcpy(dst + done*cfg.n_bytes_per_item, channel.window + offset_in_window*cfg.n_bytes_per_item, n_copy*cfg.n_bytes_per_item);
+        done += n_copy;
+    }
+    return true;
+}
+
+// Takes the place of receive_device() in iqrecorder.cpp. Streams the channels of the device from the input into its ringbuffer, a packet is
+// committed when its last sample is due, as recv returns it. The last ringbuffer block is only handed on when it is full, so the source
+// continues with zeros after the input until the first device sees the measurement complete or gives up.
+static void run_replay(const size_t device, const iqrecord_t* record, const double rate, const std::chrono::steady_clock::time_point t_start,
+    const double timeout_sec, std::atomic<bool>& stop_requested)
+{
+    replay_device_t& dev = devices[device];
+    const unsigned long long n_samples = iqrecord_n_samples(record);
+    const auto t_stream_max = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout_sec));
+    std::vector<replay_channel_t> channels(cfg.n_channels, replay_channel_t{NULL, 0, 0, std::vector<char>()});
+
+    std::vector<char*> buffs = channelsounder::get_ringbuffer_rx_pointers(device, 0);
+    unsigned long long s = 0;
+    while(true){
+        if(device == 0 and not stop_requested){
+            if(channelsounder::is_complete_fifo_ch_measurement())
+                stop_requested = true;
+            else if(std::chrono::steady_clock::now() - t_start > t_stream_max){
+                std::cerr << "iqreplay: measurement incomplete after " << s << " samples, stop streaming." << std::endl;
+                stop_requested = true;
+            }
+        }
+        if(stop_requested)
+            break;
+
+        const unsigned long long n = cfg.packet;
+        const unsigned long long n_input = (s < n_samples) ? std::min(n, n_samples - s) : 0;
+        for(size_t ch = 0; ch < cfg.n_channels; ch++){
+            if(n_input > 0 and not copy_samples(record, device*cfg.n_channels + ch, channels[ch], s, n_input, buffs[ch])){
+                std::cerr << "iqreplay: unable to read sample " << s << " of channel " << device*cfg.n_channels + ch << ": " << iqrecord_last_error() << std::endl;
+                stop_requested = true;
+            }
+            std::memset(buffs[ch] + n_input*cfg.n_bytes_per_item, 0, (n - n_input)*cfg.n_bytes_per_item);
+        }
+
+        // the padding is not part of the recording and is streamed as fast as possible
+        if(cfg.speed > 0.0 and n_input > 0){
+            const auto t_due = t_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((s + n_input)/(rate*cfg.speed)));
+            if(t_due - std::chrono::steady_clock::now() > SPIN_BEFORE_DUE)
+                std::this_thread::sleep_until(t_due - SPIN_BEFORE_DUE);
+            while(std::chrono::steady_clock::now() < t_due)
+                ;
+            const unsigned long long late_ns = (unsigned long long) std::max<long long>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_due).count());
+            dev.late_sum_ns += late_ns;
+            if(late_ns > dev.late_max_ns)
+                dev.late_max_ns = late_ns;
+        }
+
+        // as fast as possible means as fast as the sinks release the blocks, the padding must not overwrite the end of the input either
+        if(cfg.speed == 0.0 or n_input == 0)
+            channelsounder::wait_free_block_ringbuffer_rx(device, n);
+        buffs = channelsounder::get_ringbuffer_rx_pointers(device, n);
+        s += n;
+        dev.n_streamed = s;
+        dev.n_packets++;
+    }
+}
+
+static void feed_replay(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<channelsounder::gap_t> &gaps){
+    channelsounder::feed_ddc(device, buffs, n_new_samples, gaps);
+}
+
+/***********************************************************************
+ * Inputs and verification
+ **********************************************************************/
+// Measurements to replay, a directory stands for its .bin files, manifests and archive entries sorted by file name. Outputs of earlier replays
+// are skipped.
+static std::vector<std::string> list_inputs(const std::string& input){
+    std::vector<std::string> items, inputs;
+    boost::split(items, input, boost::is_any_of(","));
+    for(size_t i = 0; i < items.size(); i++){
+        if(items[i].size() == 0)
+            continue;
+        struct stat st;
+        if(stat(items[i].c_str(), &st) != 0 or not S_ISDIR(st.st_mode)){
+            inputs.push_back(items[i]);
+            continue;
+        }
+        std::string directory = items[i];
+        if(directory.back() != '/')
+            directory += "/";
+
+        // file name and path, an archive entry is addressed as <segment index>#<file name>
+        std::vector<std::pair<std::string, std::string>> found;
+        DIR* dir = opendir(directory.c_str());
+        struct dirent* entry;
+        while(dir != NULL and (entry = readdir(dir)) != NULL){
+            const std::string name(entry->d_name);
+            if(boost::ends_with(name, ".bin") or boost::ends_with(name, ".manifest"))
+                found.push_back(std::make_pair(name, directory + name));
+            else if(boost::starts_with(name, "archive_") and boost::ends_with(name, ".idx")){
+                std::ifstream fin(directory + name);
+                std::string line;
+                while(std::getline(fin, line)){
+                    std::istringstream ss(line);
+                    std::string key, file_name;
+                    if(ss >> key >> file_name and key == "entry")
+                        found.push_back(std::make_pair(file_name, directory + name + "#" + file_name));
+                }
+            }
+        }
+        if(dir != NULL)
+            closedir(dir);
+        std::sort(found.begin(), found.end());
+        for(size_t k = 0; k < found.size(); k++){
+            iqrecord_name_t parts;
+            if(iqrecord_parse_name(found[k].first.c_str(), &parts) and std::strcmp(parts.tag, "replay") != 0)
+                inputs.push_back(found[k].second);
+        }
+    }
+    return inputs;
+}
+
+// Number of samples of the output that differ from the input, an output that cannot be read or has the wrong size counts as entirely different.
+static unsigned long long compare_measurement(const iqrecord_t* input, const std::string& full_file_path){
+    const size_t n_channels_total = iqrecord_n_channels(input);
+    const unsigned long long n_samples = iqrecord_n_samples(input);
+    iqrecord_t* output = iqrecord_open(full_file_path.c_str(), n_channels_total, cfg.n_bytes_per_item);
+    if(output == NULL){
+        std::cerr << "iqreplay: " << iqrecord_last_error() << std::endl;
+        return n_samples*n_channels_total;
+    }
+    if(iqrecord_n_samples(output) != n_samples or iqrecord_n_channels(output) != n_channels_total){
+        std::cerr << "iqreplay: " << full_file_path << " has " << iqrecord_n_samples(output) << " samples on " << iqrecord_n_channels(output)
+                  << " channels, expected " << n_samples << " on " << n_channels_total << std::endl;
+        iqrecord_close(output);
+        return n_samples*n_channels_total;
+    }
+
+    const size_t n_bytes_per_item = cfg.n_bytes_per_item;
+    std::vector<char> samples_input(VERIFY_PIECE_SAMPLES*n_bytes_per_item);
+    std::vector<char> samples_output(VERIFY_PIECE_SAMPLES*n_bytes_per_item);
+    unsigned long long n_different = 0;
+    for(size_t ch = 0; ch < n_channels_total; ch++){
+        for(unsigned long long done = 0; done < n_samples; done += VERIFY_PIECE_SAMPLES){
+            const unsigned long long n_piece = std::min(VERIFY_PIECE_SAMPLES, n_samples - done);
+            if(iqrecord_read(input, ch, done, n_piece, samples_input.data()) != n_piece or iqrecord_read(output, ch, done, n_piece, samples_output.data()) != n_piece){
+                n_different += n_samples - done;
+                break;
+            }
+            if(std::memcmp(samples_input.data(), samples_output.data(), n_piece*n_bytes_per_item) == 0)
+                continue;
+            for(unsigned long long k = 0; k < n_piece; k++)
+                if(std::memcmp(&samples_input[k*n_bytes_per_item], &samples_output[k*n_bytes_per_item], n_bytes_per_item) != 0)
+                    n_different++;
+        }
+    }
+    iqrecord_close(output);
+    return n_different;
+}
+
+// removes all files of an output, see writer.h
+static void remove_measurement(const std::string& full_file_path){
+    // the archive recycles its segments itself
+    if(full_file_path.find('#') != std::string::npos)
+        return;
+    const std::string::size_type dot = full_file_path.find_last_of('.');
+    const std::string base = full_file_path.substr(0, dot);
+    if(full_file_path.compare(dot, std::string::npos, ".manifest") == 0){
+        std::ifstream fin(full_file_path);
+        std::string line;
+        while(std::getline(fin, line)){
+            if(line.compare(0, 5, "file ") != 0)
+                continue;
+            std::istringstream ss(line.substr(5));
+            size_t index;
+            std::string path;
+            ss >> index;
+            std::getline(ss >> std::ws, path);
+            std::remove(path.c_str());
+        }
+    }
+    std::remove(full_file_path.c_str());
+    std::remove((base + ".gaps").c_str());
+    std::remove((base + ".hashes").c_str());
+}
+
+// Waits for the completion message of the measurement with file_id, older messages are skipped. Returns false on timeout,
+// otherwise the fields separated by ';'.
+static bool receive_completion(boost::asio::ip::udp::socket& socket, const unsigned int file_id, const double timeout_sec, std::vector<std::string>& fields){
+    const auto t_end = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout_sec));
+    std::vector<char> message(65536);
+    while(std::chrono::steady_clock::now() < t_end){
+        if(socket.available() == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        boost::asio::ip::udp::endpoint sender;
+        const size_t n_bytes = socket.receive_from(boost::asio::buffer(message), sender);
+        std::string text(message.data(), n_bytes);
+        boost::split(fields, text, boost::is_any_of(";"));
+        if(fields.size() < 9 or fields[0] != "Measurement_Done_")
+            continue;
+
+        // a file that could not be written has no name
+        iqrecord_name_t name;
+        if(fields[1].size() == 0 or (iqrecord_parse_name(fields[1].c_str(), &name) and name.file_id == file_id))
+            return true;
+        std::cerr << "iqreplay: skipping completion message of " << fields[1] << std::endl;
+    }
+    return false;
+}
+
+/***********************************************************************
+ * Main
+ **********************************************************************/
+int main(int argc, char* argv[]){
+    std::string input;
+    size_t n_channels_file;
+    std::string rx_cpu;
+    double rate;
+    double speed;
+    unsigned int repeat;
+    size_t n_devices;
+    size_t packet;
+    size_t readahead_MiB;
+    size_t rb_block_samples;
+    size_t rb_blocks;
+    bool zero_fill;
+    std::string save_dirs;
+    std::string write_layout;
+    size_t stripe_size_MiB;
+    size_t io_threads;
+    size_t archive_segment_MiB;
+    size_t archive_budget_GiB;
+    size_t hash_chunk_MiB;
+    size_t stream_chunk_MiB;
+    size_t stream_budget_MiB;
+    unsigned short notify_port;
+    bool keep;
+    std::string output;
+
+    po::options_description desc("Replay of recorded measurements through the recording pipeline without a USRP, allowed options");
+    // clang-format off
+    desc.add_options()
+        ("help", "help message")
+        ("input", po::value<std::string>(&input)->default_value(SAVE_PATH), "measurements to replay, .bin files, manifests, archive entries or directories separated by ','")
+        ("channels", po::value<size_t>(&n_channels_file)->default_value(1), "number of channels of a .bin file, manifests and the archive know their channels")
+        ("rx_cpu", po::value<std::string>(&rx_cpu)->default_value("fc32"), "sample type of a .bin file (fc64, fc32, sc16, sc8)")
+        ("rate", po::value<double>(&rate)->default_value(0.0), "sample rate of the input, 0 takes it from the manifest or the archive")
+        ("speed", po::value<double>(&speed)->default_value(1.0), "replay speed as a multiple of the sample rate, 0 replays as fast as the pipeline takes the samples")
+        ("repeat", po::value<unsigned int>(&repeat)->default_value(1), "number of times the inputs are replayed")
+        ("devices", po::value<size_t>(&n_devices)->default_value(1), "number of devices the channels are split into, each with its own source, ringbuffer and processing thread")
+        ("packet", po::value<size_t>(&packet)->default_value(2000), "samples per recv")
+        ("readahead", po::value<size_t>(&readahead_MiB)->default_value(64), "MiB per channel requested from disk ahead of the replay")
+        ("rb_block_samples", po::value<size_t>(&rb_block_samples)->default_value(1000000), "samples per channel in one ringbuffer block")
+        ("rb_blocks", po::value<size_t>(&rb_blocks)->default_value(2), "number of ringbuffer blocks per device")
+        ("zero_fill", po::value<bool>(&zero_fill)->default_value(true), "replace missing samples by zeros, as in iqrecorder")
+        ("save_dirs", po::value<std::string>(&save_dirs)->default_value(SAVE_PATH), "directories the outputs are written to")
+        ("write_layout", po::value<std::string>(&write_layout)->default_value("single"), "file layout of an output (single, channel, stripes, archive)")
+        ("stripe_size", po::value<size_t>(&stripe_size_MiB)->default_value(64), "stripe size in MiB for write_layout stripes")
+        ("io_threads", po::value<size_t>(&io_threads)->default_value(0), "number of I/O threads of the writer, 0 selects one per file")
+        ("archive_segment", po::value<size_t>(&archive_segment_MiB)->default_value(1024), "size in MiB of the preallocated segment files for write_layout archive")
+        ("archive_budget", po::value<size_t>(&archive_budget_GiB)->default_value(100), "disk space in GiB of all segments for write_layout archive, the oldest segments are recycled")
+        ("hash_chunk", po::value<size_t>(&hash_chunk_MiB)->default_value(4), "chunk size in MiB of the CRC-32C hash table written with each measurement, 0 writes none")
+        ("stream_chunk", po::value<size_t>(&stream_chunk_MiB)->default_value(0), "chunk size in MiB per channel for streaming outputs to disk, 0 keeps them in memory")
+        ("stream_budget", po::value<size_t>(&stream_budget_MiB)->default_value(1024), "memory in MiB for chunks not yet written to disk when streaming")
+        ("notify_port", po::value<unsigned short>(&notify_port)->default_value(8891), "local UDP port the completion messages are received on")
+        ("keep", po::value<bool>(&keep)->default_value(false), "keep the outputs, otherwise only outputs that differ from their input are kept")
+        ("output", po::value<std::string>(&output)->default_value(""), "log with one line per input, empty for replay.log in the first save directory")
+    ;
+    // clang-format on
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return ~0;
+    }
+
+    size_t n_bytes_per_item_file = 0;
+    if (rx_cpu == "fc64")
+        n_bytes_per_item_file = 16;
+    else if (rx_cpu == "fc32")
+        n_bytes_per_item_file = 8;
+    else if (rx_cpu == "sc16")
+        n_bytes_per_item_file = 4;
+    else if (rx_cpu == "sc8")
+        n_bytes_per_item_file = 2;
+    else
+        throw std::runtime_error("Invalid rx_cpu specified.");
+    if (n_devices == 0 or packet == 0 or readahead_MiB == 0 or speed < 0.0)
+        throw std::runtime_error("devices, packet and readahead must be at least 1, speed at least 0.");
+
+    // all inputs pass through one pipeline, so they need the same channels and sample size, the rate is checked per input
+    const std::vector<std::string> inputs = list_inputs(input);
+    if (inputs.size() == 0)
+        throw std::runtime_error("No measurement to replay.");
+    size_t n_channels_total = 0, n_bytes_per_item = 0;
+    double rate_pipeline = rate;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        iqrecord_t* record = iqrecord_open(inputs[i].c_str(), n_channels_file, n_bytes_per_item_file);
+        if (record == NULL)
+            throw std::runtime_error(iqrecord_last_error());
+        if (i == 0) {
+            n_channels_total = iqrecord_n_channels(record);
+            n_bytes_per_item = iqrecord_bytes_per_sample(record);
+            if (rate_pipeline == 0.0)
+                rate_pipeline = iqrecord_sample_rate(record);
+        }
+        const bool consistent = iqrecord_n_channels(record) == n_channels_total and iqrecord_bytes_per_sample(record) == n_bytes_per_item;
+        const bool has_rate = rate > 0.0 or iqrecord_sample_rate(record) > 0.0;
+        const bool empty = iqrecord_n_samples(record) == 0;
+        iqrecord_close(record);
+        if (not consistent)
+            throw std::runtime_error("All inputs need the channels and sample size of " + inputs[0] + ", " + inputs[i] + " differs.");
+        if (speed > 0.0 and not has_rate)
+            throw std::runtime_error("The sample rate of " + inputs[i] + " is unknown, set rate or replay with speed 0.");
+        if (empty)
+            throw std::runtime_error(inputs[i] + " is empty.");
+    }
+    if (n_channels_total % n_devices != 0)
+        throw std::runtime_error("The channels of the inputs cannot be split evenly into the devices.");
+    const size_t n_channels = n_channels_total/n_devices;
+
+    cfg = {n_devices, n_channels, n_bytes_per_item, speed, packet, std::max<unsigned long long>(packet, readahead_MiB*1024ULL*1024/n_bytes_per_item)};
+    for (size_t device = 0; device < n_devices; device++)
+        devices.emplace_back();
+
+    std::atomic<bool> burst_timer_elapsed(false);
+    boost::thread_group thread_group;
+
+    // writer, fifo, downconverter and ringbuffers as in iqrecorder.cpp, the downconverter passes the samples on unchanged
+    std::vector<std::string> save_dir_list;
+    boost::split(save_dir_list, save_dirs, boost::is_any_of("\"',"));
+    channelsounder::writer_layout_t layout = channelsounder::WRITER_LAYOUT_SINGLE_FILE;
+    if (write_layout == "channel")
+        layout = channelsounder::WRITER_LAYOUT_CHANNEL_PER_FILE;
+    else if (write_layout == "stripes")
+        layout = channelsounder::WRITER_LAYOUT_STRIPES;
+    else if (write_layout == "archive")
+        layout = channelsounder::WRITER_LAYOUT_ARCHIVE;
+    else if (write_layout != "single")
+        throw std::runtime_error("Invalid write layout specified.");
+    if (channelsounder::init_writer(save_dir_list, layout, stripe_size_MiB*1024*1024, io_threads, n_channels_total, rate_pipeline) == 0)
+        throw std::runtime_error("Unable to initialize writer.");
+    if (layout == channelsounder::WRITER_LAYOUT_ARCHIVE and channelsounder::init_archive_writer(archive_segment_MiB*1024ULL*1024, archive_budget_GiB*1024ULL*1024*1024) == 0)
+        throw std::runtime_error("Unable to initialize archive.");
+    if (channelsounder::init_hash_writer(hash_chunk_MiB*1024*1024) == 0)
+        throw std::runtime_error("Unable to initialize chunk hashes.");
+    for (size_t i = 0; i < channelsounder::get_writer_n_io_threads(); i++)
+        thread_group.create_thread([&]() { channelsounder::run_writer_io(burst_timer_elapsed); });
+
+    if (channelsounder::init_fifo_ch_measurement(std::vector<size_t>(n_devices, n_channels), n_bytes_per_item, zero_fill, stream_chunk_MiB*1024*1024, stream_budget_MiB*1024*1024, rate_pipeline) == 0)
+        throw std::runtime_error("Unable to initialize fifo.");
+    thread_group.create_thread([&]() { channelsounder::send_save_ch_measurements(burst_timer_elapsed); });
+
+    std::vector<channelsounder::ringbuffer_sink_t> sinks;
+    sinks.push_back({"capture", feed_replay, channelsounder::SINK_POLICY_BLOCK, 0});
+    for (size_t device = 0; device < n_devices; device++) {
+        if (channelsounder::init_ringbuffer_rx(device, n_channels, n_bytes_per_item, packet, rb_block_samples, rb_blocks, sinks) == 0)
+            throw std::runtime_error("Unable to initialize ringbuffer, rb_block_samples must be at least 1 and rb_blocks at least 2.");
+        if (channelsounder::init_ddc(device, n_channels, rb_block_samples + 2*packet, (rate_pipeline > 0.0) ? rate_pipeline : 1.0, 0.0, 1, 32, 0) == 0)
+            throw std::runtime_error("Unable to initialize digital downconverter.");
+        thread_group.create_thread([&, device]() { channelsounder::process_ringbuffer_rx(device, 0, burst_timer_elapsed); });
+    }
+
+    // completion messages are sent to ourselves
+    boost::asio::io_service io_service;
+    boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), notify_port));
+    channelsounder::set_notification_receiver("127.0.0.1", notify_port);
+
+    // the configuration is part of the log, so logs of two runs show whether they can be compared
+    if (output.size() == 0)
+        output = save_dir_list[0] + "/replay.log";
+    std::ofstream log(output);
+    log << "# inputs " << inputs.size() << ", repeat " << repeat << ", speed " << speed << ", rate " << rate << ", devices " << n_devices << ", packet " << packet
+        << ", rb_block_samples " << rb_block_samples << ", rb_blocks " << rb_blocks << ", write_layout " << write_layout << ", stream_chunk " << stream_chunk_MiB << std::endl;
+    log << "# time_sec measurement n_samples n_bytes replay_sec throughput_MSps late_mean_us late_max_us dropped_samples write_MBps different_samples input" << std::endl;
+
+    std::cout << "iqreplay: " << inputs.size() << " inputs with " << n_channels_total << " channels of " << n_bytes_per_item << " bytes on " << n_devices
+              << " devices, speed " << speed << ", log " << output << std::endl;
+
+    const auto t_start = std::chrono::steady_clock::now();
+    unsigned long long n_replayed = 0;
+    unsigned long long n_different_outputs = 0;
+    unsigned long long n_samples_total = 0;
+    unsigned long long n_dropped_total = 0;
+    double replay_sec_total = 0.0;
+    double late_max_us_total = 0.0;
+    for (unsigned int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            const unsigned int file_id = (unsigned int) n_replayed;
+            iqrecord_t* record = iqrecord_open(inputs[i].c_str(), n_channels_file, n_bytes_per_item_file);
+            if (record == NULL)
+                throw std::runtime_error(iqrecord_last_error());
+            const unsigned long long n_samples = iqrecord_n_samples(record);
+            const unsigned long long n_bytes = n_samples*n_channels_total*n_bytes_per_item;
+            const double rate_input = (rate > 0.0) ? rate : iqrecord_sample_rate(record);
+            const double timeout_sec = COMPLETION_TIMEOUT_SEC + ((speed > 0.0) ? n_samples/(rate_input*speed) : 0.0) + n_bytes/100.0e6;
+
+            for (size_t device = 0; device < n_devices; device++) {
+                channelsounder::reset_ringbuffer_rx(device);
+                channelsounder::reset_ddc(device);
+                replay_device_t& dev = devices[device];
+                dev.n_streamed = dev.n_packets = dev.late_sum_ns = dev.late_max_ns = 0;
+            }
+            channelsounder::reset_fifo_ch_measurement(n_samples, file_id, "replay");
+            channelsounder::current_time(0);
+
+            // the first device is streamed in this thread, as in capture_measurement(), all devices are paced from the same start
+            const auto t_replay = std::chrono::steady_clock::now();
+            std::atomic<bool> stop_requested(false);
+            boost::thread_group source_threads;
+            for (size_t device = 1; device < n_devices; device++)
+                source_threads.create_thread([&, device]() { run_replay(device, record, rate_input, t_replay, timeout_sec, stop_requested); });
+            run_replay(0, record, rate_input, t_replay, timeout_sec, stop_requested);
+            stop_requested = true;
+            source_threads.join_all();
+            const double replay_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_replay).count();
+            if (not channelsounder::is_complete_fifo_ch_measurement())
+                channelsounder::cancel_fifo_ch_measurement();
+
+            unsigned long long n_packets = 0, late_sum_ns = 0, late_max_ns = 0;
+            for (size_t device = 0; device < n_devices; device++) {
+                n_packets += devices[device].n_packets;
+                late_sum_ns += devices[device].late_sum_ns;
+                late_max_ns = std::max<unsigned long long>(late_max_ns, devices[device].late_max_ns);
+            }
+            const double late_mean_us = (n_packets > 0) ? late_sum_ns/1.0e3/n_packets : 0.0;
+            const double late_max_us = late_max_ns/1.0e3;
+
+            // the save thread reports the file, a measurement that never completed is lost
+            std::vector<std::string> fields;
+            unsigned long long n_different = n_samples*n_channels_total;
+            unsigned long long n_dropped = 0;
+            double write_MBps = 0.0;
+            std::string full_file_path;
+            if (not channelsounder::is_complete_fifo_ch_measurement())
+                std::cerr << "iqreplay: replay of " << inputs[i] << " never completed" << std::endl;
+            else if (not receive_completion(socket, file_id, timeout_sec, fields))
+                std::cerr << "iqreplay: no completion message for " << inputs[i] << std::endl;
+            else if (fields[1].size() == 0)
+                std::cerr << "iqreplay: replay of " << inputs[i] << " could not be written" << std::endl;
+            else {
+                full_file_path = fields[1];
+                n_dropped = std::stoull(fields[3]);
+                write_MBps = std::stod(fields[5]);
+                n_different = compare_measurement(record, full_file_path);
+            }
+            iqrecord_close(record);
+
+            n_replayed++;
+            n_samples_total += n_samples;
+            n_dropped_total += n_dropped;
+            replay_sec_total += replay_sec;
+            late_max_us_total = std::max(late_max_us_total, late_max_us);
+            if (n_different > 0) {
+                n_different_outputs++;
+                std::cerr << "iqreplay: output of " << inputs[i] << " differs in " << n_different << " samples, kept " << full_file_path << std::endl;
+            } else if (not keep) {
+                remove_measurement(full_file_path);
+            }
+
+            const double time_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+            const double throughput_MSps = n_samples/std::max(replay_sec, 1.0e-9)/1.0e6;
+            log << std::fixed << std::setprecision(3) << time_sec << " " << file_id << " " << n_samples << " " << n_bytes << " " << replay_sec << " " << throughput_MSps;
+            log << " " << std::setprecision(1) << late_mean_us << " " << late_max_us << " " << n_dropped << " " << write_MBps << " " << n_different << " " << inputs[i] << std::endl;
+
+            // std::cout keeps its format for the debug output at the end
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1) << "[" << time_sec << " s] " << inputs[i] << ": " << n_samples << " samples, " << n_bytes/1.0e6 << " MB in "
+                 << std::setprecision(3) << replay_sec << " s, " << std::setprecision(1) << throughput_MSps << " MS/s, late " << late_mean_us << " us mean, "
+                 << late_max_us << " us max, " << n_dropped << " dropped, " << write_MBps << " MB/s written, " << ((n_different == 0) ? "identical" : "DIFFERENT");
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    burst_timer_elapsed = true;
+    thread_group.join_all();
+
+    channelsounder::show_debug_information_ringbuffer_rx();
+    channelsounder::show_debug_information_fifo();
+    channelsounder::show_debug_information_writer();
+
+    std::cout << std::endl
+              << boost::format("Replay summary:\n"
+                               "  Replayed:                 %u\n"
+                               "  Different outputs:        %u\n"
+                               "  Samples per channel:      %u\n"
+                               "  Dropped samples:          %u\n"
+                               "  Merged gaps:              %u\n"
+                               "  Replay time:              %.3f s\n"
+                               "  Throughput:               %.1f MS/s\n"
+                               "  Max late packet:          %.1f us\n")
+                     % n_replayed % n_different_outputs % n_samples_total % n_dropped_total
+                     % (channelsounder::get_n_gaps_merged_ringbuffer_rx() + channelsounder::get_n_gaps_merged_ddc()) % replay_sec_total
+                     % (n_samples_total/std::max(replay_sec_total, 1.0e-9)/1.0e6) % late_max_us_total
+              << std::endl;
+
+    return (n_different_outputs == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
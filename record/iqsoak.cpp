@@ -0,0 +1,651 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Soak test of the recording pipeline without a USRP. A synthetic source per device takes the place of the rx thread and streams
+// samples that carry their timestamp as a counter into the ringbuffer, with random recv sizes, start skews, injected overflows, packets
+// that repeat samples and stalls of the capture sink. The timestamps pass through the same alignment as in iqrecorder.cpp.
+// Measurements of random length pass through the downconverter, the fifo and the writer as in iqrecorder.cpp, are read back with
+// libiqrecord and checked sample by sample against the counters and their gap index. Every measurement appends a line with its
+// throughput and drop rate to a log, process/A22_plot_soak.m charts it.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "config.h"
+#include "gap.h"
+#include "ringbuffer_rx.h"
+#include "rx_align.h"
+#include "ddc.h"
+#include "fifo_measurement.h"
+#include "writer.h"
+#include "iqrecord_reader.h"
+
+namespace po = boost::program_options;
+
+namespace {
+constexpr unsigned long long MAX_ADDITIONAL_SAMPLES_PER_MEASUREMENT = 10000000; // streamed on top of twice the measurement length before giving up, as in iqrecorder.cpp
+constexpr unsigned long long LARGE_MEASUREMENT_BYTES = 1ULL << 32;              // large measurements exceed 32 bit byte offsets
+constexpr unsigned long long VERIFY_PIECE_SAMPLES = 1 << 20;                    // samples per channel compared at once
+constexpr double COMPLETION_TIMEOUT_SEC = 60.0;                                 // plus one second per 100 MB of the measurement, see get_timeout_sec()
+constexpr unsigned int MAX_ERRORS_SHOWN = 10;                                   // per measurement
+} // namespace
+
+/***********************************************************************
+ * Synthetic source
+ **********************************************************************/
+struct soak_config_t{
+    size_t n_devices;
+    size_t n_channels;                          // per device
+    size_t n_bytes_per_item;
+    double rate;                                // samples per second per channel, 0 streams as fast as the pipeline takes them
+    size_t max_packet;                          // largest number of samples per recv
+    double overflow_probability;                // per recv
+    unsigned long long max_overflow;            // largest number of samples lost in one overflow or repeated in one overlap
+    double overlap_probability;                 // per recv
+    long long max_start_skew;                   // largest offset in ticks of the first timestamp of a device from stream_time
+    double stall_probability;                   // per block handed to the capture sink
+    unsigned int stall_ms;                      // longest stall of the capture sink
+};
+static soak_config_t cfg;
+
+// State of the source of one device and what the capture sink saw. Atomic, the main thread reads the counters after each measurement.
+struct soak_device_t{
+    std::mt19937_64 rng;                                // used by the source
+    std::mt19937_64 rng_sink;                           // used by the capture sink
+    std::atomic<unsigned long long> n_streamed;         // samples per channel of the current measurement, including the overflows
+    std::atomic<unsigned long long> n_overflows;
+    std::atomic<unsigned long long> n_samples_overflow;
+    std::atomic<unsigned long long> n_overlaps;
+    std::atomic<unsigned long long> n_samples_trimmed;  // samples before stream_time or repeated, cut off by align_packet_rx()
+    std::atomic<unsigned long long> n_stalls;
+    std::atomic<unsigned long long> n_ringbuffer_gaps;  // gaps of the ringbuffer passed to the capture sink
+    std::atomic<unsigned long long> n_samples_ringbuffer;
+};
+static std::deque<soak_device_t> devices;
+
+// the sample at tick s after stream_time of channel ch carries s*256 + ch, truncated to the sample size, fc64 samples carry it twice.
+// All devices carry the same counter at the same tick, the check of the counters is a check of the alignment across devices.
+static inline uint64_t get_counter(const unsigned long long s, const size_t ch){
+    return (s << 8) | (ch & 0xff);
+}
+
+template <size_t N>
+static void fill_counters(char* dst, const size_t ch, const unsigned long long s, const unsigned long long n){
+    for(unsigned long long k = 0; k < n; k++){
+        const uint64_t counter = get_counter(s + k, ch);
+        std::memcpy(dst + k*N, &counter, (N < 8) ? N : 8);
+        if(N == 16)
+            std::memcpy(dst + k*N + 8, &counter, 8);
+    }
+}
+
+static void fill_counters(char* dst, const size_t n_bytes_per_item, const size_t ch, const unsigned long long s, const unsigned long long n){
+    switch(n_bytes_per_item){
+        case 16:
+            fill_counters<16>(dst, ch, s, n);
+            break;
+        case 8:
+            fill_counters<8>(dst, ch, s, n);
+            break;
+        case 4:
+            fill_counters<4>(dst, ch, s, n);
+            break;
+        default:
+            fill_counters<2>(dst, ch, s, n);
+            break;
+    }
+}
+
+// time the pipeline gets to save a measurement
+static double get_timeout_sec(const unsigned long long n_samples){
+    return COMPLETION_TIMEOUT_SEC + n_samples*cfg.n_devices*cfg.n_channels*cfg.n_bytes_per_item/100.0e6;
+}
+
+// Takes the place of receive_device() in iqrecorder.cpp. Streams counters into the ringbuffer of the device until the first device sees the
+// measurement complete or gives up, recv returns between 0 and max_packet samples. Each device starts at a random skew from stream_time,
+// align_packet_rx() cuts off the samples of an early start and reports a late start as a gap. An overflow is a jump of the timestamps,
+// an overlap steps them back so that the next packets repeat samples already received, both are left to align_packet_rx() as in the recorder.
+static void run_source(const size_t device, const unsigned long long n_samples, std::atomic<bool>& stop_requested){
+    soak_device_t& dev = devices[device];
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::uniform_int_distribution<size_t> packet_size(0, cfg.max_packet);
+    std::uniform_int_distribution<unsigned long long> overflow_size(1, std::max<unsigned long long>(1, cfg.max_overflow));
+
+    // ticks relative to stream_time, the timestamp of the first packet is skewed as if the devices started streaming apart
+    long long expected_ticks = 0;
+    long long packet_ticks = std::uniform_int_distribution<long long>(-cfg.max_start_skew, cfg.max_start_skew)(dev.rng);
+
+    const unsigned long long n_stream_max = 2ULL*n_samples + MAX_ADDITIONAL_SAMPLES_PER_MEASUREMENT;
+    const auto t_stream_max = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(get_timeout_sec(n_samples)));
+    const auto t_start = std::chrono::steady_clock::now();
+
+    std::vector<char*> buffs = channelsounder::get_ringbuffer_rx_pointers(device, 0);
+    unsigned long long s = 0;                   // samples streamed, including the samples missing
+    while(true){
+        if(device == 0 and not stop_requested){
+            if(channelsounder::is_complete_fifo_ch_measurement())
+                stop_requested = true;
+            // an unpaced source outruns every stall of the pipeline by far more samples, it gives up after a time instead
+            const bool exceeded = (cfg.rate > 0.0) ? (s > n_stream_max) : (std::chrono::steady_clock::now() - t_start > t_stream_max);
+            if(exceeded){
+                std::cerr << "iqsoak: measurement incomplete after " << s << " samples, stop streaming." << std::endl;
+                stop_requested = true;
+            }
+        }
+        if(stop_requested)
+            break;
+
+        // the edges are drawn more often than the sizes in between, 0 is what recv returns on a timeout
+        const double u = uniform(dev.rng);
+        const size_t n = (u < 0.05) ? 0 : ((u < 0.1) ? 1 : ((u < 0.2) ? cfg.max_packet : packet_size(dev.rng)));
+
+        // the samples of an overflow never arrive, the next packet continues after them
+        if(n > 0 and cfg.overflow_probability > 0.0 and uniform(dev.rng) < cfg.overflow_probability){
+            const unsigned long long n_missing = overflow_size(dev.rng);
+            packet_ticks += n_missing;
+            dev.n_overflows++;
+            dev.n_samples_overflow += n_missing;
+        }
+        // the next packets start with samples already received, partly or entirely
+        if(n > 0 and cfg.overlap_probability > 0.0 and uniform(dev.rng) < cfg.overlap_probability){
+            packet_ticks -= overflow_size(dev.rng);
+            dev.n_overlaps++;
+        }
+
+        // counters of samples before stream_time wrap around, they are cut off
+        for(size_t ch = 0; ch < buffs.size(); ch++)
+            fill_counters(buffs[ch], cfg.n_bytes_per_item, device*cfg.n_channels + ch, (unsigned long long) packet_ticks, n);
+        s += n;
+        const channelsounder::packet_alignment_t alignment = channelsounder::align_packet_rx(device, buffs, cfg.n_bytes_per_item, n, packet_ticks, expected_ticks);
+        packet_ticks += n;
+        s += alignment.n_missing;
+        dev.n_samples_trimmed += alignment.n_early;
+        dev.n_streamed = s;
+        buffs = channelsounder::get_ringbuffer_rx_pointers(device, alignment.n_kept);
+
+        // like recv, the source waits for samples that are not due yet
+        if(cfg.rate > 0.0){
+            const auto t_due = t_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(s/cfg.rate));
+            if(t_due - std::chrono::steady_clock::now() > std::chrono::milliseconds(1))
+                std::this_thread::sleep_until(t_due);
+        }
+    }
+}
+
+// Capture sink, counts the gaps of the ringbuffer and stalls now and then before it passes the block on like the capture of iqrecorder.cpp.
+static void feed_soak(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<channelsounder::gap_t> &gaps){
+    soak_device_t& dev = devices[device];
+    for(size_t i = 0; i < gaps.size(); i++){
+        if(gaps[i].source == channelsounder::GAP_SOURCE_RINGBUFFER){
+            dev.n_ringbuffer_gaps++;
+            dev.n_samples_ringbuffer += gaps[i].length;
+        }
+    }
+
+    if(cfg.stall_probability > 0.0 and std::uniform_real_distribution<double>(0.0, 1.0)(dev.rng_sink) < cfg.stall_probability){
+        dev.n_stalls++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::uniform_int_distribution<unsigned int>(0, cfg.stall_ms)(dev.rng_sink)));
+    }
+
+    channelsounder::feed_ddc(device, buffs, n_new_samples, gaps);
+}
+
+/***********************************************************************
+ * Verification
+ **********************************************************************/
+// Compares n samples of channel ch from offset on with the counters from s on, or with zeros. Returns the number of wrong samples.
+static unsigned long long check_samples(const iqrecord_t* record, const size_t ch, const unsigned long long offset, const unsigned long long n,
+    const unsigned long long s, const bool zeros, unsigned int& n_errors_shown)
+{
+    const size_t n_bytes_per_item = iqrecord_bytes_per_sample(record);
+    // sized to the samples compared, called twice per gap
+    std::vector<char> samples(std::min(VERIFY_PIECE_SAMPLES, n)*n_bytes_per_item);
+    std::vector<char> expected(std::min(VERIFY_PIECE_SAMPLES, n)*n_bytes_per_item, 0);
+
+    unsigned long long n_wrong = 0;
+    for(unsigned long long done = 0; done < n; done += VERIFY_PIECE_SAMPLES){
+        const unsigned long long n_piece = std::min(VERIFY_PIECE_SAMPLES, n - done);
+        if(iqrecord_read(record, ch, offset + done, n_piece, samples.data()) != n_piece)
+            return n - done;
+        if(not zeros)
+            fill_counters(expected.data(), n_bytes_per_item, ch, s + done, n_piece);
+        if(std::memcmp(samples.data(), expected.data(), n_piece*n_bytes_per_item) == 0)
+            continue;
+
+        for(unsigned long long k = 0; k < n_piece; k++){
+            if(std::memcmp(&samples[k*n_bytes_per_item], &expected[k*n_bytes_per_item], n_bytes_per_item) == 0)
+                continue;
+            n_wrong++;
+            if(n_errors_shown < MAX_ERRORS_SHOWN){
+                n_errors_shown++;
+                uint64_t found = 0;
+                std::memcpy(&found, &samples[k*n_bytes_per_item], std::min<size_t>(n_bytes_per_item, 8));
+                std::cerr << "iqsoak: channel " << ch << " sample " << offset + done + k << ": expected ";
+                if(zeros)
+                    std::cerr << "zero";
+                else
+                    std::cerr << "sample " << s + done + k;
+                std::cerr << ", found 0x" << std::hex << found << std::dec << std::endl;
+            }
+        }
+    }
+    return n_wrong;
+}
+
+// Checks every sample of a measurement. The gaps of a device are missing in its channels, with zero fill they are zeros.
+// Returns the number of wrong samples, a file that cannot be read or has the wrong length counts as entirely wrong.
+static unsigned long long verify_measurement(const std::string& full_file_path, const unsigned long long n_samples){
+    const size_t n_channels_total = cfg.n_devices*cfg.n_channels;
+    iqrecord_t* record = iqrecord_open(full_file_path.c_str(), n_channels_total, cfg.n_bytes_per_item);
+    if(record == NULL){
+        std::cerr << "iqsoak: " << iqrecord_last_error() << std::endl;
+        return n_samples*n_channels_total;
+    }
+    if(iqrecord_n_samples(record) != n_samples or iqrecord_n_channels(record) != n_channels_total){
+        std::cerr << "iqsoak: " << full_file_path << " has " << iqrecord_n_samples(record) << " samples on " << iqrecord_n_channels(record)
+                  << " channels, expected " << n_samples << " on " << n_channels_total << std::endl;
+        iqrecord_close(record);
+        return n_samples*n_channels_total;
+    }
+
+    const bool zero_fill = iqrecord_zero_fill(record) != 0;
+    unsigned long long n_wrong = 0;
+    unsigned int n_errors_shown = 0;
+    for(size_t ch = 0; ch < n_channels_total; ch++){
+        const size_t device = ch/cfg.n_channels;
+
+        // position in the file and counter expected there, without zero fill the counters jump over the gaps
+        unsigned long long offset = 0;
+        unsigned long long s = 0;
+        for(size_t i = 0; i < iqrecord_n_gaps(record); i++){
+            unsigned long long gap_offset, gap_length;
+            size_t gap_device;
+            iqrecord_gap(record, i, &gap_offset, &gap_length, &gap_device);
+            if(gap_device != device)
+                continue;
+            if(gap_offset < offset or gap_offset > n_samples){
+                std::cerr << "iqsoak: gap at " << gap_offset << " of device " << device << " out of order" << std::endl;
+                n_wrong++;
+                continue;
+            }
+
+            n_wrong += check_samples(record, ch, offset, gap_offset - offset, s, false, n_errors_shown);
+            s += gap_offset - offset + gap_length;
+            offset = gap_offset;
+            if(zero_fill){
+                const unsigned long long n_zeros = std::min(gap_length, n_samples - offset);
+                n_wrong += check_samples(record, ch, offset, n_zeros, 0, true, n_errors_shown);
+                offset += n_zeros;
+            }
+        }
+        n_wrong += check_samples(record, ch, offset, n_samples - offset, s, false, n_errors_shown);
+    }
+
+    iqrecord_close(record);
+    return n_wrong;
+}
+
+// removes the files of a measurement, with a manifest also the files it lists
+static void remove_measurement(const std::string& full_file_path){
+    // the archive recycles its segments itself
+    if(full_file_path.find('#') != std::string::npos)
+        return;
+    const std::string::size_type dot = full_file_path.find_last_of('.');
+    const std::string base = full_file_path.substr(0, dot);
+    if(full_file_path.compare(dot, std::string::npos, ".manifest") == 0){
+        std::ifstream fin(full_file_path);
+        std::string line;
+        while(std::getline(fin, line)){
+            if(line.compare(0, 5, "file ") != 0)
+                continue;
+            std::istringstream ss(line.substr(5));
+            size_t index;
+            std::string path;
+            ss >> index;
+            std::getline(ss >> std::ws, path);
+            std::remove(path.c_str());
+        }
+    }
+    std::remove(full_file_path.c_str());
+    std::remove((base + ".gaps").c_str());
+    std::remove((base + ".hashes").c_str());
+}
+
+// Waits for the completion message of the measurement with file_id, older messages are skipped. Returns false on timeout,
+// otherwise the fields separated by ';'.
+static bool receive_completion(boost::asio::ip::udp::socket& socket, const unsigned int file_id, const double timeout_sec, std::vector<std::string>& fields){
+    const auto t_end = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout_sec));
+    std::vector<char> message(65536);
+    while(std::chrono::steady_clock::now() < t_end){
+        if(socket.available() == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        boost::asio::ip::udp::endpoint sender;
+        const size_t n_bytes = socket.receive_from(boost::asio::buffer(message), sender);
+        std::string text(message.data(), n_bytes);
+        boost::split(fields, text, boost::is_any_of(";"));
+        if(fields.size() < 9 or fields[0] != "Measurement_Done_")
+            continue;
+
+        // a file that could not be written has no name
+        iqrecord_name_t name;
+        if(fields[1].size() == 0 or (iqrecord_parse_name(fields[1].c_str(), &name) and name.file_id == file_id))
+            return true;
+        std::cerr << "iqsoak: skipping completion message of " << fields[1] << std::endl;
+    }
+    return false;
+}
+
+/***********************************************************************
+ * Main
+ **********************************************************************/
+int main(int argc, char* argv[]){
+    double duration;
+    size_t n_devices;
+    size_t n_channels;
+    std::string rx_cpu;
+    double rate;
+    size_t max_packet;
+    size_t rb_block_samples;
+    size_t rb_blocks;
+    unsigned long long min_length;
+    unsigned long long max_length;
+    unsigned int large_every;
+    bool zero_fill;
+    std::string save_dirs;
+    std::string write_layout;
+    size_t stripe_size_MiB;
+    size_t io_threads;
+    size_t archive_segment_MiB;
+    size_t archive_budget_GiB;
+    size_t hash_chunk_MiB;
+    size_t stream_chunk_MiB;
+    size_t stream_budget_MiB;
+    double overflow_probability;
+    unsigned long long max_overflow;
+    double overlap_probability;
+    unsigned long long max_start_skew;
+    double stall_probability;
+    unsigned int stall_ms;
+    unsigned short notify_port;
+    unsigned long long seed;
+    bool keep;
+    std::string output;
+
+    po::options_description desc("Soak test of the recording pipeline without a USRP, allowed options");
+    // clang-format off
+    desc.add_options()
+        ("help", "help message")
+        ("duration", po::value<double>(&duration)->default_value(60.0), "duration of the test in seconds, the last measurement is completed")
+        ("devices", po::value<size_t>(&n_devices)->default_value(1), "number of devices, each with its own source, ringbuffer and processing thread")
+        ("channels", po::value<size_t>(&n_channels)->default_value(2), "channels per device")
+        ("rx_cpu", po::value<std::string>(&rx_cpu)->default_value("fc32"), "sample type on the host (fc64, fc32, sc16, sc8)")
+        ("rate", po::value<double>(&rate)->default_value(0.0), "samples per second per channel of the source, 0 streams as fast as the pipeline takes the samples")
+        ("max_packet", po::value<size_t>(&max_packet)->default_value(2000), "largest number of samples per recv, recv sizes are random from 0 to max_packet")
+        ("rb_block_samples", po::value<size_t>(&rb_block_samples)->default_value(100003), "samples per channel in one ringbuffer block")
+        ("rb_blocks", po::value<size_t>(&rb_blocks)->default_value(4), "number of ringbuffer blocks per device")
+        ("min_length", po::value<unsigned long long>(&min_length)->default_value(1), "shortest measurement in samples per channel")
+        ("max_length", po::value<unsigned long long>(&max_length)->default_value(20000000), "longest measurement in samples per channel")
+        ("large_every", po::value<unsigned int>(&large_every)->default_value(0), "every large_every-th measurement is larger than 4 GiB in total, 0 never")
+        ("zero_fill", po::value<bool>(&zero_fill)->default_value(true), "replace missing samples by zeros, as in iqrecorder")
+        ("save_dirs", po::value<std::string>(&save_dirs)->default_value(SAVE_PATH), "directories the measurements are written to")
+        ("write_layout", po::value<std::string>(&write_layout)->default_value("single"), "file layout of a measurement (single, channel, stripes, archive)")
+        ("stripe_size", po::value<size_t>(&stripe_size_MiB)->default_value(64), "stripe size in MiB for write_layout stripes")
+        ("io_threads", po::value<size_t>(&io_threads)->default_value(0), "number of I/O threads of the writer, 0 selects one per file")
+        ("archive_segment", po::value<size_t>(&archive_segment_MiB)->default_value(256), "size in MiB of the preallocated segment files for write_layout archive")
+        ("archive_budget", po::value<size_t>(&archive_budget_GiB)->default_value(2), "disk space in GiB of all segments for write_layout archive, the oldest segments are recycled")
+        ("hash_chunk", po::value<size_t>(&hash_chunk_MiB)->default_value(4), "chunk size in MiB of the CRC-32C hash table written with each measurement, 0 writes none")
+        ("stream_chunk", po::value<size_t>(&stream_chunk_MiB)->default_value(0), "chunk size in MiB per channel for streaming measurements to disk, 0 keeps measurements in memory")
+        ("stream_budget", po::value<size_t>(&stream_budget_MiB)->default_value(1024), "memory in MiB for chunks not yet written to disk when streaming")
+        ("overflow_probability", po::value<double>(&overflow_probability)->default_value(1e-4), "probability of an overflow per recv")
+        ("max_overflow", po::value<unsigned long long>(&max_overflow)->default_value(100000), "largest number of samples lost in one overflow or repeated in one overlap")
+        ("overlap_probability", po::value<double>(&overlap_probability)->default_value(1e-4), "probability per recv that the timestamps step back and the next packets repeat samples")
+        ("max_start_skew", po::value<unsigned long long>(&max_start_skew)->default_value(10000), "largest offset in samples of the first timestamp of a device from the start time, early samples are cut off and a late start is a gap")
+        ("stall_probability", po::value<double>(&stall_probability)->default_value(0.01), "probability that the capture sink stalls before a block")
+        ("stall_ms", po::value<unsigned int>(&stall_ms)->default_value(50), "longest stall of the capture sink in ms")
+        ("notify_port", po::value<unsigned short>(&notify_port)->default_value(8890), "local UDP port the completion messages are received on")
+        ("seed", po::value<unsigned long long>(&seed)->default_value(0), "seed of the random numbers, 0 for a random seed")
+        ("keep", po::value<bool>(&keep)->default_value(false), "keep the measurements, otherwise only measurements that failed the check are kept")
+        ("output", po::value<std::string>(&output)->default_value(""), "log with one line per measurement, empty for soak.log in the first save directory")
+    ;
+    // clang-format on
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return ~0;
+    }
+
+    size_t n_bytes_per_item = 0;
+    if (rx_cpu == "fc64")
+        n_bytes_per_item = 16;
+    else if (rx_cpu == "fc32")
+        n_bytes_per_item = 8;
+    else if (rx_cpu == "sc16")
+        n_bytes_per_item = 4;
+    else if (rx_cpu == "sc8")
+        n_bytes_per_item = 2;
+    else
+        throw std::runtime_error("Invalid rx_cpu specified.");
+    if (n_devices == 0 or n_channels == 0 or max_packet == 0 or min_length == 0 or min_length > max_length)
+        throw std::runtime_error("devices, channels, max_packet and min_length must be at least 1 and max_length at least min_length.");
+    const size_t n_channels_total = n_devices*n_channels;
+    const unsigned long long large_length = (LARGE_MEASUREMENT_BYTES + n_channels_total*n_bytes_per_item - 1)/(n_channels_total*n_bytes_per_item);
+
+    if (seed == 0)
+        seed = std::random_device()();
+    std::mt19937_64 rng(seed);
+    cfg = {n_devices, n_channels, n_bytes_per_item, rate, max_packet, overflow_probability, max_overflow, overlap_probability, (long long) max_start_skew, stall_probability, stall_ms};
+    for (size_t device = 0; device < n_devices; device++) {
+        devices.emplace_back();
+        devices[device].rng.seed(seed + 2*device + 1);
+        devices[device].rng_sink.seed(seed + 2*device + 2);
+    }
+
+    std::atomic<bool> burst_timer_elapsed(false);
+    boost::thread_group thread_group;
+
+    // writer, fifo, downconverter and ringbuffers as in iqrecorder.cpp, the downconverter passes the samples on unchanged
+    std::vector<std::string> save_dir_list;
+    boost::split(save_dir_list, save_dirs, boost::is_any_of("\"',"));
+    channelsounder::writer_layout_t layout = channelsounder::WRITER_LAYOUT_SINGLE_FILE;
+    if (write_layout == "channel")
+        layout = channelsounder::WRITER_LAYOUT_CHANNEL_PER_FILE;
+    else if (write_layout == "stripes")
+        layout = channelsounder::WRITER_LAYOUT_STRIPES;
+    else if (write_layout == "archive")
+        layout = channelsounder::WRITER_LAYOUT_ARCHIVE;
+    else if (write_layout != "single")
+        throw std::runtime_error("Invalid write layout specified.");
+    if (channelsounder::init_writer(save_dir_list, layout, stripe_size_MiB*1024*1024, io_threads, n_channels_total, rate) == 0)
+        throw std::runtime_error("Unable to initialize writer.");
+    if (layout == channelsounder::WRITER_LAYOUT_ARCHIVE and channelsounder::init_archive_writer(archive_segment_MiB*1024ULL*1024, archive_budget_GiB*1024ULL*1024*1024) == 0)
+        throw std::runtime_error("Unable to initialize archive.");
+    if (channelsounder::init_hash_writer(hash_chunk_MiB*1024*1024) == 0)
+        throw std::runtime_error("Unable to initialize chunk hashes.");
+    for (size_t i = 0; i < channelsounder::get_writer_n_io_threads(); i++)
+        thread_group.create_thread([&]() { channelsounder::run_writer_io(burst_timer_elapsed); });
+
+    if (channelsounder::init_fifo_ch_measurement(std::vector<size_t>(n_devices, n_channels), n_bytes_per_item, zero_fill, stream_chunk_MiB*1024*1024, stream_budget_MiB*1024*1024, rate) == 0)
+        throw std::runtime_error("Unable to initialize fifo.");
+    thread_group.create_thread([&]() { channelsounder::send_save_ch_measurements(burst_timer_elapsed); });
+
+    std::vector<channelsounder::ringbuffer_sink_t> sinks;
+    sinks.push_back({"capture", feed_soak, channelsounder::SINK_POLICY_BLOCK, 0});
+    for (size_t device = 0; device < n_devices; device++) {
+        if (channelsounder::init_ringbuffer_rx(device, n_channels, n_bytes_per_item, max_packet, rb_block_samples, rb_blocks, sinks) == 0)
+            throw std::runtime_error("Unable to initialize ringbuffer, rb_block_samples must be at least 1 and rb_blocks at least 2.");
+        if (channelsounder::init_ddc(device, n_channels, rb_block_samples + 2*max_packet, (rate > 0.0) ? rate : 1.0, 0.0, 1, 32, 0) == 0)
+            throw std::runtime_error("Unable to initialize digital downconverter.");
+        thread_group.create_thread([&, device]() { channelsounder::process_ringbuffer_rx(device, 0, burst_timer_elapsed); });
+    }
+
+    // completion messages are sent to ourselves
+    boost::asio::io_service io_service;
+    boost::asio::ip::udp::socket socket(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), notify_port));
+    channelsounder::set_notification_receiver("127.0.0.1", notify_port);
+
+    if (output.size() == 0)
+        output = save_dir_list[0] + "/soak.log";
+    std::ofstream log(output);
+    log << "# seed " << seed << std::endl;
+    log << "# time_sec measurement n_samples n_bytes capture_sec throughput_MSps dropped_samples drop_rate write_MBps overflows ringbuffer_gaps stalls wrong_samples" << std::endl;
+
+    std::cout << "iqsoak: " << n_devices << " devices with " << n_channels << " channels of " << rx_cpu << ", seed " << seed << ", log " << output << std::endl;
+
+    const auto t_start = std::chrono::steady_clock::now();
+    unsigned long long n_measurements = 0;
+    unsigned long long n_failed = 0;
+    unsigned long long n_bytes_verified = 0;
+    unsigned long long n_overflows_total = 0, n_ringbuffer_gaps_total = 0, n_stalls_total = 0, n_overlaps_total = 0, n_samples_trimmed_total = 0;
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count() < duration) {
+        const unsigned int file_id = (unsigned int) n_measurements;
+
+        // lengths are drawn log uniformly, short measurements end within the first block
+        unsigned long long n_samples;
+        if (large_every > 0 and n_measurements % large_every == large_every - 1)
+            n_samples = std::uniform_int_distribution<unsigned long long>(large_length, large_length + large_length/16)(rng);
+        else
+            n_samples = (unsigned long long) std::exp(std::uniform_real_distribution<double>(std::log((double) min_length), std::log((double) max_length + 1.0))(rng));
+        n_samples = std::max(min_length, n_samples);
+        const unsigned long long n_bytes = n_samples*n_channels_total*n_bytes_per_item;
+
+        for (size_t device = 0; device < n_devices; device++) {
+            channelsounder::reset_ringbuffer_rx(device);
+            channelsounder::reset_ddc(device);
+            soak_device_t& dev = devices[device];
+            dev.n_streamed = dev.n_overflows = dev.n_samples_overflow = dev.n_overlaps = dev.n_samples_trimmed = dev.n_stalls = dev.n_ringbuffer_gaps = dev.n_samples_ringbuffer = 0;
+        }
+        channelsounder::reset_fifo_ch_measurement(n_samples, file_id, "soak");
+        channelsounder::current_time(0);
+
+        // the first device is streamed in this thread, as in capture_measurement()
+        const auto t_capture = std::chrono::steady_clock::now();
+        std::atomic<bool> stop_requested(false);
+        boost::thread_group source_threads;
+        for (size_t device = 1; device < n_devices; device++)
+            source_threads.create_thread([&, device]() { run_source(device, n_samples, stop_requested); });
+        run_source(0, n_samples, stop_requested);
+        stop_requested = true;
+        source_threads.join_all();
+        const double capture_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_capture).count();
+        if (not channelsounder::is_complete_fifo_ch_measurement())
+            channelsounder::cancel_fifo_ch_measurement();
+
+        unsigned long long n_overflows = 0, n_ringbuffer_gaps = 0, n_stalls = 0;
+        for (size_t device = 0; device < n_devices; device++) {
+            n_overflows += devices[device].n_overflows;
+            n_overlaps_total += devices[device].n_overlaps;
+            n_samples_trimmed_total += devices[device].n_samples_trimmed;
+            n_ringbuffer_gaps += devices[device].n_ringbuffer_gaps;
+            n_stalls += devices[device].n_stalls;
+        }
+        n_overflows_total += n_overflows;
+        n_ringbuffer_gaps_total += n_ringbuffer_gaps;
+        n_stalls_total += n_stalls;
+
+        // the save thread reports the file, a measurement that never completed is lost
+        std::vector<std::string> fields;
+        unsigned long long n_wrong = n_samples*n_channels_total;
+        unsigned long long n_dropped = 0;
+        double write_MBps = 0.0;
+        std::string full_file_path;
+        if (not channelsounder::is_complete_fifo_ch_measurement())
+            std::cerr << "iqsoak: measurement " << file_id << " never completed" << std::endl;
+        else if (not receive_completion(socket, file_id, get_timeout_sec(n_samples), fields))
+            std::cerr << "iqsoak: no completion message for measurement " << file_id << std::endl;
+        else if (fields[1].size() == 0)
+            std::cerr << "iqsoak: measurement " << file_id << " could not be written" << std::endl;
+        else {
+            full_file_path = fields[1];
+            n_dropped = std::stoull(fields[3]);
+            write_MBps = std::stod(fields[5]);
+            if (std::stoull(fields[2]) != n_samples)
+                std::cerr << "iqsoak: completion message reports " << fields[2] << " samples, expected " << n_samples << std::endl;
+            else
+                n_wrong = verify_measurement(full_file_path, n_samples);
+        }
+
+        n_measurements++;
+        if (n_wrong > 0) {
+            n_failed++;
+            std::cerr << "iqsoak: measurement " << file_id << " of " << n_samples << " samples has " << n_wrong << " wrong samples, kept " << full_file_path << std::endl;
+        } else {
+            n_bytes_verified += n_bytes;
+            if (not keep)
+                remove_measurement(full_file_path);
+        }
+
+        const double time_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+        const double throughput_MSps = devices[0].n_streamed/std::max(capture_sec, 1.0e-9)/1.0e6;
+        const double drop_rate = (double) n_dropped/(n_samples*n_devices);
+        log << std::fixed << std::setprecision(3) << time_sec << " " << file_id << " " << n_samples << " " << n_bytes << " " << capture_sec << " " << throughput_MSps;
+        log << " " << n_dropped << " " << std::setprecision(6) << drop_rate << " " << std::setprecision(1) << write_MBps;
+        log << " " << n_overflows << " " << n_ringbuffer_gaps << " " << n_stalls << " " << n_wrong << std::endl;
+
+        // formatted apart from std::cout, whose format the later debug output relies on
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1) << "[" << time_sec << " s] measurement " << file_id << ": " << n_samples << " samples, " << n_bytes/1.0e6 << " MB, "
+             << throughput_MSps << " MS/s, " << std::setprecision(4) << 100.0*drop_rate << "% dropped, " << std::setprecision(1) << write_MBps << " MB/s written, "
+             << n_overflows << " overflows, " << n_ringbuffer_gaps << " ringbuffer gaps, " << n_stalls << " stalls, " << ((n_wrong == 0) ? "ok" : "FAILED");
+        std::cout << line.str() << std::endl;
+    }
+
+    burst_timer_elapsed = true;
+    thread_group.join_all();
+
+    channelsounder::show_debug_information_ringbuffer_rx();
+    channelsounder::show_debug_information_fifo();
+    channelsounder::show_debug_information_writer();
+
+    std::cout << std::endl
+              << boost::format("Soak summary:\n"
+                               "  Measurements:             %u\n"
+                               "  Failed:                   %u\n"
+                               "  Verified bytes:           %u\n"
+                               "  Overflows injected:       %u\n"
+                               "  Overlaps injected:        %u\n"
+                               "  Ringbuffer gaps:          %u\n"
+                               "  Merged gaps:              %u\n"
+                               "  Trimmed samples:          %u\n"
+                               "  Stalls injected:          %u\n"
+                               "  Seed:                     %u\n")
+                     % n_measurements % n_failed % n_bytes_verified % n_overflows_total % n_overlaps_total % n_ringbuffer_gaps_total
+                     % (channelsounder::get_n_gaps_merged_ringbuffer_rx() + channelsounder::get_n_gaps_merged_ddc()) % n_samples_trimmed_total % n_stalls_total % seed
+              << std::endl;
+
+    return (n_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
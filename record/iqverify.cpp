@@ -0,0 +1,368 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Verification of recorded measurements against the chunk hash tables the writer stores with them, see init_hash_writer() in writer.h.
+// The measurements are read through libiqrecord, so all layouts and the archive are checked the same way, and the chunks are hashed by
+// several threads. A corrupted chunk is reported with the channels and samples it covers.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "crc32c.h"
+#include "iqrecord_reader.h"
+
+namespace po = boost::program_options;
+
+namespace {
+constexpr size_t BATCH_MEASUREMENTS = 64;                       // measurements opened at once, their chunks are distributed over the threads
+} // namespace
+
+enum chunk_state_t{
+    CHUNK_OK = 0,
+    CHUNK_CORRUPTED = 1,
+    CHUNK_UNREADABLE = 2,
+    CHUNK_UNHASHED = 3                                          // the writer did not hash the chunk completely
+};
+
+struct measurement_t{
+    std::string path;
+    iqrecord_t* record;
+    std::string error;                                          // measurement cannot be verified at all
+    bool has_hashes;
+    unsigned long long chunk_bytes;
+    unsigned long long n_bytes;
+    std::vector<bool> hashed;
+    std::vector<uint32_t> crcs;
+    std::vector<chunk_state_t> states;
+};
+
+// Measurements to verify, a directory stands for its .bin files, manifests and archive entries sorted by file name.
+static std::vector<std::string> list_inputs(const std::string& input){
+    std::vector<std::string> items, inputs;
+    boost::split(items, input, boost::is_any_of(","));
+    for(size_t i = 0; i < items.size(); i++){
+        if(items[i].size() == 0)
+            continue;
+        struct stat st;
+        if(stat(items[i].c_str(), &st) != 0 or not S_ISDIR(st.st_mode)){
+            inputs.push_back(items[i]);
+            continue;
+        }
+        std::string directory = items[i];
+        if(directory.back() != '/')
+            directory += "/";
+
+        // file name and path, an archive entry is addressed as <segment index>#<file name>
+        std::vector<std::pair<std::string, std::string>> found;
+        DIR* dir = opendir(directory.c_str());
+        struct dirent* entry;
+        while(dir != NULL and (entry = readdir(dir)) != NULL){
+            const std::string name(entry->d_name);
+            if(boost::ends_with(name, ".bin") or boost::ends_with(name, ".manifest"))
+                found.push_back(std::make_pair(name, directory + name));
+            else if(boost::starts_with(name, "archive_") and boost::ends_with(name, ".idx")){
+                std::ifstream fin(directory + name);
+                std::string line;
+                while(std::getline(fin, line)){
+                    std::istringstream ss(line);
+                    std::string key, file_name;
+                    if(ss >> key >> file_name and key == "entry")
+                        found.push_back(std::make_pair(file_name, directory + name + "#" + file_name));
+                }
+            }
+        }
+        if(dir != NULL)
+            closedir(dir);
+        std::sort(found.begin(), found.end());
+        for(size_t k = 0; k < found.size(); k++)
+            inputs.push_back(found[k].second);
+    }
+    return inputs;
+}
+
+// the hash table is next to the file or the manifest, for the archive next to the index of the segment, as the gap index
+static std::string get_hash_path(const std::string& path){
+    const size_t hash = path.find('#');
+    if(hash != std::string::npos){
+        const size_t slash = path.find_last_of('/', hash);
+        return ((slash == std::string::npos) ? std::string("") : path.substr(0, slash + 1)) + path.substr(hash + 1) + ".hashes";
+    }
+    const size_t slash = path.find_last_of('/');
+    const size_t dot = path.find_last_of('.');
+    if(dot == std::string::npos or (slash != std::string::npos and dot < slash))
+        return path + ".hashes";
+    return path.substr(0, dot) + ".hashes";
+}
+
+// Reads the hash table of the measurement, returns false if there is none. Errors in the table are stored in the measurement.
+static bool read_hashes(measurement_t& m){
+    std::ifstream fin(get_hash_path(m.path));
+    if(not fin.is_open())
+        return false;
+
+    std::string line;
+    std::vector<std::pair<unsigned long long, uint32_t>> chunks;
+    m.chunk_bytes = 0;
+    m.n_bytes = 0;
+    while(std::getline(fin, line)){
+        std::istringstream ss(line);
+        std::string key;
+        if(not (ss >> key) or key[0] == '#')
+            continue;
+        if(key == "algorithm"){
+            std::string algorithm;
+            ss >> algorithm;
+            if(algorithm != "crc32c")
+                m.error = "unknown hash algorithm " + algorithm;
+        }
+        else if(key == "chunk_bytes")
+            ss >> m.chunk_bytes;
+        else if(key == "n_bytes")
+            ss >> m.n_bytes;
+        else if(key == "chunk"){
+            unsigned long long idx;
+            uint32_t crc;
+            if(ss >> idx >> std::hex >> crc)
+                chunks.push_back(std::make_pair(idx, crc));
+        }
+    }
+
+    const unsigned long long n_bytes_record = iqrecord_n_channels(m.record)*iqrecord_n_samples(m.record)*iqrecord_bytes_per_sample(m.record);
+    if(m.error.size() > 0)
+        return true;
+    if(m.chunk_bytes == 0 or m.chunk_bytes % iqrecord_bytes_per_sample(m.record) != 0)
+        m.error = "invalid chunk size in hash table";
+    else if(m.n_bytes != n_bytes_record)
+        m.error = "measurement has " + std::to_string(n_bytes_record) + " bytes, hash table " + std::to_string(m.n_bytes);
+    if(m.error.size() > 0)
+        return true;
+
+    const unsigned long long n_chunks = (m.n_bytes + m.chunk_bytes - 1)/m.chunk_bytes;
+    m.hashed.assign(n_chunks, false);
+    m.crcs.assign(n_chunks, 0);
+    for(size_t i = 0; i < chunks.size(); i++){
+        if(chunks[i].first >= n_chunks)
+            continue;
+        m.hashed[chunks[i].first] = true;
+        m.crcs[chunks[i].first] = chunks[i].second;
+    }
+    return true;
+}
+
+// Hashes one chunk, all channels concatenated as the writer hashed them. Pieces stored contiguously are hashed in place, others are copied.
+static chunk_state_t verify_chunk(const measurement_t& m, const unsigned long long chunk_idx, std::vector<char>& buffer){
+    if(not m.hashed[chunk_idx])
+        return CHUNK_UNHASHED;
+
+    const size_t bps = iqrecord_bytes_per_sample(m.record);
+    const unsigned long long n_bytes_channel = iqrecord_n_samples(m.record)*bps;
+    unsigned long long offset = chunk_idx*m.chunk_bytes;
+    const unsigned long long offset_end = std::min(offset + m.chunk_bytes, m.n_bytes);
+
+    uint32_t crc = 0;
+    while(offset < offset_end){
+        const size_t ch = offset / n_bytes_channel;
+        const unsigned long long sample = (offset % n_bytes_channel)/bps;
+        const unsigned long long n_samples = std::min(offset_end - offset, n_bytes_channel - offset % n_bytes_channel)/bps;
+
+        const void* data = iqrecord_view(m.record, ch, sample, n_samples);
+        if(data == NULL){
+            buffer.resize(n_samples*bps);
+            if(iqrecord_read(m.record, ch, sample, n_samples, buffer.data()) != n_samples)
+                return CHUNK_UNREADABLE;
+            data = buffer.data();
+        }
+        crc = channelsounder::crc32c_update(crc, data, n_samples*bps);
+        offset += n_samples*bps;
+    }
+
+    return (crc == m.crcs[chunk_idx]) ? CHUNK_OK : CHUNK_CORRUPTED;
+}
+
+// channels and samples of a chunk, e.g. "channel 0 samples 524288 to 786431"
+static std::string describe_chunk(const measurement_t& m, const unsigned long long chunk_idx){
+    const size_t bps = iqrecord_bytes_per_sample(m.record);
+    const unsigned long long n_bytes_channel = iqrecord_n_samples(m.record)*bps;
+    unsigned long long offset = chunk_idx*m.chunk_bytes;
+    const unsigned long long offset_end = std::min(offset + m.chunk_bytes, m.n_bytes);
+
+    std::ostringstream ss;
+    ss << "bytes " << offset << " to " << offset_end - 1;
+    while(offset < offset_end){
+        const unsigned long long n_bytes = std::min(offset_end - offset, n_bytes_channel - offset % n_bytes_channel);
+        const unsigned long long sample = (offset % n_bytes_channel)/bps;
+        ss << ", channel " << offset / n_bytes_channel << " samples " << sample << " to " << sample + n_bytes/bps - 1;
+        offset += n_bytes;
+    }
+    return ss.str();
+}
+
+int main(int argc, char* argv[]){
+    std::string input;
+    size_t n_channels_file;
+    std::string rx_cpu;
+    size_t n_threads;
+    bool quiet;
+
+    po::options_description desc("Verification of recorded measurements against their chunk hash tables, allowed options");
+    // clang-format off
+    desc.add_options()
+        ("help", "help message")
+        ("input", po::value<std::string>(&input)->default_value(SAVE_PATH), "measurements to verify, .bin files, manifests, archive entries or directories separated by ','")
+        ("channels", po::value<size_t>(&n_channels_file)->default_value(1), "number of channels of a .bin file, manifests and the archive know their channels")
+        ("rx_cpu", po::value<std::string>(&rx_cpu)->default_value("fc32"), "sample type of a .bin file (fc64, fc32, sc16, sc8)")
+        ("threads", po::value<size_t>(&n_threads)->default_value(0), "number of threads hashing chunks, 0 selects one per cpu")
+        ("quiet", po::value<bool>(&quiet)->default_value(false), "only report measurements that failed or have no hash table")
+    ;
+    // clang-format on
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return ~0;
+    }
+
+    size_t n_bytes_per_item_file = 0;
+    if (rx_cpu == "fc64")
+        n_bytes_per_item_file = 16;
+    else if (rx_cpu == "fc32")
+        n_bytes_per_item_file = 8;
+    else if (rx_cpu == "sc16")
+        n_bytes_per_item_file = 4;
+    else if (rx_cpu == "sc8")
+        n_bytes_per_item_file = 2;
+    else
+        throw std::runtime_error("Invalid rx_cpu specified.");
+    if (n_threads == 0)
+        n_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    const std::vector<std::string> inputs = list_inputs(input);
+    if (inputs.size() == 0)
+        throw std::runtime_error("No measurement to verify.");
+
+    std::cout << "iqverify: " << inputs.size() << " measurements, " << n_threads << " threads, crc32c " << channelsounder::get_crc32c_implementation() << std::endl;
+
+    const auto t_start = std::chrono::steady_clock::now();
+    unsigned long long n_verified = 0, n_without_hashes = 0, n_failed = 0;
+    unsigned long long n_chunks_corrupted = 0, n_chunks_unhashed = 0, n_bytes_verified = 0;
+    for (size_t first = 0; first < inputs.size(); first += BATCH_MEASUREMENTS) {
+        std::vector<measurement_t> measurements;
+        for (size_t i = first; i < std::min(first + BATCH_MEASUREMENTS, inputs.size()); i++) {
+            measurement_t m;
+            m.path = inputs[i];
+            m.record = iqrecord_open(inputs[i].c_str(), n_channels_file, n_bytes_per_item_file);
+            m.has_hashes = false;
+            m.chunk_bytes = m.n_bytes = 0;
+            if (m.record == NULL)
+                m.error = iqrecord_last_error();
+            else
+                m.has_hashes = read_hashes(m);
+            m.states.assign(m.hashed.size(), CHUNK_UNHASHED);
+            measurements.push_back(m);
+        }
+
+        // chunks of all measurements of the batch, so small measurements keep all threads busy as well
+        std::vector<std::pair<size_t, unsigned long long>> work;
+        for (size_t k = 0; k < measurements.size(); k++)
+            if (measurements[k].has_hashes and measurements[k].error.size() == 0)
+                for (unsigned long long c = 0; c < measurements[k].hashed.size(); c++)
+                    work.push_back(std::make_pair(k, c));
+
+        // each chunk state is written by exactly one thread
+        std::atomic<size_t> next(0);
+        boost::thread_group threads;
+        for (size_t t = 0; t < n_threads; t++) {
+            threads.create_thread([&]() {
+                std::vector<char> buffer;
+                for (size_t w = next++; w < work.size(); w = next++) {
+                    measurement_t& m = measurements[work[w].first];
+                    m.states[work[w].second] = verify_chunk(m, work[w].second, buffer);
+                }
+            });
+        }
+        threads.join_all();
+
+        for (size_t k = 0; k < measurements.size(); k++) {
+            measurement_t& m = measurements[k];
+            if (m.record == NULL or m.error.size() > 0) {
+                n_failed++;
+                std::cout << m.path << ": FAILED, " << m.error << std::endl;
+            }
+            else if (not m.has_hashes) {
+                n_without_hashes++;
+                std::cout << m.path << ": no hash table" << std::endl;
+            }
+            else {
+                unsigned long long n_bad = 0, n_unhashed = 0;
+                for (size_t c = 0; c < m.states.size(); c++) {
+                    if (m.states[c] == CHUNK_UNHASHED)
+                        n_unhashed++;
+                    else if (m.states[c] != CHUNK_OK)
+                        n_bad++;
+                }
+                n_verified++;
+                n_chunks_corrupted += n_bad;
+                n_chunks_unhashed += n_unhashed;
+                n_bytes_verified += m.n_bytes;
+                if (n_bad > 0)
+                    n_failed++;
+                if (n_bad > 0 or not quiet)
+                    std::cout << m.path << ": " << m.states.size() << " chunks, " << ((n_bad == 0) ? "ok" : "CORRUPTED")
+                              << ((n_unhashed > 0) ? ", " + std::to_string(n_unhashed) + " without hash" : std::string("")) << std::endl;
+                for (size_t c = 0; c < m.states.size(); c++) {
+                    if (m.states[c] == CHUNK_CORRUPTED or m.states[c] == CHUNK_UNREADABLE)
+                        std::cout << "  chunk " << c << ((m.states[c] == CHUNK_CORRUPTED) ? " corrupted, " : " unreadable, ") << describe_chunk(m, c) << std::endl;
+                }
+            }
+            if (m.record != NULL)
+                iqrecord_close(m.record);
+        }
+    }
+    const double duration_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    std::cout << std::endl
+              << boost::format("Verification summary:\n"
+                               "  Measurements:             %u\n"
+                               "  Verified:                 %u\n"
+                               "  Without hash table:       %u\n"
+                               "  Failed:                   %u\n"
+                               "  Corrupted chunks:         %u\n"
+                               "  Chunks without hash:      %u\n"
+                               "  Verified GB:              %.3f\n"
+                               "  Throughput:               %.1f MB/s\n")
+                     % inputs.size() % n_verified % n_without_hashes % n_failed % n_chunks_corrupted % n_chunks_unhashed
+                     % (n_bytes_verified/1.0e9) % (n_bytes_verified/1.0e6/std::max(duration_sec, 1.0e-9))
+              << std::endl;
+
+    return (n_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
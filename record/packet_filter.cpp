@@ -0,0 +1,1111 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+
+#include "packet_filter.h"
+#include "fft.h"
+
+#define PKT_RATE                        20.0e6      // the preamble is decoded at the rate of a 20 MHz channel
+#define PKT_STF_LAG                     16          // period of the short training field
+#define PKT_STF_WINDOW                  48          // samples of the autocorrelation
+#define PKT_STF_PLATEAU                 48          // consecutive positions above the threshold that detect a short training field
+#define PKT_STF_METRIC                  0.8         // normalized autocorrelation of a short training field
+#define PKT_STF_SKIP                    160         // samples skipped after a detection that could not be decoded
+#define PKT_LTF_OFFSET                  192         // from the start of the packet to the first long training symbol
+#define PKT_LTF_EARLY                   32          // the first long training symbol is searched from PKT_LTF_EARLY before ...
+#define PKT_LTF_LATE                    96          // ... until PKT_LTF_LATE after its expected position
+#define PKT_FFT_BACKOFF                 2           // fft windows start within the guard interval
+#define PKT_LOOKAHEAD                   1024        // samples after a detection needed to decode the preamble
+#define PKT_MAX_DURATION_US             5484        // longest packet L-SIG announces, 4095 bytes at 6 Mbit/s
+#define PKT_RL_SIG_CORR                 0.5         // correlation of L-SIG and RL-SIG of HE packets
+#define PKT_QBPSK_RATIO                 2.0f        // power of the quadrature over the in-phase part of a QBPSK symbol
+#define PKT_MAX_MAC_BYTES               512         // legacy frames up to this length are decoded for their MAC addresses
+#define PKT_SIFS                        320         // from the end of a packet to the start of its response, 16 us
+#define PKT_SIFS_TOLERANCE              80          // deviation of the start of a response from PKT_SIFS
+#define PKT_MAX_RECENT                  16          // packets remembered to find the packet a response answers
+#define PKT_MAX_STATIONS                256         // transmitters told apart per device
+#define PKT_STATION_AVERAGE             16          // packets the frequency offset of a station is averaged over
+
+namespace channelsounder
+{
+enum packet_format_t{
+    PKT_FORMAT_LEGACY = 0,
+    PKT_FORMAT_HT = 1,
+    PKT_FORMAT_VHT = 2,
+    PKT_FORMAT_HE_SU = 3,
+    PKT_FORMAT_HE_TB = 4,
+    PKT_FORMAT_HE_MU = 5,                               // HE-MU and HE-ER-SU
+    PKT_FORMAT_COUNT = 6
+};
+
+static const char* format_names[PKT_FORMAT_COUNT] = {"legacy", "ht", "vht", "he_su", "he_tb", "he_mu"};
+
+// fields of L-SIG and HE-SIG-A, -1 if not decoded
+struct packet_info_t{
+    packet_format_t format;
+    int bandwidth_mhz;
+    int mcs;
+    int length;
+    int dcm;
+    int coding;
+    int n_sts;
+    int bss_color;
+    int ul_dl;
+    double snr_db;
+    double cfo_hz;
+};
+
+// decoded packet waiting for its samples and its response, indices since the start of the measurement
+struct packet_pending_t{
+    unsigned long long start;                           // window, the packet itself if it is not kept
+    unsigned long long end;
+    unsigned long long packet_start;
+    unsigned long long packet_end;
+    unsigned long long first;                           // reference of the frequency offset correction
+    unsigned long long ltf;                             // first sample of the first long training symbol
+    double w;                                           // frequency offset in rad per sample
+    cf32_t H[57];                                       // channel of subcarriers -28 to 28
+    bool keep;                                          // the window is written
+    bool decode_mac;                                    // the MAC header of a legacy frame is decoded
+    int station;                                        // transmitter, -1 if unknown
+    int rx_station;                                     // station of the response, -1 if there is none
+    int solicitation;                                   // station of the packet this one answers, -1 if there is none
+    packet_info_t info;
+};
+
+// recently decoded packet, a packet starting PKT_SIFS after the end of another one is its response
+struct packet_recent_t{
+    unsigned long long start;
+    unsigned long long end;
+    int station;
+};
+
+// transmitter told apart from the others by its frequency offset, its address is learned from the legacy frames it sends or answers
+struct packet_station_t{
+    double cfo_hz;
+    unsigned long long n_packets;
+    bool mac_known;
+    uint8_t mac[6];
+};
+
+struct packet_device_t{
+    size_t device;
+    size_t n_channels;
+
+    // measurement
+    unsigned int file_id;
+    double start_time_epoch_sec;
+    unsigned long long n_in;                            // index of the next input sample, gaps included
+    std::atomic<unsigned long long> n_kept_measurement{0};  // read by the rx thread
+
+    // samples of all channels since work_start, sample work_start + i of channel ch is work[ch*capacity + i]
+    std::vector<cf32_t> work;
+    size_t capacity;
+    unsigned long long work_start;
+    size_t work_len;
+    unsigned long long n_scan;                          // next position the short training field is searched at
+    std::deque<packet_pending_t> pending;               // packets whose window or response is incomplete
+    std::deque<packet_recent_t> recent;
+    std::vector<packet_station_t> stations;
+
+    // preamble decoding
+    std::vector<cf32_t> preamble;                       // samples after a detection, frequency offset corrected
+    std::vector<cf32_t> fft_out;
+    std::vector<cf32_t> fft_scratch;
+
+    // data field of legacy frames
+    std::vector<float> llr;
+    std::vector<uint8_t> bits;
+    std::vector<uint64_t> decisions;
+
+    // statistics
+    unsigned long long n_detected = 0;
+    unsigned long long n_lsig_failed = 0;
+    unsigned long long n_siga_failed = 0;
+    unsigned long long n_format[PKT_FORMAT_COUNT] = {};
+    unsigned long long n_kept = 0;
+    unsigned long long n_rejected = 0;
+    unsigned long long n_dropped = 0;
+    unsigned long long n_mac_decoded = 0;
+    unsigned long long n_fcs_failed = 0;
+    unsigned long long n_linked = 0;                    // kept packets with a known transmitter and receiver
+    unsigned long long n_samples_total = 0;
+    double process_time_sec = 0.0;
+    double decode_time_sec = 0.0;                       // preambles and MAC headers
+};
+
+// deque, elements are never moved
+static std::deque<packet_device_t> devices;
+
+static size_t n_bytes_per_item;
+static double rate;
+static bool keep_format[PKT_FORMAT_COUNT];
+static int mcs_min;
+static int mcs_max;
+static std::vector<int> bandwidths_mhz;
+static double stf_power_min;                            // sum of the power over PKT_STF_WINDOW samples
+static size_t margin;
+static double cfo_tolerance_hz;
+static fft_plan_t plan;
+
+// L-LTF of subcarriers -26 to 26 and its time domain symbol
+static const int8_t ltf_freq[53] = {1, 1, -1, -1, 1, 1, -1, 1, -1, 1, 1, 1, 1, 1, 1, -1, -1, 1, 1, -1, 1, -1, 1, 1, 1, 1, 0,
+                                    1, -1, -1, 1, 1, -1, 1, -1, 1, -1, -1, -1, -1, -1, 1, 1, -1, -1, 1, -1, 1, -1, 1, 1, 1, 1};
+static cf32_t ltf_time[64];
+
+// pilots and their polarity, symbol n after the L-LTF uses pilot_polarity[n % 127]
+static const int pilot_sc[4] = {-21, -7, 7, 21};
+static const float pilot_val[4] = {1.0f, 1.0f, 1.0f, -1.0f};
+static float pilot_polarity[127];
+
+// legacy rates by MCS 0 to 7 (6 to 54 Mbit/s), rate_mcs maps the RATE bits R1 to R4, mcs_period are the input bits of one puncturing period
+static const int rate_mcs[16] = {-1, 6, -1, 7, -1, 2, -1, 3, -1, 4, -1, 5, -1, 0, -1, 1};
+static const unsigned int mcs_n_dbps[8] = {24, 36, 48, 72, 96, 144, 192, 216};
+static const unsigned int mcs_n_bpsc[8] = {1, 1, 2, 2, 4, 4, 6, 6};
+static const unsigned int mcs_period[8] = {1, 3, 1, 3, 1, 3, 2, 3};
+
+// data subcarriers in ascending order, L-SIG uses 48, HE-SIG-A 52 including -28, -27, 27 and 28
+static std::vector<int> lsig_sc;
+static std::vector<int> siga_sc;
+
+// coded bit k is carried by data subcarrier deinterleave[k]
+static std::vector<size_t> lsig_deinterleave;
+static std::vector<size_t> siga_deinterleave;
+static std::vector<size_t> legacy_deinterleave[7];      // by bits per subcarrier, coded bit k is bit deinterleave[k] of the symbol
+
+// convolutional code, outputs of state s (the last 6 input bits, the latest in the msb) and input b
+static uint8_t conv_out[64][2];
+
+// output
+static std::string output_path;
+static double run_start_epoch_sec;
+static std::ofstream fout_bin;
+static std::ofstream fout_idx;
+static unsigned long long n_bytes_written;
+static boost::mutex m_mutex;
+
+// statistics
+static unsigned long long n_windows_failed = 0;
+
+// converts n samples of any supported type to fc32, sc16 and sc8 are scaled to full scale 1
+static void convert_samples(const char* in, cf32_t* out, const size_t n){
+    switch(n_bytes_per_item){
+        case 16:
+        {
+            const double* x = reinterpret_cast<const double*>(in);
+            for(size_t k = 0; k < n; k++)
+                out[k] = cf32_t((float) x[2*k], (float) x[2*k + 1]);
+            break;
+        }
+        case 8:
+            std::memcpy(out, in, n*sizeof(cf32_t));
+            break;
+        case 4:
+        {
+            const int16_t* x = reinterpret_cast<const int16_t*>(in);
+            for(size_t k = 0; k < n; k++)
+                out[k] = cf32_t(x[2*k]*(1.0f/32768.0f), x[2*k + 1]*(1.0f/32768.0f));
+            break;
+        }
+        default:
+        {
+            const int8_t* x = reinterpret_cast<const int8_t*>(in);
+            for(size_t k = 0; k < n; k++)
+                out[k] = cf32_t(x[2*k]*(1.0f/128.0f), x[2*k + 1]*(1.0f/128.0f));
+            break;
+        }
+    }
+}
+
+// data subcarriers from -k_max to k_max without dc and pilots, and the inverse of the interleaver of one BPSK symbol with n_col columns
+static void init_symbol_tables(const int k_max, const size_t n_col, std::vector<int>& sc, std::vector<size_t>& deinterleave){
+    sc.clear();
+    for(int k = -k_max; k <= k_max; k++){
+        if(k != 0 && std::abs(k) != 7 && std::abs(k) != 21)
+            sc.push_back(k);
+    }
+    const size_t n_cbps = sc.size();
+    const size_t n_row = n_cbps/n_col;
+    deinterleave.resize(n_cbps);
+    for(size_t k = 0; k < n_cbps; k++)
+        deinterleave[k] = n_row*(k % n_col) + k/n_col;
+}
+
+int init_packet_filter(const std::vector<size_t>& n_channels_per_device, const std::vector<size_t>& max_samples_per_block, const size_t n_bytes_per_item_arg, const double rate_arg,
+                       const std::vector<std::string>& formats, const int mcs_min_arg, const int mcs_max_arg, const std::vector<int>& bandwidths_mhz_arg, const double threshold_dbfs,
+                       const size_t margin_arg, const double cfo_tolerance_hz_arg, const std::string& output){
+
+    if(std::abs(rate_arg - PKT_RATE) > 1.0 || max_samples_per_block.size() != n_channels_per_device.size() || mcs_min_arg > mcs_max_arg){
+        std::cerr << "packet_filter: needs a rate of " << PKT_RATE/1.0e6 << " MS/s and mcs_min must not be larger than mcs_max" << std::endl;
+        return 0;
+    }
+    if(n_bytes_per_item_arg != 16 && n_bytes_per_item_arg != 8 && n_bytes_per_item_arg != 4 && n_bytes_per_item_arg != 2)
+        return 0;
+
+    for(size_t f = 0; f < PKT_FORMAT_COUNT; f++)
+        keep_format[f] = formats.empty();
+    for(size_t i = 0; i < formats.size(); i++){
+        size_t f = 0;
+        while(f < PKT_FORMAT_COUNT && formats[i] != format_names[f])
+            f++;
+        if(f == PKT_FORMAT_COUNT){
+            std::cerr << "packet_filter: unknown format " << formats[i] << std::endl;
+            return 0;
+        }
+        keep_format[f] = true;
+    }
+
+    n_bytes_per_item = n_bytes_per_item_arg;
+    rate = rate_arg;
+    mcs_min = mcs_min_arg;
+    mcs_max = mcs_max_arg;
+    bandwidths_mhz = bandwidths_mhz_arg;
+    stf_power_min = PKT_STF_WINDOW*std::pow(10.0, threshold_dbfs/10.0);
+    margin = margin_arg;
+    cfo_tolerance_hz = cfo_tolerance_hz_arg;
+    output_path = output;
+    run_start_epoch_sec = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    init_fft_plan(plan, 64);
+    for(size_t t = 0; t < 64; t++){
+        std::complex<double> sum = 0.0;
+        for(int k = -26; k <= 26; k++)
+            sum += (double) ltf_freq[k + 26]*std::polar(1.0, 2.0*M_PI*k*t/64.0);
+        ltf_time[t] = cf32_t((float) (sum.real()/64.0), (float) (sum.imag()/64.0));
+    }
+    init_symbol_tables(26, 16, lsig_sc, lsig_deinterleave);
+    init_symbol_tables(28, 13, siga_sc, siga_deinterleave);
+
+    // second permutation of the legacy interleaver, adjacent coded bits alternate between less and more significant bits
+    for(size_t n_bpsc = 1; n_bpsc <= 6; n_bpsc++){
+        const size_t n_cbps = 48*n_bpsc;
+        const size_t s = std::max<size_t>(n_bpsc/2, 1);
+        legacy_deinterleave[n_bpsc].resize(n_cbps);
+        for(size_t k = 0; k < n_cbps; k++){
+            const size_t i = (n_cbps/16)*(k % 16) + k/16;
+            legacy_deinterleave[n_bpsc][k] = s*(i/s) + (i + n_cbps - 16*i/n_cbps) % s;
+        }
+    }
+
+    // the pilot polarity is the output of the scrambler with all ones, 1 mapped to -1 and 0 to 1
+    uint8_t scrambler = 0x7f;
+    for(size_t n = 0; n < 127; n++){
+        const uint8_t bit = (uint8_t) (((scrambler >> 6) ^ (scrambler >> 3)) & 1);
+        scrambler = (uint8_t) (((scrambler << 1) | bit) & 0x7f);
+        pilot_polarity[n] = bit ? -1.0f : 1.0f;
+    }
+
+    // generator polynomials 133 and 171 (octal)
+    for(size_t s = 0; s < 64; s++){
+        for(size_t b = 0; b < 2; b++){
+            const unsigned int r = (unsigned int) ((b << 6) | s);
+            conv_out[s][b] = (uint8_t) ((__builtin_parity(r & 0133) << 1) | __builtin_parity(r & 0171));
+        }
+    }
+
+    // the longest window stays in the work buffer until it is complete
+    const size_t max_window = (size_t) (PKT_MAX_DURATION_US*rate/1.0e6) + 2*margin + PKT_LTF_OFFSET;
+    for(size_t device = 0; device < n_channels_per_device.size(); device++){
+        devices.emplace_back();
+        packet_device_t &dev = devices.back();
+        dev.device = device;
+        dev.n_channels = n_channels_per_device[device];
+        dev.capacity = max_window + PKT_LOOKAHEAD + PKT_SIFS + PKT_SIFS_TOLERANCE + PKT_STF_PLATEAU + max_samples_per_block[device];
+        dev.work.resize(dev.n_channels*dev.capacity);
+        dev.preamble.resize(PKT_LOOKAHEAD);
+        dev.fft_out.resize(64);
+        dev.fft_scratch.resize(64);
+        const size_t n_bits_max = 16 + 8*PKT_MAX_MAC_BYTES + 6 + mcs_n_dbps[7];
+        dev.llr.resize(2*n_bits_max);
+        dev.bits.resize(n_bits_max);
+        dev.decisions.resize(n_bits_max);
+        reset_packet_filter(device, 0, 0.0);
+    }
+
+    fout_bin.open(output + ".bin", std::ios::binary | std::ios::app);
+    fout_idx.open(output + ".idx", std::ios::app);
+    if(!fout_bin.is_open() || !fout_idx.is_open()){
+        std::cerr << "packet_filter: unable to open " << output << ".bin and .idx" << std::endl;
+        return 0;
+    }
+    fout_bin.seekp(0, std::ios::end);
+    n_bytes_written = (unsigned long long) fout_bin.tellp();
+    if(n_bytes_written == 0)
+        fout_idx << "# offset_bytes n_samples n_channels device file_id packet_offset time_epoch_sec format bandwidth_mhz mcs length dcm coding n_sts bss_color snr_db cfo_hz"
+                    " ul_dl tx_station rx_station tx_mac rx_mac" << std::endl;
+
+    std::cout << "packet_filter: keeps";
+    for(size_t f = 0; f < PKT_FORMAT_COUNT; f++){
+        if(keep_format[f])
+            std::cout << " " << format_names[f];
+    }
+    std::cout << ", mcs " << mcs_min << " to " << mcs_max << ", threshold " << threshold_dbfs << " dBFS, margin " << margin << " samples, stations " << cfo_tolerance_hz
+              << " Hz apart, output " << output << ".bin" << std::endl;
+
+    return 1;
+}
+
+int reset_packet_filter(const size_t device, const unsigned int file_id, const double start_time_epoch_sec){
+    // packet filter disabled
+    if(device >= devices.size())
+        return 1;
+    packet_device_t &dev = devices[device];
+
+    dev.n_dropped += dev.pending.size();
+    dev.pending.clear();
+    dev.recent.clear();
+    dev.file_id = file_id;
+    dev.start_time_epoch_sec = start_time_epoch_sec;
+    dev.n_in = 0;
+    dev.n_kept_measurement = 0;
+    dev.work_start = 0;
+    dev.work_len = 0;
+    dev.n_scan = 0;
+
+    return 1;
+}
+
+// soft decision Viterbi decoder of a terminated rate 1/2 code, positive llr are ones, punctured bits are 0, one decision per bit
+static void viterbi_decode(const float* llr, const size_t n_bits, uint8_t* bits, uint64_t* decisions){
+    float metric[64];
+    float metric_next[64];
+    for(size_t s = 0; s < 64; s++)
+        metric[s] = (s == 0) ? 0.0f : -1.0e30f;
+
+    for(size_t n = 0; n < n_bits; n++){
+        const float l0 = llr[2*n];
+        const float l1 = llr[2*n + 1];
+        uint64_t decision = 0;
+        for(size_t s_next = 0; s_next < 64; s_next++){
+            // s_next = (b << 5) | (s >> 1), the two predecessors differ in their oldest bit
+            const size_t b = s_next >> 5;
+            float best = -1.0e30f;
+            for(size_t x = 0; x < 2; x++){
+                const size_t s = ((s_next & 31) << 1) | x;
+                const uint8_t out = conv_out[s][b];
+                const float m = metric[s] + ((out & 2) ? l0 : -l0) + ((out & 1) ? l1 : -l1);
+                if(m > best){
+                    best = m;
+                    if(x == 1)
+                        decision |= (uint64_t) 1 << s_next;
+                }
+            }
+            metric_next[s_next] = best;
+        }
+        decisions[n] = decision;
+        std::memcpy(metric, metric_next, sizeof(metric));
+    }
+
+    // the tail bits end the code in state 0
+    size_t s = 0;
+    for(size_t n = n_bits; n-- > 0;){
+        bits[n] = (uint8_t) (s >> 5);
+        s = ((s & 31) << 1) | ((decisions[n] >> s) & 1);
+    }
+}
+
+// CRC-8 of HT-SIG (x^8 + x^2 + x + 1, preset to ones, inverted), c7 in the msb is sent first
+static uint8_t crc8(const uint8_t* bits, const size_t n){
+    uint8_t reg = 0xff;
+    for(size_t i = 0; i < n; i++){
+        const uint8_t feedback = (uint8_t) (((reg >> 7) & 1) ^ bits[i]);
+        reg = (uint8_t) (reg << 1);
+        if(feedback)
+            reg ^= 0x07;
+    }
+    return (uint8_t) ~reg;
+}
+
+static unsigned int get_field(const uint8_t* bits, const size_t first, const size_t n){
+    unsigned int value = 0;
+    for(size_t i = 0; i < n; i++)
+        value |= (unsigned int) bits[first + i] << i;
+    return value;
+}
+
+// y[i] = x[i]*exp(-j*w*(n + i)), n is the distance of x from the reference of the frequency offset
+static void rotate(cf32_t* y, const cf32_t* x, const size_t n_samples, const double w, const unsigned long long n){
+    for(size_t i = 0; i < n_samples; i++){
+        const std::complex<double> r = std::polar(1.0, -w*(double) (n + i));
+        y[i] = cmul(x[i], cf32_t((float) r.real(), (float) r.imag()));
+    }
+}
+
+static float correlate_ltf(const cf32_t* y){
+    cf32_t sum = 0.0f;
+    for(size_t k = 0; k < 64; k++)
+        sum += cmul(y[k], std::conj(ltf_time[k]));
+    return std::abs(sum);
+}
+
+// fft of the symbol whose guard interval ends at y, bin k + 64 is subcarrier k
+static const cf32_t* demodulate(packet_device_t &dev, const cf32_t* y){
+    fft(plan, dev.fft_out.data(), y - PKT_FFT_BACKOFF, dev.fft_scratch.data());
+    return dev.fft_out.data();
+}
+
+// equalized subcarriers -28 to 28 of symbol n after the L-LTF, weighted with the channel and corrected by the phase of the pilots
+static void equalize(const cf32_t* Y, const cf32_t* H, const size_t n, cf32_t* eq){
+    cf32_t pilots = 0.0f;
+    for(size_t p = 0; p < 4; p++)
+        pilots += pilot_polarity[n % 127]*pilot_val[p]*cmul(Y[(pilot_sc[p] + 64) % 64], std::conj(H[pilot_sc[p] + 28]));
+    const float pilots_abs = std::abs(pilots);
+    const cf32_t derotate = (pilots_abs > 0.0f) ? std::conj(pilots)/pilots_abs : cf32_t(1.0f, 0.0f);
+    for(int k = -28; k <= 28; k++)
+        eq[k + 28] = cmul(cmul(Y[(k + 64) % 64], std::conj(H[k + 28])), derotate);
+}
+
+// true if the data subcarriers of a symbol are rotated by 90 degrees (QBPSK)
+static bool is_qbpsk(const cf32_t* eq){
+    float sum_re = 0.0f;
+    float sum_im = 0.0f;
+    for(size_t i = 0; i < lsig_sc.size(); i++){
+        const cf32_t v = eq[lsig_sc[i] + 28];
+        sum_re += v.real()*v.real();
+        sum_im += v.imag()*v.imag();
+    }
+    return sum_im > PKT_QBPSK_RATIO*sum_re;
+}
+
+// decodes one BPSK symbol per half of llr, each symbol interleaved on its own
+static void decode_bpsk(const cf32_t* const* eq, const size_t n_symbols, const std::vector<int>& sc, const std::vector<size_t>& deinterleave, uint8_t* bits){
+    float llr[2*64];
+    uint64_t decisions[64];
+    const size_t n_cbps = sc.size();
+    for(size_t sym = 0; sym < n_symbols; sym++){
+        for(size_t k = 0; k < n_cbps; k++)
+            llr[sym*n_cbps + k] = eq[sym][sc[deinterleave[k]] + 28].real();
+    }
+    viterbi_decode(llr, n_symbols*n_cbps/2, bits, decisions);
+}
+
+// duration of a packet in us from L-SIG
+static unsigned int get_duration_us(const packet_info_t& info, const unsigned int n_dbps){
+    if(info.format == PKT_FORMAT_HE_SU || info.format == PKT_FORMAT_HE_TB || info.format == PKT_FORMAT_HE_MU){
+        const unsigned int m = 3 - info.length % 3;
+        return 20 + 4*((info.length + 3 + m)/3);
+    }
+    return 20 + 4*((16 + 8*info.length + 6 + n_dbps - 1)/n_dbps);
+}
+
+static bool is_kept(const packet_info_t& info){
+    if(!keep_format[info.format])
+        return false;
+    if(info.mcs >= 0 && (info.mcs < mcs_min || info.mcs > mcs_max))
+        return false;
+    if(info.bandwidth_mhz > 0 && bandwidths_mhz.size() > 0 && std::find(bandwidths_mhz.begin(), bandwidths_mhz.end(), info.bandwidth_mhz) == bandwidths_mhz.end())
+        return false;
+    return true;
+}
+
+// the station with the closest frequency offset within cfo_tolerance_hz, or a new one
+static int assign_station(packet_device_t &dev, const double cfo_hz){
+    int best = -1;
+    double distance_min = cfo_tolerance_hz;
+    for(size_t i = 0; i < dev.stations.size(); i++){
+        const double distance = std::abs(dev.stations[i].cfo_hz - cfo_hz);
+        if(distance < distance_min){
+            distance_min = distance;
+            best = (int) i;
+        }
+    }
+    if(best < 0){
+        if(dev.stations.size() >= PKT_MAX_STATIONS)
+            return -1;
+        packet_station_t station;
+        station.cfo_hz = cfo_hz;
+        station.n_packets = 0;
+        station.mac_known = false;
+        dev.stations.push_back(station);
+        best = (int) dev.stations.size() - 1;
+    }
+
+    // the oscillators drift slowly, the offset follows the latest packets
+    packet_station_t &station = dev.stations[best];
+    station.n_packets++;
+    station.cfo_hz += (cfo_hz - station.cfo_hz)/(double) std::min<unsigned long long>(station.n_packets, PKT_STATION_AVERAGE);
+    return best;
+}
+
+// the packet starting at start answers the pending packets that end PKT_SIFS before it
+static void set_response(packet_device_t &dev, const unsigned long long start, const int station){
+    for(size_t i = 0; i < dev.pending.size(); i++){
+        if(dev.pending[i].packet_end + PKT_SIFS + PKT_SIFS_TOLERANCE >= start && dev.pending[i].packet_end + PKT_SIFS <= start + PKT_SIFS_TOLERANCE)
+            dev.pending[i].rx_station = station;
+    }
+}
+
+// station of the packet that ends PKT_SIFS before start, -1 if there is none
+static int find_solicitation(const packet_device_t &dev, const unsigned long long start){
+    for(size_t i = 0; i < dev.recent.size(); i++){
+        if(dev.recent[i].end + PKT_SIFS + PKT_SIFS_TOLERANCE >= start && dev.recent[i].end + PKT_SIFS <= start + PKT_SIFS_TOLERANCE)
+            return dev.recent[i].station;
+    }
+    return -1;
+}
+
+// decodes the preamble of a short training field detected at position first of the work buffer, returns the position the search continues at
+static size_t decode_packet(packet_device_t &dev, const size_t first, const std::complex<double> c_stf){
+    cf32_t* y = dev.preamble.data();
+
+    // coarse frequency offset from the short training field
+    const double w_coarse = -std::arg(c_stf)/PKT_STF_LAG;
+    rotate(y, dev.work.data() + first, PKT_LOOKAHEAD, w_coarse, 0);
+
+    // timing from the two long training symbols, then the fine frequency offset from their phase difference
+    size_t t1 = 0;
+    float metric_max = -1.0f;
+    for(size_t t = PKT_LTF_OFFSET - PKT_LTF_EARLY; t <= PKT_LTF_OFFSET + PKT_LTF_LATE; t++){
+        const float metric = correlate_ltf(y + t) + correlate_ltf(y + t + 64);
+        if(metric > metric_max){
+            metric_max = metric;
+            t1 = t;
+        }
+    }
+    cf32_t c_ltf = 0.0f;
+    for(size_t k = 0; k < 64; k++)
+        c_ltf += cmul(y[t1 + k], std::conj(y[t1 + 64 + k]));
+    const double w_fine = -std::arg(c_ltf)/64.0;
+    rotate(y, y, PKT_LOOKAHEAD, w_fine, 0);
+
+    packet_info_t info;
+    info.bandwidth_mhz = -1;
+    info.mcs = -1;
+    info.dcm = -1;
+    info.coding = -1;
+    info.n_sts = -1;
+    info.bss_color = -1;
+    info.ul_dl = -1;
+    info.cfo_hz = (w_coarse + w_fine)*rate/(2.0*M_PI);
+
+    // channel of subcarriers -28 to 28, the outermost four are only used by HE-SIG-A and copied from -26 and 26
+    cf32_t H[57];
+    float power_signal = 0.0f;
+    float power_noise = 0.0f;
+    {
+        cf32_t Y1[64];
+        std::memcpy(Y1, demodulate(dev, y + t1), sizeof(Y1));
+        const cf32_t* Y2 = demodulate(dev, y + t1 + 64);
+        for(int k = -26; k <= 26; k++){
+            const size_t m = (size_t) (k + 64) % 64;
+            H[k + 28] = 0.5f*(Y1[m] + Y2[m])*(float) ltf_freq[k + 26];
+            if(k != 0){
+                power_signal += std::norm(H[k + 28]);
+                power_noise += 0.5f*std::norm(Y1[m] - Y2[m]);
+            }
+        }
+        H[0] = H[1] = H[2];
+        H[56] = H[55] = H[54];
+    }
+    info.snr_db = (power_noise > 0.0f) ? 10.0*std::log10(power_signal/power_noise) : 99.0;
+
+    // L-SIG and the three symbols after it
+    cf32_t eq[4][57];
+    for(size_t sym = 0; sym < 4; sym++)
+        equalize(demodulate(dev, y + t1 + 128 + 80*sym + 16), H, sym, eq[sym]);
+
+    uint8_t bits[64];
+    const cf32_t* eq_lsig[1] = {eq[0]};
+    decode_bpsk(eq_lsig, 1, lsig_sc, lsig_deinterleave, bits);
+
+    // rate, reserved bit, length and even parity
+    const unsigned int rate_bits = (unsigned int) ((bits[0] << 3) | (bits[1] << 2) | (bits[2] << 1) | bits[3]);
+    unsigned int parity = 0;
+    for(size_t i = 0; i < 18; i++)
+        parity ^= bits[i];
+    info.length = (int) get_field(bits, 5, 12);
+    if(rate_mcs[rate_bits] < 0 || bits[4] != 0 || parity != 0 || info.length == 0){
+        dev.n_lsig_failed++;
+        return first + PKT_STF_SKIP;
+    }
+    const int lsig_mcs = rate_mcs[rate_bits];
+
+    // RL-SIG repeats L-SIG
+    float corr = 0.0f;
+    float power_lsig = 0.0f;
+    float power_rlsig = 0.0f;
+    for(size_t i = 0; i < lsig_sc.size(); i++){
+        const float a = eq[0][lsig_sc[i] + 28].real();
+        const float b = eq[1][lsig_sc[i] + 28].real();
+        corr += a*b;
+        power_lsig += a*a;
+        power_rlsig += b*b;
+    }
+    const bool rl_sig = corr > PKT_RL_SIG_CORR*std::sqrt(power_lsig*power_rlsig);
+
+    if(lsig_mcs == 0 && rl_sig && info.length % 3 != 0){
+        if(info.length % 3 == 2){
+            info.format = PKT_FORMAT_HE_MU;
+        }
+        else{
+            const cf32_t* eq_siga[2] = {eq[2], eq[3]};
+            decode_bpsk(eq_siga, 2, siga_sc, siga_deinterleave, bits);
+
+            // CRC over HE-SIG-A1 and B0 to B15 of HE-SIG-A2, B16 to B19 are c7 to c4
+            const uint8_t crc = crc8(bits, 42);
+            bool crc_ok = true;
+            for(size_t i = 0; i < 4; i++)
+                crc_ok = crc_ok && bits[42 + i] == ((crc >> (7 - i)) & 1);
+            if(!crc_ok){
+                dev.n_siga_failed++;
+                return first + PKT_STF_SKIP;
+            }
+            if(bits[0] == 1){
+                static const int bandwidths[4] = {20, 40, 80, 160};
+                info.format = PKT_FORMAT_HE_SU;
+                info.ul_dl = bits[2];
+                info.mcs = (int) get_field(bits, 3, 4);
+                info.dcm = bits[7];
+                info.bss_color = (int) get_field(bits, 8, 6);
+                info.bandwidth_mhz = bandwidths[get_field(bits, 19, 2)];
+                info.n_sts = (int) get_field(bits, 23, 3) + 1;
+                info.coding = bits[26 + 7];
+            }
+            else{
+                info.format = PKT_FORMAT_HE_TB;
+            }
+        }
+    }
+    else if(lsig_mcs == 0 && is_qbpsk(eq[1])){
+        info.format = PKT_FORMAT_HT;
+    }
+    else if(lsig_mcs == 0 && is_qbpsk(eq[2])){
+        info.format = PKT_FORMAT_VHT;
+    }
+    else{
+        info.format = PKT_FORMAT_LEGACY;
+        info.mcs = lsig_mcs;
+        info.bandwidth_mhz = 20;
+    }
+    dev.n_format[info.format]++;
+
+    // the transmitter is told by its frequency offset, the search continues after the packet
+    const size_t packet_start = (first + t1 > PKT_LTF_OFFSET) ? first + t1 - PKT_LTF_OFFSET : 0;
+    const size_t duration = (size_t) (get_duration_us(info, mcs_n_dbps[lsig_mcs])*rate/1.0e6);
+    packet_recent_t recent;
+    recent.start = dev.work_start + packet_start;
+    recent.end = recent.start + duration;
+    recent.station = assign_station(dev, info.cfo_hz);
+    const int solicitation = find_solicitation(dev, recent.start);
+    set_response(dev, recent.start, recent.station);
+    dev.recent.push_back(recent);
+    if(dev.recent.size() > PKT_MAX_RECENT)
+        dev.recent.pop_front();
+
+    const bool keep = is_kept(info);
+    const bool decode_mac = info.format == PKT_FORMAT_LEGACY && info.length <= PKT_MAX_MAC_BYTES;
+    if(keep){
+        dev.n_kept++;
+        dev.n_kept_measurement++;
+    }
+    else
+        dev.n_rejected++;
+    if(keep || decode_mac){
+        packet_pending_t pending;
+        pending.packet_start = recent.start;
+        pending.packet_end = recent.end;
+        pending.start = recent.start;
+        if(keep)
+            pending.start = (packet_start > margin) ? recent.start - margin : dev.work_start;
+        pending.end = keep ? recent.end + margin : recent.end;
+        pending.first = dev.work_start + first;
+        pending.ltf = pending.first + t1;
+        pending.w = w_coarse + w_fine;
+        std::memcpy(pending.H, H, sizeof(H));
+        pending.keep = keep;
+        pending.decode_mac = decode_mac;
+        pending.station = recent.station;
+        pending.rx_station = -1;
+        pending.solicitation = solicitation;
+        pending.info = info;
+        dev.pending.push_back(pending);
+    }
+
+    return packet_start + duration;
+}
+
+// searches the short training field from n_scan on as long as a preamble after it is complete
+static void scan_packets(packet_device_t &dev){
+    if(dev.n_scan < dev.work_start || dev.n_scan - dev.work_start + PKT_LOOKAHEAD > dev.work_len)
+        return;
+    const cf32_t* x = dev.work.data();
+    const size_t n_end = dev.work_len - PKT_LOOKAHEAD;
+
+    // autocorrelation with a lag of one period of the short training field
+    size_t n = (size_t) (dev.n_scan - dev.work_start);
+    size_t n_plateau = 0;
+    size_t first = 0;
+    std::complex<double> c_plateau = 0.0;
+    std::complex<double> c = 0.0;
+    double p = 0.0;
+    bool sums_valid = false;
+    while(n < n_end){
+        if(!sums_valid){
+            c = 0.0;
+            p = 0.0;
+            for(size_t k = 0; k < PKT_STF_WINDOW; k++){
+                c += std::complex<double>(cmul(x[n + k], std::conj(x[n + k + PKT_STF_LAG])));
+                p += std::norm(x[n + k + PKT_STF_LAG]);
+            }
+            sums_valid = true;
+        }
+
+        if(p > stf_power_min && std::norm(c) > PKT_STF_METRIC*PKT_STF_METRIC*p*p){
+            if(n_plateau == 0){
+                first = n;
+                c_plateau = 0.0;
+            }
+            n_plateau++;
+            c_plateau += c;
+            if(n_plateau == PKT_STF_PLATEAU){
+                dev.n_detected++;
+                auto t_start = std::chrono::steady_clock::now();
+                n = decode_packet(dev, first, c_plateau);
+                std::chrono::duration<double> decode_time = std::chrono::steady_clock::now() - t_start;
+                dev.decode_time_sec += decode_time.count();
+                n_plateau = 0;
+                sums_valid = false;
+                continue;
+            }
+        }
+        else{
+            n_plateau = 0;
+        }
+
+        c += std::complex<double>(cmul(x[n + PKT_STF_WINDOW], std::conj(x[n + PKT_STF_WINDOW + PKT_STF_LAG])) - cmul(x[n], std::conj(x[n + PKT_STF_LAG])));
+        p += (double) std::norm(x[n + PKT_STF_WINDOW + PKT_STF_LAG]) - (double) std::norm(x[n + PKT_STF_LAG]);
+        n++;
+    }
+
+    // a plateau that reaches the end is searched again with the next samples
+    dev.n_scan = dev.work_start + ((n_plateau > 0) ? first : n);
+}
+
+// CRC-32 of the FCS
+static uint32_t crc32(const uint8_t* bytes, const size_t n){
+    uint32_t crc = 0xffffffff;
+    for(size_t i = 0; i < n; i++){
+        crc ^= bytes[i];
+        for(size_t b = 0; b < 8; b++)
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+// decodes the data field of a legacy frame, returns the number of addresses of a frame with correct FCS, 0 otherwise
+static size_t decode_mac(packet_device_t &dev, const packet_pending_t &pending, uint8_t* addr1, uint8_t* addr2, bool& response){
+    // puncturing keeps these mother code bits of each period
+    static const size_t kept_bits[4][4] = {{0, 0, 0, 0}, {0, 1, 0, 0}, {0, 1, 2, 0}, {0, 1, 2, 5}};
+    static const float scale_16qam = std::sqrt(10.0f);
+    static const float scale_64qam = std::sqrt(42.0f);
+
+    const packet_info_t &info = pending.info;
+    const size_t mcs = (size_t) info.mcs;
+    const size_t n_bpsc = mcs_n_bpsc[mcs];
+    const size_t n_cbps = 48*n_bpsc;
+    const size_t period = mcs_period[mcs];
+    const size_t n_bits = 16 + 8*(size_t) info.length + 6;
+    const size_t n_symbols = (n_bits + mcs_n_dbps[mcs] - 1)/mcs_n_dbps[mcs];
+    float* llr = dev.llr.data();
+    std::fill(llr, llr + 2*n_symbols*mcs_n_dbps[mcs], 0.0f);
+
+    size_t n_llr = 0;
+    size_t n_kept = 0;
+    float soft[6*48];
+    cf32_t eq[57];
+    for(size_t sym = 0; sym < n_symbols; sym++){
+        // symbol sym + 1 after the L-LTF
+        const unsigned long long pos = pending.ltf + 128 + 80*(sym + 1) + 16 - PKT_FFT_BACKOFF;
+        rotate(dev.preamble.data(), dev.work.data() + (pos - dev.work_start), 64, pending.w, pos - pending.first);
+        fft(plan, dev.fft_out.data(), dev.preamble.data(), dev.fft_scratch.data());
+        equalize(dev.fft_out.data(), pending.H, sym + 1, eq);
+
+        // max-log llr of the gray coded constellations, weighted with the power of the channel
+        for(size_t d = 0; d < 48; d++){
+            const cf32_t v = eq[lsig_sc[d] + 28];
+            const float h2 = std::norm(pending.H[lsig_sc[d] + 28]);
+            float* b = soft + d*n_bpsc;
+            switch(n_bpsc){
+                case 1:
+                    b[0] = v.real();
+                    break;
+                case 2:
+                    b[0] = v.real();
+                    b[1] = v.imag();
+                    break;
+                case 4:
+                    b[0] = scale_16qam*v.real();
+                    b[1] = 2.0f*h2 - std::abs(b[0]);
+                    b[2] = scale_16qam*v.imag();
+                    b[3] = 2.0f*h2 - std::abs(b[2]);
+                    break;
+                default:
+                    b[0] = scale_64qam*v.real();
+                    b[1] = 4.0f*h2 - std::abs(b[0]);
+                    b[2] = 2.0f*h2 - std::abs(b[1]);
+                    b[3] = scale_64qam*v.imag();
+                    b[4] = 4.0f*h2 - std::abs(b[3]);
+                    b[5] = 2.0f*h2 - std::abs(b[4]);
+                    break;
+            }
+        }
+
+        // punctured bits stay 0
+        for(size_t k = 0; k < n_cbps; k++){
+            llr[n_llr + kept_bits[period][n_kept]] = soft[legacy_deinterleave[n_bpsc][k]];
+            if(++n_kept == period + 1){
+                n_kept = 0;
+                n_llr += 2*period;
+            }
+        }
+    }
+    uint8_t* bits = dev.bits.data();
+    viterbi_decode(llr, n_bits, bits, dev.decisions.data());
+
+    // the first 7 bits of SERVICE are zeros and reveal the scrambler
+    uint8_t scrambler = 0;
+    for(size_t n = 0; n < n_bits; n++){
+        const uint8_t s = (n < 7) ? bits[n] : (uint8_t) (((scrambler >> 6) ^ (scrambler >> 3)) & 1);
+        scrambler = (uint8_t) (((scrambler << 1) | s) & 0x7f);
+        bits[n] ^= s;
+    }
+    uint8_t* bytes = bits;
+    for(size_t i = 0; i < (size_t) info.length; i++)
+        bytes[i] = (uint8_t) get_field(bits, 16 + 8*i, 8);
+    const size_t n_fcs = (size_t) info.length - 4;
+    const uint32_t fcs = (uint32_t) bytes[n_fcs] | ((uint32_t) bytes[n_fcs + 1] << 8) | ((uint32_t) bytes[n_fcs + 2] << 16) | ((uint32_t) bytes[n_fcs + 3] << 24);
+    if(info.length < 14 || (bytes[0] & 3) != 0 || crc32(bytes, n_fcs) != fcs){
+        dev.n_fcs_failed++;
+        return 0;
+    }
+    dev.n_mac_decoded++;
+
+    // ACK and CTS only have the receiver address, CTS, ACK and BlockAck answer the station they are addressed to
+    const unsigned int type = (bytes[0] >> 2) & 3;
+    const unsigned int subtype = bytes[0] >> 4;
+    response = type == 1 && (subtype == 9 || subtype == 12 || subtype == 13);
+    std::memcpy(addr1, bytes + 4, 6);
+    if((type == 1 && (subtype == 12 || subtype == 13)) || info.length < 20)
+        return 1;
+    std::memcpy(addr2, bytes + 10, 6);
+    return 2;
+}
+
+static void set_station_mac(packet_device_t &dev, const int station, const uint8_t* mac){
+    if(station < 0)
+        return;
+    dev.stations[station].mac_known = true;
+    std::memcpy(dev.stations[station].mac, mac, 6);
+}
+
+static void write_mac(std::ostream &out, const packet_device_t &dev, const int station){
+    if(station < 0 || !dev.stations[station].mac_known){
+        out << "-";
+        return;
+    }
+    const uint8_t* mac = dev.stations[station].mac;
+    out << std::hex << std::setfill('0');
+    for(size_t i = 0; i < 6; i++)
+        out << ((i > 0) ? ":" : "") << std::setw(2) << (unsigned int) mac[i];
+    out << std::dec << std::setfill(' ');
+}
+
+// completes the packets whose samples are there and whose response would have been found, writes the kept windows
+// and keeps the samples still needed in the work buffer
+static void complete_packets(packet_device_t &dev){
+    const unsigned long long work_end = dev.work_start + dev.work_len;
+    for(size_t i = 0; i < dev.pending.size();){
+        if(dev.pending[i].end > work_end || dev.n_scan < dev.pending[i].packet_end + PKT_SIFS + PKT_SIFS_TOLERANCE + PKT_STF_PLATEAU){
+            i++;
+            continue;
+        }
+        const packet_pending_t pending = dev.pending[i];
+        dev.pending.erase(dev.pending.begin() + (long) i);
+
+        // legacy frames name their transmitter, responses also the station they answer
+        if(pending.decode_mac){
+            auto t_start = std::chrono::steady_clock::now();
+            uint8_t addr1[6];
+            uint8_t addr2[6];
+            bool response = false;
+            const size_t n_addr = decode_mac(dev, pending, addr1, addr2, response);
+            if(n_addr == 2)
+                set_station_mac(dev, pending.station, addr2);
+            if(n_addr > 0 && response)
+                set_station_mac(dev, pending.solicitation, addr1);
+            std::chrono::duration<double> decode_time = std::chrono::steady_clock::now() - t_start;
+            dev.decode_time_sec += decode_time.count();
+        }
+        if(!pending.keep)
+            continue;
+
+        // the receiver of a packet is the station that answers it
+        const int rx_station = pending.rx_station;
+        if(pending.station >= 0 && rx_station >= 0)
+            dev.n_linked++;
+
+        const size_t n_samples = (size_t) (pending.end - pending.start);
+        const size_t offset = (size_t) (pending.start - dev.work_start);
+        const packet_info_t& info = pending.info;
+        boost::mutex::scoped_lock lock(m_mutex);
+        for(size_t ch = 0; ch < dev.n_channels; ch++)
+            fout_bin.write(reinterpret_cast<const char*>(dev.work.data() + ch*dev.capacity + offset), (std::streamsize) (n_samples*sizeof(cf32_t)));
+        if(!fout_bin.good()){
+            n_windows_failed++;
+            fout_bin.clear();
+            continue;
+        }
+        fout_idx << n_bytes_written << " " << n_samples << " " << dev.n_channels << " " << dev.device << " " << dev.file_id << " " << pending.packet_start - pending.start << " "
+                 << std::fixed << std::setprecision(9) << dev.start_time_epoch_sec + pending.packet_start/rate << " " << format_names[info.format] << " " << info.bandwidth_mhz << " "
+                 << info.mcs << " " << info.length << " " << info.dcm << " " << info.coding << " " << info.n_sts << " " << info.bss_color << " "
+                 << std::setprecision(1) << info.snr_db << " " << std::setprecision(0) << info.cfo_hz << std::defaultfloat << " "
+                 << info.ul_dl << " " << pending.station << " " << rx_station << " ";
+        write_mac(fout_idx, dev, pending.station);
+        fout_idx << " ";
+        write_mac(fout_idx, dev, rx_station);
+        fout_idx << std::endl;
+        n_bytes_written += n_samples*dev.n_channels*sizeof(cf32_t);
+    }
+
+    unsigned long long keep_from = std::min(dev.n_scan, work_end);
+    keep_from = (keep_from > margin + PKT_LTF_OFFSET) ? keep_from - margin - PKT_LTF_OFFSET : 0;
+    for(size_t i = 0; i < dev.pending.size(); i++)
+        keep_from = std::min(keep_from, dev.pending[i].start);
+    if(keep_from <= dev.work_start)
+        return;
+    const size_t n_shift = (size_t) (keep_from - dev.work_start);
+    for(size_t ch = 0; ch < dev.n_channels; ch++)
+        std::memmove(dev.work.data() + ch*dev.capacity, dev.work.data() + ch*dev.capacity + n_shift, (dev.work_len - n_shift)*sizeof(cf32_t));
+    dev.work_start = keep_from;
+    dev.work_len -= n_shift;
+}
+
+static void take_samples(packet_device_t &dev, const std::vector<std::vector<char>> &buffs, unsigned long long offset, unsigned long long n){
+    while(n > 0){
+        const size_t n_take = (size_t) std::min<unsigned long long>(dev.capacity - dev.work_len, n);
+        for(size_t ch = 0; ch < dev.n_channels; ch++)
+            convert_samples(&buffs[ch][0] + offset*n_bytes_per_item, dev.work.data() + ch*dev.capacity + dev.work_len, n_take);
+        dev.work_len += n_take;
+        dev.n_in += n_take;
+        offset += n_take;
+        n -= n_take;
+
+        scan_packets(dev);
+        complete_packets(dev);
+    }
+}
+
+void feed_packet_filter(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    if(device >= devices.size())
+        return;
+    packet_device_t &dev = devices[device];
+    auto t_start = std::chrono::steady_clock::now();
+
+    unsigned long long n_consumed_samples = 0;
+    for(size_t i = 0; i < gaps.size(); i++){
+        const unsigned long long gap_offset = std::min(gaps[i].offset, n_new_samples);
+        if(gap_offset > n_consumed_samples){
+            take_samples(dev, buffs, n_consumed_samples, gap_offset - n_consumed_samples);
+            n_consumed_samples = gap_offset;
+        }
+
+        // windows containing the gap are dropped, the search starts again after it
+        dev.n_dropped += dev.pending.size();
+        dev.pending.clear();
+        dev.recent.clear();
+        dev.n_in += gaps[i].length;
+        dev.work_start = dev.n_in;
+        dev.work_len = 0;
+        dev.n_scan = dev.n_in;
+    }
+
+    if(n_new_samples > n_consumed_samples)
+        take_samples(dev, buffs, n_consumed_samples, n_new_samples - n_consumed_samples);
+
+    std::chrono::duration<double> process_time = std::chrono::steady_clock::now() - t_start;
+    dev.process_time_sec += process_time.count();
+    dev.n_samples_total += n_new_samples;
+}
+
+unsigned long long get_n_kept_packet_filter(){
+    unsigned long long n_kept_max = 0;
+    for(size_t device = 0; device < devices.size(); device++)
+        n_kept_max = std::max<unsigned long long>(n_kept_max, devices[device].n_kept_measurement);
+    return n_kept_max;
+}
+
+void close_packet_filter(){
+    boost::mutex::scoped_lock lock(m_mutex);
+    if(fout_bin.is_open())
+        fout_bin.close();
+    if(fout_idx.is_open())
+        fout_idx.close();
+    if(devices.size() == 0)
+        return;
+
+    // addresses learned after the packets of a station were written
+    std::ofstream fout_stations(output_path + ".stations", std::ios::app);
+    fout_stations << "# stations of the run started " << std::fixed << std::setprecision(3) << run_start_epoch_sec << ": device station mac cfo_hz n_packets" << std::endl;
+    for(size_t device = 0; device < devices.size(); device++){
+        const packet_device_t &dev = devices[device];
+        for(size_t station = 0; station < dev.stations.size(); station++){
+            fout_stations << device << " " << station << " ";
+            write_mac(fout_stations, dev, (int) station);
+            fout_stations << " " << std::setprecision(0) << dev.stations[station].cfo_hz << " " << dev.stations[station].n_packets << std::endl;
+        }
+    }
+}
+
+void show_debug_information_packet_filter(){
+    if(devices.size() == 0)
+        return;
+    for(size_t device = 0; device < devices.size(); device++){
+        const packet_device_t &dev = devices[device];
+        std::cout << "--------------------------" << std::endl;
+        std::cout << "packet_filter " << device << std::endl;
+        std::cout << "n_detected: " << dev.n_detected << std::endl;
+        std::cout << "n_lsig_failed: " << dev.n_lsig_failed << std::endl;
+        std::cout << "n_siga_failed: " << dev.n_siga_failed << std::endl;
+        for(size_t f = 0; f < PKT_FORMAT_COUNT; f++)
+            std::cout << "n_" << format_names[f] << ": " << dev.n_format[f] << std::endl;
+        std::cout << "n_kept: " << dev.n_kept << std::endl;
+        std::cout << "n_rejected: " << dev.n_rejected << std::endl;
+        std::cout << "n_dropped: " << dev.n_dropped << std::endl;
+        std::cout << "n_mac_decoded: " << dev.n_mac_decoded << std::endl;
+        std::cout << "n_fcs_failed: " << dev.n_fcs_failed << std::endl;
+        std::cout << "n_linked: " << dev.n_linked << std::endl;
+        size_t n_mac_known = 0;
+        for(size_t station = 0; station < dev.stations.size(); station++)
+            n_mac_known += dev.stations[station].mac_known ? 1 : 0;
+        std::cout << "n_stations: " << dev.stations.size() << ", " << n_mac_known << " with address" << std::endl;
+        std::cout << "n_windows_failed: " << n_windows_failed << std::endl;
+        std::cout << "process_ns_per_sample: " << ((dev.n_samples_total > 0) ? 1.0e9*dev.process_time_sec/dev.n_samples_total : 0.0) << std::endl;
+        std::cout << "decoded_packets_per_s_per_core: " << ((dev.decode_time_sec > 0.0) ? (dev.n_detected - dev.n_lsig_failed - dev.n_siga_failed)/dev.decode_time_sec : 0.0) << std::endl;
+        std::cout << "--------------------------" << std::endl;
+    }
+}
+}
@@ -0,0 +1,107 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_PACKET_FILTER_H
+#define CHANNELSOUNDER_PACKET_FILTER_H
+
+#include <vector>
+#include <string>
+
+#include "gap.h"
+
+namespace channelsounder
+{
+/*!
+ * Inits unit internally. Must be called first.
+ * The packet filter is a sink of each ringbuffer that finds Wi-Fi packets in a 20 MHz channel sampled at 20 MS/s. It detects the
+ * legacy short training field on the first channel of each device, estimates timing, frequency offset and channel from the long training
+ * field and decodes L-SIG (BPSK, rate 1/2 Viterbi, parity). The symbol after L-SIG tells the format: a repetition of L-SIG (RL-SIG)
+ * is HE, a rotated (QBPSK) symbol HT or VHT, anything else legacy. HE-SU and HE-TB packets also decode HE-SIG-A (CRC-4) for the
+ * bandwidth, MCS, DCM, coding, spatial streams and BSS color, L-SIG LENGTH gives the duration of all formats.
+ * Packets matching the filter are written as windows of all channels of the device, from margin samples before the start of the packet
+ * until margin samples after its end, and are listed in an index. Windows containing a gap are dropped.
+ * To tell the links apart, transmitters are grouped into stations by their frequency offset. Legacy frames of up to 512 bytes are decoded
+ * completely (demapping, Viterbi, descrambling, FCS), their transmitter address names the station that sent them, and the receiver
+ * address of a CTS, ACK or BlockAck the station that sent the packet one SIFS before. The receiver of a kept packet is the station
+ * that answers it one SIFS after its end. The data field of HT, VHT and HE packets is not decoded.
+ *
+ * Window file <output>.bin, all windows back to back, each channel after the other as fc32 in host byte order, sc16 and sc8 scaled to
+ * full scale 1. Index file <output>.idx, one line per window:
+ *
+ *      <offset_bytes> <n_samples> <n_channels> <device> <file_id> <packet_offset> <time_epoch_sec> <format> <bandwidth_mhz> <mcs>
+ *      <length> <dcm> <coding> <n_sts> <bss_color> <snr_db> <cfo_hz> <ul_dl> <tx_station> <rx_station> <tx_mac> <rx_mac>
+ *
+ * packet_offset is the sample of the window the packet starts at, time_epoch_sec the time of that sample. format is one of legacy, ht, vht,
+ * he_su, he_tb and he_mu (HE-MU and HE-ER-SU, HE-SIG-A is not decoded). length is L-SIG LENGTH. Fields that are not decoded are -1.
+ * Stations are numbered per device and run of the program, -1 if unknown. The addresses are those known when the window was written, '-'
+ * if unknown. When the unit is closed, <output>.stations lists the stations of the run with the addresses learned until then.
+ *
+ * n_channels_per_device        number of channels of each device
+ * max_samples_per_block        maximum number of samples per channel passed to feed_packet_filter() at once by each device
+ * n_bytes_per_item             size of complex sample, 16, 8, 4 and 2 bytes (fc64, fc32, sc16, sc8) are supported
+ * rate                         sample rate in samples per second, must be 20 MS/s
+ * formats                      formats kept, see above, empty for all
+ * mcs_min                      smallest MCS kept, packets without decoded MCS pass, legacy rates count as MCS 0 to 7
+ * mcs_max                      largest MCS kept
+ * bandwidths_mhz               bandwidths kept, empty for all, packets without decoded bandwidth pass
+ * threshold_dbfs               minimum power of the short training field in dB relative to full scale
+ * margin                       samples saved before and after each packet
+ * cfo_tolerance_hz             largest frequency offset between two packets of the same station
+ * output                       path of the window and index file without extension
+ * return                       1 on success and 0 on failure
+*/
+int init_packet_filter(const std::vector<size_t>& n_channels_per_device, const std::vector<size_t>& max_samples_per_block, const size_t n_bytes_per_item, const double rate,
+                       const std::vector<std::string>& formats, const int mcs_min, const int mcs_max, const std::vector<int>& bandwidths_mhz, const double threshold_dbfs,
+                       const size_t margin, const double cfo_tolerance_hz, const std::string& output);
+
+/*!
+ * Starts a new measurement of a device, packets that are still incomplete are dropped.
+ * Must be called before each measurement while the sinks of the device are idle.
+ *
+ * device                       index of the device
+ * file_id                      id of the measurement, written into the index
+ * start_time_epoch_sec         time of the first sample of the measurement in seconds since the epoch
+ * return                       1 on success and 0 on failure
+*/
+int reset_packet_filter(const size_t device, const unsigned int file_id, const double start_time_epoch_sec);
+
+/*!
+ * Called by the sink thread of the device for every block it accepts, see ringbuffer_sink_t. Does nothing if the unit was not initialized.
+ *
+ * buffs                        samples of each channel of the device
+ * n_new_samples                number of samples per channel
+ * gaps                         gaps within the samples, ordered by offset
+*/
+void feed_packet_filter(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
+
+/*!
+ * Number of packets of the current measurement that matched the filter so far, the largest count of all devices as they receive the same
+ * channel. Lock-free, called by the rx thread, e.g. to stop a measurement once enough packets were found. 0 if the unit was not initialized.
+*/
+unsigned long long get_n_kept_packet_filter();
+
+/*!
+ * Closes the window and index file. Must be called after all threads have ended.
+*/
+void close_packet_filter();
+
+/*!
+ * Shows the detected, decoded and kept packets of each format, the stations and the decoded packets per second of processing time.
+*/
+void show_debug_information_packet_filter();
+}
+
+#endif
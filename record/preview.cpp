@@ -0,0 +1,355 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <iostream>
+#include <iomanip>
+#include <deque>
+#include <chrono>
+#include <complex>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <boost/asio.hpp>
+
+#include "preview.h"
+
+#define PREVIEW_HEADER_BYTES            56
+#define PREVIEW_CHANNEL_BYTES           16
+#define PREVIEW_MAX_DATAGRAM_BYTES      65507
+
+namespace channelsounder
+{
+typedef std::complex<float> cf32_t;
+
+struct preview_channel_t{
+    double sum_power;
+    float peak_power;
+    uint32_t n_clipped;
+    uint32_t n_analysed;
+
+    // box car average of the next IQ sample
+    cf32_t acc;
+    size_t n_acc;
+};
+
+struct preview_device_t{
+    size_t device;
+    size_t n_channels;
+
+    // measurement, sample indices count from its start, gaps included
+    double start_time_epoch_sec;
+    unsigned long long n_in;
+    unsigned long long interval_start;
+    uint32_t n_missing;
+
+    std::vector<preview_channel_t> channels;
+    std::vector<cf32_t> iq;                             // n_iq samples of each channel
+    size_t n_iq_filled;                                 // the same for all channels
+    std::vector<char> datagram;
+    uint64_t sequence = 0;
+
+    // statistics
+    double time_interval_sec = 0.0;                     // spent since the last datagram
+    double time_total_sec = 0.0;
+    double time_max_sec = 0.0;                          // of one block
+    unsigned long long n_samples_total = 0;
+    unsigned long long n_datagrams = 0;
+    unsigned long long n_datagrams_failed = 0;
+};
+
+// analyses n samples of one channel, updates its statistics and appends decimated IQ samples
+typedef void (*preview_kernel_fn_t)(preview_device_t &dev, const size_t ch, const char* in, const size_t n);
+
+// deque, elements are never moved
+static std::deque<preview_device_t> devices;
+
+static double rate;
+static size_t n_bytes_per_item;
+static unsigned long long interval_samples;
+static unsigned long long analysed_samples;             // at the start of each interval
+static size_t n_iq;
+static size_t decimation;
+static preview_kernel_fn_t kernel = nullptr;
+
+static boost::asio::io_service io_context;
+static boost::asio::ip::udp::socket preview_socket(io_context);
+static boost::asio::ip::udp::endpoint preview_endpoint;
+
+// Samples are scaled to full scale 1. A sample is clipped if I or Q reaches clip_high or clip_low, the limits of the integer types
+// and +-1 for floats.
+template<typename T>
+static void analyse_samples(preview_device_t &dev, const size_t ch, const char* in, const size_t n, const float scale, const T clip_high, const T clip_low){
+    const T* x = reinterpret_cast<const T*>(in);
+    preview_channel_t &c = dev.channels[ch];
+    cf32_t* iq = dev.iq.data() + ch*n_iq;
+
+    double sum_power = 0.0;
+    float peak_power = c.peak_power;
+    uint32_t n_clipped = 0;
+    size_t n_iq_filled = dev.n_iq_filled;
+    for(size_t k = 0; k < n; k++){
+        const T re = x[2*k];
+        const T im = x[2*k + 1];
+        const float re_f = (float) re*scale;
+        const float im_f = (float) im*scale;
+        const float power = re_f*re_f + im_f*im_f;
+        sum_power += power;
+        peak_power = std::max(peak_power, power);
+        n_clipped += (re >= clip_high || re <= clip_low || im >= clip_high || im <= clip_low);
+
+        if(n_iq_filled < n_iq){
+            c.acc += cf32_t(re_f, im_f);
+            if(++c.n_acc == decimation){
+                iq[n_iq_filled++] = c.acc*(1.0f/decimation);
+                c.acc = 0.0f;
+                c.n_acc = 0;
+            }
+        }
+    }
+    c.sum_power += sum_power;
+    c.peak_power = peak_power;
+    c.n_clipped += n_clipped;
+    c.n_analysed += n;
+
+    // all channels are analysed over the same samples, the last channel decides
+    if(ch + 1 == dev.n_channels)
+        dev.n_iq_filled = n_iq_filled;
+}
+
+static void kernel_fc64(preview_device_t &dev, const size_t ch, const char* in, const size_t n){
+    analyse_samples<double>(dev, ch, in, n, 1.0f, 1.0, -1.0);
+}
+
+static void kernel_fc32(preview_device_t &dev, const size_t ch, const char* in, const size_t n){
+    analyse_samples<float>(dev, ch, in, n, 1.0f, 1.0f, -1.0f);
+}
+
+static void kernel_sc16(preview_device_t &dev, const size_t ch, const char* in, const size_t n){
+    analyse_samples<int16_t>(dev, ch, in, n, 1.0f/32768.0f, INT16_MAX, INT16_MIN);
+}
+
+static void kernel_sc8(preview_device_t &dev, const size_t ch, const char* in, const size_t n){
+    analyse_samples<int8_t>(dev, ch, in, n, 1.0f/128.0f, INT8_MAX, INT8_MIN);
+}
+
+int init_preview(const std::vector<size_t>& n_channels_per_device, const size_t n_bytes_per_item_arg, const double rate_arg, const double interval_sec,
+                 const double fraction, const size_t n_iq_arg, const size_t decimation_arg, const std::string& address, const int ttl){
+
+    if(interval_sec <= 0.0 || fraction <= 0.0 || fraction > 1.0 || rate_arg <= 0.0)
+        return 0;
+    switch(n_bytes_per_item_arg){
+        case 16: kernel = kernel_fc64; break;
+        case 8: kernel = kernel_fc32; break;
+        case 4: kernel = kernel_sc16; break;
+        case 2: kernel = kernel_sc8; break;
+        default: return 0;
+    }
+
+    rate = rate_arg;
+    n_bytes_per_item = n_bytes_per_item_arg;
+    interval_samples = std::max<unsigned long long>(1, std::llround(interval_sec*rate));
+    analysed_samples = std::max<unsigned long long>(1, std::llround(fraction*interval_samples));
+    n_iq = n_iq_arg;
+    decimation = (decimation_arg > 0) ? decimation_arg : std::max<size_t>(1, analysed_samples/std::max<size_t>(1, n_iq));
+
+    for(size_t device = 0; device < n_channels_per_device.size(); device++){
+        devices.emplace_back();
+        preview_device_t &dev = devices.back();
+        dev.device = device;
+        dev.n_channels = n_channels_per_device[device];
+        dev.channels.resize(dev.n_channels);
+        dev.iq.resize(dev.n_channels*n_iq);
+        dev.datagram.resize(PREVIEW_HEADER_BYTES + dev.n_channels*(PREVIEW_CHANNEL_BYTES + n_iq*sizeof(cf32_t)));
+        if(dev.datagram.size() > PREVIEW_MAX_DATAGRAM_BYTES){
+            std::cerr << "preview: datagrams of device " << device << " exceed " << PREVIEW_MAX_DATAGRAM_BYTES << " bytes, reduce the IQ samples" << std::endl;
+            return 0;
+        }
+        reset_preview(device, 0.0);
+    }
+
+    // <address>:<port>, multicast datagrams stay within ttl hops
+    const size_t colon = address.rfind(':');
+    if(colon == std::string::npos || colon == 0){
+        std::cerr << "preview: invalid address " << address << ", expected <address>:<port>" << std::endl;
+        return 0;
+    }
+    try{
+        preview_endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(address.substr(0, colon)),
+                                                          (unsigned short) std::stoi(address.substr(colon + 1)));
+        preview_socket.open(preview_endpoint.protocol());
+        if(preview_endpoint.address().is_multicast()){
+            preview_socket.set_option(boost::asio::ip::multicast::hops(ttl));
+            preview_socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+        }
+        preview_socket.non_blocking(true);
+    }
+    catch(std::exception& e){
+        std::cerr << "preview: invalid address " << address << ": " << e.what() << std::endl;
+        return 0;
+    }
+
+    std::cout << "preview: every " << interval_sec*1.0e3 << " ms to " << address << ", " << 100.0*fraction << " % of the samples analysed, "
+              << n_iq << " IQ samples per channel at " << rate/decimation/1.0e3 << " kS/s" << std::endl;
+
+    return 1;
+}
+
+// sends the datagram of the current interval and starts the next one
+static void send_datagram(preview_device_t &dev){
+    char* p = dev.datagram.data();
+    const uint32_t header_u32[3] = {(uint32_t) dev.device, (uint32_t) dev.n_channels, (uint32_t) n_iq};
+    const uint64_t sequence = dev.sequence++;
+    const double header_f64[3] = {dev.start_time_epoch_sec + dev.interval_start/rate, interval_samples/rate, rate/decimation};
+    const float cost = (float) (dev.time_interval_sec/(interval_samples/rate));
+    std::memcpy(p, "PRV1", 4);
+    std::memcpy(p + 4, header_u32, sizeof(header_u32));
+    std::memcpy(p + 16, &sequence, sizeof(sequence));
+    std::memcpy(p + 24, header_f64, sizeof(header_f64));
+    std::memcpy(p + 48, &cost, sizeof(cost));
+    std::memcpy(p + 52, &dev.n_missing, sizeof(dev.n_missing));
+    p += PREVIEW_HEADER_BYTES;
+
+    for(size_t ch = 0; ch < dev.n_channels; ch++){
+        const preview_channel_t &c = dev.channels[ch];
+        const float rms_peak[2] = {(c.n_analysed > 0) ? (float) std::sqrt(c.sum_power/c.n_analysed) : 0.0f, std::sqrt(c.peak_power)};
+        const uint32_t counts[2] = {c.n_clipped, c.n_analysed};
+        std::memcpy(p, rms_peak, sizeof(rms_peak));
+        std::memcpy(p + sizeof(rms_peak), counts, sizeof(counts));
+        p += PREVIEW_CHANNEL_BYTES;
+    }
+
+    // IQ samples not filled because of a gap are zero
+    for(size_t ch = 0; ch < dev.n_channels; ch++)
+        std::fill(dev.iq.begin() + ch*n_iq + dev.n_iq_filled, dev.iq.begin() + (ch + 1)*n_iq, cf32_t(0.0f, 0.0f));
+    std::memcpy(p, dev.iq.data(), dev.iq.size()*sizeof(cf32_t));
+
+    // never blocks the sink thread, a full socket buffer drops the datagram
+    boost::system::error_code ec;
+    preview_socket.send_to(boost::asio::buffer(dev.datagram), preview_endpoint, 0, ec);
+    if(ec)
+        dev.n_datagrams_failed++;
+    else
+        dev.n_datagrams++;
+
+    for(size_t ch = 0; ch < dev.n_channels; ch++){
+        preview_channel_t &c = dev.channels[ch];
+        c.sum_power = 0.0;
+        c.peak_power = 0.0f;
+        c.n_clipped = 0;
+        c.n_analysed = 0;
+        c.acc = 0.0f;
+        c.n_acc = 0;
+    }
+    dev.n_iq_filled = 0;
+    dev.n_missing = 0;
+    dev.time_interval_sec = 0.0;
+}
+
+int reset_preview(const size_t device, const double start_time_epoch_sec){
+    // preview disabled
+    if(device >= devices.size())
+        return 1;
+    preview_device_t &dev = devices[device];
+
+    // the last interval of the previous measurement
+    if(dev.channels.size() > 0 && dev.channels[0].n_analysed > 0)
+        send_datagram(dev);
+
+    dev.start_time_epoch_sec = start_time_epoch_sec;
+    dev.n_in = 0;
+    dev.interval_start = 0;
+    dev.n_missing = 0;
+    for(size_t ch = 0; ch < dev.n_channels; ch++)
+        dev.channels[ch] = preview_channel_t{0.0, 0.0f, 0, 0, 0.0f, 0};
+    dev.n_iq_filled = 0;
+
+    return 1;
+}
+
+// analyses the samples within the first part of each interval
+static void take_samples(preview_device_t &dev, const std::vector<std::vector<char>> &buffs, unsigned long long offset, unsigned long long n){
+    while(n > 0){
+        if(dev.n_in >= dev.interval_start + interval_samples){
+            if(dev.channels[0].n_analysed > 0 || dev.n_missing > 0)
+                send_datagram(dev);
+            dev.interval_start += (dev.n_in - dev.interval_start)/interval_samples*interval_samples;
+        }
+
+        unsigned long long n_take = std::min(n, dev.interval_start + interval_samples - dev.n_in);
+        if(dev.n_in < dev.interval_start + analysed_samples){
+            n_take = std::min(n_take, dev.interval_start + analysed_samples - dev.n_in);
+            for(size_t ch = 0; ch < dev.n_channels; ch++)
+                kernel(dev, ch, &buffs[ch][0] + offset*n_bytes_per_item, (size_t) n_take);
+        }
+        dev.n_in += n_take;
+        offset += n_take;
+        n -= n_take;
+    }
+}
+
+void feed_preview(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    if(device >= devices.size())
+        return;
+    preview_device_t &dev = devices[device];
+    auto t_start = std::chrono::steady_clock::now();
+
+    unsigned long long n_consumed_samples = 0;
+    for(size_t i = 0; i < gaps.size(); i++){
+        const unsigned long long gap_offset = std::min(gaps[i].offset, n_new_samples);
+        if(gap_offset > n_consumed_samples){
+            take_samples(dev, buffs, n_consumed_samples, gap_offset - n_consumed_samples);
+            n_consumed_samples = gap_offset;
+        }
+
+        // the box car average restarts after the gap, the gap is counted in the interval it starts in
+        dev.n_missing += (uint32_t) gaps[i].length;
+        dev.n_in += gaps[i].length;
+        for(size_t ch = 0; ch < dev.n_channels; ch++){
+            dev.channels[ch].acc = 0.0f;
+            dev.channels[ch].n_acc = 0;
+        }
+    }
+
+    if(n_new_samples > n_consumed_samples)
+        take_samples(dev, buffs, n_consumed_samples, n_new_samples - n_consumed_samples);
+
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - t_start;
+    dev.time_interval_sec += time.count();
+    dev.time_total_sec += time.count();
+    dev.time_max_sec = std::max(dev.time_max_sec, time.count());
+    dev.n_samples_total += n_new_samples;
+}
+
+void show_debug_information_preview(){
+    for(size_t device = 0; device < devices.size(); device++){
+        const preview_device_t &dev = devices[device];
+        std::cout << "--------------------------" << std::endl;
+        std::cout << "preview " << device << std::endl;
+        std::cout << "n_datagrams: " << dev.n_datagrams << std::endl;
+        std::cout << "n_datagrams_failed: " << dev.n_datagrams_failed << std::endl;
+        std::cout << "time_total_ms: " << dev.time_total_sec*1.0e3 << std::endl;
+        std::cout << "time_max_per_block_ms: " << dev.time_max_sec*1.0e3 << std::endl;
+        if(dev.n_samples_total > 0){
+            std::cout << "ns_per_sample: " << std::fixed << std::setprecision(3) << dev.time_total_sec*1.0e9/dev.n_samples_total << std::endl;
+            std::cout << "share_of_real_time_percent: " << 100.0*dev.time_total_sec/(dev.n_samples_total/rate) << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+            std::cout << std::setprecision(6);
+        }
+        std::cout << "--------------------------" << std::endl;
+    }
+}
+}
@@ -0,0 +1,91 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_PREVIEW_H
+#define CHANNELSOUNDER_PREVIEW_H
+
+#include <vector>
+#include <string>
+
+#include "gap.h"
+
+namespace channelsounder
+{
+/*!
+ * Inits unit internally. Must be called first.
+ * The preview is a sink of each ringbuffer with its own thread, it skips blocks instead of delaying the other sinks. Every interval it sends one datagram per device
+ * with the RMS, the peak and the number of clipped samples of each channel and a few decimated IQ samples (box car average of decimation samples).
+ * Only the first fraction of each interval is analysed, so the cost per sample is one pass over fraction of the samples plus one datagram per
+ * interval. The time spent is measured and sent along with each datagram.
+ *
+ * Datagram format, host byte order (little endian on x86):
+ *
+ *      char[4]     "PRV1"
+ *      uint32      device
+ *      uint32      n_channels
+ *      uint32      n_iq                        IQ samples per channel
+ *      uint64      sequence                    counts the datagrams of the device
+ *      float64     time_start                  start of the interval, seconds since the epoch
+ *      float64     duration                    interval in s
+ *      float64     iq_rate                     sample rate of the decimated IQ samples
+ *      float32     cost                        time spent by the preview divided by the duration of the interval
+ *      uint32      n_missing                   samples per channel lost in gaps during the interval
+ *      per channel:
+ *      float32     rms                         full scale is 1
+ *      float32     peak                        largest magnitude
+ *      uint32      n_clipped                   samples at full scale in I or Q
+ *      uint32      n_analysed                  samples analysed
+ *      cf32        iq[n_channels][n_iq]
+ *
+ * n_channels_per_device        number of channels of each device
+ * n_bytes_per_item             size of complex sample, 16, 8, 4 and 2 bytes (fc64, fc32, sc16, sc8) are supported
+ * rate                         sample rate in samples per second
+ * interval_sec                 time between two datagrams of a device
+ * fraction                     fraction of each interval analysed from 0 to 1, bounds the cost
+ * n_iq                         IQ samples per channel and datagram
+ * decimation                   samples averaged per IQ sample, 0 spreads the IQ samples over the analysed part of the interval
+ * address                      <address>:<port>, multicast or unicast
+ * ttl                          time to live of multicast datagrams
+ * return                       1 on success and 0 on failure
+*/
+int init_preview(const std::vector<size_t>& n_channels_per_device, const size_t n_bytes_per_item, const double rate, const double interval_sec,
+                 const double fraction, const size_t n_iq, const size_t decimation, const std::string& address, const int ttl);
+
+/*!
+ * Starts a new measurement of a device. Must be called before each measurement while the sinks of the device are idle.
+ *
+ * device                       index of the device
+ * start_time_epoch_sec         time of the first sample of the measurement in seconds since the epoch
+ * return                       1 on success and 0 on failure
+*/
+int reset_preview(const size_t device, const double start_time_epoch_sec);
+
+/*!
+ * Called by the sink thread of the device for every block it accepts, see ringbuffer_sink_t. Does nothing if the unit was not initialized.
+ *
+ * buffs                        samples of each channel of the device
+ * n_new_samples                number of samples per channel
+ * gaps                         gaps within the samples, ordered by offset
+*/
+void feed_preview(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
+
+/*!
+ * Shows some stats of the preview, including its share of the processing time.
+*/
+void show_debug_information_preview();
+}
+
+#endif
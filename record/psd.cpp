@@ -0,0 +1,535 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <iostream>
+#include <fstream>
+#include <deque>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <boost/asio.hpp>
+
+#include "psd.h"
+#include "fft.h"
+
+#define PSD_SLOTS_PER_WORKER            8           // segments in flight per device and worker in addition to the segments of one block
+#define PSD_FRAME_HEADER_BYTES          52
+#define PSD_MAX_DATAGRAM_BYTES          65507
+
+namespace channelsounder
+{
+enum psd_slot_state_t{
+    PSD_SLOT_FREE = 0,
+    PSD_SLOT_FILLING = 1,                               // the sink thread copies samples into the slot
+    PSD_SLOT_FILLED = 2,                                // waits for a worker
+    PSD_SLOT_BUSY = 3,                                  // a worker computes the power spectrum
+    PSD_SLOT_DONE = 4                                   // waits until the slots before it are added to the frame
+};
+
+struct psd_slot_t{
+    psd_slot_state_t state;
+    unsigned long long start;                           // index of the first sample since the start of the measurement
+    std::vector<cf32_t> samples;                        // fft_size samples of each channel
+    std::vector<float> power;                           // fft_size bins of each channel, ordered by frequency
+};
+
+// buffers of one thread that transforms segments
+struct psd_scratch_t{
+    std::vector<cf32_t> in;
+    std::vector<cf32_t> out;
+    std::vector<cf32_t> fft_scratch;
+};
+
+struct psd_device_t{
+    size_t device;
+    size_t n_channels;
+
+    // measurement
+    double start_time_epoch_sec;
+    double center_freq;
+    unsigned long long n_in;                            // index of the next input sample, gaps included
+    unsigned long long next_start;                      // index of the first sample of the next segment
+    bool filling;                                       // slot idx_write is being filled
+    size_t n_filled;
+
+    // segments are filled, claimed and added to the frame in the order of the slots
+    std::vector<psd_slot_t> slots;
+    size_t idx_write;
+    size_t idx_claim;
+    size_t idx_read;
+    psd_scratch_t scratch;                              // used by the sink thread without workers
+
+    // current frame
+    long long frame;                                    // index of the integration period since the epoch, -1 if no spectrum was added yet
+    unsigned long long n_spectra;
+    std::vector<double> sum;
+    std::vector<float> max;
+
+    // statistics
+    unsigned long long n_spectra_total = 0;
+    unsigned long long n_spectra_skipped = 0;
+    unsigned long long n_frames = 0;
+};
+
+// deque, elements are never moved
+static std::deque<psd_device_t> devices;
+
+static size_t n_bytes_per_item;
+static double rate;
+static size_t fft_size;
+static size_t n_bins;
+static double integration_sec;
+static unsigned long long stride;                       // distance between the starts of two segments
+static size_t n_workers;
+static fft_plan_t plan;
+static std::vector<float> window;
+static float power_scale;                               // power of a bin relative to full scale
+
+// output
+static bool output_udp = false;
+static std::ofstream fout;
+static boost::asio::io_service io_context;
+static boost::asio::ip::udp::socket psd_socket(io_context);
+static boost::asio::ip::udp::endpoint psd_endpoint;
+static std::vector<char> frame_buffer;
+
+// slots of all devices and the output
+static boost::mutex m_mutex;
+static boost::condition_variable m_condition_filled;
+static boost::condition_variable m_condition_done;
+
+// statistics
+static unsigned long long n_frames_failed = 0;
+
+// converts n samples of any supported type to fc32, sc16 and sc8 are scaled to full scale 1
+static void convert_samples(const char* in, cf32_t* out, const size_t n){
+    switch(n_bytes_per_item){
+        case 16:
+        {
+            const double* x = reinterpret_cast<const double*>(in);
+            for(size_t k = 0; k < n; k++)
+                out[k] = cf32_t((float) x[2*k], (float) x[2*k + 1]);
+            break;
+        }
+        case 8:
+            std::memcpy(out, in, n*sizeof(cf32_t));
+            break;
+        case 4:
+        {
+            const int16_t* x = reinterpret_cast<const int16_t*>(in);
+            for(size_t k = 0; k < n; k++)
+                out[k] = cf32_t(x[2*k]*(1.0f/32768.0f), x[2*k + 1]*(1.0f/32768.0f));
+            break;
+        }
+        default:
+        {
+            const int8_t* x = reinterpret_cast<const int8_t*>(in);
+            for(size_t k = 0; k < n; k++)
+                out[k] = cf32_t(x[2*k]*(1.0f/128.0f), x[2*k + 1]*(1.0f/128.0f));
+            break;
+        }
+    }
+}
+
+int init_psd(const std::vector<size_t>& n_channels_per_device, const std::vector<size_t>& max_samples_per_block, const size_t n_bytes_per_item_arg, const double rate_arg, const size_t fft_size_arg, const size_t n_bins_arg,
+             const double integration_sec_arg, const double fraction, const std::string& output, const size_t n_workers_arg){
+
+    const size_t n_bins_out = (n_bins_arg == 0) ? fft_size_arg : n_bins_arg;
+    if(fft_size_arg < 2 || fft_size_arg % n_bins_out != 0 || max_samples_per_block.size() != n_channels_per_device.size() || integration_sec_arg <= 0.0 || fraction <= 0.0 || fraction > 1.0 || rate_arg <= 0.0)
+        return 0;
+    if(n_bytes_per_item_arg != 16 && n_bytes_per_item_arg != 8 && n_bytes_per_item_arg != 4 && n_bytes_per_item_arg != 2)
+        return 0;
+
+    n_bytes_per_item = n_bytes_per_item_arg;
+    rate = rate_arg;
+    fft_size = fft_size_arg;
+    n_bins = n_bins_out;
+    integration_sec = integration_sec_arg;
+    stride = (unsigned long long) std::llround(fft_size/fraction);
+    n_workers = n_workers_arg;
+
+    // Hann window, the power of a tone of amplitude 1 at the center of a bin is 1
+    init_fft_plan(plan, fft_size);
+    window.resize(fft_size);
+    double window_sum = 0.0;
+    for(size_t t = 0; t < fft_size; t++){
+        window[t] = (float) (0.5 - 0.5*std::cos(2.0*M_PI*t/fft_size));
+        window_sum += window[t];
+    }
+    power_scale = (float) (1.0/(window_sum*window_sum));
+
+    size_t n_channels_max = 0;
+    for(size_t device = 0; device < n_channels_per_device.size(); device++){
+        devices.emplace_back();
+        psd_device_t &dev = devices.back();
+        dev.device = device;
+        dev.n_channels = n_channels_per_device[device];
+        n_channels_max = std::max(n_channels_max, dev.n_channels);
+
+        psd_slot_t slot_template;
+        slot_template.state = PSD_SLOT_FREE;
+        slot_template.samples.resize(dev.n_channels*fft_size);
+        slot_template.power.resize(dev.n_channels*fft_size);
+        // segments of one block plus some headroom, without workers each segment is transformed right after it has been filled
+        const size_t n_slots = (n_workers == 0) ? 2 : (size_t) (max_samples_per_block[device]/stride) + 2 + PSD_SLOTS_PER_WORKER*n_workers;
+        dev.slots.assign(n_slots, slot_template);
+        dev.scratch.in.resize(fft_size);
+        dev.scratch.out.resize(fft_size);
+        dev.scratch.fft_scratch.resize(fft_size);
+        dev.sum.resize(dev.n_channels*n_bins);
+        dev.max.resize(dev.n_channels*n_bins);
+        dev.frame = -1;
+        dev.n_spectra = 0;
+        reset_psd(device, 0.0, 0.0);
+    }
+    frame_buffer.resize(PSD_FRAME_HEADER_BYTES + 2*n_channels_max*n_bins*sizeof(int16_t));
+
+    // udp:<address>:<port> or a file
+    if(output.compare(0, 4, "udp:") == 0){
+        const size_t colon = output.rfind(':');
+        if(colon <= 4 || frame_buffer.size() > PSD_MAX_DATAGRAM_BYTES){
+            std::cerr << "psd: frames must fit into one datagram of " << PSD_MAX_DATAGRAM_BYTES << " bytes and the output udp:<address>:<port>" << std::endl;
+            return 0;
+        }
+        try{
+            psd_endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(output.substr(4, colon - 4)),
+                                                          (unsigned short) std::stoi(output.substr(colon + 1)));
+            psd_socket.open(boost::asio::ip::udp::v4());
+        }
+        catch(std::exception& e){
+            std::cerr << "psd: invalid output " << output << ": " << e.what() << std::endl;
+            return 0;
+        }
+        output_udp = true;
+    }
+    else{
+        fout.open(output, std::ios::binary | std::ios::app);
+        if(!fout.is_open()){
+            std::cerr << "psd: unable to open " << output << std::endl;
+            return 0;
+        }
+    }
+
+    std::cout << "psd: " << fft_size << " point fft (" << rate/fft_size/1.0e3 << " kHz), " << n_bins << " bins per frame, " << integration_sec
+              << " s per frame, " << 100.0*fft_size/stride << " % of the samples, " << n_workers << " worker threads, output " << output << std::endl;
+
+    return 1;
+}
+
+// writes the current frame of the device, called with m_mutex locked
+static void write_frame(psd_device_t &dev){
+    const size_t n_combined = fft_size/n_bins;
+
+    char* p = frame_buffer.data();
+    const uint32_t header_u32[4] = {(uint32_t) dev.device, (uint32_t) dev.n_channels, (uint32_t) n_bins, (uint32_t) dev.n_spectra};
+    const double header_f64[4] = {dev.frame*integration_sec, integration_sec,
+                                  dev.center_freq + ((double) n_combined*0.5 - 0.5 - (double) (fft_size/2))*rate/fft_size, n_combined*rate/fft_size};
+    std::memcpy(p, "PSD1", 4);
+    std::memcpy(p + 4, header_u32, sizeof(header_u32));
+    std::memcpy(p + 4 + sizeof(header_u32), header_f64, sizeof(header_f64));
+    p += PSD_FRAME_HEADER_BYTES;
+
+    // mean and max hold in 0.01 dB, empty bins at the lower limit
+    const size_t n_values = dev.n_channels*n_bins;
+    int16_t* mean_cdB = reinterpret_cast<int16_t*>(p);
+    int16_t* max_cdB = mean_cdB + n_values;
+    for(size_t i = 0; i < n_values; i++){
+        const double mean = dev.sum[i]/(dev.n_spectra*n_combined);
+        mean_cdB[i] = (int16_t) std::max(-32768.0, std::min(32767.0, std::round(1000.0*std::log10(mean + 1e-300))));
+        max_cdB[i] = (int16_t) std::max(-32768.0, std::min(32767.0, std::round(1000.0*std::log10(dev.max[i] + 1e-300))));
+    }
+    const size_t n_bytes = PSD_FRAME_HEADER_BYTES + 2*n_values*sizeof(int16_t);
+
+    if(output_udp){
+        try{
+            psd_socket.send_to(boost::asio::buffer(frame_buffer.data(), n_bytes), psd_endpoint);
+            dev.n_frames++;
+        }
+        catch(std::exception& e){
+            n_frames_failed++;
+        }
+    }
+    else{
+        fout.write(frame_buffer.data(), n_bytes);
+        fout.flush();
+        if(fout.good())
+            dev.n_frames++;
+        else
+            n_frames_failed++;
+    }
+}
+
+// adds the done slots to the frame in order, called with m_mutex locked
+static void collect_spectra(psd_device_t &dev){
+    const size_t n_combined = fft_size/n_bins;
+
+    while(dev.slots[dev.idx_read].state == PSD_SLOT_DONE){
+        psd_slot_t &slot = dev.slots[dev.idx_read];
+
+        // a spectrum belongs to the integration period of its first sample
+        const long long frame = (long long) std::floor((dev.start_time_epoch_sec + slot.start/rate)/integration_sec);
+        if(frame != dev.frame){
+            if(dev.n_spectra > 0)
+                write_frame(dev);
+            dev.frame = frame;
+            dev.n_spectra = 0;
+            std::fill(dev.sum.begin(), dev.sum.end(), 0.0);
+            std::fill(dev.max.begin(), dev.max.end(), 0.0f);
+        }
+
+        // adjacent bins are summed for the mean, the max hold keeps the largest of them
+        for(size_t ch = 0; ch < dev.n_channels; ch++){
+            const float* power = slot.power.data() + ch*fft_size;
+            for(size_t bin = 0; bin < n_bins; bin++){
+                double sum = 0.0;
+                float max = dev.max[ch*n_bins + bin];
+                for(size_t k = bin*n_combined; k < (bin + 1)*n_combined; k++){
+                    sum += power[k];
+                    max = std::max(max, power[k]);
+                }
+                dev.sum[ch*n_bins + bin] += sum;
+                dev.max[ch*n_bins + bin] = max;
+            }
+        }
+        dev.n_spectra++;
+        dev.n_spectra_total++;
+
+        slot.state = PSD_SLOT_FREE;
+        dev.idx_read = (dev.idx_read + 1) % dev.slots.size();
+    }
+}
+
+// power spectrum of each channel of a segment, ordered by frequency from -rate/2 to rate/2
+static void compute_spectrum(psd_slot_t &slot, const size_t n_channels, psd_scratch_t &scratch){
+    const size_t shift = (fft_size + 1)/2;
+    for(size_t ch = 0; ch < n_channels; ch++){
+        const cf32_t* x = slot.samples.data() + ch*fft_size;
+        for(size_t t = 0; t < fft_size; t++)
+            scratch.in[t] = x[t]*window[t];
+        fft(plan, scratch.out.data(), scratch.in.data(), scratch.fft_scratch.data());
+
+        float* power = slot.power.data() + ch*fft_size;
+        for(size_t i = 0; i < fft_size; i++){
+            const cf32_t X = scratch.out[(i + shift) % fft_size];
+            power[i] = (X.real()*X.real() + X.imag()*X.imag())*power_scale;
+        }
+    }
+}
+
+int reset_psd(const size_t device, const double start_time_epoch_sec, const double center_freq){
+    // psd disabled
+    if(device >= devices.size())
+        return 1;
+    psd_device_t &dev = devices[device];
+
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    // segments of the previous measurement that are still transformed by the workers
+    bool busy = true;
+    while(busy){
+        busy = false;
+        for(size_t i = 0; i < dev.slots.size(); i++)
+            busy = busy || dev.slots[i].state == PSD_SLOT_FILLED || dev.slots[i].state == PSD_SLOT_BUSY;
+        if(busy && m_condition_done.wait_for(lock, boost::chrono::milliseconds(5000)) == boost::cv_status::timeout)
+            break;
+    }
+    for(size_t i = 0; i < dev.slots.size(); i++)
+        dev.slots[i].state = PSD_SLOT_FREE;
+
+    if(dev.n_spectra > 0)
+        write_frame(dev);
+    dev.frame = -1;
+    dev.n_spectra = 0;
+
+    dev.start_time_epoch_sec = start_time_epoch_sec;
+    dev.center_freq = center_freq;
+    dev.n_in = 0;
+    dev.next_start = 0;
+    dev.filling = false;
+    dev.n_filled = 0;
+    dev.idx_write = 0;
+    dev.idx_claim = 0;
+    dev.idx_read = 0;
+
+    return 1;
+}
+
+// copies n samples starting at offset into segments, samples between segments are not used
+static void take_samples(psd_device_t &dev, const std::vector<std::vector<char>> &buffs, unsigned long long offset, unsigned long long n){
+    while(n > 0){
+        if(!dev.filling){
+            dev.next_start = std::max(dev.next_start, dev.n_in);
+            if(dev.n_in + n <= dev.next_start){
+                dev.n_in += n;
+                return;
+            }
+            const unsigned long long n_skip = dev.next_start - dev.n_in;
+            offset += n_skip;
+            n -= n_skip;
+            dev.n_in += n_skip;
+
+            // the segment is skipped if all slots are in use
+            psd_slot_t &slot = dev.slots[dev.idx_write];
+            bool slot_free = false;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                if(slot.state == PSD_SLOT_FREE){
+                    slot.state = PSD_SLOT_FILLING;
+                    slot_free = true;
+                }
+            }
+            if(!slot_free){
+                dev.n_spectra_skipped++;
+                dev.next_start += stride;
+                continue;
+            }
+            slot.start = dev.n_in;
+            dev.filling = true;
+            dev.n_filled = 0;
+        }
+
+        psd_slot_t &slot = dev.slots[dev.idx_write];
+        const size_t n_take = (size_t) std::min<unsigned long long>(fft_size - dev.n_filled, n);
+        for(size_t ch = 0; ch < dev.n_channels; ch++)
+            convert_samples(&buffs[ch][0] + offset*n_bytes_per_item, slot.samples.data() + ch*fft_size + dev.n_filled, n_take);
+        dev.n_filled += n_take;
+        dev.n_in += n_take;
+        offset += n_take;
+        n -= n_take;
+
+        if(dev.n_filled == fft_size){
+            dev.filling = false;
+            dev.next_start += stride;
+            dev.idx_write = (dev.idx_write + 1) % dev.slots.size();
+
+            // without workers the sink thread transforms the segment itself
+            if(n_workers == 0){
+                compute_spectrum(slot, dev.n_channels, dev.scratch);
+                boost::mutex::scoped_lock lock(m_mutex);
+                slot.state = PSD_SLOT_DONE;
+                collect_spectra(dev);
+            }
+            else{
+                {
+                    boost::mutex::scoped_lock lock(m_mutex);
+                    slot.state = PSD_SLOT_FILLED;
+                }
+                m_condition_filled.notify_one();
+            }
+        }
+    }
+}
+
+void feed_psd(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    if(device >= devices.size())
+        return;
+    psd_device_t &dev = devices[device];
+
+    unsigned long long n_consumed_samples = 0;
+    for(size_t i = 0; i < gaps.size(); i++){
+        const unsigned long long gap_offset = std::min(gaps[i].offset, n_new_samples);
+        if(gap_offset > n_consumed_samples){
+            take_samples(dev, buffs, n_consumed_samples, gap_offset - n_consumed_samples);
+            n_consumed_samples = gap_offset;
+        }
+
+        // the segment being filled contains the gap
+        if(dev.filling){
+            boost::mutex::scoped_lock lock(m_mutex);
+            dev.slots[dev.idx_write].state = PSD_SLOT_FREE;
+            dev.filling = false;
+            dev.n_spectra_skipped++;
+        }
+        dev.n_in += gaps[i].length;
+    }
+
+    if(n_new_samples > n_consumed_samples)
+        take_samples(dev, buffs, n_consumed_samples, n_new_samples - n_consumed_samples);
+}
+
+void run_psd_worker(std::atomic<bool>& burst_timer_elapsed){
+    psd_scratch_t scratch;
+    scratch.in.resize(fft_size);
+    scratch.out.resize(fft_size);
+    scratch.fft_scratch.resize(fft_size);
+
+    while(1){
+        psd_device_t* dev = nullptr;
+        psd_slot_t* slot = nullptr;
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            while(dev == nullptr){
+                for(size_t device = 0; device < devices.size() && dev == nullptr; device++){
+                    if(devices[device].slots[devices[device].idx_claim].state == PSD_SLOT_FILLED)
+                        dev = &devices[device];
+                }
+                if(dev != nullptr)
+                    break;
+
+                // from time to time we check if "burst_timer_elapsed" was set to true
+                m_condition_filled.wait_for(lock, boost::chrono::milliseconds(5000));
+                if(burst_timer_elapsed == true)
+                    return;
+            }
+            slot = &dev->slots[dev->idx_claim];
+            slot->state = PSD_SLOT_BUSY;
+            dev->idx_claim = (dev->idx_claim + 1) % dev->slots.size();
+        }
+
+        compute_spectrum(*slot, dev->n_channels, scratch);
+
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            slot->state = PSD_SLOT_DONE;
+            collect_spectra(*dev);
+        }
+        m_condition_done.notify_all();
+    }
+}
+
+void close_psd(){
+    boost::mutex::scoped_lock lock(m_mutex);
+    for(size_t device = 0; device < devices.size(); device++){
+        if(devices[device].n_spectra > 0)
+            write_frame(devices[device]);
+        devices[device].n_spectra = 0;
+    }
+    if(fout.is_open())
+        fout.close();
+    if(psd_socket.is_open())
+        psd_socket.close();
+}
+
+void show_debug_information_psd(){
+    if(devices.size() == 0)
+        return;
+    for(size_t device = 0; device < devices.size(); device++){
+        const psd_device_t &dev = devices[device];
+        std::cout << "--------------------------" << std::endl;
+        std::cout << "psd " << device << std::endl;
+        std::cout << "fft_size: " << fft_size << std::endl;
+        std::cout << "n_bins: " << n_bins << std::endl;
+        std::cout << "n_workers: " << n_workers << std::endl;
+        std::cout << "n_spectra_total: " << dev.n_spectra_total << std::endl;
+        std::cout << "n_spectra_skipped: " << dev.n_spectra_skipped << std::endl;
+        std::cout << "n_frames: " << dev.n_frames << std::endl;
+        std::cout << "n_frames_failed: " << n_frames_failed << std::endl;
+        std::cout << "--------------------------" << std::endl;
+    }
+}
+}
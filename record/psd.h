@@ -0,0 +1,108 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_PSD_H
+#define CHANNELSOUNDER_PSD_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "gap.h"
+
+namespace channelsounder
+{
+/*!
+ * Inits unit internally. Must be called first.
+ * The psd unit is a sink of each ringbuffer next to the downconverter. It cuts the samples of each device into segments of fft_size samples,
+ * weights them with a Hann window and averages their power spectra over integration_sec. Every integration period becomes one frame with
+ * the mean and the maximum (max hold) of each bin and channel. Frames are aligned to multiples of integration_sec since the epoch, so the
+ * frames of long recordings line up in time.
+ * Segments are copied by the sink threads and transformed by the worker threads (run_psd_worker()). If the workers fall behind,
+ * segments are skipped instead of slowing down the sink threads, each frame reports the number of spectra it averages.
+ * Segments containing a gap are skipped as well.
+ *
+ * Frame format, host byte order (little endian on x86):
+ *
+ *      char[4]     "PSD1"
+ *      uint32      device
+ *      uint32      n_channels
+ *      uint32      n_bins
+ *      uint32      n_spectra                   spectra averaged
+ *      float64     time_start                  start of the integration period, seconds since the epoch
+ *      float64     duration                    integration period in s
+ *      float64     freq_first                  center of the first bin in Hz, absolute
+ *      float64     bin_width                   in Hz
+ *      int16       mean[n_channels][n_bins]    mean power in 0.01 dBFS
+ *      int16       max[n_channels][n_bins]     maximum power in 0.01 dBFS
+ *
+ * Bins are ordered by frequency. 0 dBFS is a tone of amplitude 1 (fc32) or full scale (sc16, sc8).
+ *
+ * n_channels_per_device        number of channels of each device
+ * max_samples_per_block        maximum number of samples per channel passed to feed_psd() at once by each device, the segments of one block are
+ *                              buffered, so the workers only have to keep up on average
+ * n_bytes_per_item             size of complex sample, 16, 8, 4 and 2 bytes (fc64, fc32, sc16, sc8) are supported
+ * rate                         sample rate in samples per second
+ * fft_size                     samples per segment, the frequency resolution is rate/fft_size
+ * n_bins                       bins per frame, must divide fft_size, adjacent bins of the fft are combined, 0 keeps all
+ * integration_sec              duration of one frame in s
+ * fraction                     fraction of the samples analysed from 0 to 1, segments start every fft_size/fraction samples
+ * output                       file the frames are appended to, or udp:<address>:<port> to send each frame as one datagram
+ * n_workers                    number of threads started with run_psd_worker(), 0 transforms the segments in the sink threads
+ * return                       1 on success and 0 on failure
+*/
+int init_psd(const std::vector<size_t>& n_channels_per_device, const std::vector<size_t>& max_samples_per_block, const size_t n_bytes_per_item, const double rate, const size_t fft_size, const size_t n_bins,
+             const double integration_sec, const double fraction, const std::string& output, const size_t n_workers);
+
+/*!
+ * Starts a new measurement of a device. The frame of the previous measurement is written, even if its integration period is incomplete.
+ * Must be called before each measurement while the sinks of the device are idle.
+ *
+ * device                       index of the device
+ * start_time_epoch_sec         time of the first sample of the measurement in seconds since the epoch
+ * center_freq                  rx center frequency of the measurement in Hz
+ * return                       1 on success and 0 on failure
+*/
+int reset_psd(const size_t device, const double start_time_epoch_sec, const double center_freq);
+
+/*!
+ * Called by the sink thread of the device for every block it accepts, see ringbuffer_sink_t. Does nothing if the unit was not initialized.
+ *
+ * buffs                        samples of each channel of the device
+ * n_new_samples                number of samples per channel
+ * gaps                         gaps within the samples, ordered by offset
+*/
+void feed_psd(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
+
+/*!
+ * Worker thread, transforms the segments of all devices. Returns once "burst_timer_elapsed" is set.
+ *
+ * burst_timer_elapsed          set to true to end the thread
+*/
+void run_psd_worker(std::atomic<bool>& burst_timer_elapsed);
+
+/*!
+ * Writes the pending frames and closes the output. Must be called after all threads have ended.
+*/
+void close_psd();
+
+/*!
+ * Shows some stats of the psd.
+*/
+void show_debug_information_psd();
+}
+
+#endif
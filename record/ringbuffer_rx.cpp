@@ -16,174 +16,554 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <iostream>
+#include <iomanip>
+#include <deque>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <boost/thread/thread.hpp>
 
 #include "debug.h"
 #include "ringbuffer_rx.h"
-#include "fifo_measurement.h"
+#include "gap.h"
 
-#define N_COMPLEX_SAMPLES_PER_BUFFER        1000000
+#define N_MAX_GAPS_PER_BUFFER               4096        // reserved up front, the rx thread never allocates
+#define N_MIN_PACKETS_PER_BLOCK             16          // lower limit of the auto tuned block size
+#define COPY_UTILIZATION_WARNING            0.5         // warn if copying or processing a block takes longer than this fraction of its duration
+#define N_MIN_BLOCKS_RETUNE                 16          // blocks a sink must have processed before its process time is used for re-tuning
 
 namespace channelsounder
 {
-static size_t n_channels;                   // number of channels/antennas, set in init function
-static size_t n_bytes_per_item;             // size of complex sample
-static size_t max_items_per_packet;         // maximum number of samples passed on by uhd driver
-
-enum buffer_enum{
-    NO_BUFFER = -1,
-    BUFFER0 = 0,
-    BUFFER1 = 1
+// one block of the ringbuffer, owned by the rx thread until it is handed over to the sinks
+struct block_t{
+    // columns: number of rx channels (antennas)
+    // rows: container for samples
+    std::vector<std::vector<char>> buffs;
+
+    // gaps within the samples of this block
+    std::vector<gap_t> gaps;
+
+    unsigned long long n_samples;           // number of samples in this block when it was handed over
+    unsigned long long n_span;              // samples and gaps, what a sink misses when it skips this block
+    size_t n_refs;                          // sinks that have not released this block yet
 };
-static buffer_enum buffer2write;
-static buffer_enum buffer2process;
-static unsigned long long n_samples;        // number of samples written to current write buffer
-static unsigned long long n_samples_old;    // number of samples written to last buffer used
-
-// the static memory uhd will write to
-// columns: number of rx channels (antennas)
-// rows: container for samples
-static std::vector<std::vector<char>> buffs0;
-static std::vector<std::vector<char>> buffs1;
-
-static boost::mutex m_mutex;
-static boost::condition_variable m_condition;
-    
-// statistics
-static unsigned long long n_buffer_full = 0;
-static unsigned long long n_worker_not_done = 0;
-static unsigned long long n_samples_total = 0;
-static unsigned long long n_worker_wait = 0;
-static unsigned long long n_worker_executed = 0;
-
-int init_ringbuffer_rx(const size_t n_channels_arg, const size_t n_bytes_per_item_arg, const size_t max_items_per_packet_arg){
-    n_channels = n_channels_arg;
-    n_bytes_per_item = n_bytes_per_item_arg;
-    max_items_per_packet = max_items_per_packet_arg;
-
-    buffer2write = BUFFER0;
-    buffer2process = NO_BUFFER;
-    n_samples = 0;
-    n_samples_old = 0;
+
+// a block in the queue of a sink
+struct sink_entry_t{
+    size_t idx_block;
+    unsigned long long n_skipped_before;    // samples of the blocks the sink skipped right before this block
+};
+
+// one thread per sink, its queue holds the blocks it accepted in order
+struct sink_state_t{
+    ringbuffer_sink_t sink;
+
+    std::vector<sink_entry_t> queue;        // ring with one entry per block of the ringbuffer
+    size_t queue_head = 0;
+    size_t queue_size = 0;
+    size_t n_held = 0;                      // blocks queued or in work
+    unsigned long long n_skipped_next = 0;  // samples skipped since the last accepted block
+    std::vector<gap_t> gaps;                // gaps passed to the sink if blocks were skipped, reserved up front
+
+    boost::condition_variable m_condition;
+
+    // statistics
+    unsigned long long n_worker_wait = 0;
+    unsigned long long n_worker_executed = 0;
+
+    // statistics per block, always collected
+    size_t n_held_max = 0;
+    unsigned long long n_blocks_processed = 0;
+    unsigned long long n_blocks_skipped = 0;
+    double process_time_sum_sec = 0.0;
+    double process_time_max_sec = 0.0;
+};
+
+// one ringbuffer per device, each filled by its own rx thread and emptied by the threads of its sinks
+struct ringbuffer_t{
+    size_t n_channels;                      // number of channels/antennas of this device, set in init function
+    size_t n_bytes_per_item;                // size of complex sample
+    size_t max_items_per_packet;            // maximum number of samples passed on by uhd driver
+    size_t n_samples_per_block;             // a block is handed over as soon as it contains at least this many samples
+
+    std::vector<block_t> blocks;
+    std::vector<size_t> free_blocks;        // blocks released by all sinks, reserved up front
+    size_t idx_write;                       // block the rx thread writes to, only used by the rx thread
+    size_t n_blocks_filled;                 // blocks handed over and not released by all sinks yet
+    unsigned long long n_samples;           // number of samples written to current write block
+    unsigned long long n_missing_pending;   // missing samples reported while the gaps of the write block were full
+
+    // deque, sinks hold a condition variable and are never moved
+    std::deque<sink_state_t> sinks;
+
+    boost::mutex m_mutex;                   // only held for bookkeeping, never while samples are processed
+    boost::condition_variable m_condition_idle;
+
+    // statistics
+    unsigned long long n_buffer_full = 0;
+    unsigned long long n_worker_not_done = 0;
+    unsigned long long n_samples_total = 0;
+    unsigned long long n_gaps = 0;
+    unsigned long long n_samples_dropped = 0;
+
+    // statistics per block, always collected
+    size_t n_blocks_filled_max = 0;
+    unsigned long long n_gaps_merged = 0;   // gaps that did not fit into the gaps of a block, the block became one gap
+};
+
+// deque, elements are never moved when devices are added
+static std::deque<ringbuffer_t> ringbuffers;
+
+void tune_ringbuffer_rx(const double rate, const size_t n_channels, const size_t n_bytes_per_item, const size_t max_items_per_packet,
+                        const double latency_sec, const double slack_sec, size_t& n_samples_per_block, size_t& n_blocks){
+
+    // block size: the processing thread sees the samples at the latest after one block duration
+    if(n_samples_per_block == 0){
+        n_samples_per_block = (size_t) std::ceil(rate*latency_sec);
+        n_samples_per_block = std::max(n_samples_per_block, N_MIN_PACKETS_PER_BLOCK*max_items_per_packet);
+    }
+    const double block_duration_sec = n_samples_per_block/rate;
+
+    // the processing thread mainly copies blocks into the fifo, measure how long that takes on this machine
+    std::vector<std::vector<char>> source(n_channels, std::vector<char>(n_samples_per_block*n_bytes_per_item, 1));
+    std::vector<std::vector<char>> destination(n_channels, std::vector<char>(n_samples_per_block*n_bytes_per_item, 0));
+    double copy_time_sec = 1.0e9;
+    for(size_t k = 0; k < 3; k++){
+        auto t_start = std::chrono::steady_clock::now();
+        for(size_t ch = 0; ch < n_channels; ch++)
+            std::memcpy(&destination[ch][0], &source[ch][0], source[ch].size());
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - t_start;
+        copy_time_sec = std::min(copy_time_sec, t.count());
+    }
+
+    // block count: the blocks besides the one being written bridge stalls of the processing thread of up to slack_sec,
+    // the time the processing thread needs for each block is subtracted
+    if(n_blocks == 0){
+        const double block_margin_sec = std::max(block_duration_sec - copy_time_sec, 0.1*block_duration_sec);
+        n_blocks = 1 + (size_t) std::ceil(slack_sec/block_margin_sec);
+        n_blocks = std::max<size_t>(n_blocks, 2);
+    }
+
+    const double memory_MB = (double) n_blocks*(n_samples_per_block + 2*max_items_per_packet)*n_channels*n_bytes_per_item/1.0e6;
+    std::cout << std::fixed << std::setprecision(2)
+              << "ringbuffer_rx: " << n_blocks << " blocks of " << n_samples_per_block << " samples per channel"
+              << " (" << block_duration_sec*1.0e3 << " ms per block, " << (n_blocks - 1)*block_duration_sec*1.0e3 << " ms slack, " << memory_MB << " MB)"
+              << ", copy time per block " << copy_time_sec*1.0e3 << " ms" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+
+    if(copy_time_sec > COPY_UTILIZATION_WARNING*block_duration_sec)
+        std::cerr << "ringbuffer_rx: warning, copying a block takes " << (int) (100.0*copy_time_sec/block_duration_sec) << "% of its duration, the processing thread might not keep up" << std::endl;
+}
+
+int init_ringbuffer_rx(const size_t device, const size_t n_channels_arg, const size_t n_bytes_per_item_arg, const size_t max_items_per_packet_arg,
+                       const size_t n_samples_per_block_arg, const size_t n_blocks_arg, const std::vector<ringbuffer_sink_t>& sinks){
+
+    // devices are initialized in order
+    if(device > ringbuffers.size() || n_samples_per_block_arg == 0 || n_blocks_arg < 2 || sinks.size() == 0)
+        return 0;
+    for(size_t s = 0; s < sinks.size(); s++)
+        if(sinks[s].feed == nullptr || (sinks[s].policy != SINK_POLICY_BLOCK && sinks[s].depth == 0))
+            return 0;
+    if(device == ringbuffers.size())
+        ringbuffers.emplace_back();
+
+    ringbuffer_t &rb = ringbuffers[device];
+
+    rb.n_channels = n_channels_arg;
+    rb.n_bytes_per_item = n_bytes_per_item_arg;
+    rb.max_items_per_packet = max_items_per_packet_arg;
+    rb.n_samples_per_block = n_samples_per_block_arg;
+
+    // sinks that may drop blocks get blocks of their own, they never take blocks away from the others
+    size_t n_blocks = n_blocks_arg;
+    for(size_t s = 0; s < sinks.size(); s++)
+        if(sinks[s].policy != SINK_POLICY_BLOCK)
+            n_blocks += sinks[s].depth;
+
+    rb.idx_write = 0;
+    rb.n_blocks_filled = 0;
+    rb.n_samples = 0;
+    rb.n_missing_pending = 0;
     
-    // initialize buffers
-    std::vector<char> buff_template((N_COMPLEX_SAMPLES_PER_BUFFER + max_items_per_packet*2) * n_bytes_per_item);
-    for (size_t ch = 0; ch < n_channels; ch++){
+    // initialize blocks, the last packet of a block can exceed n_samples_per_block
+    std::vector<char> buff_template((rb.n_samples_per_block + rb.max_items_per_packet*2) * rb.n_bytes_per_item);
+    rb.blocks.clear();
+    rb.blocks.resize(n_blocks);
+    for(size_t i = 0; i < rb.blocks.size(); i++){
         // create one row for each channel/antenna
-        buffs0.push_back(buff_template);
-        buffs1.push_back(buff_template);
+        rb.blocks[i].buffs.assign(rb.n_channels, buff_template);
+        rb.blocks[i].gaps.reserve(N_MAX_GAPS_PER_BUFFER);
+        rb.blocks[i].n_samples = 0;
+        rb.blocks[i].n_span = 0;
+        rb.blocks[i].n_refs = 0;
     }
+
+    // block 0 is the first write block
+    rb.free_blocks.clear();
+    rb.free_blocks.reserve(n_blocks);
+    for(size_t i = n_blocks - 1; i > 0; i--)
+        rb.free_blocks.push_back(i);
+
+    rb.sinks.clear();
+    std::cout << "ringbuffer_rx: device " << device << " passes " << n_blocks << " blocks to";
+    for(size_t s = 0; s < sinks.size(); s++){
+        rb.sinks.emplace_back();
+        sink_state_t &sink = rb.sinks.back();
+        sink.sink = sinks[s];
+        sink.queue.resize(n_blocks);
+        sink.gaps.reserve(N_MAX_GAPS_PER_BUFFER + 1);
+
+        std::cout << ((s > 0) ? ", " : " ") << sink.sink.name;
+        if(sink.sink.policy == SINK_POLICY_DROP_NEWEST)
+            std::cout << " (drops newest, " << sink.sink.depth << " blocks)";
+        else if(sink.sink.policy == SINK_POLICY_DROP_OLDEST)
+            std::cout << " (drops oldest, " << sink.sink.depth << " blocks)";
+    }
+    std::cout << std::endl;
     
     return 1;
 }
     
-int reset_ringbuffer_rx(){
-    buffer2write = BUFFER0;
-    buffer2process = NO_BUFFER;
-    n_samples = 0;
-    n_samples_old = 0;
+int reset_ringbuffer_rx(const size_t device){
+    ringbuffer_t &rb = ringbuffers[device];
+
+    // wait until all sinks have released the blocks of the previous measurement
+    boost::mutex::scoped_lock lock(rb.m_mutex);
+    while(rb.n_blocks_filled > 0)
+        rb.m_condition_idle.wait(lock);
+
+    rb.n_samples = 0;
+    rb.n_missing_pending = 0;
+
+    for(size_t i = 0; i < rb.blocks.size(); i++)
+        rb.blocks[i].gaps.clear();
+
+    // blocks skipped at the end of the previous measurement are not reported in the next one
+    for(size_t s = 0; s < rb.sinks.size(); s++)
+        rb.sinks[s].n_skipped_next = 0;
     
     return 1;
 }    
-    
-std::vector<char*> get_ringbuffer_rx_pointers(const unsigned long long n_new_samples){
-    
-    std::vector<char*> buffs_out;
 
-    // current write buffer not full yet
-    if(n_samples < N_COMPLEX_SAMPLES_PER_BUFFER){
-        unsigned int offset = n_samples*n_bytes_per_item;
-        if(buffer2write == BUFFER0){
-            for (size_t ch = 0; ch < n_channels; ch++)
-                buffs_out.push_back(&(buffs0[ch][offset]));
+size_t retune_ringbuffer_rx(const size_t device, const double rate, const double slack_sec){
+    ringbuffer_t &rb = ringbuffers[device];
+
+    // the sinks must have released all blocks, then none of them is written or read
+    boost::mutex::scoped_lock lock(rb.m_mutex);
+    while(rb.n_blocks_filled > 0)
+        rb.m_condition_idle.wait(lock);
+
+    // the slowest sink that never skips blocks determines how fast blocks are released, the others have blocks of their own
+    double process_time_sec = -1.0;
+    size_t n_blocks_own = 0;
+    for(size_t s = 0; s < rb.sinks.size(); s++){
+        const sink_state_t &sink = rb.sinks[s];
+        if(sink.sink.policy != SINK_POLICY_BLOCK)
+            n_blocks_own += sink.sink.depth;
+        else if(sink.n_blocks_processed >= N_MIN_BLOCKS_RETUNE)
+            process_time_sec = std::max(process_time_sec, sink.process_time_sum_sec/sink.n_blocks_processed);
+    }
+    if(process_time_sec < 0.0)
+        return 0;
+
+    // same rule as tune_ringbuffer_rx(), with the measured instead of the estimated time per block
+    const double block_duration_sec = rb.n_samples_per_block/rate;
+    const double block_margin_sec = std::max(block_duration_sec - process_time_sec, 0.1*block_duration_sec);
+    const size_t n_blocks = std::max<size_t>(1 + (size_t) std::ceil(slack_sec/block_margin_sec), 2);
+    const size_t n_blocks_old = rb.blocks.size();
+    if(n_blocks <= n_blocks_old - n_blocks_own)
+        return 0;
+    const size_t n_blocks_added = n_blocks - (n_blocks_old - n_blocks_own);
+
+    // blocks are moved, their samples are not, the rx thread fetches new pointers at the start of each measurement anyway
+    std::vector<char> buff_template((rb.n_samples_per_block + rb.max_items_per_packet*2) * rb.n_bytes_per_item);
+    rb.blocks.resize(n_blocks_old + n_blocks_added);
+    rb.free_blocks.reserve(rb.blocks.size());
+    for(size_t i = n_blocks_old; i < rb.blocks.size(); i++){
+        rb.blocks[i].buffs.assign(rb.n_channels, buff_template);
+        rb.blocks[i].gaps.reserve(N_MAX_GAPS_PER_BUFFER);
+        rb.blocks[i].n_samples = 0;
+        rb.blocks[i].n_span = 0;
+        rb.blocks[i].n_refs = 0;
+        rb.free_blocks.push_back(i);
+    }
+
+    // all queues are empty
+    for(size_t s = 0; s < rb.sinks.size(); s++){
+        rb.sinks[s].queue.resize(rb.blocks.size());
+        rb.sinks[s].queue_head = 0;
+    }
+
+    const double memory_MB = (double) n_blocks_added*buff_template.size()*rb.n_channels/1.0e6;
+    std::cout << std::fixed << std::setprecision(2)
+              << "ringbuffer_rx: device " << device << " processes a block in " << process_time_sec*1.0e3 << " ms, " << n_blocks_added << " blocks added"
+              << " (" << n_blocks << " blocks, " << (n_blocks - 1)*block_duration_sec*1.0e3 << " ms slack, " << memory_MB << " MB more)" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+
+    if(process_time_sec > COPY_UTILIZATION_WARNING*block_duration_sec)
+        std::cerr << "ringbuffer_rx: warning, processing a block takes " << (int) (100.0*process_time_sec/block_duration_sec) << "% of its duration, the processing thread might not keep up" << std::endl;
+
+    return n_blocks_added;
+}
+
+void report_gap_ringbuffer_rx(const size_t device, const unsigned long long n_missing_samples){
+    ringbuffer_t &rb = ringbuffers[device];
+    std::vector<gap_t> &gaps = rb.blocks[rb.idx_write].gaps;
+
+    // n_samples is the offset of the samples received next
+    if(gaps.size() < N_MAX_GAPS_PER_BUFFER && rb.n_missing_pending == 0){
+        gap_t gap = {rb.n_samples, n_missing_samples, GAP_SOURCE_UHD, device};
+        gaps.push_back(gap);
+        DBG_RB(rb.n_gaps++;)
+    }
+    // No room for another gap, only if several gaps are reported between two commits, a block is handed over once its gaps are full.
+    // get_ringbuffer_rx_pointers() turns the block into one gap once the samples after it are committed.
+    else{
+        rb.n_missing_pending += n_missing_samples;
+        rb.n_gaps_merged++;
+    }
+}
+
+// All samples of the current write block are overwritten. They and all gaps in them become one gap at the beginning of the block.
+static void drop_write_buffer(const size_t device, std::vector<gap_t> &gaps, const unsigned long long n_samples_full){
+    unsigned long long n_missing_samples = n_samples_full;
+    for(size_t i = 0; i < gaps.size(); i++)
+        n_missing_samples += gaps[i].length;
+
+    gaps.clear();
+    gap_t gap = {0, n_missing_samples, GAP_SOURCE_RINGBUFFER, device};
+    gaps.push_back(gap);
+}
+
+// Must be called with the mutex held. The block returns to the free blocks once the last sink has released it.
+static void release_block(ringbuffer_t &rb, const size_t idx_block){
+    block_t &block = rb.blocks[idx_block];
+    if(--block.n_refs == 0){
+        rb.free_blocks.push_back(idx_block);
+        rb.n_blocks_filled--;
+    }
+}
+
+// Must be called with the mutex held. Queues the block for the sink or skips it according to the policy of the sink.
+static void dispatch_block(ringbuffer_t &rb, sink_state_t &sink, const size_t idx_block){
+    block_t &block = rb.blocks[idx_block];
+
+    if(sink.sink.policy != SINK_POLICY_BLOCK && sink.n_held >= sink.sink.depth){
+        // the oldest queued block is skipped, the samples it missed are passed on to the block after it
+        if(sink.sink.policy == SINK_POLICY_DROP_OLDEST && sink.queue_size > 0){
+            const sink_entry_t oldest = sink.queue[sink.queue_head];
+            sink.queue_head = (sink.queue_head + 1) % sink.queue.size();
+            sink.queue_size--;
+            sink.n_held--;
+            sink.n_blocks_skipped++;
+
+            const unsigned long long n_skipped = oldest.n_skipped_before + rb.blocks[oldest.idx_block].n_span;
+            if(sink.queue_size > 0)
+                sink.queue[sink.queue_head].n_skipped_before += n_skipped;
+            else
+                sink.n_skipped_next += n_skipped;
+            release_block(rb, oldest.idx_block);
         }
+        // the new block is skipped
         else{
-            for (size_t ch = 0; ch < n_channels; ch++)
-                buffs_out.push_back(&(buffs1[ch][offset]));           
+            sink.n_skipped_next += block.n_span;
+            sink.n_blocks_skipped++;
+            return;
         }
     }
-    // buffer full, so switch buffer
-    else{
-        DBG_RB(n_buffer_full++;)
-        n_samples_old = n_samples;
-        n_samples = 0;
+
+    sink_entry_t entry = {idx_block, sink.n_skipped_next};
+    sink.queue[(sink.queue_head + sink.queue_size) % sink.queue.size()] = entry;
+    sink.queue_size++;
+    sink.n_skipped_next = 0;
+    sink.n_held++;
+    sink.n_held_max = std::max(sink.n_held_max, sink.n_held);
+    block.n_refs++;
+}
+    
+std::vector<char*> get_ringbuffer_rx_pointers(const size_t device, const unsigned long long n_new_samples){
+    ringbuffer_t &rb = ringbuffers[device];
+    
+    std::vector<char*> buffs_out;
+
+    // The gaps of the write block overflowed. Its samples so far, its gaps and the missing samples become one gap in front of the new samples,
+    // which move to the beginning of the block. Sample indices stay exact, only the samples of this block are lost.
+    if(rb.n_missing_pending > 0){
+        block_t &block = rb.blocks[rb.idx_write];
+        DBG_RB(rb.n_samples_dropped += rb.n_samples;)
+        drop_write_buffer(device, block.gaps, rb.n_samples + rb.n_missing_pending);
+        for(size_t ch = 0; ch < rb.n_channels; ch++)
+            std::memmove(&block.buffs[ch][0], &block.buffs[ch][rb.n_samples*rb.n_bytes_per_item], n_new_samples*rb.n_bytes_per_item);
+        rb.n_samples = 0;
+        rb.n_missing_pending = 0;
+    }
+
+    // the new samples were written to the pointers of the last call
+    DBG_RB(rb.n_samples_total += n_new_samples;)
+    rb.n_samples += n_new_samples;
+
+    // current write block full, hand it over and continue with the next one, a block whose gaps are full is handed over early
+    if(rb.n_samples >= rb.n_samples_per_block || rb.blocks[rb.idx_write].gaps.size() >= N_MAX_GAPS_PER_BUFFER){
+        DBG_RB(rb.n_buffer_full++;)
+        const unsigned long long n_samples_full = rb.n_samples;
+        rb.n_samples = 0;
+
+        block_t &block = rb.blocks[rb.idx_write];
+        unsigned long long n_span = n_samples_full;
+        for(size_t i = 0; i < block.gaps.size(); i++)
+            n_span += block.gaps[i].length;
+
+        bool handed_over = false;
         {
-            boost::mutex::scoped_lock lock(m_mutex, boost::try_to_lock);
-            
-            // if we were able to lock the mutex, the processing thread must be in waiting state, so we prepare processing and then notify worker thread
-            if(lock){
-                if(buffer2write == BUFFER0){
-                    buffer2write = BUFFER1;
-                    buffer2process = BUFFER0;
-                    for (size_t ch = 0; ch < n_channels; ch++)
-                        buffs_out.push_back(&(buffs1[ch][0]));
-                }
-                else{
-                    buffer2write = BUFFER0;
-                    buffer2process = BUFFER1;
-                    for (size_t ch = 0; ch < n_channels; ch++)
-                        buffs_out.push_back(&(buffs0[ch][0]));
-                }
-            }
-            // if we were unable to lock the mutex, the processing thread is not done yet and we write data into the same buffer again, therefore losing samples
-            else{
-                DBG_RB(n_worker_not_done++;)
-                buffer2process = NO_BUFFER;
-                if(buffer2write == BUFFER0){
-                    for (size_t ch = 0; ch < n_channels; ch++)
-                        buffs_out.push_back(&(buffs0[ch][0]));
-                }
-                else{
-                    for (size_t ch = 0; ch < n_channels; ch++)
-                        buffs_out.push_back(&(buffs1[ch][0]));
-                }            
+            boost::mutex::scoped_lock lock(rb.m_mutex);
+
+            // the rx thread needs a free block to continue with
+            if(rb.free_blocks.size() > 0){
+                block.n_samples = n_samples_full;
+                block.n_span = n_span;
+                block.n_refs = 0;
+                for(size_t s = 0; s < rb.sinks.size(); s++)
+                    dispatch_block(rb, rb.sinks[s], rb.idx_write);
+
+                // skipped by all sinks
+                if(block.n_refs == 0)
+                    rb.free_blocks.push_back(rb.idx_write);
+                else
+                    rb.n_blocks_filled++;
+                rb.n_blocks_filled_max = std::max(rb.n_blocks_filled_max, rb.n_blocks_filled);
+
+                rb.idx_write = rb.free_blocks.back();
+                rb.free_blocks.pop_back();
+                handed_over = true;
             }
         }
-        m_condition.notify_all();
+
+        if(handed_over){
+            for(size_t s = 0; s < rb.sinks.size(); s++)
+                rb.sinks[s].m_condition.notify_all();
+            rb.blocks[rb.idx_write].gaps.clear();
+        }
+        // all other blocks are still held by sinks that never skip blocks, we write data into the same block again, therefore losing samples
+        else{
+            DBG_RB(rb.n_worker_not_done++;)
+            DBG_RB(rb.n_samples_dropped += n_samples_full;)
+            drop_write_buffer(device, block.gaps, n_samples_full);
+        }
     }
-    
-    DBG_RB(n_samples_total += n_new_samples;)
-    n_samples += n_new_samples;    
+
+    unsigned long long offset = rb.n_samples*rb.n_bytes_per_item;
+    block_t &block = rb.blocks[rb.idx_write];
+    for (size_t ch = 0; ch < rb.n_channels; ch++)
+        buffs_out.push_back(&(block.buffs[ch][offset]));
     
     return buffs_out;
 }
     
-void process_ringbuffer_rx(std::atomic<bool>& burst_timer_elapsed){
+unsigned long long get_n_gaps_merged_ringbuffer_rx(){
+    unsigned long long n_gaps_merged = 0;
+    for(size_t device = 0; device < ringbuffers.size(); device++)
+        n_gaps_merged += ringbuffers[device].n_gaps_merged;
+    return n_gaps_merged;
+}
+
+void wait_free_block_ringbuffer_rx(const size_t device, const unsigned long long n_new_samples){
+    ringbuffer_t &rb = ringbuffers[device];
+
+    // the write block is handed over only once it or its gaps are full
+    if(rb.n_samples + n_new_samples < rb.n_samples_per_block && rb.blocks[rb.idx_write].gaps.size() + 1 < N_MAX_GAPS_PER_BUFFER)
+        return;
+
+    boost::mutex::scoped_lock lock(rb.m_mutex);
+    while(rb.free_blocks.size() == 0)
+        rb.m_condition_idle.wait(lock);
+}
+
+void process_ringbuffer_rx(const size_t device, const size_t sink_idx, std::atomic<bool>& burst_timer_elapsed){
+    ringbuffer_t &rb = ringbuffers[device];
+    sink_state_t &sink = rb.sinks[sink_idx];
     
     while(1){
-            boost::mutex::scoped_lock lock(m_mutex);
+            sink_entry_t entry;
+            {
+                boost::mutex::scoped_lock lock(rb.m_mutex);
+
+                while(sink.queue_size == 0){
+                    DBG_RB(sink.n_worker_wait++;)
+                                        
+                    // from time to time we check if "burst_timer_elapsed" was set to true
+                    sink.m_condition.wait_for(lock, boost::chrono::milliseconds(5000));
+                    
+                    // is set in main thread to stop execution
+                    if(burst_timer_elapsed == true)
+                        return;
+                }
+
+                // the block stays held by this sink until it is released
+                entry = sink.queue[sink.queue_head];
+                sink.queue_head = (sink.queue_head + 1) % sink.queue.size();
+                sink.queue_size--;
+            }
 
-            while(buffer2process == NO_BUFFER){
-                DBG_RB(n_worker_wait++;)
-                                    
-                // from time to time we check if "burst_timer_elapsed" was set to true
-                m_condition.wait_for(lock, boost::chrono::milliseconds(5000));
-                
-                // is set in main thread to stop execution
-                if(burst_timer_elapsed == true)
-                    return;
-            }    
+            DBG_RB(sink.n_worker_executed++;)
 
-            DBG_RB(n_worker_executed++;)
+            // the block is shared read only with the other sinks, the rx thread continues with the free blocks
+            auto t_start = std::chrono::steady_clock::now();
+            const block_t &block = rb.blocks[entry.idx_block];
+            if(entry.n_skipped_before > 0){
+                sink.gaps.clear();
+                gap_t gap = {0, entry.n_skipped_before, GAP_SOURCE_SINK, device};
+                sink.gaps.push_back(gap);
+                sink.gaps.insert(sink.gaps.end(), block.gaps.begin(), block.gaps.end());
+                sink.sink.feed(device, block.buffs, block.n_samples, sink.gaps);
+            }
+            else
+                sink.sink.feed(device, block.buffs, block.n_samples, block.gaps);
+            std::chrono::duration<double> process_time = std::chrono::steady_clock::now() - t_start;
 
-            if(buffer2process == BUFFER0)
-                feed_new_ch_measurement(buffs0, n_samples_old);
-            else if(buffer2process == BUFFER1)
-                feed_new_ch_measurement(buffs1, n_samples_old);
+            sink.n_blocks_processed++;
+            sink.process_time_sum_sec += process_time.count();
+            sink.process_time_max_sec = std::max(sink.process_time_max_sec, process_time.count());
 
-            // we are done, make sure we enter wait loop
-            buffer2process = NO_BUFFER;
+            // we are done, release the block
+            {
+                boost::mutex::scoped_lock lock(rb.m_mutex);
+                sink.n_held--;
+                release_block(rb, entry.idx_block);
+            }
+            rb.m_condition_idle.notify_all();
     }
 }
     
 void show_debug_information_ringbuffer_rx(){
-    std::cout << "--------------------------" << std::endl;
-    std::cout << "ringbuffer_rx" << std::endl;
-    std::cout << "n_buffer_full: " << n_buffer_full << std::endl;
-    std::cout << "n_worker_not_done: " << n_worker_not_done << std::endl;
-    std::cout << "n_samples_total: " << n_samples_total << std::endl;
-    std::cout << "n_worker_wait: " << n_worker_wait << std::endl;
-    std::cout << "n_worker_executed: " << n_worker_executed << std::endl;
-    std::cout << "--------------------------" << std::endl; 
+    for(size_t device = 0; device < ringbuffers.size(); device++){
+        const ringbuffer_t &rb = ringbuffers[device];
+        std::cout << "--------------------------" << std::endl;
+        std::cout << "ringbuffer_rx " << device << std::endl;
+        std::cout << "n_blocks: " << rb.blocks.size() << std::endl;
+        std::cout << "n_samples_per_block: " << rb.n_samples_per_block << std::endl;
+        std::cout << "n_blocks_filled_max: " << rb.n_blocks_filled_max << std::endl;
+        std::cout << "n_buffer_full: " << rb.n_buffer_full << std::endl;
+        std::cout << "n_worker_not_done: " << rb.n_worker_not_done << std::endl;
+        std::cout << "n_samples_total: " << rb.n_samples_total << std::endl;
+        std::cout << "n_gaps: " << rb.n_gaps << std::endl;
+        std::cout << "n_gaps_merged: " << rb.n_gaps_merged << std::endl;
+        std::cout << "n_samples_dropped: " << rb.n_samples_dropped << std::endl;
+        for(size_t s = 0; s < rb.sinks.size(); s++){
+            const sink_state_t &sink = rb.sinks[s];
+            std::cout << "sink " << sink.sink.name << std::endl;
+            std::cout << "  n_blocks_processed: " << sink.n_blocks_processed << std::endl;
+            std::cout << "  n_blocks_skipped: " << sink.n_blocks_skipped << std::endl;
+            std::cout << "  n_held_max: " << sink.n_held_max << std::endl;
+            if(sink.n_blocks_processed > 0)
+                std::cout << "  process_time_mean_ms: " << sink.process_time_sum_sec/sink.n_blocks_processed*1.0e3 << std::endl;
+            std::cout << "  process_time_max_ms: " << sink.process_time_max_sec*1.0e3 << std::endl;
+            std::cout << "  n_worker_wait: " << sink.n_worker_wait << std::endl;
+            std::cout << "  n_worker_executed: " << sink.n_worker_executed << std::endl;
+        }
+        std::cout << "--------------------------" << std::endl; 
+    }
 }
 }
@@ -19,26 +19,114 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CHANNELSOUNDER_RINGBUFFER_RX_H
 
 #include <vector>
+#include <string>
 #include <atomic>
 
+#include "gap.h"
+
 namespace channelsounder
 {
 /*!
- * Inits unit internally. Must be called first.
+ * Chooses the size of the ringbuffer blocks. Sizes that are not 0 are kept, sizes that are 0 are derived from the sample rate:
+ * a block holds latency_sec of samples, and there are enough blocks to bridge a stall of the processing thread of slack_sec.
+ * Measures how long copying one block takes, which is what the processing thread mainly does, takes it into account for the
+ * number of blocks and warns if the processing thread might not keep up. The chosen sizes are printed. The copy time is only an
+ * estimate, retune_ringbuffer_rx() corrects the number of blocks once the sinks have processed blocks.
+ *
+ * rate                         sample rate per channel in samples per second
+ * n_channels                   number of channels of the device
+ * n_bytes_per_item             size of complex sample
+ * max_items_per_packet         maximum number of samples passed on by uhd driver, lower limit for the block size
+ * latency_sec                  target duration of one block
+ * slack_sec                    target duration the processing thread may stall without samples being dropped
+ * n_samples_per_block          block size in samples per channel, 0 for auto tuning, contains the chosen size on return
+ * n_blocks                     number of blocks, 0 for auto tuning, contains the chosen number on return
+*/
+void tune_ringbuffer_rx(const double rate, const size_t n_channels, const size_t n_bytes_per_item, const size_t max_items_per_packet,
+                        const double latency_sec, const double slack_sec, size_t& n_samples_per_block, size_t& n_blocks);
+
+/*!
+ * Consumer of the blocks of a ringbuffer, e.g. feed_ddc(), feed_psd() or feed_preview(). Called by the thread of the sink for every block it accepts.
+ *
+ * device                       index of the device
+ * buffs                        samples of each channel, read only, shared with the other sinks
+ * n_new_samples                number of samples per channel
+ * gaps                         gaps within the samples, ordered by offset
+*/
+typedef void (*sink_feed_fn_t)(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
+
+/*!
+ * What a sink does when a block is handed over while it already holds as many blocks as it may.
+*/
+enum sink_policy_t{
+    SINK_POLICY_BLOCK = 0,          // never skips a block, if it falls behind the rx thread runs out of blocks and drops samples
+    SINK_POLICY_DROP_NEWEST = 1,    // skips the new block
+    SINK_POLICY_DROP_OLDEST = 2     // skips the oldest block it has not started yet, skips the new block if there is none
+};
+
+/*!
+ * A sink of a ringbuffer. Blocks skipped by a sink become a gap of source GAP_SOURCE_SINK at the start of the next block it accepts.
+ *
+ * name                         shown in the stats
+ * feed                         called for every block
+ * policy                       see sink_policy_t
+ * depth                        blocks the sink may hold, queued or in work, ignored for SINK_POLICY_BLOCK
+*/
+struct ringbuffer_sink_t{
+    std::string name;
+    sink_feed_fn_t feed;
+    sink_policy_t policy;
+    size_t depth;
+};
+
+/*!
+ * Inits unit internally. Must be called first, once for each device in ascending order.
+ * Each device has its own ringbuffer, filled by its own rx thread. Every full block is handed over to all sinks of the device, each sink
+ * processes its blocks in order in its own thread and a block is reused once the last sink has released it.
+ * The ringbuffer consists of n_blocks blocks for the sinks with SINK_POLICY_BLOCK, plus the depth of every other sink. Therefore a slow sink
+ * that may drop blocks never takes blocks away from the others and never causes the rx thread to drop samples.
  *
+ * device                       index of the device, usually one device per motherboard
  * num_channels_arg             in our case this is the number of rx antennas
  * num_bytes_per_item_arg       one item is one complex sample with real and imag, e.g. with data type "float" it is num_bytes_per_item_arg=8
  * max_items_per_packet_arg     depends on what uhd driver does, tries to fully utilize 10Gbit/s bandwidth of ethernet NIC, needed for size of internal static memory
+ * n_samples_per_block_arg      a block is handed over to the sinks once it contains this many samples per channel
+ * n_blocks_arg                 number of blocks, at least 2
+ * sinks                        sinks of the device, at least one
  * return                       1 on success and 0 on failure
 */
-int init_ringbuffer_rx(const size_t n_channels_arg, const size_t n_bytes_per_item_arg, const size_t max_items_per_packet_arg);
+int init_ringbuffer_rx(const size_t device, const size_t n_channels_arg, const size_t n_bytes_per_item_arg, const size_t max_items_per_packet_arg,
+                       const size_t n_samples_per_block_arg, const size_t n_blocks_arg, const std::vector<ringbuffer_sink_t>& sinks);
 
 /*!
  * Resets unit internally. This is the state is has after calling init_ringbuffer_rx(). Drops old samples in buffers.
+ * Blocks until all sinks have released the blocks that were handed over before the reset.
  *
  * return                       1 on success and 0 on failure
 */
-int reset_ringbuffer_rx();
+int reset_ringbuffer_rx(const size_t device);
+
+/*!
+ * Re-tunes the number of blocks with the process time per block the sinks measured, the downconverter, the spectra or the filters can take
+ * much longer than the copy timed by tune_ringbuffer_rx(). Once the sinks that never skip blocks have processed a few blocks, blocks are added
+ * until a stall of slack_sec is bridged, blocks are never removed. Must be called between measurements before reset_ringbuffer_rx(), blocks
+ * until all sinks have released their blocks. Allocates, get_ringbuffer_rx_pointers() must be called with n_new_samples=0 afterwards.
+ *
+ * rate                         sample rate per channel in samples per second
+ * slack_sec                    target duration the processing thread may stall without samples being dropped
+ * return                       number of blocks added
+*/
+size_t retune_ringbuffer_rx(const size_t device, const double rate, const double slack_sec);
+
+/*!
+ * Records a gap in the samples, e.g. after an overflow. Must be called before get_ringbuffer_rx_pointers() commits the samples received after the gap.
+ * Only called by the rx thread, never allocates. A block is handed over early once its gaps are full. If several gaps are reported between
+ * two commits and do not fit anymore, the samples of the block so far become part of one gap with the missing samples, sample indices stay
+ * exact. These merged gaps are counted by get_n_gaps_merged_ringbuffer_rx().
+ *
+ * n_missing_samples            number of samples per channel missing before the samples received next
+*/
+void report_gap_ringbuffer_rx(const size_t device, const unsigned long long n_missing_samples);
 
 /*!
  * Must be called initially with n_new_samples=0.
@@ -47,18 +135,32 @@ int reset_ringbuffer_rx();
  * n_new_samples                number of new samples written per channel to pointers from last call
  * return                       vector of pointers pointing to internal static vectors (faster than dedicated write function), this is where uhd writes to
 */
-std::vector<char*> get_ringbuffer_rx_pointers(const unsigned long long n_new_samples);
+std::vector<char*> get_ringbuffer_rx_pointers(const size_t device, const unsigned long long n_new_samples);
 
 /*!
- * Must be started in additional thread, processes unused half of ringbuffer.
- * Must process faster than it takes to fill one buffer, otherwise samples are dropped.
+ * Blocks until the rx thread can continue with a free block once the next packet fills the current write block. A source that is not bound to a
+ * sample rate, e.g. a replay of recorded files, calls it before each recv and never loses samples. Only called by the rx thread.
  *
+ * n_new_samples                number of samples per channel the rx thread commits next
+*/
+void wait_free_block_ringbuffer_rx(const size_t device, const unsigned long long n_new_samples);
+
+/*!
+ * Must be started in additional thread for each sink of each device, passes the blocks handed over by the rx thread to the sink in order.
+ * Sinks with SINK_POLICY_BLOCK must process faster than the blocks are filled on average, otherwise samples are dropped once all blocks are in use.
+ *
+ * sink                         index of the sink within the sinks of the device
  * burst_timer_elapsed          when set to true, the thread has to finish
 */
-void process_ringbuffer_rx(std::atomic<bool>& burst_timer_elapsed);
+void process_ringbuffer_rx(const size_t device, const size_t sink, std::atomic<bool>& burst_timer_elapsed);
+
+/*!
+ * Number of gaps of all devices that did not fit into the gaps of their block, see report_gap_ringbuffer_rx(). Read it once the rx threads are done.
+*/
+unsigned long long get_n_gaps_merged_ringbuffer_rx();
 
 /*!
- * Shows some stats of the ring buffer.
+ * Shows some stats of the ring buffers.
 */
 void show_debug_information_ringbuffer_rx();
 }
@@ -0,0 +1,51 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "rx_align.h"
+#include "ringbuffer_rx.h"
+
+namespace channelsounder
+{
+packet_alignment_t align_packet_rx(const size_t device, const std::vector<char*>& buffs, const size_t n_bytes_per_item,
+                                   const unsigned long long n_new_samples, const long long packet_ticks, long long& expected_ticks)
+{
+    packet_alignment_t alignment = {packet_ticks - expected_ticks, 0, 0, n_new_samples, packet_ticks};
+    if(n_new_samples == 0)
+        return alignment;
+
+    // the gap has to be reported before the new samples are committed to the ringbuffer
+    if(alignment.delta_ticks > 0){
+        alignment.n_missing = alignment.delta_ticks;
+        report_gap_ringbuffer_rx(device, alignment.n_missing);
+    }
+    // samples before stream_time or samples we already have, they are cut off to keep the devices aligned
+    else if(alignment.delta_ticks < 0){
+        alignment.n_early = std::min<unsigned long long>(-alignment.delta_ticks, n_new_samples);
+        alignment.n_kept = n_new_samples - alignment.n_early;
+        for(size_t ch = 0; ch < buffs.size(); ch++)
+            std::memmove(buffs[ch], buffs[ch] + alignment.n_early*n_bytes_per_item, alignment.n_kept*n_bytes_per_item);
+        alignment.first_ticks += alignment.n_early;
+    }
+
+    if(alignment.n_kept > 0)
+        expected_ticks = alignment.first_ticks + alignment.n_kept;
+    return alignment;
+}
+}
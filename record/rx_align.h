@@ -0,0 +1,55 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_RX_ALIGN_H
+#define CHANNELSOUNDER_RX_ALIGN_H
+
+#include <vector>
+#include <cstddef>
+
+namespace channelsounder
+{
+/*!
+ * What align_packet_rx() did with one received packet.
+*/
+struct packet_alignment_t{
+    long long delta_ticks;                  // timestamp of the packet minus the expected timestamp
+    unsigned long long n_missing;           // samples missing before the packet, reported as a gap
+    unsigned long long n_early;             // samples at the start of the packet before the expected timestamp, discarded
+    unsigned long long n_kept;              // samples per channel left to commit
+    long long first_ticks;                  // timestamp of the first sample left to commit
+};
+
+/*!
+ * Sample accurate alignment of a packet to the timestamps, called by the rx thread between recv and get_ringbuffer_rx_pointers().
+ * The timestamp of each packet must continue where the last packet ended. Missing samples are reported to the ringbuffer as a gap.
+ * Samples before the expected timestamp, e.g. before stream_time or samples already received, are cut off the front of the packet.
+ * All devices start with the same expected timestamp and stay aligned. Timestamps are in ticks of the sample rate, no uhd types.
+ *
+ * device                       ringbuffer the gap is reported to
+ * buffs                        pointers the packet was received to, the samples left are moved to their start
+ * n_bytes_per_item             bytes per sample
+ * n_new_samples                samples per channel of the packet
+ * packet_ticks                 timestamp of the first sample of the packet
+ * expected_ticks               timestamp of the next sample expected, initially stream_time, advanced past the samples left
+ * return                       gap and trim of the packet
+*/
+packet_alignment_t align_packet_rx(const size_t device, const std::vector<char*>& buffs, const size_t n_bytes_per_item,
+                                   const unsigned long long n_new_samples, const long long packet_ticks, long long& expected_ticks);
+}
+
+#endif
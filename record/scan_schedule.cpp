@@ -0,0 +1,154 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "scan_schedule.h"
+
+namespace channelsounder
+{
+static std::vector<scan_dwell_t> dwells;
+static unsigned int n_repeat = 1;
+
+// statistics, one entry per dwell
+struct dwell_stats_t{
+    unsigned long long n_executed;
+    unsigned long long n_retune_gaps;           // number of valid retune gaps
+    double retune_gap_sum_sec;
+    double retune_gap_min_sec;
+    double retune_gap_max_sec;
+    unsigned long long n_dropped_samples;
+    unsigned long long n_overruns;
+};
+static std::vector<dwell_stats_t> stats;
+
+int init_scan_schedule(const std::string& path){
+
+    std::ifstream fin(path);
+    if(!fin.is_open()){
+        std::cerr << "Scan schedule: unable to open " << path << std::endl;
+        return 0;
+    }
+
+    std::vector<scan_dwell_t> dwells_new;
+    unsigned int n_repeat_new = 1;
+
+    std::string line;
+    unsigned int line_cnt = 0;
+    while(std::getline(fin, line)){
+        line_cnt++;
+
+        // skip comments and empty lines
+        size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#')
+            continue;
+
+        std::istringstream iss(line);
+
+        if(line.compare(first, 6, "repeat") == 0){
+            std::string keyword;
+            if(!(iss >> keyword >> n_repeat_new) || n_repeat_new == 0){
+                std::cerr << "Scan schedule: invalid repeat count in line " << line_cnt << std::endl;
+                return 0;
+            }
+            continue;
+        }
+
+        double center_freq_MHz;
+        scan_dwell_t dwell;
+        if(!(iss >> center_freq_MHz >> dwell.gain >> dwell.n_samples) || dwell.n_samples == 0){
+            std::cerr << "Scan schedule: invalid dwell in line " << line_cnt << ": " << line << std::endl;
+            return 0;
+        }
+        dwell.center_freq = center_freq_MHz*1e6;
+        dwells_new.push_back(dwell);
+    }
+
+    if(dwells_new.size() == 0){
+        std::cerr << "Scan schedule: no dwells found in " << path << std::endl;
+        return 0;
+    }
+
+    dwells = dwells_new;
+    n_repeat = n_repeat_new;
+
+    // reset statistics if the number of dwells changed
+    if(stats.size() != dwells.size()){
+        dwell_stats_t stats_template = {0, 0, 0.0, 1.0e9, 0.0, 0, 0};
+        stats.assign(dwells.size(), stats_template);
+    }
+
+    std::cout << "Scan schedule: loaded " << dwells.size() << " dwells with " << n_repeat << " repetitions from " << path << std::endl;
+
+    return 1;
+}
+
+const std::vector<scan_dwell_t>& get_scan_schedule(){
+    return dwells;
+}
+
+unsigned int get_scan_schedule_repeat(){
+    return n_repeat;
+}
+
+void report_scan_dwell(const size_t dwell_idx, const unsigned int repeat_idx, const double retune_gap_sec, const unsigned long long n_dropped_samples, const unsigned long long n_overruns){
+
+    if(dwell_idx >= stats.size())
+        return;
+
+    dwell_stats_t &s = stats[dwell_idx];
+    s.n_executed++;
+    if(retune_gap_sec >= 0.0){
+        s.n_retune_gaps++;
+        s.retune_gap_sum_sec += retune_gap_sec;
+        s.retune_gap_min_sec = std::min(s.retune_gap_min_sec, retune_gap_sec);
+        s.retune_gap_max_sec = std::max(s.retune_gap_max_sec, retune_gap_sec);
+    }
+    s.n_dropped_samples += n_dropped_samples;
+    s.n_overruns += n_overruns;
+
+    std::cout << "Scan schedule: repeat " << repeat_idx << " dwell " << dwell_idx
+              << " at " << dwells[dwell_idx].center_freq/1e6 << " MHz"
+              << ", retune gap " << retune_gap_sec*1e3 << " ms"
+              << ", dropped samples " << n_dropped_samples
+              << ", overruns " << n_overruns << std::endl;
+}
+
+void show_debug_information_scan_schedule(){
+    std::cout << "--------------------------" << std::endl;
+    std::cout << "scan_schedule" << std::endl;
+    std::cout << "dwell  freq_MHz  executed  gap_min_ms  gap_mean_ms  gap_max_ms  dropped  overruns" << std::endl;
+    for(size_t i = 0; i < stats.size() && i < dwells.size(); i++){
+        const dwell_stats_t &s = stats[i];
+        double gap_mean_sec = (s.n_retune_gaps > 0) ? s.retune_gap_sum_sec/s.n_retune_gaps : 0.0;
+        double gap_min_sec = (s.n_retune_gaps > 0) ? s.retune_gap_min_sec : 0.0;
+        std::cout << std::setw(5) << i
+                  << std::setw(10) << dwells[i].center_freq/1e6
+                  << std::setw(10) << s.n_executed
+                  << std::setw(12) << gap_min_sec*1e3
+                  << std::setw(13) << gap_mean_sec*1e3
+                  << std::setw(12) << s.retune_gap_max_sec*1e3
+                  << std::setw(9) << s.n_dropped_samples
+                  << std::setw(10) << s.n_overruns << std::endl;
+    }
+    std::cout << "--------------------------" << std::endl;
+}
+}
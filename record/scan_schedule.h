@@ -0,0 +1,74 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_SCAN_SCHEDULE_H
+#define CHANNELSOUNDER_SCAN_SCHEDULE_H
+
+#include <vector>
+#include <string>
+
+namespace channelsounder
+{
+/*!
+ * One entry of a scan schedule, the recorder tunes to this frequency and records one capture.
+*/
+struct scan_dwell_t{
+    double center_freq;             // center frequency in Hz
+    double gain;                    // gain in dB, same value for each rx channel
+    unsigned long long n_samples;   // number of samples recorded per channel during this dwell
+};
+
+/*!
+ * Loads a scan schedule from a text file. Can be called again to reload an edited file.
+ * Empty lines and lines starting with '#' are ignored. All other lines are either
+ *
+ *      repeat <n>                              number of times the whole schedule is executed, default is 1
+ *      <center_freq_MHz> <gain_dB> <n_samples> one dwell
+ *
+ * path                         path of the schedule file
+ * return                       1 on success and 0 on failure
+*/
+int init_scan_schedule(const std::string& path);
+
+/*!
+ * Dwells in the order they are executed.
+*/
+const std::vector<scan_dwell_t>& get_scan_schedule();
+
+/*!
+ * Number of times the list of dwells is executed.
+*/
+unsigned int get_scan_schedule_repeat();
+
+/*!
+ * Called by the rx thread after each dwell to collect statistics.
+ *
+ * dwell_idx                    index of the dwell within the schedule
+ * repeat_idx                   index of the current repetition
+ * retune_gap_sec               time between the last sample of the previous dwell and the first sample of this dwell, negative if unknown
+ * n_dropped_samples            samples dropped by uhd during this dwell
+ * n_overruns                   overruns reported by uhd during this dwell
+*/
+void report_scan_dwell(const size_t dwell_idx, const unsigned int repeat_idx, const double retune_gap_sec, const unsigned long long n_dropped_samples, const unsigned long long n_overruns);
+
+/*!
+ * Shows per dwell stats of all executed schedules.
+*/
+void show_debug_information_scan_schedule();
+}
+
+#endif
@@ -0,0 +1,404 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <thread>
+#include <boost/thread/thread.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "thread_placement.h"
+
+// set_mempolicy() without depending on libnuma
+#define CS_MPOL_PREFERRED 1
+
+namespace channelsounder
+{
+static const char* role_names[THREAD_ROLE_COUNT] = {"main", "rx", "process", "save", "writer", "control", "filter", "psd", "sink"};
+
+struct role_placement_t{
+    bool configured;
+    std::vector<std::vector<int>> cpu_sets;     // used round-robin by the threads of the role
+    std::vector<int> nodes;                     // NUMA node of each set, -1 if the set was given as cpus
+    int policy;                                 // SCHED_FIFO, SCHED_OTHER or -1 to keep the policy
+    int priority;
+};
+static role_placement_t placements[THREAD_ROLE_COUNT];
+
+// effective placement of each thread, read back after applying it
+struct thread_info_t{
+    thread_role_t role;
+    size_t index;
+    long tid;
+    std::string cpus;
+    int policy;
+    int priority;
+    bool success;
+};
+static boost::mutex m_mutex;
+static std::vector<thread_info_t> threads;
+
+static bool read_line(const std::string& path, std::string& line){
+    std::ifstream fin(path);
+    if(!fin.is_open())
+        return false;
+    std::getline(fin, line);
+    return true;
+}
+
+// kernel cpu list format, e.g. "0-3,8,10-11"
+static bool parse_cpu_list(const std::string& list, std::vector<int>& cpus){
+    std::stringstream ss(list);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        if(item.find_first_not_of(" \t\r\n") == std::string::npos)
+            continue;
+        int first, last;
+        char dash;
+        std::istringstream iss(item);
+        if(!(iss >> first))
+            return false;
+        last = first;
+        if(iss >> dash && (dash != '-' || !(iss >> last)))
+            return false;
+        if(first < 0 || last < first)
+            return false;
+        for(int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return true;
+}
+
+static std::string format_cpu_list(const std::vector<int>& cpus){
+    std::ostringstream ss;
+    for(size_t i = 0; i < cpus.size(); i++){
+        size_t j = i;
+        while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+        ss << ((i > 0) ? "," : "") << cpus[i];
+        if(j > i)
+            ss << "-" << cpus[j];
+        i = j;
+    }
+    return ss.str();
+}
+
+static std::string format_policy(const int policy, const int priority){
+    std::ostringstream ss;
+    if(policy == SCHED_FIFO)
+        ss << "SCHED_FIFO " << priority;
+    else if(policy == SCHED_RR)
+        ss << "SCHED_RR " << priority;
+    else if(policy == SCHED_OTHER)
+        ss << "SCHED_OTHER";
+    else
+        ss << "unchanged";
+    return ss.str();
+}
+
+// one set of cpus, either a cpu list or nodeN
+static bool parse_cpu_set(const std::string& set, std::vector<int>& cpus, int& node){
+    node = -1;
+    if(set.compare(0, 4, "node") == 0){
+        std::istringstream iss(set.substr(4));
+        std::string cpulist;
+        if(!(iss >> node) || node < 0 || !read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpulist))
+            return false;
+        return parse_cpu_list(cpulist, cpus) && cpus.size() > 0;
+    }
+    return parse_cpu_list(set, cpus) && cpus.size() > 0;
+}
+
+static std::set<int> get_cpus_of_role(const thread_role_t role){
+    std::set<int> cpus;
+    for(size_t i = 0; i < placements[role].cpu_sets.size(); i++)
+        cpus.insert(placements[role].cpu_sets[i].begin(), placements[role].cpu_sets[i].end());
+    return cpus;
+}
+
+// rx and process threads are latency critical, they should neither share their cpu nor its hyperthread sibling
+static void validate_placement(const std::set<int>& cpus_isolated){
+    const thread_role_t roles_critical[2] = {THREAD_ROLE_RX, THREAD_ROLE_PROCESS};
+
+    if(cpus_isolated.size() == 0 && (placements[THREAD_ROLE_RX].configured || placements[THREAD_ROLE_PROCESS].configured))
+        std::cerr << "Thread placement: warning, no isolated cpus, other processes can run on the cpus of rx and process threads (see isolcpus)" << std::endl;
+
+    for(size_t k = 0; k < 2; k++){
+        const thread_role_t role = roles_critical[k];
+        if(!placements[role].configured)
+            continue;
+
+        const std::set<int> cpus = get_cpus_of_role(role);
+        for(int cpu : cpus){
+            if(cpus_isolated.size() > 0 && cpus_isolated.count(cpu) == 0)
+                std::cerr << "Thread placement: warning, cpu " << cpu << " of " << role_names[role] << " is not isolated" << std::endl;
+
+            for(size_t other = 0; other < THREAD_ROLE_COUNT; other++){
+                if(other == (size_t) role || (other < (size_t) role && (other == THREAD_ROLE_RX || other == THREAD_ROLE_PROCESS)))
+                    continue;
+                if(get_cpus_of_role((thread_role_t) other).count(cpu) > 0)
+                    std::cerr << "Thread placement: warning, " << role_names[role] << " and " << role_names[other] << " share cpu " << cpu << std::endl;
+            }
+
+            std::string siblings_list;
+            std::vector<int> siblings;
+            if(!read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list", siblings_list) || !parse_cpu_list(siblings_list, siblings))
+                continue;
+            for(int sibling : siblings){
+                if(sibling == cpu)
+                    continue;
+                bool used = false;
+                for(size_t other = 0; other < THREAD_ROLE_COUNT; other++){
+                    if(get_cpus_of_role((thread_role_t) other).count(sibling) > 0){
+                        std::cerr << "Thread placement: warning, cpu " << cpu << " of " << role_names[role] << " and cpu " << sibling << " of " << role_names[other] << " are hyperthreads of the same core" << std::endl;
+                        used = true;
+                    }
+                }
+                if(!used && cpus_isolated.count(sibling) == 0)
+                    std::cerr << "Thread placement: warning, hyperthread sibling " << sibling << " of cpu " << cpu << " of " << role_names[role] << " is not isolated, disable hyperthreading or isolate it" << std::endl;
+            }
+        }
+    }
+}
+
+int init_thread_placement(const std::string& placement){
+
+    for(size_t role = 0; role < THREAD_ROLE_COUNT; role++){
+        placements[role].configured = false;
+        placements[role].cpu_sets.clear();
+        placements[role].nodes.clear();
+        placements[role].policy = -1;
+        placements[role].priority = 0;
+    }
+
+    if(placement.size() == 0)
+        return 1;
+
+    // either a file or lines separated by ';'
+    std::vector<std::string> lines;
+    std::ifstream fin(placement);
+    std::string line;
+    if(fin.is_open()){
+        while(std::getline(fin, line))
+            lines.push_back(line);
+    }
+    else if(placement.find(' ') != std::string::npos){
+        std::stringstream ss(placement);
+        while(std::getline(ss, line, ';'))
+            lines.push_back(line);
+    }
+    else{
+        std::cerr << "Thread placement: unable to open " << placement << std::endl;
+        return 0;
+    }
+
+    // cpus the placement can use
+    std::string cpulist;
+    std::vector<int> cpus_online_list;
+    if(!read_line("/sys/devices/system/cpu/online", cpulist) || !parse_cpu_list(cpulist, cpus_online_list)){
+        for(unsigned int cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++)
+            cpus_online_list.push_back(cpu);
+    }
+    const std::set<int> cpus_online(cpus_online_list.begin(), cpus_online_list.end());
+
+    std::vector<int> cpus_isolated_list;
+    if(read_line("/sys/devices/system/cpu/isolated", cpulist))
+        parse_cpu_list(cpulist, cpus_isolated_list);
+    const std::set<int> cpus_isolated(cpus_isolated_list.begin(), cpus_isolated_list.end());
+
+    for(size_t line_cnt = 1; line_cnt <= lines.size(); line_cnt++){
+        line = lines[line_cnt - 1];
+
+        // skip comments and empty lines
+        size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#')
+            continue;
+
+        std::istringstream iss(line);
+        std::string role_name, sets, policy_name;
+        if(!(iss >> role_name >> sets)){
+            std::cerr << "Thread placement: invalid line " << line_cnt << ": " << line << std::endl;
+            return 0;
+        }
+
+        size_t role = 0;
+        while(role < THREAD_ROLE_COUNT && role_name != role_names[role])
+            role++;
+        if(role == THREAD_ROLE_COUNT){
+            std::cerr << "Thread placement: unknown role " << role_name << " in line " << line_cnt << std::endl;
+            return 0;
+        }
+        role_placement_t &p = placements[role];
+        p.configured = true;
+        p.cpu_sets.clear();
+        p.nodes.clear();
+
+        std::stringstream ss(sets);
+        std::string set;
+        while(std::getline(ss, set, '/')){
+            std::vector<int> cpus;
+            int node;
+            if(!parse_cpu_set(set, cpus, node)){
+                std::cerr << "Thread placement: invalid cpus " << set << " in line " << line_cnt << std::endl;
+                return 0;
+            }
+            for(int cpu : cpus){
+                if(cpus_online.count(cpu) == 0){
+                    std::cerr << "Thread placement: cpu " << cpu << " of " << role_name << " is not online" << std::endl;
+                    return 0;
+                }
+            }
+            p.cpu_sets.push_back(cpus);
+            p.nodes.push_back(node);
+        }
+
+        p.policy = -1;
+        p.priority = 0;
+        if(iss >> policy_name){
+            if(policy_name == "fifo"){
+                p.policy = SCHED_FIFO;
+                if(!(iss >> p.priority) || p.priority < sched_get_priority_min(SCHED_FIFO) || p.priority > sched_get_priority_max(SCHED_FIFO)){
+                    std::cerr << "Thread placement: invalid priority for " << role_name << " in line " << line_cnt << std::endl;
+                    return 0;
+                }
+            }
+            else if(policy_name == "other"){
+                p.policy = SCHED_OTHER;
+            }
+            else{
+                std::cerr << "Thread placement: unknown policy " << policy_name << " in line " << line_cnt << std::endl;
+                return 0;
+            }
+        }
+
+        std::cout << "Thread placement: " << role_name << " on cpus ";
+        for(size_t i = 0; i < p.cpu_sets.size(); i++)
+            std::cout << ((i > 0) ? "/" : "") << format_cpu_list(p.cpu_sets[i]);
+        std::cout << ", " << format_policy(p.policy, p.priority) << std::endl;
+    }
+
+    validate_placement(cpus_isolated);
+
+    return 1;
+}
+
+int apply_thread_placement(const thread_role_t role, const size_t index){
+    const role_placement_t &p = placements[role];
+    bool success = true;
+
+    if(p.configured){
+        const size_t set_idx = index % p.cpu_sets.size();
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for(int cpu : p.cpu_sets[set_idx])
+            CPU_SET(cpu, &cpu_set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0){
+            std::cerr << "Thread placement: unable to set affinity of " << role_names[role] << " " << index << std::endl;
+            success = false;
+        }
+
+        // memory allocated by this thread from now on prefers the node of its cpus
+        const int node = p.nodes[set_idx];
+        if(node >= 0 && node < (int) (8*sizeof(unsigned long))){
+            unsigned long node_mask = 1UL << node;
+            if(syscall(SYS_set_mempolicy, CS_MPOL_PREFERRED, &node_mask, 8*sizeof(node_mask)) != 0){
+                std::cerr << "Thread placement: unable to prefer memory of node " << node << " for " << role_names[role] << " " << index << std::endl;
+                success = false;
+            }
+        }
+
+        if(p.policy >= 0){
+            sched_param param;
+            param.sched_priority = (p.policy == SCHED_OTHER) ? 0 : p.priority;
+            if(pthread_setschedparam(pthread_self(), p.policy, &param) != 0){
+                std::cerr << "Thread placement: unable to set " << format_policy(p.policy, p.priority) << " for " << role_names[role] << " " << index << ", missing permission (rtprio)?" << std::endl;
+                success = false;
+            }
+        }
+    }
+
+    // log what is effective, not what was requested
+    thread_info_t info;
+    info.role = role;
+    info.index = index;
+    info.tid = syscall(SYS_gettid);
+    info.success = success;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    std::vector<int> cpus;
+    if(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0){
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+            if(CPU_ISSET(cpu, &cpu_set))
+                cpus.push_back(cpu);
+        }
+    }
+    info.cpus = format_cpu_list(cpus);
+
+    sched_param param;
+    if(pthread_getschedparam(pthread_self(), &info.policy, &param) == 0){
+        info.priority = param.sched_priority;
+    }
+    else{
+        info.policy = -1;
+        info.priority = 0;
+    }
+
+    // threads that are started for each capture, e.g. rx threads of further devices, replace their predecessor and are only logged if their placement changed
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        size_t i = 0;
+        while(i < threads.size() && (threads[i].role != role || threads[i].index != index))
+            i++;
+        const bool changed = (i == threads.size() || threads[i].cpus != info.cpus || threads[i].policy != info.policy || threads[i].priority != info.priority || threads[i].success != info.success);
+        if(i == threads.size())
+            threads.push_back(info);
+        else
+            threads[i] = info;
+        if(changed)
+            std::cout << "Thread placement: " << role_names[role] << " " << index << " (tid " << info.tid << ") on cpus " << info.cpus << ", " << format_policy(info.policy, info.priority) << std::endl;
+    }
+
+    return success ? 1 : 0;
+}
+
+void show_debug_information_thread_placement(){
+    boost::mutex::scoped_lock lock(m_mutex);
+    std::cout << "--------------------------" << std::endl;
+    std::cout << "thread_placement" << std::endl;
+    std::cout << "role     index  tid       cpus              policy" << std::endl;
+    for(size_t i = 0; i < threads.size(); i++){
+        const thread_info_t &t = threads[i];
+        std::cout << std::left << std::setw(9) << role_names[t.role]
+                  << std::setw(7) << t.index
+                  << std::setw(10) << t.tid
+                  << std::setw(18) << t.cpus
+                  << format_policy(t.policy, t.priority)
+                  << (t.success ? "" : " (placement failed)") << std::right << std::endl;
+    }
+    std::cout << "--------------------------" << std::endl;
+}
+}
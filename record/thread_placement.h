@@ -0,0 +1,78 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_THREAD_PLACEMENT_H
+#define CHANNELSOUNDER_THREAD_PLACEMENT_H
+
+#include <string>
+
+namespace channelsounder
+{
+/*!
+ * Threads of the recorder. A role can have several threads, e.g. one rx thread per device.
+*/
+enum thread_role_t{
+    THREAD_ROLE_MAIN = 0,           // allocates all buffers at startup, its NUMA node is where the buffers are
+    THREAD_ROLE_RX = 1,             // receives samples, one per device
+    THREAD_ROLE_PROCESS = 2,        // passes the blocks of a ringbuffer to the first sink, usually the capture, one per device
+    THREAD_ROLE_SAVE = 3,           // hands complete measurements to the writer
+    THREAD_ROLE_WRITER = 4,         // writer I/O threads
+    THREAD_ROLE_CONTROL = 5,        // udp control plane
+    THREAD_ROLE_FILTER = 6,         // downconverter and filterbank workers, ddc_threads per device
+    THREAD_ROLE_PSD = 7,            // psd workers, shared by all devices
+    THREAD_ROLE_SINK = 8,           // passes the blocks of a ringbuffer to the other sinks, e.g. psd, preview and packet filter
+    THREAD_ROLE_COUNT = 9
+};
+
+/*!
+ * Loads the thread placement and validates it against the cpus of the host. Must be called before any thread is started.
+ * The placement is either a file or the same lines separated by ';'. Empty lines and lines starting with '#' are ignored, all other lines are
+ *
+ *      <role> <cpus> [<policy> [<priority>]]
+ *
+ * role                         main, rx, process, save, writer, control, filter, psd or sink
+ * cpus                         cpus and ranges separated by ',', e.g. 2,4-7, or nodeN for all cpus of NUMA node N, the thread then also prefers
+ *                              memory of node N. Sets separated by '/' are used round-robin by the threads of a role, e.g. "rx 2/10" pins
+ *                              the rx thread of device 0 to cpu 2 and of device 1 to cpu 10.
+ * policy                       fifo for SCHED_FIFO or other for SCHED_OTHER, if omitted the policy is not changed
+ * priority                     1 to 99 for fifo
+ *
+ * Warnings are printed if rx or process threads run on cpus that are not isolated (isolcpus), share a cpu with another role,
+ * or if the hyperthread sibling of their cpu is used by another thread.
+ *
+ * placement                    path of a file or lines separated by ';', empty for no placement
+ * return                       1 on success and 0 on failure
+*/
+int init_thread_placement(const std::string& placement);
+
+/*!
+ * Applies the placement of a role to the calling thread and logs the effective affinity and policy.
+ * Roles without placement are left unchanged.
+ *
+ * role                         role of the calling thread
+ * index                        index of the thread within its role, e.g. the device of an rx thread
+ * return                       1 on success and 0 if the placement could not be applied, e.g. SCHED_FIFO without permission
+*/
+int apply_thread_placement(const thread_role_t role, const size_t index);
+
+/*!
+ * Shows the effective placement of all threads that called apply_thread_placement().
+*/
+void show_debug_information_thread_placement();
+}
+
+#endif
@@ -0,0 +1,504 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRIGGER_X86_KERNELS
+#endif
+
+#include "trigger.h"
+#include "ddc.h"
+#include "fifo_measurement.h"
+
+#define N_MAX_GAPS_HISTORY              4096        // gaps remembered for the pre-trigger samples, the oldest are forgotten first
+
+namespace channelsounder
+{
+// sum of the power of n complex samples, full scale is 1
+typedef float (*trigger_power_fn_t)(const char* in, const size_t n);
+
+template<typename T>
+static float power_scalar(const char* in, const size_t n, const float scale){
+    const T* x = reinterpret_cast<const T*>(in);
+    float sum = 0.0f;
+    for(size_t i = 0; i < 2*n; i++){
+        const float v = (float) x[i];
+        sum += v*v;
+    }
+    return sum*scale*scale;
+}
+
+static float power_fc64(const char* in, const size_t n){
+    return power_scalar<double>(in, n, 1.0f);
+}
+
+static float power_fc32(const char* in, const size_t n){
+    return power_scalar<float>(in, n, 1.0f);
+}
+
+static float power_sc16(const char* in, const size_t n){
+    return power_scalar<int16_t>(in, n, 1.0f/32768.0f);
+}
+
+static float power_sc8(const char* in, const size_t n){
+    return power_scalar<int8_t>(in, n, 1.0f/128.0f);
+}
+
+#ifdef TRIGGER_X86_KERNELS
+__attribute__((target("avx2,fma")))
+static float power_fc32_avx2(const char* in, const size_t n){
+    const float* x = reinterpret_cast<const float*>(in);
+    const size_t n_floats = 2*n;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for(; i + 16 <= n_floats; i += 16){
+        const __m256 a = _mm256_loadu_ps(x + i);
+        const __m256 b = _mm256_loadu_ps(x + i + 8);
+        acc0 = _mm256_fmadd_ps(a, a, acc0);
+        acc1 = _mm256_fmadd_ps(b, b, acc1);
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    float sum = _mm_cvtss_f32(s);
+    for(; i < n_floats; i++)
+        sum += x[i]*x[i];
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static float power_fc32_avx512(const char* in, const size_t n){
+    const float* x = reinterpret_cast<const float*>(in);
+    const size_t n_floats = 2*n;
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for(; i + 16 <= n_floats; i += 16){
+        const __m512 a = _mm512_loadu_ps(x + i);
+        acc = _mm512_fmadd_ps(a, a, acc);
+    }
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, acc);
+    float sum = 0.0f;
+    for(size_t k = 0; k < 16; k++)
+        sum += lanes[k];
+    for(; i < n_floats; i++)
+        sum += x[i]*x[i];
+    return sum;
+}
+#endif
+
+// configuration
+static size_t n_channels;
+static size_t n_bytes_per_item;
+static size_t max_samples_per_block;
+static double rate;
+static float threshold_power;                           // sum of the power of one window
+static size_t window;
+static size_t min_duration;
+static size_t holdoff;
+static size_t n_pre;
+static size_t n_post;
+static unsigned long long n_samples_saved;
+static unsigned int max_triggers;
+static trigger_power_fn_t power_kernel = nullptr;
+static const char* kernel_name = "scalar";
+
+// stream, sample indices count the received samples since the reset, gaps are not included
+static double stream_time_uhd_sec;
+static double start_time_epoch_sec;
+static unsigned int file_id;
+static unsigned long long n_received;                   // samples received before the current block
+static unsigned long long n_missing;                    // samples missing before the current block
+
+// received sample r is stored at r % n_history, n_history covers the pre-trigger samples of a burst that fires in the current block
+static size_t n_history;
+static std::vector<std::vector<char>> history;
+static std::vector<gap_t> history_gaps;                 // offset is the index of the sample after the gap
+static std::vector<std::vector<char>> scratch;          // the start of a measurement is assembled here
+static std::vector<gap_t> scratch_gaps;
+
+// detector
+static std::vector<float> acc;                          // power of each channel in the current window
+static size_t n_acc;                                    // samples in the current window
+static bool in_burst;
+static bool burst_handled;                              // the burst fired or was suppressed
+static unsigned long long burst_start;
+static unsigned long long armed_from;                   // bursts starting before are suppressed
+static bool fired;                                      // in the current block
+static unsigned long long fired_at;
+
+// measurement
+static std::atomic<bool> capturing(false);
+static std::atomic<bool> done(false);
+static unsigned int n_triggers_stream;
+static std::atomic<unsigned int> file_id_last(0);
+static bool latency_pending = false;
+static unsigned long long n_finished_target;
+static double trigger_time_epoch_sec;
+
+// statistics
+static unsigned long long n_triggers = 0;
+static unsigned long long n_false_triggers = 0;
+static unsigned long long n_suppressed = 0;
+static unsigned long long n_samples_total = 0;
+static double time_detector_sec = 0.0;
+static double time_fifo_wait_max_sec = 0.0;
+static unsigned long long n_latency = 0;
+static double latency_sum_sec = 0.0;
+static double latency_max_sec = 0.0;
+
+int init_trigger(const size_t n_channels_arg, const size_t n_bytes_per_item_arg, const size_t max_samples_per_block_arg, const double rate_arg, const double threshold_dbfs,
+                 const size_t window_arg, const size_t min_duration_arg, const size_t holdoff_arg, const size_t n_pre_arg, const size_t n_post_arg, const unsigned long long n_samples_saved_arg,
+                 const unsigned int max_triggers_arg){
+
+    if(window_arg == 0 || n_post_arg == 0 || n_samples_saved_arg == 0 || rate_arg <= 0.0)
+        return 0;
+    switch(n_bytes_per_item_arg){
+        case 16: power_kernel = power_fc64; break;
+        case 8: power_kernel = power_fc32; break;
+        case 4: power_kernel = power_sc16; break;
+        case 2: power_kernel = power_sc8; break;
+        default: return 0;
+    }
+#ifdef TRIGGER_X86_KERNELS
+    if(n_bytes_per_item_arg == 8 && __builtin_cpu_supports("avx512f")){
+        power_kernel = power_fc32_avx512;
+        kernel_name = "avx512";
+    }
+    else if(n_bytes_per_item_arg == 8 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        power_kernel = power_fc32_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+
+    n_channels = n_channels_arg;
+    n_bytes_per_item = n_bytes_per_item_arg;
+    max_samples_per_block = max_samples_per_block_arg;
+    rate = rate_arg;
+    window = window_arg;
+    threshold_power = (float) (std::pow(10.0, threshold_dbfs/10.0)*window);
+    min_duration = std::max(min_duration_arg, window);
+    holdoff = holdoff_arg;
+    n_pre = n_pre_arg;
+    n_post = n_post_arg;
+    n_samples_saved = n_samples_saved_arg;
+    max_triggers = max_triggers_arg;
+
+    // a burst fires at most min_duration + window samples after its start
+    n_history = n_pre + min_duration + window;
+    history.assign(n_channels, std::vector<char>(n_history*n_bytes_per_item));
+    history_gaps.reserve(N_MAX_GAPS_HISTORY);
+    scratch.assign(n_channels, std::vector<char>(max_samples_per_block*n_bytes_per_item));
+    scratch_gaps.reserve(2*N_MAX_GAPS_HISTORY);
+    acc.assign(n_channels, 0.0f);
+
+    std::cout << "trigger: " << threshold_dbfs << " dBFS in windows of " << window << " samples for at least " << min_duration << " samples, "
+              << n_pre << " samples before and " << n_post << " after the start of a burst, holdoff " << holdoff << " samples, kernel " << kernel_name << std::endl;
+
+    return 1;
+}
+
+int reset_trigger(const unsigned int file_id_arg, const double stream_time_uhd_sec_arg, const double start_time_epoch_sec_arg){
+    file_id = file_id_arg;
+    file_id_last = file_id_arg;
+    stream_time_uhd_sec = stream_time_uhd_sec_arg;
+    start_time_epoch_sec = start_time_epoch_sec_arg;
+    n_received = 0;
+    n_missing = 0;
+    history_gaps.clear();
+
+    std::fill(acc.begin(), acc.end(), 0.0f);
+    n_acc = 0;
+    in_burst = false;
+    burst_handled = false;
+    armed_from = 0;
+
+    capturing = false;
+    done = false;
+    n_triggers_stream = 0;
+
+    // a cancelled measurement is never saved
+    latency_pending = false;
+
+    return 1;
+}
+
+// checks if the file of the last trigger has been saved
+static void poll_latency(){
+    if(!latency_pending)
+        return;
+    double time_epoch_sec;
+    if(get_finished_fifo_ch_measurement(time_epoch_sec) >= n_finished_target){
+        const double latency_sec = time_epoch_sec - trigger_time_epoch_sec;
+        latency_sum_sec += latency_sec;
+        latency_max_sec = std::max(latency_max_sec, latency_sec);
+        n_latency++;
+        latency_pending = false;
+    }
+}
+
+// called for every complete window ending at sample r_end
+static void evaluate_window(const unsigned long long r_end){
+    bool above = false;
+    for(size_t ch = 0; ch < n_channels; ch++)
+        above = above || (acc[ch] >= threshold_power);
+
+    if(above){
+        if(!in_burst){
+            in_burst = true;
+            burst_handled = false;
+            burst_start = r_end - window;
+        }
+        if(!burst_handled && r_end - burst_start >= min_duration){
+            burst_handled = true;
+            const bool armed = !capturing && !fired && burst_start >= armed_from && (max_triggers == 0 || n_triggers_stream < max_triggers);
+            if(armed){
+                fired = true;
+                fired_at = burst_start;
+                capturing = true;
+            }
+            else
+                n_suppressed++;
+        }
+    }
+    else{
+        // the burst ended before it lasted min_duration
+        if(in_burst && !burst_handled)
+            n_false_triggers++;
+        in_burst = false;
+    }
+}
+
+// evaluates n samples without gaps starting at sample offset of the block
+static void detect_samples(const std::vector<std::vector<char>> &buffs, unsigned long long offset, unsigned long long n){
+    while(n > 0){
+        const size_t n_take = (size_t) std::min<unsigned long long>(window - n_acc, n);
+        for(size_t ch = 0; ch < n_channels; ch++)
+            acc[ch] += power_kernel(&buffs[ch][offset*n_bytes_per_item], n_take);
+        n_acc += n_take;
+        offset += n_take;
+        n -= n_take;
+
+        if(n_acc == window){
+            evaluate_window(n_received + offset);
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            n_acc = 0;
+        }
+    }
+}
+
+// copies samples [r_first, r_first + n) from the history or the current block into the scratch buffers
+static void copy_samples(const std::vector<std::vector<char>> &buffs, const unsigned long long r_first, const size_t n){
+    size_t done_samples = 0;
+    while(done_samples < n){
+        const unsigned long long r = r_first + done_samples;
+        if(r < n_received){
+            // up to the end of the ring or of the history
+            const size_t idx = (size_t) (r % n_history);
+            const size_t n_copy = (size_t) std::min<unsigned long long>(n - done_samples, std::min<unsigned long long>(n_history - idx, n_received - r));
+            for(size_t ch = 0; ch < n_channels; ch++)
+                std::memcpy(&scratch[ch][done_samples*n_bytes_per_item], &history[ch][idx*n_bytes_per_item], n_copy*n_bytes_per_item);
+            done_samples += n_copy;
+        }
+        else{
+            const size_t n_copy = n - done_samples;
+            for(size_t ch = 0; ch < n_channels; ch++)
+                std::memcpy(&scratch[ch][done_samples*n_bytes_per_item], &buffs[ch][(r - n_received)*n_bytes_per_item], n_copy*n_bytes_per_item);
+            done_samples += n_copy;
+        }
+    }
+}
+
+// starts the measurement of the burst that fired in the current block, its samples up to the end of the block are passed on at once
+static void start_measurement(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    const unsigned long long r_oldest = n_received - std::min<unsigned long long>(n_received, n_history);
+    const unsigned long long r_start = std::max(r_oldest, (fired_at >= n_pre) ? fired_at - n_pre : 0);
+    const unsigned long long r_end = n_received + n_new_samples;
+
+    // samples missing before a sample are needed for its time
+    unsigned long long n_missing_after_start = 0, n_missing_after_fire = 0, n_missing_block = 0;
+    for(size_t i = 0; i < history_gaps.size(); i++){
+        n_missing_after_start += (history_gaps[i].offset > r_start) ? history_gaps[i].length : 0;
+        n_missing_after_fire += (history_gaps[i].offset > fired_at) ? history_gaps[i].length : 0;
+    }
+    for(size_t i = 0; i < gaps.size(); i++){
+        const unsigned long long offset = n_received + gaps[i].offset;
+        n_missing_after_start += (offset > r_start) ? gaps[i].length : 0;
+        n_missing_after_fire += (offset > fired_at) ? gaps[i].length : 0;
+        n_missing_block += gaps[i].length;
+    }
+    const unsigned long long n_missing_end = n_missing + n_missing_block;
+    const unsigned long long stream_start = r_start + n_missing_end - n_missing_after_start;
+    const unsigned long long stream_fired = fired_at + n_missing_end - n_missing_after_fire;
+
+    // the previous measurement must have been saved
+    auto t_wait = std::chrono::steady_clock::now();
+    reset_ddc(device);
+    reset_fifo_ch_measurement(n_samples_saved, file_id, "");
+    std::chrono::duration<double> wait_time = std::chrono::steady_clock::now() - t_wait;
+    time_fifo_wait_max_sec = std::max(time_fifo_wait_max_sec, wait_time.count());
+    poll_latency();
+
+    current_time(0);
+    report_start_time(stream_time_uhd_sec + stream_start/rate);
+    file_id_last = file_id;
+    file_id++;
+    n_triggers++;
+    n_triggers_stream++;
+    armed_from = fired_at + n_post + holdoff;
+
+    double time_epoch_sec;
+    latency_pending = true;
+    n_finished_target = get_finished_fifo_ch_measurement(time_epoch_sec) + 1;
+    trigger_time_epoch_sec = start_time_epoch_sec + stream_fired/rate;
+
+    // chunks of at most one block, a gap belongs to the chunk of the sample after it, gaps before the first sample are left out
+    for(unsigned long long r = r_start; r < r_end; r += max_samples_per_block){
+        const size_t n = (size_t) std::min<unsigned long long>(max_samples_per_block, r_end - r);
+        copy_samples(buffs, r, n);
+
+        scratch_gaps.clear();
+        for(size_t i = 0; i < history_gaps.size(); i++){
+            if(history_gaps[i].offset > r_start && history_gaps[i].offset >= r && history_gaps[i].offset < r + n){
+                gap_t gap = history_gaps[i];
+                gap.offset -= r;
+                scratch_gaps.push_back(gap);
+            }
+        }
+        for(size_t i = 0; i < gaps.size(); i++){
+            const unsigned long long offset = n_received + gaps[i].offset;
+            if(offset > r_start && offset >= r && (offset < r + n || (offset == r_end && r + n == r_end))){
+                gap_t gap = gaps[i];
+                gap.offset = offset - r;
+                scratch_gaps.push_back(gap);
+            }
+        }
+        feed_ddc(device, scratch, n, scratch_gaps);
+    }
+}
+
+// keeps the last n_history received samples and their gaps
+static void append_history(const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    const size_t n_keep = (size_t) std::min<unsigned long long>(n_new_samples, n_history);
+    for(size_t ch = 0; ch < n_channels; ch++){
+        size_t done_samples = 0;
+        while(done_samples < n_keep){
+            const unsigned long long r = n_received + n_new_samples - n_keep + done_samples;
+            const size_t idx = (size_t) (r % n_history);
+            const size_t n_copy = std::min(n_keep - done_samples, n_history - idx);
+            std::memcpy(&history[ch][idx*n_bytes_per_item], &buffs[ch][(n_new_samples - n_keep + done_samples)*n_bytes_per_item], n_copy*n_bytes_per_item);
+            done_samples += n_copy;
+        }
+    }
+
+    const unsigned long long r_oldest = n_received + n_new_samples - std::min<unsigned long long>(n_received + n_new_samples, n_history);
+    history_gaps.erase(std::remove_if(history_gaps.begin(), history_gaps.end(), [r_oldest](const gap_t &gap){return gap.offset < r_oldest;}), history_gaps.end());
+    for(size_t i = 0; i < gaps.size(); i++){
+        if(history_gaps.size() == N_MAX_GAPS_HISTORY)
+            history_gaps.erase(history_gaps.begin());
+        gap_t gap = gaps[i];
+        gap.offset += n_received;
+        history_gaps.push_back(gap);
+        n_missing += gaps[i].length;
+    }
+}
+
+void feed_trigger(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps){
+    poll_latency();
+
+    // samples of the current measurement
+    if(capturing){
+        feed_ddc(device, buffs, n_new_samples, gaps);
+        if(is_complete_fifo_ch_measurement())
+            capturing = false;
+    }
+
+    // windows and bursts do not continue across gaps
+    auto t_start = std::chrono::steady_clock::now();
+    fired = false;
+    unsigned long long n_consumed_samples = 0;
+    for(size_t i = 0; i < gaps.size(); i++){
+        const unsigned long long gap_offset = std::min(gaps[i].offset, n_new_samples);
+        if(gap_offset > n_consumed_samples){
+            detect_samples(buffs, n_consumed_samples, gap_offset - n_consumed_samples);
+            n_consumed_samples = gap_offset;
+        }
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        n_acc = 0;
+        in_burst = false;
+    }
+    if(n_new_samples > n_consumed_samples)
+        detect_samples(buffs, n_consumed_samples, n_new_samples - n_consumed_samples);
+    std::chrono::duration<double> detector_time = std::chrono::steady_clock::now() - t_start;
+    time_detector_sec += detector_time.count();
+    n_samples_total += n_new_samples;
+
+    if(fired){
+        start_measurement(device, buffs, n_new_samples, gaps);
+        if(is_complete_fifo_ch_measurement())
+            capturing = false;
+    }
+
+    append_history(buffs, n_new_samples, gaps);
+    n_received += n_new_samples;
+
+    done = !capturing && max_triggers > 0 && n_triggers_stream >= max_triggers;
+}
+
+bool is_done_trigger(){
+    return done;
+}
+
+bool is_capturing_trigger(){
+    return capturing;
+}
+
+unsigned int get_file_id_trigger(){
+    return file_id_last;
+}
+
+void show_debug_information_trigger(){
+    if(power_kernel == nullptr)
+        return;
+    std::cout << "--------------------------" << std::endl;
+    std::cout << "trigger" << std::endl;
+    std::cout << "kernel: " << kernel_name << std::endl;
+    std::cout << "n_triggers: " << n_triggers << std::endl;
+    std::cout << "n_false_triggers: " << n_false_triggers << std::endl;
+    std::cout << "n_suppressed: " << n_suppressed << std::endl;
+    if(n_samples_total > 0){
+        std::cout << "trigger_rate_per_s: " << n_triggers/(n_samples_total/rate) << std::endl;
+        std::cout << "false_trigger_rate_per_s: " << n_false_triggers/(n_samples_total/rate) << std::endl;
+        std::cout << "detector_ns_per_sample: " << time_detector_sec*1.0e9/n_samples_total << std::endl;
+    }
+    if(n_latency > 0){
+        std::cout << "trigger_to_file_latency_mean_ms: " << latency_sum_sec/n_latency*1.0e3 << std::endl;
+        std::cout << "trigger_to_file_latency_max_ms: " << latency_max_sec*1.0e3 << std::endl;
+    }
+    std::cout << "fifo_wait_max_ms: " << time_fifo_wait_max_sec*1.0e3 << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+}
@@ -0,0 +1,94 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef CHANNELSOUNDER_TRIGGER_H
+#define CHANNELSOUNDER_TRIGGER_H
+
+#include <vector>
+
+#include "gap.h"
+
+namespace channelsounder
+{
+/*!
+ * Inits unit internally. Must be called first.
+ * In trigger mode the trigger is the capture sink of the ringbuffer in place of the downconverter. It streams continuously and
+ * evaluates the power of every channel in windows of window samples. A burst starts with the first window whose mean power exceeds the
+ * threshold on any channel and fires the trigger once it lasted min_duration samples. Each trigger starts a measurement of n_pre samples
+ * before and n_post samples after the start of the burst, passed on to the downconverter and the fifo and saved as a file of its own.
+ * While a measurement is collected and for holdoff samples after it the trigger is disarmed. At most one trigger fires per ringbuffer block.
+ * Only one device is supported.
+ *
+ * n_channels                   number of channels of the device
+ * n_bytes_per_item             size of complex sample, 16, 8, 4 and 2 bytes (fc64, fc32, sc16, sc8) are supported
+ * max_samples_per_block        maximum number of samples per channel passed to feed_trigger() and feed_ddc() at once
+ * rate                         sample rate in samples per second
+ * threshold_dbfs               mean power of a window in dB relative to full scale
+ * window                       samples per window
+ * min_duration                 samples a burst must last, shorter bursts are counted as false triggers
+ * holdoff                      samples after the end of a measurement before the trigger is armed again
+ * n_pre                        samples before the start of the burst, limited to the samples received since the reset
+ * n_post                       samples from the start of the burst on
+ * n_samples_saved              samples per channel of each measurement after the downconverter, (n_pre + n_post)/decimation
+ * max_triggers                 triggers per reset, 0 for no limit
+ * return                       1 on success and 0 on failure
+*/
+int init_trigger(const size_t n_channels, const size_t n_bytes_per_item, const size_t max_samples_per_block, const double rate, const double threshold_dbfs,
+                 const size_t window, const size_t min_duration, const size_t holdoff, const size_t n_pre, const size_t n_post, const unsigned long long n_samples_saved,
+                 const unsigned int max_triggers);
+
+/*!
+ * Arms the trigger for a new stream. Must be called before each stream while the sinks are idle.
+ *
+ * file_id                      id of the file of the first trigger, counts up with every trigger
+ * stream_time_uhd_sec          uhd timestamp of the first sample of the stream
+ * start_time_epoch_sec         time of the first sample of the stream in seconds since the epoch
+ * return                       1 on success and 0 on failure
+*/
+int reset_trigger(const unsigned int file_id, const double stream_time_uhd_sec, const double start_time_epoch_sec);
+
+/*!
+ * Called by the sink thread of the device for every block, see ringbuffer_sink_t.
+ * Triggers start a new fifo measurement, so the previous one must have been saved. Until then the sink thread blocks.
+ *
+ * buffs                        samples of each channel of the device
+ * n_new_samples                number of samples per channel
+ * gaps                         gaps within the samples, ordered by offset
+*/
+void feed_trigger(const size_t device, const std::vector<std::vector<char>> &buffs, const unsigned long long n_new_samples, const std::vector<gap_t> &gaps);
+
+/*!
+ * Called by the rx thread to check if max_triggers measurements have been collected since the last reset.
+*/
+bool is_done_trigger();
+
+/*!
+ * Called by the rx thread after the stream stopped, true if a measurement was still being collected and has to be cancelled.
+*/
+bool is_capturing_trigger();
+
+/*!
+ * File id of the last trigger, or of the first trigger if none fired yet.
+*/
+unsigned int get_file_id_trigger();
+
+/*!
+ * Shows the trigger rate, the false triggers and the latency from the start of a burst until its file was saved.
+*/
+void show_debug_information_trigger();
+}
+
+#endif
@@ -0,0 +1,903 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <boost/thread/thread.hpp>
+
+#include "crc32c.h"
+#include "debug.h"
+#include "writer.h"
+
+namespace channelsounder
+{
+static std::vector<std::string> directories;
+static writer_layout_t layout;
+static size_t stripe_size_bytes;
+static size_t n_io_threads;
+static size_t n_channels;
+static double sample_rate;
+
+// one file of the measurement currently being written
+struct write_file_t{
+    std::string full_file_path;
+    size_t directory_idx;
+    int fd;
+    bool success;
+};
+
+// one contiguous piece of a chunk written to one position of one file
+struct write_job_t{
+    size_t file_idx;
+    unsigned long long file_offset;
+    unsigned long long measurement_offset;      // byte offset as if all channels were concatenated in one file
+    const char* ptr;
+    size_t n_bytes;
+    size_t* n_jobs_pending_chunk;
+};
+
+// files of the measurement currently being written
+static std::vector<write_file_t> files;
+static std::string file_name_measurement;
+static unsigned long long n_samples_measurement;
+static size_t n_bytes_per_item_measurement;
+static bool measurement_open = false;
+
+static std::deque<write_job_t> job_queue;
+static size_t n_jobs_pending = 0;
+
+static boost::mutex m_mutex;
+static boost::condition_variable m_condition_job;
+static boost::condition_variable m_condition_done;
+
+// bytes handed to the writer but not on disk yet
+static std::atomic<unsigned long long> backlog_bytes(0);
+
+// rolling archive, see init_archive_writer()
+struct archive_segment_t{
+    unsigned long long sequence;
+    size_t directory_idx;
+    unsigned long long size;
+};
+static unsigned long long archive_segment_bytes = 0;
+static unsigned long long archive_budget_bytes = 0;
+static std::deque<archive_segment_t> archive_segments;         // closed segments, oldest first
+static archive_segment_t archive_current = {0, 0, 0};          // segment measurements are appended to
+static unsigned long long archive_next_sequence = 0;
+static int archive_fd = -1;                                     // -1 if there is no current segment
+static int archive_index_fd = -1;
+static unsigned long long archive_offset = 0;                   // first free byte of the current segment
+static unsigned long long archive_entry_offset = 0;             // byte offset of the open measurement in the current segment
+
+// chunk hashes, see init_hash_writer()
+struct hash_piece_t{
+    unsigned long long chunk_idx;
+    unsigned long long offset_in_chunk;
+    unsigned long long n_bytes;
+    uint32_t crc;
+};
+static size_t hash_chunk_bytes = 0;                             // 0 if hashes are disabled
+static std::vector<hash_piece_t> hash_pieces;                   // pieces of the open measurement in the order they were written
+
+// statistics, one entry per directory
+struct directory_stats_t{
+    unsigned long long n_files;
+    unsigned long long n_files_failed;
+    unsigned long long n_bytes;
+    double duration_sec;                        // time the I/O threads spent writing to this directory
+};
+static std::vector<directory_stats_t> stats;
+static unsigned long long n_measurements = 0;
+static unsigned long long n_measurements_aborted = 0;
+static unsigned long long n_chunks = 0;
+static unsigned long long backlog_bytes_max = 0;
+static unsigned long long n_worker_wait = 0;
+static unsigned long long n_segments = 0;
+static unsigned long long n_segments_recycled = 0;
+static unsigned long long n_segments_removed = 0;
+static unsigned long long n_bytes_hashed = 0;
+static double hash_duration_sec = 0.0;                          // time the I/O threads spent hashing
+static size_t n_jobs_active = 0;                                // jobs the I/O threads are executing
+static double busy_sec = 0.0;                                   // time at least one I/O thread was executing a job, see get_writer_busy_sec()
+static std::chrono::steady_clock::time_point t_busy_start;
+
+static const char* get_layout_name(const writer_layout_t layout_arg){
+    switch(layout_arg){
+        case WRITER_LAYOUT_CHANNEL_PER_FILE:    return "channel";
+        case WRITER_LAYOUT_STRIPES:             return "stripes";
+        case WRITER_LAYOUT_ARCHIVE:             return "archive";
+        default:                                return "single";
+    }
+}
+
+int init_writer(const std::vector<std::string>& directories_arg, const writer_layout_t layout_arg, const size_t stripe_size_bytes_arg, const size_t n_io_threads_arg, const size_t n_channels_arg,
+                const double sample_rate_arg){
+
+    if(directories_arg.size() == 0){
+        std::cerr << "Writer: no directory given." << std::endl;
+        return 0;
+    }
+
+    if(layout_arg == WRITER_LAYOUT_STRIPES && (stripe_size_bytes_arg == 0 || stripe_size_bytes_arg % 4096 != 0)){
+        std::cerr << "Writer: stripe size must be a multiple of 4096 bytes." << std::endl;
+        return 0;
+    }
+
+    directories.clear();
+    for(size_t i = 0; i < directories_arg.size(); i++){
+        std::string directory = directories_arg[i];
+        if(directory.size() == 0)
+            continue;
+        if(directory.back() != '/')
+            directory += "/";
+        if(access(directory.c_str(), W_OK) != 0){
+            std::cerr << "Writer: directory " << directory << " does not exist or is not writable." << std::endl;
+            return 0;
+        }
+        directories.push_back(directory);
+    }
+
+    if(directories.size() == 0){
+        std::cerr << "Writer: no directory given." << std::endl;
+        return 0;
+    }
+
+    layout = layout_arg;
+    stripe_size_bytes = stripe_size_bytes_arg;
+    n_channels = n_channels_arg;
+    sample_rate = sample_rate_arg;
+
+    // by default one thread per file
+    n_io_threads = n_io_threads_arg;
+    if(n_io_threads == 0){
+        if(layout == WRITER_LAYOUT_CHANNEL_PER_FILE)
+            n_io_threads = n_channels;
+        else if(layout == WRITER_LAYOUT_STRIPES)
+            n_io_threads = directories.size();
+        else
+            n_io_threads = 1;
+    }
+
+    directory_stats_t stats_template = {0, 0, 0, 0.0};
+    stats.assign(directories.size(), stats_template);
+    busy_sec = 0.0;
+
+    std::cout << "Writer: layout " << get_layout_name(layout) << ", " << directories.size() << " directories, " << n_io_threads << " I/O threads" << std::endl;
+
+    return 1;
+}
+
+static std::string get_archive_name(const unsigned long long sequence){
+    std::ostringstream ss;
+    ss << "archive_" << std::setw(10) << std::setfill('0') << sequence;
+    return ss.str();
+}
+
+static std::string get_segment_path(const archive_segment_t& segment){
+    return directories[segment.directory_idx] + get_archive_name(segment.sequence) + ".seg";
+}
+
+static std::string get_index_path(const unsigned long long sequence){
+    return directories[0] + get_archive_name(sequence) + ".idx";
+}
+
+int init_archive_writer(const unsigned long long segment_bytes, const unsigned long long budget_bytes){
+
+    if(segment_bytes == 0 || segment_bytes % 4096 != 0){
+        std::cerr << "Writer: archive segment size must be a multiple of 4096 bytes." << std::endl;
+        return 0;
+    }
+
+    // the segment of the last measurement must not be recycled while it is being loaded, so there are at least two
+    if(budget_bytes < 2*segment_bytes){
+        std::cerr << "Writer: archive budget must hold at least two segments." << std::endl;
+        return 0;
+    }
+
+    archive_segment_bytes = segment_bytes;
+    archive_budget_bytes = budget_bytes;
+
+    // segments of an earlier run stay readable until they are recycled
+    archive_segments.clear();
+    for(size_t d = 0; d < directories.size(); d++){
+        DIR* dir = opendir(directories[d].c_str());
+        if(dir == NULL)
+            continue;
+        while(struct dirent* entry = readdir(dir)){
+            const std::string name(entry->d_name);
+            if(name.size() != 22 || name.compare(0, 8, "archive_") != 0 || name.compare(18, 4, ".seg") != 0 || name.find_first_not_of("0123456789", 8) != 18)
+                continue;
+            struct stat st;
+            if(stat((directories[d] + name).c_str(), &st) != 0)
+                continue;
+            archive_segment_t segment = {std::strtoull(name.c_str() + 8, NULL, 10), d, (unsigned long long) st.st_size};
+            archive_segments.push_back(segment);
+        }
+        closedir(dir);
+    }
+    std::sort(archive_segments.begin(), archive_segments.end(), [](const archive_segment_t &a, const archive_segment_t &b){return a.sequence < b.sequence;});
+    archive_next_sequence = (archive_segments.size() > 0) ? archive_segments.back().sequence + 1 : 0;
+
+    std::cout << "Writer: archive segments of " << segment_bytes/1024/1024 << " MiB, budget " << budget_bytes/1024/1024 << " MiB, " << archive_segments.size()
+              << " segments of an earlier run" << std::endl;
+
+    return 1;
+}
+
+int init_hash_writer(const size_t chunk_bytes){
+
+    if(chunk_bytes % 16 != 0){
+        std::cerr << "Writer: hash chunk size must be a multiple of 16 bytes." << std::endl;
+        return 0;
+    }
+
+    hash_chunk_bytes = chunk_bytes;
+
+    if(hash_chunk_bytes > 0)
+        std::cout << "Writer: crc32c (" << get_crc32c_implementation() << ") of chunks of " << hash_chunk_bytes/1024.0/1024.0 << " MiB" << std::endl;
+
+    return 1;
+}
+
+size_t get_writer_n_io_threads(){
+    return n_io_threads;
+}
+
+const std::string& get_writer_primary_directory(){
+    return directories[0];
+}
+
+unsigned long long get_writer_backlog_bytes(){
+    return backlog_bytes;
+}
+
+double get_writer_busy_sec(){
+    boost::mutex::scoped_lock lock(m_mutex);
+    if(n_jobs_active == 0)
+        return busy_sec;
+    return busy_sec + std::chrono::duration<double>(std::chrono::steady_clock::now() - t_busy_start).count();
+}
+
+static std::string get_absolute_path(const std::string& full_file_path){
+    std::string full_file_path_abs = full_file_path;
+    char* path_resolved = realpath(full_file_path.c_str(), NULL);
+    if(path_resolved != NULL){
+        full_file_path_abs = path_resolved;
+        free(path_resolved);
+    }
+    return full_file_path_abs;
+}
+
+// make the renames in a directory durable
+static void sync_directory(const std::string& directory){
+    int fd_dir = open(directory.c_str(), O_RDONLY);
+    if(fd_dir >= 0){
+        fsync(fd_dir);
+        close(fd_dir);
+    }
+}
+
+static std::string get_hash_path(){
+    return directories[0] + file_name_measurement + ".hashes";
+}
+
+// CRC of each piece of the job within one hash chunk, the pieces are combined when the measurement is closed
+static void hash_job(const write_job_t& job, std::vector<hash_piece_t>& pieces){
+    const char* ptr = job.ptr;
+    size_t n_bytes_left = job.n_bytes;
+    unsigned long long offset = job.measurement_offset;
+    while(n_bytes_left > 0){
+        hash_piece_t piece;
+        piece.chunk_idx = offset / hash_chunk_bytes;
+        piece.offset_in_chunk = offset % hash_chunk_bytes;
+        piece.n_bytes = std::min<unsigned long long>(n_bytes_left, hash_chunk_bytes - piece.offset_in_chunk);
+        piece.crc = crc32c_update(0, ptr, piece.n_bytes);
+        pieces.push_back(piece);
+
+        ptr += piece.n_bytes;
+        offset += piece.n_bytes;
+        n_bytes_left -= piece.n_bytes;
+    }
+}
+
+static bool execute_job(const write_job_t& job){
+    const char* ptr = job.ptr;
+    size_t n_bytes_left = job.n_bytes;
+    off_t offset = job.file_offset;
+    while(n_bytes_left > 0){
+        ssize_t n_bytes_written = pwrite(files[job.file_idx].fd, ptr, n_bytes_left, offset);
+        if(n_bytes_written <= 0)
+            return false;
+        ptr += n_bytes_written;
+        offset += n_bytes_written;
+        n_bytes_left -= n_bytes_written;
+    }
+    return true;
+}
+
+void run_writer_io(std::atomic<bool>& burst_timer_elapsed){
+
+    std::vector<hash_piece_t> pieces;
+
+    while(1){
+        write_job_t job;
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+
+            while(job_queue.size() == 0){
+                DBG_RB(n_worker_wait++;)
+
+                // from time to time we check if "burst_timer_elapsed" was set to true
+                m_condition_job.wait_for(lock, boost::chrono::milliseconds(5000));
+
+                // is set in main thread to stop execution
+                if(burst_timer_elapsed == true)
+                    return;
+            }
+
+            job = job_queue.front();
+            job_queue.pop_front();
+            if(n_jobs_active++ == 0)
+                t_busy_start = std::chrono::steady_clock::now();
+        }
+
+        // the samples are hashed right before the write, which then finds them in the cache
+        auto t_start_hash = std::chrono::steady_clock::now();
+        pieces.clear();
+        if(hash_chunk_bytes > 0)
+            hash_job(job, pieces);
+
+        // files is not resized while jobs are pending, so no lock is needed for the write itself
+        auto t_start = std::chrono::steady_clock::now();
+        bool success = execute_job(job);
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - t_start;
+        std::chrono::duration<double> duration_hash = t_start - t_start_hash;
+
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            write_file_t &file = files[job.file_idx];
+            if(!success)
+                file.success = false;
+            directory_stats_t &s = stats[file.directory_idx];
+            s.n_bytes += job.n_bytes;
+            s.duration_sec += duration.count();
+            if(hash_chunk_bytes > 0){
+                hash_pieces.insert(hash_pieces.end(), pieces.begin(), pieces.end());
+                n_bytes_hashed += job.n_bytes;
+                hash_duration_sec += duration_hash.count();
+            }
+            (*job.n_jobs_pending_chunk)--;
+            n_jobs_pending--;
+            if(--n_jobs_active == 0)
+                busy_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_busy_start).count();
+        }
+        backlog_bytes -= job.n_bytes;
+        m_condition_done.notify_all();
+    }
+}
+
+static bool write_all(const int fd, const std::string& text){
+    const char* ptr = text.c_str();
+    size_t n_bytes_left = text.size();
+    while(n_bytes_left > 0){
+        ssize_t n_bytes_written = write(fd, ptr, n_bytes_left);
+        if(n_bytes_written <= 0)
+            return false;
+        ptr += n_bytes_written;
+        n_bytes_left -= n_bytes_written;
+    }
+    return true;
+}
+
+static void close_archive_segment(){
+    if(archive_fd < 0)
+        return;
+    close(archive_fd);
+    close(archive_index_fd);
+    archive_fd = -1;
+    archive_index_fd = -1;
+    archive_segments.push_back(archive_current);
+}
+
+// removes the index of a segment and the gap indices and hash tables of its measurements
+static void remove_archive_index(const unsigned long long sequence){
+    const std::string index_path = get_index_path(sequence);
+    std::ifstream fin(index_path);
+    std::string line;
+    while(std::getline(fin, line)){
+        std::istringstream ss(line);
+        std::string key, file_name;
+        if(ss >> key >> file_name && key == "entry"){
+            std::remove((directories[0] + file_name + ".gaps").c_str());
+            std::remove((directories[0] + file_name + ".hashes").c_str());
+        }
+    }
+    fin.close();
+    std::remove(index_path.c_str());
+}
+
+// Closes the current segment and opens the next one with room for at least n_bytes. The oldest segments are recycled until the budget is kept,
+// the first of them with the size of the new segment is renamed instead of removed, so its blocks do not have to be allocated again.
+static bool open_archive_segment(const unsigned long long n_bytes){
+    close_archive_segment();
+
+    const unsigned long long size = std::max(archive_segment_bytes, (n_bytes + 4095)/4096*4096);
+    if(size > archive_budget_bytes){
+        std::cerr << "Writer: measurement of " << n_bytes << " bytes exceeds the archive budget." << std::endl;
+        return false;
+    }
+
+    archive_segment_t segment = {archive_next_sequence, (size_t) (archive_next_sequence % directories.size()), size};
+    archive_next_sequence++;
+
+    unsigned long long n_bytes_used = 0;
+    for(size_t i = 0; i < archive_segments.size(); i++)
+        n_bytes_used += archive_segments[i].size;
+
+    std::string recycled_path;
+    while(archive_segments.size() > 0 && n_bytes_used + size > archive_budget_bytes){
+        const archive_segment_t oldest = archive_segments.front();
+        archive_segments.pop_front();
+        n_bytes_used -= oldest.size;
+
+        // readers find no entries of the segment anymore before it is overwritten
+        remove_archive_index(oldest.sequence);
+        if(recycled_path.size() == 0 && oldest.size == size){
+            recycled_path = get_segment_path(oldest);
+            segment.directory_idx = oldest.directory_idx;
+            n_segments_recycled++;
+        }
+        else{
+            std::remove(get_segment_path(oldest).c_str());
+            n_segments_removed++;
+        }
+    }
+
+    const std::string segment_path = get_segment_path(segment);
+    if(recycled_path.size() > 0 && std::rename(recycled_path.c_str(), segment_path.c_str()) != 0){
+        std::remove(recycled_path.c_str());
+        recycled_path.clear();
+    }
+
+    archive_fd = open(segment_path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if(archive_fd < 0){
+        std::cerr << "Writer: unable to open " << segment_path << std::endl;
+        return false;
+    }
+    if(recycled_path.size() == 0 && posix_fallocate(archive_fd, 0, size) != 0){
+        std::cerr << "Writer: unable to allocate " << size << " bytes for " << segment_path << std::endl;
+        close(archive_fd);
+        archive_fd = -1;
+        std::remove(segment_path.c_str());
+        return false;
+    }
+
+    const std::string index_path = get_index_path(segment.sequence);
+    archive_index_fd = open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if(archive_index_fd < 0 || !write_all(archive_index_fd, "# iqrecord archive index\nsegment " + get_absolute_path(segment_path) + "\n")){
+        std::cerr << "Writer: unable to write " << index_path << std::endl;
+        if(archive_index_fd >= 0)
+            close(archive_index_fd);
+        close(archive_fd);
+        archive_fd = -1;
+        archive_index_fd = -1;
+        std::remove(index_path.c_str());
+        std::remove(segment_path.c_str());
+        return false;
+    }
+
+    sync_directory(directories[segment.directory_idx]);
+    if(segment.directory_idx != 0)
+        sync_directory(directories[0]);
+
+    archive_current = segment;
+    archive_offset = 0;
+    n_segments++;
+
+    return true;
+}
+
+int begin_measurement_writer(const std::string& file_name, const unsigned long long n_samples, const size_t n_bytes_per_item){
+
+    file_name_measurement = file_name;
+    n_samples_measurement = n_samples;
+    n_bytes_per_item_measurement = n_bytes_per_item;
+
+    files.clear();
+    hash_pieces.clear();
+    switch(layout){
+        case WRITER_LAYOUT_CHANNEL_PER_FILE:
+            for(size_t ch = 0; ch < n_channels; ch++){
+                size_t d = ch % directories.size();
+                write_file_t file = {directories[d] + file_name + ".ch" + std::to_string(ch), d, -1, true};
+                files.push_back(file);
+            }
+            break;
+
+        case WRITER_LAYOUT_STRIPES:
+            for(size_t d = 0; d < directories.size(); d++){
+                write_file_t file = {directories[d] + file_name + ".s" + std::to_string(d), d, -1, true};
+                files.push_back(file);
+            }
+            break;
+
+        case WRITER_LAYOUT_ARCHIVE:
+        {
+            // a measurement that does not fit into the rest of the current segment starts the next one
+            const unsigned long long n_bytes = n_channels*n_samples*n_bytes_per_item;
+            const bool fits = (archive_fd >= 0 && archive_offset + n_bytes <= archive_current.size) || open_archive_segment(n_bytes);
+            archive_entry_offset = archive_offset;
+            write_file_t file = {get_segment_path(archive_current), archive_current.directory_idx, fits ? archive_fd : -1, fits};
+            files.push_back(file);
+            measurement_open = true;
+        }
+        return files[0].success ? 1 : 0;
+
+        default:
+        {
+            write_file_t file = {directories[0] + file_name + ".bin", 0, -1, true};
+            files.push_back(file);
+        }
+        break;
+    }
+
+    // all files are written under a temporary name and renamed when the measurement is complete
+    int success = 1;
+    for(size_t i = 0; i < files.size(); i++){
+        std::string full_file_path_tmp = files[i].full_file_path + ".tmp";
+        files[i].fd = open(full_file_path_tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(files[i].fd < 0){
+            std::cerr << "Writer: unable to open " << full_file_path_tmp << std::endl;
+            files[i].success = false;
+            success = 0;
+        }
+    }
+
+    measurement_open = true;
+
+    return success;
+}
+
+// Maps samples of one channel to positions in the files of the layout and queues one job per contiguous piece.
+// Must be called with m_mutex locked.
+static void queue_jobs(const size_t ch, const char* ptr, const unsigned long long sample_offset, const unsigned long long n_samples, size_t* n_jobs_pending_chunk){
+
+    unsigned long long n_bytes = n_samples*n_bytes_per_item_measurement;
+
+    // byte offset as if all channels were concatenated in one file
+    unsigned long long offset = (ch*n_samples_measurement + sample_offset)*n_bytes_per_item_measurement;
+
+    while(n_bytes > 0){
+        write_job_t job;
+        job.measurement_offset = offset;
+        job.ptr = ptr;
+        job.n_jobs_pending_chunk = n_jobs_pending_chunk;
+
+        switch(layout){
+            case WRITER_LAYOUT_CHANNEL_PER_FILE:
+                job.file_idx = ch;
+                job.file_offset = sample_offset*n_bytes_per_item_measurement;
+                job.n_bytes = n_bytes;
+                break;
+
+            case WRITER_LAYOUT_STRIPES:
+            {
+                unsigned long long stripe_idx = offset / stripe_size_bytes;
+                unsigned long long offset_in_stripe = offset % stripe_size_bytes;
+                job.file_idx = stripe_idx % files.size();
+                job.file_offset = (stripe_idx / files.size())*stripe_size_bytes + offset_in_stripe;
+                job.n_bytes = std::min<unsigned long long>(n_bytes, stripe_size_bytes - offset_in_stripe);
+            }
+            break;
+
+            case WRITER_LAYOUT_ARCHIVE:
+                job.file_idx = 0;
+                job.file_offset = archive_entry_offset + offset;
+                job.n_bytes = n_bytes;
+                break;
+
+            default:
+                job.file_idx = 0;
+                job.file_offset = offset;
+                job.n_bytes = n_bytes;
+                break;
+        }
+
+        // no need to write to a file that already failed
+        if(files[job.file_idx].fd >= 0){
+            job_queue.push_back(job);
+            (*n_jobs_pending_chunk)++;
+            n_jobs_pending++;
+            backlog_bytes += job.n_bytes;
+        }
+
+        ptr += job.n_bytes;
+        offset += job.n_bytes;
+        n_bytes -= job.n_bytes;
+    }
+}
+
+static void submit(const std::vector<std::vector<char>>& buffs, const unsigned long long sample_offset, const unsigned long long n_samples, size_t* n_jobs_pending_chunk){
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        for(size_t ch = 0; ch < buffs.size(); ch++)
+            queue_jobs(ch, &buffs[ch][0], sample_offset, n_samples, n_jobs_pending_chunk);
+        n_chunks++;
+        backlog_bytes_max = std::max<unsigned long long>(backlog_bytes_max, backlog_bytes);
+    }
+    m_condition_job.notify_all();
+}
+
+static bool wait(size_t* n_jobs_pending_chunk){
+    boost::mutex::scoped_lock lock(m_mutex);
+    bool had_to_wait = (*n_jobs_pending_chunk > 0);
+    while(*n_jobs_pending_chunk > 0)
+        m_condition_done.wait(lock);
+    return had_to_wait;
+}
+
+void submit_chunk_writer(write_chunk_t& chunk){
+    submit(chunk.buffs, chunk.sample_offset, chunk.n_samples, &chunk.n_jobs_pending);
+}
+
+bool wait_chunk_writer(write_chunk_t& chunk){
+    return wait(&chunk.n_jobs_pending);
+}
+
+// Text file describing which bytes of the measurement are in which file. Written last, its presence means the measurement is complete.
+//
+// For channel: channel ch is in file ch.
+// For stripes: the channels are concatenated, stripe k is in file k % n_files at byte offset (k / n_files)*stripe_bytes.
+static bool write_manifest(const std::string& full_file_path_manifest){
+
+    std::string full_file_path_tmp = full_file_path_manifest + ".tmp";
+    std::ofstream fout(full_file_path_tmp);
+    if(!fout.is_open())
+        return false;
+
+    fout << "# iqrecord manifest" << std::endl;
+    fout << "layout " << get_layout_name(layout) << std::endl;
+    fout << "n_channels " << n_channels << std::endl;
+    fout << "n_samples " << n_samples_measurement << std::endl;
+    fout << "bytes_per_sample " << n_bytes_per_item_measurement << std::endl;
+    fout << "sample_rate " << std::fixed << std::setprecision(3) << sample_rate << std::endl;
+    fout.unsetf(std::ios::floatfield);
+    fout << "stripe_bytes " << ((layout == WRITER_LAYOUT_STRIPES) ? stripe_size_bytes : 0) << std::endl;
+    fout << "n_files " << files.size() << std::endl;
+    for(size_t i = 0; i < files.size(); i++)
+        fout << "file " << i << " " << get_absolute_path(files[i].full_file_path) << std::endl;
+    fout.close();
+
+    return !fout.fail() && std::rename(full_file_path_tmp.c_str(), full_file_path_manifest.c_str()) == 0;
+}
+
+// Chunk hash table of the measurement, see init_hash_writer(). The CRCs of the pieces of a chunk are combined in the order of their offsets.
+static bool write_hashes(const std::string& full_file_path_hashes){
+
+    std::sort(hash_pieces.begin(), hash_pieces.end(), [](const hash_piece_t &a, const hash_piece_t &b){
+        return (a.chunk_idx != b.chunk_idx) ? a.chunk_idx < b.chunk_idx : a.offset_in_chunk < b.offset_in_chunk;});
+
+    const unsigned long long n_bytes = n_channels*n_samples_measurement*n_bytes_per_item_measurement;
+
+    std::string full_file_path_tmp = full_file_path_hashes + ".tmp";
+    std::ofstream fout(full_file_path_tmp);
+    if(!fout.is_open())
+        return false;
+
+    fout << "# iqrecord chunk hashes" << std::endl;
+    fout << "algorithm crc32c" << std::endl;
+    fout << "chunk_bytes " << hash_chunk_bytes << std::endl;
+    fout << "n_bytes " << n_bytes << std::endl;
+    fout << std::hex << std::setfill('0');
+    for(size_t i = 0; i < hash_pieces.size(); ){
+        const unsigned long long chunk_idx = hash_pieces[i].chunk_idx;
+        const unsigned long long n_bytes_chunk = std::min<unsigned long long>(hash_chunk_bytes, n_bytes - chunk_idx*hash_chunk_bytes);
+        uint32_t crc = 0;
+        unsigned long long n_bytes_covered = 0;
+        for(; i < hash_pieces.size() && hash_pieces[i].chunk_idx == chunk_idx; i++){
+            if(hash_pieces[i].offset_in_chunk != n_bytes_covered)
+                continue;
+            crc = crc32c_combine(crc, hash_pieces[i].crc, hash_pieces[i].n_bytes);
+            n_bytes_covered += hash_pieces[i].n_bytes;
+        }
+        if(n_bytes_covered == n_bytes_chunk)
+            fout << "chunk " << std::dec << chunk_idx << " " << std::hex << std::setw(8) << crc << std::endl;
+    }
+    fout.close();
+
+    return !fout.fail() && std::rename(full_file_path_tmp.c_str(), full_file_path_hashes.c_str()) == 0;
+}
+
+// The samples of the measurement are synced and its entry is appended to the index, the segment stays open for the next measurement.
+// Samples of an aborted measurement are overwritten by the next one.
+static bool close_archive_entry(const bool keep){
+    measurement_open = false;
+    if(!keep)
+        return true;
+
+    write_file_t &file = files[0];
+    stats[file.directory_idx].n_files++;
+
+    bool success = file.success && fdatasync(file.fd) == 0;
+    if(success && hash_chunk_bytes > 0)
+        success = write_hashes(get_hash_path());
+    if(success){
+        std::ostringstream ss;
+        ss << "entry " << file_name_measurement << " " << archive_entry_offset << " " << n_channels << " " << n_samples_measurement << " " << n_bytes_per_item_measurement;
+        ss << " " << std::fixed << std::setprecision(3) << sample_rate << "\n";
+        success = write_all(archive_index_fd, ss.str()) && fdatasync(archive_index_fd) == 0;
+    }
+
+    if(success){
+        archive_offset = (archive_entry_offset + n_channels*n_samples_measurement*n_bytes_per_item_measurement + 4095)/4096*4096;
+    }
+    else{
+        // the next measurement starts a new segment, this one might end with a partial entry
+        std::cerr << "Writer: unable to write " << file_name_measurement << " to " << file.full_file_path << std::endl;
+        stats[file.directory_idx].n_files_failed++;
+        if(hash_chunk_bytes > 0)
+            std::remove(get_hash_path().c_str());
+        close_archive_segment();
+    }
+
+    return success;
+}
+
+// waits for all pending jobs, then syncs and closes all files and either renames them to their final names or removes them
+static bool close_files(const bool keep){
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        while(n_jobs_pending > 0)
+            m_condition_done.wait(lock);
+    }
+
+    if(layout == WRITER_LAYOUT_ARCHIVE)
+        return close_archive_entry(keep);
+
+    // the hash table is in place before the measurement becomes visible
+    bool success = true;
+    if(keep && hash_chunk_bytes > 0){
+        for(size_t i = 0; i < files.size(); i++)
+            success = success && files[i].success;
+        success = success && write_hashes(get_hash_path());
+    }
+
+    std::vector<bool> directory_used(directories.size(), false);
+    for(size_t i = 0; i < files.size(); i++){
+        write_file_t &file = files[i];
+        std::string full_file_path_tmp = file.full_file_path + ".tmp";
+
+        if(file.fd >= 0){
+            if(keep && fsync(file.fd) != 0)
+                file.success = false;
+            close(file.fd);
+            file.fd = -1;
+        }
+
+        if(!keep)
+            continue;
+
+        stats[file.directory_idx].n_files++;
+        if(!file.success || std::rename(full_file_path_tmp.c_str(), file.full_file_path.c_str()) != 0){
+            std::cerr << "Writer: unable to write " << file.full_file_path << std::endl;
+            stats[file.directory_idx].n_files_failed++;
+            success = false;
+        }
+        directory_used[file.directory_idx] = true;
+    }
+
+    // temporary files of aborted or failed measurements are removed
+    if(!keep || !success){
+        for(size_t i = 0; i < files.size(); i++)
+            std::remove((files[i].full_file_path + ".tmp").c_str());
+        if(keep && hash_chunk_bytes > 0)
+            std::remove(get_hash_path().c_str());
+    }
+
+    for(size_t d = 0; d < directories.size(); d++)
+        if(directory_used[d])
+            sync_directory(directories[d]);
+
+    measurement_open = false;
+
+    return success;
+}
+
+bool end_measurement_writer(std::string& full_file_path){
+
+    bool success = close_files(true);
+
+    if(layout == WRITER_LAYOUT_SINGLE_FILE){
+        full_file_path = files[0].full_file_path;
+    }
+    else if(layout == WRITER_LAYOUT_ARCHIVE){
+        full_file_path = get_absolute_path(get_index_path(archive_current.sequence)) + "#" + file_name_measurement;
+    }
+    else{
+        full_file_path = directories[0] + file_name_measurement + ".manifest";
+        if(success){
+            success = write_manifest(full_file_path);
+            sync_directory(directories[0]);
+        }
+    }
+
+    n_measurements++;
+
+    return success;
+}
+
+void abort_measurement_writer(){
+    if(!measurement_open)
+        return;
+    close_files(false);
+    n_measurements_aborted++;
+}
+
+bool write_measurement(const std::string& file_name, const std::vector<std::vector<char>>& buffs, std::string& full_file_path, const unsigned long long n_samples, const size_t n_bytes_per_item){
+
+    begin_measurement_writer(file_name, n_samples, n_bytes_per_item);
+
+    size_t n_jobs_pending_measurement = 0;
+    submit(buffs, 0, n_samples, &n_jobs_pending_measurement);
+    wait(&n_jobs_pending_measurement);
+
+    return end_measurement_writer(full_file_path);
+}
+
+void show_debug_information_writer(){
+    std::cout << "--------------------------" << std::endl;
+    std::cout << "writer" << std::endl;
+    std::cout << "layout: " << get_layout_name(layout) << std::endl;
+    std::cout << "n_io_threads: " << n_io_threads << std::endl;
+    std::cout << "n_measurements: " << n_measurements << std::endl;
+    std::cout << "n_measurements_aborted: " << n_measurements_aborted << std::endl;
+    std::cout << "n_chunks: " << n_chunks << std::endl;
+    std::cout << "backlog_MB_max: " << backlog_bytes_max/1.0e6 << std::endl;
+    std::cout << "n_worker_wait: " << n_worker_wait << std::endl;
+    if(layout == WRITER_LAYOUT_ARCHIVE){
+        std::cout << "n_segments: " << n_segments << std::endl;
+        std::cout << "n_segments_recycled: " << n_segments_recycled << std::endl;
+        std::cout << "n_segments_removed: " << n_segments_removed << std::endl;
+    }
+    if(hash_chunk_bytes > 0){
+        double write_duration_sec = 0.0;
+        for(size_t d = 0; d < directories.size(); d++)
+            write_duration_sec += stats[d].duration_sec;
+        const double throughput_MBps = (hash_duration_sec > 0.0) ? n_bytes_hashed/1.0e6/hash_duration_sec : 0.0;
+        const double share = (hash_duration_sec + write_duration_sec > 0.0) ? hash_duration_sec/(hash_duration_sec + write_duration_sec) : 0.0;
+        std::cout << "hash: crc32c " << get_crc32c_implementation() << ", MB " << n_bytes_hashed/1.0e6 << ", MB/s while busy " << throughput_MBps
+                  << ", share of I/O thread time " << 100.0*share << " %" << std::endl;
+    }
+    for(size_t d = 0; d < directories.size(); d++){
+        const directory_stats_t &s = stats[d];
+        double throughput_MBps = (s.duration_sec > 0.0) ? s.n_bytes/1.0e6/s.duration_sec : 0.0;
+        std::cout << directories[d] << ": files " << s.n_files << ", failed " << s.n_files_failed << ", MB " << s.n_bytes/1.0e6 << ", MB/s while busy " << throughput_MBps << std::endl;
+    }
+    std::cout << "--------------------------" << std::endl;
+}
+}
@@ -0,0 +1,181 @@
+/*
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHANNELSOUNDER_WRITER_H
+#define CHANNELSOUNDER_WRITER_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+namespace channelsounder
+{
+/*!
+ * How the samples of one measurement are distributed over files and directories.
+*/
+enum writer_layout_t{
+    WRITER_LAYOUT_SINGLE_FILE = 0,          // all channels concatenated in one file in the first directory, no manifest
+    WRITER_LAYOUT_CHANNEL_PER_FILE = 1,     // one file per channel, channel ch goes to directory ch % n_directories
+    WRITER_LAYOUT_STRIPES = 2,              // channels concatenated and cut into stripes, stripe k goes to directory k % n_directories
+    WRITER_LAYOUT_ARCHIVE = 3               // channels concatenated and appended to preallocated segment files, see init_archive_writer()
+};
+
+/*!
+ * Inits unit internally. Must be called first.
+ *
+ * directories                  directories to write to, ideally on different drives, the first one also receives manifests and gap indices
+ * layout                       see writer_layout_t
+ * stripe_size_bytes            size of one stripe for WRITER_LAYOUT_STRIPES, must be a multiple of 4096
+ * n_io_threads                 number of I/O threads, 0 selects one per file of a measurement
+ * n_channels_arg               number of rx channels
+ * sample_rate_arg              sample rate of the saved samples in samples per second, written to the manifest
+ * return                       1 on success and 0 on failure
+*/
+int init_writer(const std::vector<std::string>& directories, const writer_layout_t layout, const size_t stripe_size_bytes, const size_t n_io_threads, const size_t n_channels_arg,
+                const double sample_rate_arg);
+
+/*!
+ * Configures the rolling archive of WRITER_LAYOUT_ARCHIVE, must be called after init_writer().
+ *
+ * Measurements are appended to segment files archive_<sequence>.seg which are preallocated with segment_bytes and placed round-robin in the
+ * directories. A measurement larger than a segment gets a segment of its own. Each segment has an index archive_<sequence>.idx in the first
+ * directory with one line per measurement, appended after its samples are on disk:
+ *
+ *   segment <path of the segment file>
+ *   entry <file name> <byte offset in the segment> <n_channels> <n_samples> <bytes_per_sample> <sample_rate>
+ *
+ * When the segments would exceed budget_bytes, the oldest segment is recycled: its index and the gap indices of its measurements are
+ * removed and the segment file is renamed and reused for the next segment. Segments of an earlier run count towards the budget.
+ * A measurement is addressed as <path of the index>#<file name>.
+ *
+ * segment_bytes                size of one segment, must be a multiple of 4096
+ * budget_bytes                 disk space of all segments, at least one segment
+ * return                       1 on success and 0 on failure
+*/
+int init_archive_writer(const unsigned long long segment_bytes, const unsigned long long budget_bytes);
+
+/*!
+ * Enables chunk hashes, must be called after init_writer(). The bytes of a measurement, all channels concatenated as in a single file, are cut
+ * into chunks of chunk_bytes and the I/O threads compute the CRC-32C of each piece right before they write it. For every measurement that is
+ * kept, a chunk hash table <file name>.hashes is written next to its gap index before the measurement becomes visible:
+ *
+ *   algorithm crc32c
+ *   chunk_bytes <bytes per chunk, the last chunk may be shorter>
+ *   n_bytes <bytes of the measurement>
+ *   chunk <index> <CRC-32C as 8 hex digits>
+ *
+ * A chunk that was not written completely has no line. The hash table lets a copy of the measurement be checked without the original.
+ *
+ * chunk_bytes                  size of one chunk, must be a multiple of 16 so chunks start at sample boundaries, 0 disables the hashes
+ * return                       1 on success and 0 on failure
+*/
+int init_hash_writer(const size_t chunk_bytes);
+
+/*!
+ * Samples of one measurement handed to the writer in one piece. The buffers must not be touched until wait_chunk_writer() returned.
+*/
+struct write_chunk_t{
+    std::vector<std::vector<char>> buffs;       // one buffer per channel
+    unsigned long long sample_offset;           // index of the first sample of this chunk within the measurement
+    unsigned long long n_samples;               // number of valid samples per channel
+    size_t n_jobs_pending;                      // set and cleared by the writer, 0 when the chunk is on disk
+};
+
+/*!
+ * Number of I/O threads the caller has to start with run_writer_io(). Always at least 1.
+*/
+size_t get_writer_n_io_threads();
+
+/*!
+ * Directory for files that belong to a measurement but are not samples, e.g. manifests and gap indices. Ends with '/'.
+*/
+const std::string& get_writer_primary_directory();
+
+/*!
+ * Number of bytes handed to the writer that are not written yet.
+*/
+unsigned long long get_writer_backlog_bytes();
+
+/*!
+ * Seconds at least one I/O thread was executing a job since init_writer(), hashing included. Several threads writing at the same time
+ * count once. The difference over a measurement is the time the writer was busy with it.
+*/
+double get_writer_busy_sec();
+
+/*!
+ * Must be started in get_writer_n_io_threads() additional threads. Each thread writes one contiguous piece of a chunk at a time.
+ *
+ * burst_timer_elapsed          when set to true, the thread has to finish
+*/
+void run_writer_io(std::atomic<bool>& burst_timer_elapsed);
+
+/*!
+ * Opens all files of a measurement under a temporary name, for the archive it reserves space in the current segment instead.
+ * Only one measurement can be open at a time.
+ *
+ * file_name                    file name without directory and extension
+ * n_samples                    number of samples per channel of the complete measurement
+ * n_bytes_per_item             size of one complex sample
+ * return                       1 on success and 0 on failure, on failure the measurement still has to be ended or aborted
+*/
+int begin_measurement_writer(const std::string& file_name, const unsigned long long n_samples, const size_t n_bytes_per_item);
+
+/*!
+ * Queues a chunk for the I/O threads and returns immediately. Chunks may be submitted in any order.
+*/
+void submit_chunk_writer(write_chunk_t& chunk);
+
+/*!
+ * Blocks until all samples of the chunk are written, afterwards the buffers can be reused.
+ *
+ * return                       true if the chunk was not written yet and the caller had to wait
+*/
+bool wait_chunk_writer(write_chunk_t& chunk);
+
+/*!
+ * Waits for all queued chunks, syncs the files and renames them to their final names. For layouts with more than one file,
+ * a manifest describing the layout is written last, so a reader that finds the manifest finds all files.
+ *
+ * full_file_path               path of the single file, the manifest or the archive entry, this is what a reader has to open
+ * return                       true if all files were written
+*/
+bool end_measurement_writer(std::string& full_file_path);
+
+/*!
+ * Waits for all queued chunks and removes the temporary files of the open measurement, if there is one.
+*/
+void abort_measurement_writer();
+
+/*!
+ * Writes a measurement that is completely in memory and blocks until all files are on disk.
+ *
+ * file_name                    file name without directory and extension
+ * buffs                        one buffer per channel, all of the same size
+ * full_file_path               path of the single file, the manifest or the archive entry, this is what a reader has to open
+ * n_samples                    number of samples per channel
+ * n_bytes_per_item             size of one complex sample
+ * return                       true if all files were written
+*/
+bool write_measurement(const std::string& file_name, const std::vector<std::vector<char>>& buffs, std::string& full_file_path, const unsigned long long n_samples, const size_t n_bytes_per_item);
+
+/*!
+ * Shows some stats of the writer, e.g. the throughput per directory.
+*/
+void show_debug_information_writer();
+}
+
+#endif